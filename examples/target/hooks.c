@@ -23,7 +23,7 @@ static void my_osreport(const char* fmt, ...) {
     original("%s", fmt);
 }
 
-/* Example: Hook a game function by pattern */
+/* Example: Hook a game function found by its signature */
 static dh_hook g_game_func_hook;
 
 static int my_game_function(int x, int y) {
@@ -40,49 +40,37 @@ static int my_game_function(int x, int y) {
     return result * 2;
 }
 
-/* Example: Find and hook a function by pattern */
+/* Resolved by the patcher: OSReport by name from the game map (--map),
+ * the game function by its prologue. Patching fails if either can't be
+ * found exactly once, so both are valid here.
+ */
+DH_SYMBOL(sym_osreport, "OSReport");
+
+/* stwu r1,-0x20(r1); mflr r0; stw r0,0x24(r1); stw r31,0x1C(r1); mr r31,r3; ?? */
+DH_SIGNATURE(sig_game_func, "xxxxxxxxxxxxxxxxxxxx????",
+             0x94, 0x21, 0xFF, 0xE0, 0x7C, 0x08, 0x02, 0xA6,
+             0x90, 0x01, 0x00, 0x24, 0x93, 0xE1, 0x00, 0x1C,
+             0x7C, 0x7F, 0x1B, 0x78, 0x00, 0x00, 0x00, 0x00);
+
 void dh_install_all_hooks(void) {
     dh_log("Installing hooks...\n");
     
-#ifndef DOLHOOK_NO_PATTERN
-    /* Example: Find OSReport by pattern
-     * OSReport typically starts with: stwu r1, -X(r1); mflr r0
-     * Pattern: 94 21 ?? ?? 7C 08 02 A6
-     */
-    const char pattern[] = {0x94, 0x21, 0x00, 0x00, 0x7C, 0x08, 0x02, 0xA6};
-    const char mask[] = "xx??xxxx";
+    dh_log("Found OSReport at: 0x%08X\n", (unsigned int)sym_osreport.addr);
     
-    void* osreport = dh_find_pattern(
-        (void*)0x80003000,  /* Search in typical OS area */
-        0x100000,           /* Search size */
-        pattern,
-        mask
-    );
+    g_osreport_hook.target = sym_osreport.addr;
+    g_osreport_hook.replacement = my_osreport;
     
-    if (osreport) {
-        dh_log("Found OSReport at: 0x%08X\n", (unsigned int)osreport);
-        
-        g_osreport_hook.target = osreport;
-        g_osreport_hook.replacement = my_osreport;
-        
-        if (dh_hook_install(&g_osreport_hook) == 0) {
-            dh_log("OSReport hook installed!\n");
-        } else {
-            dh_log("Failed to hook OSReport\n");
-        }
+    if (dh_hook_install(&g_osreport_hook) == 0) {
+        dh_log("OSReport hook installed!\n");
+    } else {
+        dh_log("Failed to hook OSReport\n");
     }
-#endif
     
-    /* Example: Hook a known game function address */
-    void* game_func = (void*)0x80123456; /* Replace with actual address */
+    g_game_func_hook.target = sig_game_func.addr;
+    g_game_func_hook.replacement = my_game_function;
     
-    if (game_func != (void*)0x80123456) { /* Check if real address set */
-        g_game_func_hook.target = game_func;
-        g_game_func_hook.replacement = my_game_function;
-        
-        if (dh_hook_install(&g_game_func_hook) == 0) {
-            dh_log("Game function hook installed!\n");
-        }
+    if (dh_hook_install(&g_game_func_hook) == 0) {
+        dh_log("Game function hook installed!\n");
     }
     
     dh_log("Hook installation complete\n");
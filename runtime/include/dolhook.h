@@ -33,6 +33,22 @@ extern "C" {
  */
 void dh_icache_sync_range(void* addr, unsigned len);
 
+/**
+ * The steps of dh_icache_sync_range(), for syncing many ranges with one
+ * pair of barriers: flush each range's data lines, dh_cache_barrier(),
+ * invalidate each range's instruction lines (or all of them),
+ * dh_cache_barrier().
+ */
+void dh_dcache_flush_range(void* addr, unsigned len);
+void dh_icache_invalidate_range(void* addr, unsigned len);
+void dh_icache_invalidate_all(void);  /* Flash invalidate (HID0[ICFI]) */
+void dh_cache_barrier(void);          /* sync; isync */
+
+/**
+ * Lower word of the time base (bus clock / 4, 40.5 MHz on GameCube).
+ */
+uint32_t dh_time_base(void);
+
 /* ============================================================================
  * Memory Patching Primitives
  * ========================================================================= */
@@ -98,10 +114,49 @@ uint32_t dh_make_branch_imm(uint32_t from, uint32_t to, int link);
  */
 void dh_write_branch_abs(void* at, void* to, int link);
 
+/* ============================================================================
+ * Code Allocation
+ * ========================================================================= */
+
+#define DH_CODE_MAX_ALLOC 128  /* Largest block, in bytes */
+
+/**
+ * Allocate executable memory (16-byte aligned) for trampolines and stubs.
+ * Freed blocks are reused before an arena grows.
+ *
+ * @param size Bytes, 1..DH_CODE_MAX_ALLOC
+ * @param near If set, only use arenas whose every address a b instruction
+ *             can reach from near and back (±32MB); NULL = anywhere
+ * @return Block, or NULL if no arena has room
+ */
+void* dh_code_alloc(uint32_t size, const void* near);
+
+/**
+ * Return a block from dh_code_alloc() for reuse.
+ *
+ * @return 0 on success (or if p is NULL), -1 if p is not a live block
+ */
+int dh_code_free(void* p);
+
+/**
+ * Give the allocator more memory, e.g. unused space next to game code.
+ * A built-in 16KB arena is always tried first. Up to 4 arenas in total.
+ *
+ * @return 0 on success, -1 if there is no arena slot left or size is too small
+ */
+int dh_code_add_arena(void* base, uint32_t size);
+
+/**
+ * Bytes in live blocks, counting each at its size class.
+ */
+uint32_t dh_code_in_use(void);
+
 /* ============================================================================
  * Function Hooking
  * ========================================================================= */
 
+#define DH_HOOK_MAX_SITES 256  /* Distinct hooked targets */
+
 /**
  * Function hook descriptor.
  * Zero-initialize before first use.
@@ -109,46 +164,224 @@ void dh_write_branch_abs(void* at, void* to, int link);
 typedef struct dh_hook {
     void*    target;       /* Function address to detour */
     void*    replacement;  /* Your hook function */
-    void*    trampoline;   /* Generated trampoline (call original) */
+    void*    trampoline;   /* Call on: the next hook's replacement, or the original */
     uint8_t  saved[16];    /* Saved original bytes */
-    uint32_t patch_len;    /* Bytes overwritten at target (4 or 12) */
+    uint32_t patch_len;    /* Bytes overwritten at target (4 or 16) */
+    int32_t  priority;     /* Higher runs first among hooks on one target */
+    struct dh_hook* next;  /* Next lower priority hook (set by the registry) */
 } dh_hook;
 
 /**
  * Install a function hook.
  * 
- * Replaces target function's prologue with branch to replacement.
- * Generates trampoline containing original prologue + jump back.
+ * The first hook on a target replaces its prologue with a branch to a
+ * chain stub, and generates the trampoline containing the original
+ * prologue + jump back. Later hooks on the same target join its chain by
+ * priority: the stub jumps to the highest, and each hook's trampoline is
+ * the next one's replacement, the lowest getting the original. Calling
+ * h->trampoline always continues the chain with one jump.
  * 
  * Requirements:
  * - h->target and h->replacement must be set
- * - First 16 bytes of target must be safe to overwrite
- * - Target prologue should not contain PC-relative branches
+ * - The overwritten instructions must pass dh_check_stolen(); relative
+ *   branches among them are fine, dh_relocate() moves them
+ * - h->trampoline must be read at call time, as it changes when hooks
+ *   are added or removed around h
  * 
  * @param h Hook descriptor (must remain valid while hook active)
- * @return 0 on success, -1 on allocation failure, -2 if unsafe
+ * @return 0 on success, -1 on allocation failure (or if h is already
+ *         installed, or its target's last hook was removed in the open
+ *         batch), -2 if unsafe
  */
 int dh_hook_install(dh_hook* h);
 
 /**
- * Remove a previously installed hook.
- * Restores original bytes and frees trampoline.
+ * Remove a previously installed hook, leaving the others on its target
+ * in place. Removing the last one restores the original bytes and
+ * returns the stub and trampoline to dh_code_free().
  * 
  * @param h Hook descriptor from dh_hook_install()
  * @return 0 on success, -1 on error
  */
 int dh_hook_remove(dh_hook* h);
 
+/**
+ * Hooks installed on a target, highest priority first (follow ->next).
+ * Binary search over the registry, which is sorted by target.
+ *
+ * @return First hook, or NULL if the target isn't hooked
+ */
+dh_hook* dh_hook_chain(void* target);
+
+#define DH_RELOC_MAX_INSNS    8              /* Per dh_relocate() call */
+#define DH_RELOC_MAX_WORDS(n) ((n) * 6)      /* Most words n instructions relocate to */
+#define DH_RELOC_SCAN_WORDS   2048           /* dh_check_stolen() search limit */
+
+/**
+ * Copy instructions to run at another address, rewriting relative
+ * branches (b, bl, bc) so they still reach their targets. Branches that
+ * no longer reach become an absolute lis/ori/mtctr/bctr (clobbering r12
+ * and CTR); a bc gets a branch island. Branches between the copied
+ * instructions go to the new copies.
+ *
+ * @param out       Destination, or NULL to only count the words needed
+ * @param out_addr  Address the copy will run at
+ * @param out_words Room at out, in words
+ * @param in        Instructions to copy
+ * @param in_addr   Address they were built for
+ * @param count     Instruction count, up to DH_RELOC_MAX_INSNS
+ * @return Words written (or needed), -1 if out is too small, -2 if an
+ *         instruction can't be moved: bl/bcl used to read the PC, or a
+ *         CTR-counting bc that would need an absolute island
+ */
+int dh_relocate(uint32_t* out, uint32_t out_addr, uint32_t out_words,
+                const uint32_t* in, uint32_t in_addr, uint32_t count);
+
+/**
+ * Check that the first stolen_len bytes of a function can be replaced.
+ * Refuses when a branch later in the function (up to the next stack frame
+ * setup, or DH_RELOC_SCAN_WORDS) lands after the first stolen instruction,
+ * where it would run the middle of the patch, and when the stolen range
+ * runs past a blr, bctr or b that ends the function.
+ *
+ * @param code       The function's instructions
+ * @param addr       Its address
+ * @param stolen_len Bytes to be overwritten
+ * @return 0 if safe, -2 if not
+ */
+int dh_check_stolen(const uint32_t* code, uint32_t addr, uint32_t stolen_len);
+
 /**
  * Create trampoline for calling original function.
- * Used internally by dh_hook_install().
+ * Used internally by dh_hook_install(), once per target. The stolen
+ * instructions are moved with dh_relocate(). Placed within branch range
+ * of the target when possible, so the jump back is a single b; otherwise
+ * it ends in the 16-byte absolute sequence. Free with dh_code_free().
  * 
  * @param target Function address
- * @param stolen_len Bytes to copy (must be >= bytes overwritten)
+ * @param stolen_len Bytes to move (must be >= bytes overwritten)
  * @return Executable trampoline buffer, or NULL on failure
  */
 void* dh_make_trampoline(void* target, uint32_t stolen_len);
 
+/* ============================================================================
+ * Batch Patching
+ * ========================================================================= */
+
+/**
+ * Totals for one batch.
+ */
+typedef struct dh_batch_stats {
+    uint32_t writes;          /* Staged writes applied */
+    uint32_t ranges;          /* Merged cache line ranges */
+    uint32_t lines;           /* Cache lines synced */
+    uint32_t windows;         /* Interrupt-off windows (more if the queue filled) */
+    uint32_t icache_flashes;  /* Windows that invalidated the whole I-cache */
+    uint32_t irq_off_ticks;   /* Time base ticks with interrupts off */
+    uint32_t irq_off_us;      /* The same in microseconds */
+} dh_batch_stats;
+
+/**
+ * Open a batch. Until dh_batch_commit(), dh_write8/16/32(),
+ * dh_write_branch_abs(), dh_hook_install() and dh_hook_remove() queue
+ * their writes to live code instead of applying them, and new
+ * trampolines are synced at commit. Queued writes are not visible in
+ * memory yet, and hooks take effect at commit.
+ *
+ * Example:
+ *   dh_batch_stats stats;
+ *   dh_batch_begin();
+ *   for (int i = 0; i < count; i++) dh_hook_install(&hooks[i]);
+ *   dh_batch_commit(&stats);
+ *   dh_log("%u hooks, interrupts off %u us\n", count, stats.irq_off_us);
+ */
+void dh_batch_begin(void);
+
+/**
+ * Whether a batch is open.
+ */
+int dh_batch_active(void);
+
+/**
+ * Queue one 1, 2 or 4 byte write.
+ */
+void dh_batch_stage(volatile void* p, uint32_t v, unsigned size);
+
+/**
+ * Queue count consecutive words as one patch (e.g. an absolute branch):
+ * they are applied in the same window, never split by a full queue.
+ */
+void dh_batch_stage_words(volatile void* p, const uint32_t* words, unsigned count);
+
+/**
+ * Mark code written directly (e.g. a new trampoline) for syncing.
+ */
+void dh_batch_touch(void* addr, unsigned len);
+
+/**
+ * dh_code_free() a block once the queued writes no longer lead to it.
+ */
+void dh_batch_free_code(void* block);
+
+/**
+ * Apply everything queued under one interrupt-off window: writes, then
+ * every touched cache line flushed and invalidated once, in merged ranges.
+ * A full queue is applied early in its own window, between patches.
+ *
+ * @param stats Totals for the batch, or NULL
+ */
+void dh_batch_commit(dh_batch_stats* stats);
+
+/* ============================================================================
+ * Gecko Codes
+ * ========================================================================= */
+
+/**
+ * Code list embedded by the patcher (patchiso --gecko), applied by dh_init().
+ */
+typedef struct dh_gecko_list {
+    uint32_t* codes;  /* Code words, ending with F0000000 00000000 */
+    uint32_t  size;   /* Bytes; 0 = no list */
+} dh_gecko_list;
+
+/**
+ * Totals from dh_gecko_load().
+ */
+typedef struct dh_gecko_stats {
+    uint32_t codes;        /* Codes read */
+    uint32_t writes;       /* Write codes applied once */
+    uint32_t inserts;      /* C2 blocks branched to */
+    uint32_t frame_words;  /* Size of the per-frame program */
+} dh_gecko_stats;
+
+#define DH_GECKO_MAX_FRAME_WORDS 1024  /* Per-frame program limit */
+#define DH_GECKO_MAX_DEPTH       16    /* Nested conditionals */
+
+/**
+ * Apply a Gecko code list: RAM writes (00/02/04), string and serial
+ * writes (06/08), 32/16-bit conditionals (20-2E) with endif/else and full
+ * terminators (E2/E0), and insert-asm blocks (C2), each with its po
+ * variant (10-1E, 30-3E, D2). Codes outside any conditional are written
+ * once, through dh_write8/16/32() so an open batch takes them. C2 blocks
+ * run in place in the list, which must be executable and stay loaded.
+ * Conditional blocks are compiled into a program for
+ * dh_gecko_run_frame(), where a false condition jumps straight past its
+ * block. Replaces any program from an earlier call.
+ *
+ * @param codes Code list, with or without the 00D0C0DE 00D0C0DE header
+ * @param size  Bytes
+ * @param stats Totals, or NULL
+ * @return 0 on success, -1 on an unsupported or malformed code (codes
+ *         before it are applied), -2 if the per-frame program is too large
+ */
+int dh_gecko_load(uint32_t* codes, uint32_t size, dh_gecko_stats* stats);
+
+/**
+ * Run the conditional codes once. Call it every frame, e.g. from a hook
+ * on the game's VI retrace callback.
+ */
+void dh_gecko_run_frame(void);
+
 /* ============================================================================
  * Pattern Scanning (optional, disable with DOLHOOK_NO_PATTERN)
  * ========================================================================= */
@@ -156,7 +389,8 @@ void* dh_make_trampoline(void* target, uint32_t stolen_len);
 #ifndef DOLHOOK_NO_PATTERN
 
 /**
- * Search for byte pattern in memory region.
+ * Search for byte pattern in memory region, at any byte offset.
+ * For code, a compiled pattern (dh_pattern_find) is much faster.
  * 
  * @param start Search region start
  * @param size  Search region size
@@ -173,8 +407,148 @@ void* dh_make_trampoline(void* target, uint32_t stolen_len);
 void* dh_find_pattern(const void* start, size_t size,
                       const char* pat, const char* mask);
 
+/**
+ * One word of a compiled pattern: matches when (word & mask) == value.
+ */
+typedef struct dh_pword {
+    uint32_t value;
+    uint32_t mask;
+} dh_pword;
+
+#define DH_WORD(v)       { (uint32_t)(v), 0xFFFFFFFFu }                 /* Exact */
+#define DH_MASKED(v, m)  { (uint32_t)(v) & (uint32_t)(m), (uint32_t)(m) } /* Some bits */
+#define DH_ANY           { 0, 0 }                                        /* Wildcard */
+
+#define DH_PATTERN_MAX_WORDS 16
+
+/**
+ * Pattern compiled for word-aligned code scans.
+ * Set up once with dh_pattern_init() or dh_pattern_compile(), then
+ * searched with dh_pattern_find() as often as needed.
+ */
+typedef struct dh_pattern {
+    dh_pword words[DH_PATTERN_MAX_WORDS];
+    uint8_t  nwords;
+    uint8_t  anchor;     /* Rarest fully specified word, the scan looks for it */
+    uint8_t  skip[256];  /* Horspool shift (words) by hash of the last word, if no anchor */
+} dh_pattern;
+
+/**
+ * Compile a pattern from words.
+ *
+ * @param p      Pattern to fill
+ * @param words  1..DH_PATTERN_MAX_WORDS words
+ * @param nwords Word count
+ * @return 0 on success, -1 if the count is out of range
+ *
+ * Example:
+ *   static const dh_pword words[] = {
+ *       DH_MASKED(0x94210000, 0xFFFF0000),  // stwu r1,-X(r1)
+ *       DH_WORD(0x7C0802A6),                // mflr r0
+ *       DH_ANY,
+ *       DH_WORD(0x3C608040),                // lis r3,0x8040
+ *   };
+ *   static dh_pattern pat;
+ *   dh_pattern_init(&pat, words, 4);
+ *   void* found = dh_pattern_find(&pat, start, size);
+ */
+int dh_pattern_init(dh_pattern* p, const dh_pword* words, unsigned nwords);
+
+/**
+ * Compile a byte pattern and 'x'/'?' mask, as taken by dh_find_pattern().
+ * The length must be a whole number of words.
+ *
+ * @return 0 on success, -1 if the length is not a multiple of 4 or too long
+ */
+int dh_pattern_compile(dh_pattern* p, const char* pat, const char* mask);
+
+/**
+ * Find a compiled pattern at word-aligned addresses.
+ *
+ * @param p     Compiled pattern
+ * @param start Search region start (rounded up to a word)
+ * @param size  Search region size
+ * @return Pointer to first match, or NULL if not found
+ */
+void* dh_pattern_find(const dh_pattern* p, const void* start, size_t size);
+
+/**
+ * Result of one pattern in dh_find_patterns().
+ */
+typedef struct dh_match {
+    void*    addr;   /* First match, or NULL */
+    uint32_t count;  /* 0 = missing, 1 = unique, more = ambiguous */
+} dh_match;
+
+#define DH_FIND_PATTERNS_MAX 512
+
+/**
+ * Find many compiled patterns in one pass over a region.
+ * Every match is counted, so ambiguous patterns are reported rather than
+ * resolved to their first hit. Uses about 3 KB of static tables; not
+ * reentrant.
+ *
+ * @param pats    Compiled patterns
+ * @param npats   Pattern count, up to DH_FIND_PATTERNS_MAX
+ * @param start   Search region start (rounded up to a word)
+ * @param size    Search region size
+ * @param results One result per pattern
+ * @return Number of patterns found exactly once, or -1 if npats is too large
+ *
+ * Example:
+ *   const dh_pattern* pats[] = { &pat_a, &pat_b, &pat_c };
+ *   dh_match found[3];
+ *   if (dh_find_patterns(pats, 3, start, size, found) != 3) {
+ *       // found[i].count says which are missing or ambiguous
+ *   }
+ */
+int dh_find_patterns(const dh_pattern* const* pats, unsigned npats,
+                     const void* start, size_t size, dh_match* results);
+
 #endif /* DOLHOOK_NO_PATTERN */
 
+/* ============================================================================
+ * Signatures (resolved by the patcher)
+ * ========================================================================= */
+
+/**
+ * Game function located at patch time.
+ * Declared with DH_SIGNATURE() or DH_SYMBOL(). The patcher finds each one
+ * in the game's code, stores its address in 'addr', and refuses to patch
+ * when one is missing or matches more than once. Nothing is scanned at boot.
+ */
+typedef struct dh_sig {
+    const char*    name;  /* Shown in patcher errors; the symbol for DH_SYMBOL */
+    const uint8_t* pat;   /* Pattern bytes */
+    const char*    mask;  /* 'x' = match, '?' = wildcard; "" = by name */
+    void*          addr;  /* Filled in by the patcher */
+} dh_sig;
+
+/**
+ * Declare a signature, matched word-aligned against the game's text.
+ * The mask sets the pattern length.
+ *
+ * Example:
+ *   DH_SIGNATURE(sig_update, "xx??xxxxxxxx",
+ *                0x94, 0x21, 0x00, 0x00, 0x7C, 0x08, 0x02, 0xA6, 0x93, 0xE1, 0x00, 0x1C);
+ *   ...
+ *   hook.target = sig_update.addr;
+ */
+#define DH_SIGNATURE(var, mask_str, ...) \
+    static const uint8_t var##_pat[] = { __VA_ARGS__ }; \
+    _Static_assert(sizeof(var##_pat) == sizeof(mask_str) - 1, #var ": mask and pattern differ in length"); \
+    __attribute__((section(".dolhook_sigs"), used)) dh_sig var = { #var, var##_pat, mask_str, 0 }
+
+/**
+ * Declare a function looked up by name in the game map given to the
+ * patcher (patchiso --map).
+ *
+ * Example:
+ *   DH_SYMBOL(sym_osreport, "OSReport");
+ */
+#define DH_SYMBOL(var, symbol) \
+    __attribute__((section(".dolhook_sigs"), used)) dh_sig var = { symbol, 0, "", 0 }
+
 /* ============================================================================
  * Logging (optional, uses OSReport if available)
  * ========================================================================= */
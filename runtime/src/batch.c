@@ -0,0 +1,219 @@
+/**
+ * DolHook Batch Patching
+ * Apply many code writes under one interrupt-off window
+ *
+ * While a batch is open, writes to live code are queued and the lines
+ * they touch are collected as ranges. Commit sorts and merges the ranges,
+ * then, with interrupts off once: performs the writes, flushes each data
+ * line once, and invalidates each instruction line once, or the whole
+ * instruction cache when that is less work than the lines.
+ */
+
+#include "dolhook.h"
+#include <string.h>
+
+#define BATCH_MAX_WRITES 512
+#define BATCH_MAX_RANGES 512
+#define BATCH_MAX_FREES  64
+
+#define CACHE_LINE    32
+#define ICACHE_SIZE   32768  /* Gekko L1 instruction cache */
+
+typedef struct staged_write {
+    uintptr_t addr;
+    uint32_t  value;
+    uint32_t  size;
+} staged_write;
+
+/* Cache-line aligned [start, end) */
+typedef struct line_range {
+    uintptr_t start;
+    uintptr_t end;
+} line_range;
+
+static int g_batch_open = 0;
+static staged_write g_writes[BATCH_MAX_WRITES];
+static unsigned g_write_count = 0;
+static line_range g_ranges[BATCH_MAX_RANGES];
+static unsigned g_range_count = 0;
+static void* g_frees[BATCH_MAX_FREES];
+static unsigned g_free_count = 0;
+static dh_batch_stats g_stats;
+
+/* Sort by start and merge overlapping or adjacent ranges */
+static void coalesce(void) {
+    for (unsigned i = 1; i < g_range_count; i++) {
+        line_range r = g_ranges[i];
+        unsigned j = i;
+        while (j > 0 && g_ranges[j - 1].start > r.start) {
+            g_ranges[j] = g_ranges[j - 1];
+            j--;
+        }
+        g_ranges[j] = r;
+    }
+    
+    unsigned n = 0;
+    for (unsigned i = 0; i < g_range_count; i++) {
+        if (n > 0 && g_ranges[i].start <= g_ranges[n - 1].end) {
+            if (g_ranges[i].end > g_ranges[n - 1].end) {
+                g_ranges[n - 1].end = g_ranges[i].end;
+            }
+        } else {
+            g_ranges[n++] = g_ranges[i];
+        }
+    }
+    g_range_count = n;
+}
+
+/* One interrupt-off window for everything queued so far */
+static void apply(void) {
+    coalesce();
+    
+    uint32_t lines = 0;
+    for (unsigned i = 0; i < g_range_count; i++) {
+        lines += (uint32_t)((g_ranges[i].end - g_ranges[i].start) / CACHE_LINE);
+    }
+    int flash = lines * CACHE_LINE > ICACHE_SIZE;
+    
+    uint32_t msr = dh_suspend_interrupts();
+    uint32_t t0 = dh_time_base();
+    
+    for (unsigned i = 0; i < g_write_count; i++) {
+        const staged_write* w = &g_writes[i];
+        if (w->size == 4) {
+            *(volatile uint32_t*)w->addr = w->value;
+        } else if (w->size == 2) {
+            *(volatile uint16_t*)w->addr = (uint16_t)w->value;
+        } else {
+            *(volatile uint8_t*)w->addr = (uint8_t)w->value;
+        }
+    }
+    
+    for (unsigned i = 0; i < g_range_count; i++) {
+        dh_dcache_flush_range((void*)g_ranges[i].start, (unsigned)(g_ranges[i].end - g_ranges[i].start));
+    }
+    dh_cache_barrier();
+    
+    if (flash) {
+        dh_icache_invalidate_all();
+    } else {
+        for (unsigned i = 0; i < g_range_count; i++) {
+            dh_icache_invalidate_range((void*)g_ranges[i].start, (unsigned)(g_ranges[i].end - g_ranges[i].start));
+        }
+    }
+    dh_cache_barrier();
+    
+    uint32_t t1 = dh_time_base();
+    dh_restore_interrupts(msr);
+    
+    g_stats.writes += g_write_count;
+    g_stats.ranges += g_range_count;
+    g_stats.lines += lines;
+    g_stats.windows++;
+    g_stats.icache_flashes += flash;
+    g_stats.irq_off_ticks += t1 - t0;
+    g_write_count = 0;
+    g_range_count = 0;
+    
+    /* Blocks the old code pointed at are unreachable now */
+    for (unsigned i = 0; i < g_free_count; i++) {
+        dh_code_free(g_frees[i]);
+    }
+    g_free_count = 0;
+}
+
+/* Room for count more writes and one more range. A full queue is applied
+ * before the next patch is staged, so each patch and its lines land in
+ * one window. */
+static void reserve(unsigned count) {
+    if (g_range_count == BATCH_MAX_RANGES) {
+        coalesce();
+    }
+    if (g_write_count + count > BATCH_MAX_WRITES || g_range_count == BATCH_MAX_RANGES) {
+        apply();
+    }
+}
+
+static void queue(uintptr_t addr, uint32_t v, unsigned size) {
+    staged_write* w = &g_writes[g_write_count++];
+    w->addr = addr;
+    w->value = v;
+    w->size = size;
+}
+
+void dh_batch_begin(void) {
+    if (g_batch_open) {
+        return;
+    }
+    g_batch_open = 1;
+    g_write_count = 0;
+    g_range_count = 0;
+    g_free_count = 0;
+    memset(&g_stats, 0, sizeof(g_stats));
+}
+
+int dh_batch_active(void) {
+    return g_batch_open;
+}
+
+void dh_batch_touch(void* addr, unsigned len) {
+    if (len == 0) {
+        return;
+    }
+    
+    uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(CACHE_LINE - 1);
+    uintptr_t end = ((uintptr_t)addr + len + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+    
+    /* Writes mostly land next to the previous one */
+    if (g_range_count > 0) {
+        line_range* last = &g_ranges[g_range_count - 1];
+        if (start <= last->end && end >= last->start) {
+            if (start < last->start) last->start = start;
+            if (end > last->end) last->end = end;
+            return;
+        }
+    }
+    
+    reserve(0);
+    g_ranges[g_range_count].start = start;
+    g_ranges[g_range_count].end = end;
+    g_range_count++;
+}
+
+void dh_batch_stage(volatile void* p, uint32_t v, unsigned size) {
+    reserve(1);
+    queue((uintptr_t)p, v, size);
+    dh_batch_touch((void*)p, size);
+}
+
+void dh_batch_stage_words(volatile void* p, const uint32_t* words, unsigned count) {
+    reserve(count);
+    for (unsigned i = 0; i < count; i++) {
+        queue((uintptr_t)p + i * 4, words[i], 4);
+    }
+    dh_batch_touch((void*)p, count * 4);
+}
+
+void dh_batch_free_code(void* block) {
+    if (g_free_count == BATCH_MAX_FREES) {
+        apply();
+    }
+    g_frees[g_free_count++] = block;
+}
+
+void dh_batch_commit(dh_batch_stats* stats) {
+    if (!g_batch_open) {
+        return;
+    }
+    
+    if (g_write_count > 0 || g_range_count > 0 || g_free_count > 0) {
+        apply();
+    }
+    g_batch_open = 0;
+    
+    /* 40.5 MHz time base (bus clock / 4) */
+    g_stats.irq_off_us = g_stats.irq_off_ticks * 2 / 81;
+    if (stats) {
+        *stats = g_stats;
+    }
+}
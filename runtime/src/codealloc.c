@@ -0,0 +1,178 @@
+/**
+ * DolHook Code Allocator
+ * Executable memory for trampolines
+ *
+ * Each arena is carved from the bottom in 16-byte granules and keeps one
+ * free list per size class. Freed blocks go back on their class list and
+ * are handed out again before the arena grows, so installing and removing
+ * the same hooks over and over uses a fixed amount of memory. A byte per
+ * granule at the top of the arena records which class starts there, which
+ * is all dh_code_free() needs to know.
+ */
+
+#include "dolhook.h"
+
+#define CODE_GRANULE     16
+#define CODE_CLASSES     (DH_CODE_MAX_ALLOC / CODE_GRANULE)
+#define CODE_MAX_ARENAS  4
+#define CODE_FREE_FLAG   0x80
+
+/* Built-in arena, always the first one */
+#define DEFAULT_ARENA_SIZE 16384
+static uint8_t g_default_arena[DEFAULT_ARENA_SIZE] __attribute__((aligned(32)));
+
+typedef struct code_block {
+    struct code_block* next;
+} code_block;
+
+typedef struct code_arena {
+    uint8_t*    base;       /* Granule 0 */
+    uint8_t*    classes;    /* Class + 1 of the block at each granule (0 = none), CODE_FREE_FLAG if free */
+    uint32_t    granules;
+    uint32_t    top;        /* Granules carved so far */
+    code_block* free[CODE_CLASSES];
+} code_arena;
+
+static code_arena g_arenas[CODE_MAX_ARENAS];
+static unsigned g_arena_count = 0;
+static uint32_t g_code_in_use = 0;
+
+static int add_arena(void* base, uint32_t size) {
+    if (g_arena_count == CODE_MAX_ARENAS) {
+        return -1;
+    }
+    
+    uintptr_t start = ((uintptr_t)base + CODE_GRANULE - 1) & ~(uintptr_t)(CODE_GRANULE - 1);
+    uint32_t skip = (uint32_t)(start - (uintptr_t)base);
+    if (size <= skip) {
+        return -1;
+    }
+    
+    /* Each granule costs 16 bytes of code and 1 byte of class map */
+    uint32_t granules = (size - skip) / (CODE_GRANULE + 1);
+    if (granules == 0) {
+        return -1;
+    }
+    
+    code_arena* a = &g_arenas[g_arena_count++];
+    a->base = (uint8_t*)start;
+    a->classes = a->base + granules * CODE_GRANULE;
+    a->granules = granules;
+    a->top = 0;
+    for (unsigned c = 0; c < CODE_CLASSES; c++) {
+        a->free[c] = NULL;
+    }
+    
+    return 0;
+}
+
+static void ensure_default_arena(void) {
+    if (g_arena_count == 0) {
+        add_arena(g_default_arena, DEFAULT_ARENA_SIZE);
+    }
+}
+
+int dh_code_add_arena(void* base, uint32_t size) {
+    ensure_default_arena();
+    return add_arena(base, size);
+}
+
+/* Whether a b at any address in [a, a + len) reaches near, and back */
+static int in_reach(uintptr_t a, uint32_t len, uintptr_t near) {
+    intptr_t lo = (intptr_t)(a - near);
+    return lo >= -0x2000000 && lo + (intptr_t)len <= 0x1FFFFFF;
+}
+
+static void* take_free(code_arena* a, unsigned cls) {
+    code_block* b = a->free[cls];
+    if (!b) {
+        return NULL;
+    }
+    
+    a->free[cls] = b->next;
+    a->classes[((uint8_t*)b - a->base) / CODE_GRANULE] &= ~CODE_FREE_FLAG;
+    return b;
+}
+
+static void* carve(code_arena* a, unsigned cls) {
+    if (a->granules - a->top < cls + 1) {
+        return NULL;
+    }
+    
+    uint32_t g = a->top;
+    a->top += cls + 1;
+    a->classes[g] = (uint8_t)(cls + 1);
+    return a->base + g * CODE_GRANULE;
+}
+
+void* dh_code_alloc(uint32_t size, const void* near) {
+    if (size == 0 || size > DH_CODE_MAX_ALLOC) {
+        return NULL;
+    }
+    
+    ensure_default_arena();
+    unsigned cls = (size + CODE_GRANULE - 1) / CODE_GRANULE - 1;
+    
+    /* Reuse a block of the same class, then grow, then settle for a
+     * larger free block (kept whole) */
+    for (int pass = 0; pass < 3; pass++) {
+        for (unsigned i = 0; i < g_arena_count; i++) {
+            code_arena* a = &g_arenas[i];
+            if (near && !in_reach((uintptr_t)a->base, a->granules * CODE_GRANULE, (uintptr_t)near)) {
+                continue;
+            }
+            
+            void* p = NULL;
+            unsigned got = cls;
+            if (pass == 0) {
+                p = take_free(a, cls);
+            } else if (pass == 1) {
+                p = carve(a, cls);
+            } else {
+                while (!p && ++got < CODE_CLASSES) {
+                    p = take_free(a, got);
+                }
+            }
+            
+            if (p) {
+                g_code_in_use += (got + 1) * CODE_GRANULE;
+                return p;
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+int dh_code_free(void* p) {
+    if (!p) {
+        return 0;
+    }
+    
+    for (unsigned i = 0; i < g_arena_count; i++) {
+        code_arena* a = &g_arenas[i];
+        uintptr_t off = (uintptr_t)p - (uintptr_t)a->base;
+        if ((uintptr_t)p < (uintptr_t)a->base || off >= a->top * CODE_GRANULE) {
+            continue;
+        }
+        
+        /* Must be the start of a live block */
+        uint8_t c = (off % CODE_GRANULE) ? 0 : a->classes[off / CODE_GRANULE];
+        if (c == 0 || (c & CODE_FREE_FLAG)) {
+            return -1;
+        }
+        
+        code_block* b = (code_block*)p;
+        b->next = a->free[c - 1];
+        a->free[c - 1] = b;
+        a->classes[off / CODE_GRANULE] = c | CODE_FREE_FLAG;
+        g_code_in_use -= c * CODE_GRANULE;
+        return 0;
+    }
+    
+    return -1;
+}
+
+uint32_t dh_code_in_use(void) {
+    return g_code_in_use;
+}
@@ -7,33 +7,63 @@
 #include <string.h>
 #include <stdarg.h>
 
-/* Simple heap for trampolines (16KB static buffer) */
-#define TRAMPOLINE_POOL_SIZE 16384
-static uint8_t g_trampoline_pool[TRAMPOLINE_POOL_SIZE] __attribute__((aligned(32)));
-static uint32_t g_trampoline_offset = 0;
 static int g_initialized = 0;
 
 /* Weak OSReport symbol - may be resolved by game or not */
 extern void OSReport(const char* fmt, ...) __attribute__((weak));
 
+/* Code list from the patcher (gecko.c) */
+extern dh_gecko_list __dolhook_gecko;
+
 /* ============================================================================
  * Cache Maintenance
  * ========================================================================= */
 
-void dh_icache_sync_range(void* addr, unsigned len) {
+void dh_dcache_flush_range(void* addr, unsigned len) {
     uint32_t start = (uint32_t)addr & ~31;
     uint32_t end = ((uint32_t)addr + len + 31) & ~31;
     
-    /* Flush data cache */
     for (uint32_t p = start; p < end; p += 32) {
         asm volatile("dcbf 0, %0" : : "r"(p) : "memory");
     }
-    asm volatile("sync" : : : "memory");
+}
+
+void dh_icache_invalidate_range(void* addr, unsigned len) {
+    uint32_t start = (uint32_t)addr & ~31;
+    uint32_t end = ((uint32_t)addr + len + 31) & ~31;
     
-    /* Invalidate instruction cache */
     for (uint32_t p = start; p < end; p += 32) {
         asm volatile("icbi 0, %0" : : "r"(p) : "memory");
     }
+}
+
+void dh_icache_invalidate_all(void) {
+    uint32_t hid0;
+    asm volatile(
+        "mfspr %0, 1008\n"
+        "ori %0, %0, 0x0800\n"  /* ICFI */
+        "mtspr 1008, %0\n"
+        : "=r"(hid0) : : "memory"
+    );
+}
+
+void dh_cache_barrier(void) {
+    asm volatile("sync; isync" : : : "memory");
+}
+
+uint32_t dh_time_base(void) {
+    uint32_t tb;
+    asm volatile("mftb %0" : "=r"(tb));
+    return tb;
+}
+
+void dh_icache_sync_range(void* addr, unsigned len) {
+    /* Flush data cache */
+    dh_dcache_flush_range(addr, len);
+    asm volatile("sync" : : : "memory");
+    
+    /* Invalidate instruction cache */
+    dh_icache_invalidate_range(addr, len);
     asm volatile("sync; isync" : : : "memory");
 }
 
@@ -61,6 +91,11 @@ void dh_restore_interrupts(uint32_t saved_msr) {
  * ========================================================================= */
 
 void dh_write8(volatile void* p, uint8_t v) {
+    if (dh_batch_active()) {
+        dh_batch_stage(p, v, 1);
+        return;
+    }
+    
     uint32_t msr = dh_suspend_interrupts();
     *(volatile uint8_t*)p = v;
     dh_icache_sync_range((void*)p, 1);
@@ -68,6 +103,11 @@ void dh_write8(volatile void* p, uint8_t v) {
 }
 
 void dh_write16(volatile void* p, uint16_t v) {
+    if (dh_batch_active()) {
+        dh_batch_stage(p, v, 2);
+        return;
+    }
+    
     uint32_t msr = dh_suspend_interrupts();
     *(volatile uint16_t*)p = v;
     dh_icache_sync_range((void*)p, 2);
@@ -75,6 +115,11 @@ void dh_write16(volatile void* p, uint16_t v) {
 }
 
 void dh_write32(volatile void* p, uint32_t v) {
+    if (dh_batch_active()) {
+        dh_batch_stage(p, v, 4);
+        return;
+    }
+    
     uint32_t msr = dh_suspend_interrupts();
     *(volatile uint32_t*)p = v;
     dh_icache_sync_range((void*)p, 4);
@@ -101,11 +146,8 @@ uint32_t dh_make_branch_imm(uint32_t from, uint32_t to, int link) {
     return insn;
 }
 
-void dh_write_branch_abs(void* at, void* to, int link) {
-    uint32_t addr = (uint32_t)to;
-    uint32_t* p = (uint32_t*)at;
-    uint32_t msr = dh_suspend_interrupts();
-    
+/* lis/ori/mtctr/bctr to addr */
+static void encode_branch_abs(uint32_t* p, uint32_t addr, int link) {
     /* lis r12, hi16(addr) */
     p[0] = 0x3D800000 | (addr >> 16);
     
@@ -117,111 +159,97 @@ void dh_write_branch_abs(void* at, void* to, int link) {
     
     /* bctr (or bctrl if link requested, though typically not used) */
     p[3] = link ? 0x4E800421 : 0x4E800420;
-    
-    dh_icache_sync_range(at, 16);
-    dh_restore_interrupts(msr);
 }
 
-/* ============================================================================
- * Trampoline Management
- * ========================================================================= */
-
-void* dh_make_trampoline(void* target, uint32_t stolen_len) {
-    /* Align allocation to 16 bytes */
-    uint32_t aligned_offset = (g_trampoline_offset + 15) & ~15;
-    uint32_t needed = stolen_len + 16; /* stolen code + jump back */
+void dh_write_branch_abs(void* at, void* to, int link) {
+    uint32_t seq[4];
+    encode_branch_abs(seq, (uint32_t)to, link);
     
-    if (aligned_offset + needed > TRAMPOLINE_POOL_SIZE) {
-        return NULL; /* Out of trampoline memory */
+    if (dh_batch_active()) {
+        dh_batch_stage_words(at, seq, 4);
+        return;
     }
     
-    uint8_t* trampoline = &g_trampoline_pool[aligned_offset];
-    g_trampoline_offset = aligned_offset + needed;
-    
-    /* Copy stolen bytes */
-    memcpy(trampoline, target, stolen_len);
-    
-    /* Append jump back to (target + stolen_len) */
-    uint32_t return_addr = (uint32_t)target + stolen_len;
-    uint32_t branch_at = (uint32_t)(trampoline + stolen_len);
-    uint32_t branch_insn = dh_make_branch_imm(branch_at, return_addr, 0);
-    
-    if (branch_insn != 0) {
-        /* Near branch works */
-        *(uint32_t*)(trampoline + stolen_len) = branch_insn;
-    } else {
-        /* Need absolute branch */
-        dh_write_branch_abs(trampoline + stolen_len, (void*)return_addr, 0);
+    uint32_t* p = (uint32_t*)at;
+    uint32_t msr = dh_suspend_interrupts();
+    for (int i = 0; i < 4; i++) {
+        p[i] = seq[i];
     }
-    
-    /* Sync cache for trampoline */
-    dh_icache_sync_range(trampoline, needed);
-    
-    return trampoline;
+    dh_icache_sync_range(at, 16);
+    dh_restore_interrupts(msr);
 }
 
 /* ============================================================================
- * Function Hooking
+ * Trampoline Management
  * ========================================================================= */
 
-int dh_hook_install(dh_hook* h) {
-    if (!h || !h->target || !h->replacement) {
+/* Relocate the stolen code into a fresh block and append the jump back;
+ * -1 if the block is too small */
+static int fill_trampoline(uint32_t* t, uint32_t words, int near, void* target, uint32_t count) {
+    uint32_t exit_words = near ? 1 : 4;
+    if (words < exit_words) {
         return -1;
     }
     
-    /* Check if target and replacement are within ±32MB */
-    uint32_t from = (uint32_t)h->target;
-    uint32_t to = (uint32_t)h->replacement;
-    int32_t offset = (int32_t)to - (int32_t)from;
-    
-    /* Determine patch strategy */
-    int use_near = (offset >= -0x2000000 && offset <= 0x1FFFFFF);
-    uint32_t patch_len = use_near ? 4 : 16; /* 4 for bl, 16 for abs (12) + padding */
-    uint32_t stolen_len = patch_len;
-    
-    /* Save original bytes */
-    memcpy(h->saved, h->target, 16);
-    h->patch_len = patch_len;
-    
-    /* Create trampoline */
-    h->trampoline = dh_make_trampoline(h->target, stolen_len);
-    if (!h->trampoline) {
-        return -1; /* Allocation failed */
+    int n = dh_relocate(t, (uint32_t)t, words - exit_words, (const uint32_t*)target, (uint32_t)target, count);
+    if (n < 0) {
+        return n;
     }
     
-    /* Install hook */
-    uint32_t msr = dh_suspend_interrupts();
-    
-    if (use_near) {
-        /* Write branch immediate */
-        uint32_t branch = dh_make_branch_imm(from, to, 0);
-        *(uint32_t*)h->target = branch;
-        dh_icache_sync_range(h->target, 4);
+    /* Jump back to (target + stolen_len); the block isn't live code yet,
+     * so it is written directly */
+    uint32_t return_addr = (uint32_t)target + count * 4;
+    if (near) {
+        t[n] = dh_make_branch_imm((uint32_t)&t[n], return_addr, 0);
     } else {
-        /* Write absolute branch sequence */
-        dh_write_branch_abs(h->target, h->replacement, 0);
+        encode_branch_abs(&t[n], return_addr, 0);
     }
     
-    dh_restore_interrupts(msr);
-    
+    /* Sync cache for trampoline */
+    if (dh_batch_active()) {
+        dh_batch_touch(t, (n + exit_words) * 4);
+    } else {
+        dh_icache_sync_range(t, (n + exit_words) * 4);
+    }
     return 0;
 }
 
-int dh_hook_remove(dh_hook* h) {
-    if (!h || !h->target) {
-        return -1;
-    }
+void* dh_make_trampoline(void* target, uint32_t stolen_len) {
+    uint32_t count = stolen_len / 4;
     
-    /* Restore original bytes */
-    uint32_t msr = dh_suspend_interrupts();
-    memcpy(h->target, h->saved, h->patch_len);
-    dh_icache_sync_range(h->target, h->patch_len);
-    dh_restore_interrupts(msr);
+    /* Sized as if run at the target, which a near block nearly is; if the
+     * real placement needs islands, retry with room for the worst case */
+    int sized = dh_relocate(NULL, (uint32_t)target, 0, (const uint32_t*)target, (uint32_t)target, count);
+    if (sized < 0) {
+        return NULL;
+    }
     
-    /* Note: We don't free trampoline (static pool) */
-    h->trampoline = NULL;
+    uint32_t sizes[2] = { (uint32_t)sized, DH_RELOC_MAX_WORDS(count) };
+    for (int attempt = 0; attempt < 2; attempt++) {
+        /* Within reach of the target the jump back is one b, otherwise
+         * the absolute sequence */
+        uint32_t words = sizes[attempt] + 1;
+        uint32_t* t = (uint32_t*)dh_code_alloc(words * 4, target);
+        int near = t != NULL;
+        if (!near) {
+            words = sizes[attempt] + 4;
+            t = (uint32_t*)dh_code_alloc(words * 4, NULL);
+            if (!t) {
+                return NULL; /* Out of trampoline memory */
+            }
+        }
+        
+        int rc = fill_trampoline(t, words, near, target, count);
+        if (rc == 0) {
+            return t;
+        }
+        dh_code_free(t);
+        if (rc != -1) {
+            return NULL;
+        }
+    }
     
-    return 0;
+    return NULL;
 }
 
 /* ============================================================================
@@ -259,8 +287,21 @@ void dh_init(void) {
     dh_banner();
 #endif
     
-    /* Install user hooks */
+    /* Apply the embedded Gecko codes and install user hooks, all under
+     * one interrupt-off window */
+    dh_batch_stats stats;
+    dh_batch_begin();
+    if (__dolhook_gecko.size) {
+        dh_gecko_stats gecko;
+        dh_gecko_load(__dolhook_gecko.codes, __dolhook_gecko.size, &gecko);
+        dh_log("DolHook: %u Gecko codes, %u per-frame words\n", gecko.codes, gecko.frame_words);
+    }
     if (dh_install_all_hooks) {
         dh_install_all_hooks();
     }
+    dh_batch_commit(&stats);
+    if (stats.windows) {
+        dh_log("DolHook: %u writes, %u cache lines, interrupts off %u us\n",
+               stats.writes, stats.lines, stats.irq_off_us);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,441 @@
+/**
+ * DolHook Gecko Code Engine
+ * Run a Gecko code list without a per-frame code handler
+ *
+ * A traditional handler walks the whole list every frame. Here the list
+ * is read once: unconditional writes are applied at load, C2 blocks are
+ * linked in, and only conditional blocks are compiled into a program
+ * with their addresses resolved. A false condition jumps straight past
+ * its block instead of skipping the codes in it one by one.
+ *
+ * Program ops are a header word (op << 24 | arg) and their operands:
+ *
+ *   IF_*32       target            addr, value       (false: go to target)
+ *   IF_*16       target            addr, keep << 16 | value
+ *   JUMP         target
+ *   WRITE8/16/32 count             addr, value
+ *   STRING       bytes             addr, data words
+ *   SERIAL       size << 16 | count  addr, value, addr_step, value_step
+ *   PATCH                          addr, insn        (synced when it changes)
+ *   END
+ */
+
+#include "dolhook.h"
+#include <string.h>
+
+/* Game address <-> pointer (the host tests map these into a buffer) */
+#ifndef GECKO_PTR
+#define GECKO_PTR(a)  ((void*)(uintptr_t)(a))
+#define GECKO_ADDR(p) ((uint32_t)(uintptr_t)(p))
+#endif
+
+#define GECKO_BASE   0x80000000u
+#define GECKO_HEADER 0x00D0C0DE
+
+enum {
+    OP_END,
+    OP_IF_EQ32, OP_IF_NE32, OP_IF_GT32, OP_IF_LT32,
+    OP_IF_EQ16, OP_IF_NE16, OP_IF_GT16, OP_IF_LT16,
+    OP_JUMP,
+    OP_WRITE8, OP_WRITE16, OP_WRITE32,
+    OP_STRING,
+    OP_SERIAL,
+    OP_PATCH
+};
+
+/* Filled in by the patcher (patchiso --gecko); kept out of .bss */
+dh_gecko_list __dolhook_gecko __attribute__((section(".data"))) = { 0, 0 };
+
+static uint32_t g_frame[DH_GECKO_MAX_FRAME_WORDS] = { OP_END << 24 };
+
+typedef struct compiler {
+    uint32_t ba;
+    uint32_t po;
+    uint32_t len;                        /* Program words so far */
+    uint32_t depth;                      /* Open conditionals */
+    uint32_t fixup[DH_GECKO_MAX_DEPTH];  /* Header whose target ends each one */
+    int overflow;
+    dh_gecko_stats stats;
+} compiler;
+
+/* One word is always left for the closing END */
+static void emit(compiler* c, uint32_t w) {
+    if (c->len >= DH_GECKO_MAX_FRAME_WORDS - 1) {
+        c->overflow = 1;
+        return;
+    }
+    g_frame[c->len++] = w;
+}
+
+static void store(uint32_t addr, uint32_t value, unsigned size, int once) {
+    void* p = GECKO_PTR(addr);
+    if (once) {
+        if (size == 4) {
+            dh_write32(p, value);
+        } else if (size == 2) {
+            dh_write16(p, (uint16_t)value);
+        } else {
+            dh_write8(p, (uint8_t)value);
+        }
+    } else if (size == 4) {
+        *(volatile uint32_t*)p = value;
+    } else if (size == 2) {
+        *(volatile uint16_t*)p = (uint16_t)value;
+    } else {
+        *(volatile uint8_t*)p = (uint8_t)value;
+    }
+}
+
+/* count copies of a 1, 2 or 4 byte value, a word at a time where aligned */
+static void fill(uint32_t addr, uint32_t value, unsigned size, uint32_t count, int once) {
+    uint32_t word = size == 1 ? value * 0x01010101u : size == 2 ? value << 16 | value : value;
+    uint32_t end = addr + count * size;
+    while (addr < end) {
+        if ((addr & 3) == 0 && end - addr >= 4) {
+            store(addr, word, 4, once);
+            addr += 4;
+        } else {
+            store(addr, value, size, once);
+            addr += size;
+        }
+    }
+}
+
+/* Whole words where aligned, so a one-time string costs few staged writes */
+static void put_string(uint32_t addr, const uint8_t* data, uint32_t len, int once) {
+    uint32_t i = 0;
+    while (i < len) {
+        if (((addr + i) & 3) == 0 && len - i >= 4) {
+            uint32_t w;
+            memcpy(&w, data + i, 4);
+            store(addr + i, w, 4, once);
+            i += 4;
+        } else {
+            store(addr + i, data[i], 1, once);
+            i++;
+        }
+    }
+}
+
+static void serial(uint32_t addr, uint32_t value, unsigned size, uint32_t count,
+                   uint32_t addr_step, uint32_t value_step, int once) {
+    for (uint32_t i = 0; i < count; i++) {
+        store(addr, value, size, once);
+        addr += addr_step;
+        value += value_step;
+    }
+}
+
+static int holds(uint32_t op, uint32_t addr, uint32_t value) {
+    uint32_t v;
+    if (op >= OP_IF_EQ16) {
+        v = *(volatile uint16_t*)GECKO_PTR(addr) & (value >> 16);
+        value &= 0xFFFF;
+        op -= OP_IF_EQ16 - OP_IF_EQ32;
+    } else {
+        v = *(volatile uint32_t*)GECKO_PTR(addr);
+    }
+    
+    switch (op) {
+    case OP_IF_EQ32: return v == value;
+    case OP_IF_NE32: return v != value;
+    case OP_IF_GT32: return v > value;
+    default:         return v < value;
+    }
+}
+
+static void endif(compiler* c) {
+    if (c->depth > 0) {
+        g_frame[c->fixup[--c->depth]] |= c->len;
+    }
+}
+
+/* The true branch jumps over the rest; a false one lands after the jump */
+static void otherwise(compiler* c) {
+    if (c->depth == 0) {
+        return;
+    }
+    uint32_t jump = c->len;
+    emit(c, OP_JUMP << 24);
+    g_frame[c->fixup[c->depth - 1]] |= c->len;
+    c->fixup[c->depth - 1] = jump;
+}
+
+/* E0/E2: ba and po take VVVV0000/WWWW0000 when those are non-zero */
+static void set_bases(compiler* c, uint32_t w) {
+    if (w >> 16) {
+        c->ba = w & 0xFFFF0000;
+    }
+    if (w & 0xFFFF) {
+        c->po = w << 16;
+    }
+}
+
+/* Link in a C2 block: it runs in place and its last word jumps back */
+static int insert(compiler* c, uint32_t addr, uint32_t* block, uint32_t lines) {
+    uint32_t* back = &block[lines * 2 - 1];
+    uint32_t back_insn = dh_make_branch_imm(GECKO_ADDR(back), addr + 4, 0);
+    uint32_t insn = dh_make_branch_imm(addr, GECKO_ADDR(block), 0);
+    if (!back_insn || !insn) {
+        return -1;
+    }
+    
+    /* The block is code-list memory that nothing branches to until the
+     * target is patched, so its jump back is stored as data */
+    *back = back_insn;
+    if (dh_batch_active()) {
+        dh_batch_touch(block, lines * 8);
+    } else {
+        dh_icache_sync_range(block, lines * 8);
+    }
+    
+    if (c->depth == 0) {
+        dh_write32(GECKO_PTR(addr), insn);
+    } else {
+        emit(c, OP_PATCH << 24);
+        emit(c, addr);
+        emit(c, insn);
+    }
+    c->stats.inserts++;
+    return 0;
+}
+
+/* Read one code of avail words; *words is set to the words it takes */
+static int compile(compiler* c, uint32_t* code, uint32_t avail, uint32_t* words) {
+    uint32_t w0 = code[0];
+    uint32_t w1 = code[1];
+    uint32_t top = w0 >> 24;
+    int once = c->depth == 0;
+    *words = 2;
+    
+    /* Terminators */
+    if (top == 0xE0) {
+        while (c->depth > 0) {
+            endif(c);
+        }
+        set_bases(c, w1);
+        return 0;
+    }
+    if (top == 0xE2) {
+        for (uint32_t i = 0; i < (w0 & 0xFF); i++) {
+            endif(c);
+        }
+        if (((w0 >> 20) & 0xF) == 1) {
+            otherwise(c);
+        }
+        set_bases(c, w1);
+        return 0;
+    }
+    if (top >= 0xE0) {
+        return -1;
+    }
+    
+    /* Everything else: type, po flag, 25-bit offset */
+    uint32_t type = top & 0xEE;
+    uint32_t addr = ((top & 0x10) ? c->po : c->ba) + (w0 & 0x01FFFFFF);
+    
+    switch (type) {
+    case 0x00:
+        if (once) {
+            fill(addr, w1 & 0xFF, 1, (w1 >> 16) + 1, 1);
+            c->stats.writes++;
+        } else {
+            emit(c, OP_WRITE8 << 24 | ((w1 >> 16) + 1));
+            emit(c, addr);
+            emit(c, w1 & 0xFF);
+        }
+        return 0;
+        
+    case 0x02:
+        if (once) {
+            fill(addr, w1 & 0xFFFF, 2, (w1 >> 16) + 1, 1);
+            c->stats.writes++;
+        } else {
+            emit(c, OP_WRITE16 << 24 | ((w1 >> 16) + 1));
+            emit(c, addr);
+            emit(c, w1 & 0xFFFF);
+        }
+        return 0;
+        
+    case 0x04:
+        if (once) {
+            store(addr, w1, 4, 1);
+            c->stats.writes++;
+        } else {
+            emit(c, OP_WRITE32 << 24 | 1);
+            emit(c, addr);
+            emit(c, w1);
+        }
+        return 0;
+        
+    case 0x06: {
+        /* w1 bytes follow, padded to whole lines */
+        uint32_t data_words = (w1 + 7) / 8 * 2;
+        if (w1 > 0xFFFFFF || data_words > avail - 2) {
+            return -1;
+        }
+        *words = 2 + data_words;
+        if (once) {
+            put_string(addr, (const uint8_t*)&code[2], w1, 1);
+            c->stats.writes++;
+        } else {
+            emit(c, OP_STRING << 24 | w1);
+            emit(c, addr);
+            for (uint32_t i = 0; i < (w1 + 3) / 4; i++) {
+                emit(c, code[2 + i]);
+            }
+        }
+        return 0;
+    }
+        
+    case 0x08: {
+        /* 08XXXXXX VVVVVVVV  TNNNZZZZ IIIIIIII: NNN + 1 writes of size
+         * 1 << T, address step ZZZZ, value step IIIIIIII */
+        if (avail < 4 || (code[2] >> 28) > 2) {
+            return -1;
+        }
+        *words = 4;
+        unsigned size_log = code[2] >> 28;
+        uint32_t count = ((code[2] >> 16) & 0xFFF) + 1;
+        if (once) {
+            serial(addr, w1, 1u << size_log, count, code[2] & 0xFFFF, code[3], 1);
+            c->stats.writes++;
+        } else {
+            emit(c, OP_SERIAL << 24 | size_log << 16 | count);
+            emit(c, addr);
+            emit(c, w1);
+            emit(c, code[2] & 0xFFFF);
+            emit(c, code[3]);
+        }
+        return 0;
+    }
+        
+    case 0x20: case 0x22: case 0x24: case 0x26:
+    case 0x28: case 0x2A: case 0x2C: case 0x2E: {
+        /* Address bit 0: endif before this if */
+        if (addr & 1) {
+            addr &= ~1u;
+            endif(c);
+        }
+        if (c->depth == DH_GECKO_MAX_DEPTH) {
+            return -1;
+        }
+        uint32_t op = OP_IF_EQ32 + ((type - 0x20) >> 1);
+        c->fixup[c->depth++] = c->len;
+        emit(c, op << 24);
+        emit(c, addr);
+        emit(c, op >= OP_IF_EQ16 ? (~w1 & 0xFFFF0000) | (w1 & 0xFFFF) : w1);
+        return 0;
+    }
+        
+    case 0xC2:
+        /* w1 lines of code follow; the last word becomes the jump back */
+        if (w1 == 0 || w1 > (avail - 2) / 2) {
+            return -1;
+        }
+        *words = 2 + w1 * 2;
+        return insert(c, addr, &code[2], w1);
+        
+    default:
+        return -1;
+    }
+}
+
+int dh_gecko_load(uint32_t* codes, uint32_t size, dh_gecko_stats* stats) {
+    compiler c;
+    memset(&c, 0, sizeof(c));
+    c.ba = GECKO_BASE;
+    c.po = GECKO_BASE;
+    
+    /* Nothing runs from a half-built program */
+    g_frame[0] = OP_END << 24;
+    
+    uint32_t n = size / 4;
+    uint32_t i = 0;
+    if (n >= 2 && codes[0] == GECKO_HEADER && codes[1] == GECKO_HEADER) {
+        i = 2;
+    }
+    
+    int rc = 0;
+    while (i + 2 <= n && codes[i] != 0xF0000000) {
+        uint32_t words;
+        if (compile(&c, &codes[i], n - i, &words) != 0) {
+            dh_log("DolHook: Gecko code %u (%08x %08x) not supported\n",
+                   c.stats.codes, codes[i], codes[i + 1]);
+            rc = -1;
+            break;
+        }
+        i += words;
+        c.stats.codes++;
+    }
+    
+    /* The end of the list closes whatever is still open */
+    while (c.depth > 0) {
+        endif(&c);
+    }
+    g_frame[c.len] = OP_END << 24;
+    
+    if (c.overflow) {
+        dh_log("DolHook: Gecko codes need more than %u per-frame words\n", DH_GECKO_MAX_FRAME_WORDS);
+        g_frame[0] = OP_END << 24;
+        c.len = 0;
+        rc = -2;
+    }
+    c.stats.frame_words = c.len;
+    if (stats) {
+        *stats = c.stats;
+    }
+    return rc;
+}
+
+void dh_gecko_run_frame(void) {
+    const uint32_t* pc = g_frame;
+    for (;;) {
+        uint32_t op = pc[0] >> 24;
+        uint32_t arg = pc[0] & 0xFFFFFF;
+        
+        switch (op) {
+        case OP_END:
+            return;
+            
+        case OP_IF_EQ32: case OP_IF_NE32: case OP_IF_GT32: case OP_IF_LT32:
+        case OP_IF_EQ16: case OP_IF_NE16: case OP_IF_GT16: case OP_IF_LT16:
+            pc = holds(op, pc[1], pc[2]) ? pc + 3 : g_frame + arg;
+            break;
+            
+        case OP_JUMP:
+            pc = g_frame + arg;
+            break;
+            
+        case OP_WRITE8:
+        case OP_WRITE16:
+        case OP_WRITE32:
+            fill(pc[1], pc[2], 1u << (op - OP_WRITE8), arg, 0);
+            pc += 3;
+            break;
+            
+        case OP_STRING:
+            put_string(pc[1], (const uint8_t*)&pc[2], arg, 0);
+            pc += 2 + (arg + 3) / 4;
+            break;
+            
+        case OP_SERIAL:
+            serial(pc[1], pc[2], 1u << (arg >> 16), arg & 0xFFFF, pc[3], pc[4], 0);
+            pc += 5;
+            break;
+            
+        case OP_PATCH: {
+            volatile uint32_t* p = (volatile uint32_t*)GECKO_PTR(pc[1]);
+            if (*p != pc[2]) {
+                *p = pc[2];
+                dh_icache_sync_range((void*)p, 4);
+            }
+            pc += 3;
+            break;
+        }
+            
+        default:
+            return;
+        }
+    }
+}
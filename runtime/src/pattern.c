@@ -1,6 +1,18 @@
 /**
  * DolHook Pattern Scanning
  * Find byte patterns in memory with wildcard support
+ *
+ * Compiled patterns are matched a word at a time at word-aligned
+ * addresses, driven by the rarest fully specified word (the anchor): a
+ * skip loop compares four text words at a time against it and only stops
+ * where it occurs, so the rest of the pattern is checked at a handful of
+ * places. A pattern with no fully specified word falls back to Horspool
+ * over words: each window is judged by its last word, and a 256-entry
+ * table keyed by a hash of that word says how far it can move.
+ *
+ * dh_find_patterns() resolves many patterns in one pass instead: patterns
+ * are bucketed by a hash of their anchor word, each text word is hashed
+ * once, and only the patterns in its bucket are compared.
  */
 
 #include "dolhook.h"
@@ -39,4 +51,294 @@ void* dh_find_pattern(const void* start, size_t size,
     return NULL; /* Not found */
 }
 
-#endif /* DOLHOOK_NO_PATTERN */
\ No newline at end of file
+/* ============================================================================
+ * Compiled Patterns
+ * ========================================================================= */
+
+#define FULL_MASK 0xFFFFFFFFu
+
+/* Bucket of a word in the skip table */
+static inline uint8_t skip_hash(uint32_t w) {
+    return (uint8_t)((w * 0x9E3779B1u) >> 24);
+}
+
+/* Words found all over game code; poor anchors */
+static const uint32_t g_common_words[] = {
+    0x00000000,
+    0x60000000, /* nop */
+    0x4E800020, /* blr */
+    0x4E800021, /* blrl */
+    0x4E800420, /* bctr */
+    0x7C0802A6, /* mflr r0 */
+    0x7C0803A6, /* mtlr r0 */
+    0x38600000, /* li r3,0 */
+    0x38600001, /* li r3,1 */
+    0x7C7F1B78, /* mr r31,r3 */
+    0x7FE3FB78, /* mr r3,r31 */
+};
+
+/* Higher is rarer; only fully specified words qualify */
+static int word_rarity(const dh_pword* w) {
+    if (w->mask != FULL_MASK) {
+        return -1;
+    }
+    
+    for (unsigned i = 0; i < sizeof(g_common_words) / sizeof(g_common_words[0]); i++) {
+        if (w->value == g_common_words[i]) {
+            return 0;
+        }
+    }
+    
+    /* Stack frame and register save/restore opcodes open most functions */
+    switch (w->value >> 26) {
+    case 14: /* addi */
+    case 18: /* b */
+    case 32: /* lwz */
+    case 36: /* stw */
+    case 37: /* stwu */
+    case 47: /* stmw */
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+int dh_pattern_init(dh_pattern* p, const dh_pword* words, unsigned nwords) {
+    if (nwords == 0 || nwords > DH_PATTERN_MAX_WORDS) {
+        return -1;
+    }
+    
+    p->nwords = (uint8_t)nwords;
+    for (unsigned i = 0; i < nwords; i++) {
+        p->words[i].mask = words[i].mask;
+        p->words[i].value = words[i].value & words[i].mask;
+    }
+    
+    /* Rarest fully specified word, the later one on ties */
+    int best = -1;
+    p->anchor = (uint8_t)(nwords - 1);
+    for (unsigned i = 0; i < nwords; i++) {
+        int r = word_rarity(&p->words[i]);
+        if (r >= best && r >= 0) {
+            best = r;
+            p->anchor = (uint8_t)i;
+        }
+    }
+    
+    /* Shift = distance from the last word to the nearest earlier word that
+     * could equal the text word. Later words overwrite earlier (larger)
+     * shifts; a word that isn't fully specified could equal anything. */
+    for (unsigned h = 0; h < 256; h++) {
+        p->skip[h] = (uint8_t)nwords;
+    }
+    for (unsigned j = 0; j + 1 < nwords; j++) {
+        uint8_t shift = (uint8_t)(nwords - 1 - j);
+        if (p->words[j].mask == FULL_MASK) {
+            p->skip[skip_hash(p->words[j].value)] = shift;
+        } else {
+            for (unsigned h = 0; h < 256; h++) {
+                p->skip[h] = shift;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+int dh_pattern_compile(dh_pattern* p, const char* pat, const char* mask) {
+    size_t len = 0;
+    while (mask[len]) len++;
+    
+    if (len == 0 || len % 4 != 0 || len / 4 > DH_PATTERN_MAX_WORDS) {
+        return -1;
+    }
+    
+    /* Words as they sit in memory, so they compare with loaded words */
+    dh_pword words[DH_PATTERN_MAX_WORDS];
+    for (size_t w = 0; w < len / 4; w++) {
+        union { uint8_t b[4]; uint32_t u; } value, bits;
+        for (size_t i = 0; i < 4; i++) {
+            int fixed = mask[w * 4 + i] == 'x';
+            value.b[i] = fixed ? (uint8_t)pat[w * 4 + i] : 0;
+            bits.b[i] = fixed ? 0xFF : 0x00;
+        }
+        words[w].value = value.u;
+        words[w].mask = bits.u;
+    }
+    
+    return dh_pattern_init(p, words, (unsigned)(len / 4));
+}
+
+static inline int word_matches(uint32_t w, const dh_pword* pw) {
+    return ((w ^ pw->value) & pw->mask) == 0;
+}
+
+static inline int window_matches(const dh_pattern* p, const uint32_t* w) {
+    for (unsigned j = 0; j < p->nwords; j++) {
+        if (!word_matches(w[j], &p->words[j])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void* dh_pattern_find(const dh_pattern* p, const void* start, size_t size) {
+    uintptr_t first = ((uintptr_t)start + 3) & ~(uintptr_t)3;
+    if (size < first - (uintptr_t)start) {
+        return NULL;
+    }
+    
+    const uint32_t* text = (const uint32_t*)first;
+    size_t count = (size - (first - (uintptr_t)start)) / 4;
+    size_t n = p->nwords;
+    if (n == 0 || count < n) {
+        return NULL;
+    }
+    
+    const dh_pword* anchor = &p->words[p->anchor];
+    if (anchor->mask == FULL_MASK) {
+        /* k walks the anchor's place in each window; end is one past the
+         * last window's */
+        uint32_t value = anchor->value;
+        const uint32_t* k = text + p->anchor;
+        const uint32_t* end = k + (count - n) + 1;
+        for (;;) {
+            while (end - k >= 4 && k[0] != value && k[1] != value && k[2] != value && k[3] != value) {
+                k += 4;
+            }
+            if (k == end) {
+                return NULL;
+            }
+            if (*k == value && window_matches(p, k - p->anchor)) {
+                return (void*)(k - p->anchor);
+            }
+            k++;
+        }
+    }
+    
+    const dh_pword* last = &p->words[n - 1];
+    for (size_t s = 0; s <= count - n; ) {
+        uint32_t t = text[s + n - 1];
+        if (word_matches(t, last) && window_matches(p, text + s)) {
+            return (void*)(text + s);
+        }
+        s += p->skip[skip_hash(t)];
+    }
+    
+    return NULL;
+}
+
+/* ============================================================================
+ * Multi-Pattern Scan
+ * ========================================================================= */
+
+#define DISPATCH_BITS 10
+#define DISPATCH_SIZE (1u << DISPATCH_BITS)
+
+/* Bucket h holds g_dispatch_order[g_dispatch_start[h] .. g_dispatch_start[h + 1]) */
+static uint16_t g_dispatch_start[DISPATCH_SIZE + 1];
+static uint16_t g_dispatch_order[DH_FIND_PATTERNS_MAX];
+
+static inline uint32_t dispatch_hash(uint32_t w) {
+    return (w * 0x9E3779B1u) >> (32 - DISPATCH_BITS);
+}
+
+static inline int is_anchored(const dh_pattern* p) {
+    return p->nwords > 0 && p->words[p->anchor].mask == FULL_MASK;
+}
+
+static inline void record_match(dh_match* r, const void* at) {
+    if (r->count == 0) {
+        r->addr = (void*)at;
+    }
+    r->count++;
+}
+
+int dh_find_patterns(const dh_pattern* const* pats, unsigned npats,
+                     const void* start, size_t size, dh_match* results) {
+    if (npats > DH_FIND_PATTERNS_MAX) {
+        return -1;
+    }
+    
+    for (unsigned i = 0; i < npats; i++) {
+        results[i].addr = NULL;
+        results[i].count = 0;
+    }
+    
+    uintptr_t first = ((uintptr_t)start + 3) & ~(uintptr_t)3;
+    const uint32_t* text = (const uint32_t*)first;
+    size_t count = size < first - (uintptr_t)start ? 0 : (size - (first - (uintptr_t)start)) / 4;
+    
+    /* Bucket the anchored patterns by their anchor word (counting sort,
+     * filled backwards so each bucket keeps pattern order) */
+    unsigned anchored = 0;
+    for (unsigned h = 0; h < DISPATCH_SIZE; h++) {
+        g_dispatch_start[h] = 0;
+    }
+    for (unsigned i = 0; i < npats; i++) {
+        if (is_anchored(pats[i])) {
+            g_dispatch_start[dispatch_hash(pats[i]->words[pats[i]->anchor].value)]++;
+            anchored++;
+        }
+    }
+    for (unsigned h = 1; h < DISPATCH_SIZE; h++) {
+        g_dispatch_start[h] += g_dispatch_start[h - 1];
+    }
+    g_dispatch_start[DISPATCH_SIZE] = (uint16_t)anchored;
+    for (unsigned i = npats; i-- > 0; ) {
+        if (is_anchored(pats[i])) {
+            uint32_t h = dispatch_hash(pats[i]->words[pats[i]->anchor].value);
+            g_dispatch_order[--g_dispatch_start[h]] = (uint16_t)i;
+        }
+    }
+    
+    /* One pass: a pattern anchored at word a matches at t - a */
+    for (size_t t = 0; anchored && t < count; t++) {
+        uint32_t w = text[t];
+        uint32_t h = dispatch_hash(w);
+        
+        for (unsigned k = g_dispatch_start[h]; k < g_dispatch_start[h + 1]; k++) {
+            unsigned i = g_dispatch_order[k];
+            const dh_pattern* p = pats[i];
+            if (w != p->words[p->anchor].value || t < p->anchor) {
+                continue;
+            }
+            
+            size_t s = t - p->anchor;
+            if (count - s < p->nwords) {
+                continue;
+            }
+            
+            size_t j = 0;
+            while (j < p->nwords && word_matches(text[s + j], &p->words[j])) j++;
+            if (j == p->nwords) {
+                record_match(&results[i], text + s);
+            }
+        }
+    }
+    
+    /* Patterns without a fully specified word get a scan of their own */
+    for (unsigned i = 0; i < npats; i++) {
+        if (pats[i]->nwords == 0 || is_anchored(pats[i])) {
+            continue;
+        }
+        
+        const uint32_t* from = text;
+        const uint32_t* m;
+        while ((m = (const uint32_t*)dh_pattern_find(pats[i], from, (size_t)(text + count - from) * 4)) != NULL) {
+            record_match(&results[i], m);
+            from = m + 1;
+        }
+    }
+    
+    int unique = 0;
+    for (unsigned i = 0; i < npats; i++) {
+        if (results[i].count == 1) {
+            unique++;
+        }
+    }
+    
+    return unique;
+}
+
+#endif /* DOLHOOK_NO_PATTERN */
@@ -0,0 +1,249 @@
+/**
+ * DolHook Hook Registry
+ * Every hooked target, with the hooks chained on it
+ *
+ * Each hooked target has one entry in a table sorted by address. The
+ * target branches to a stub that jumps to the first replacement; each
+ * hook's trampoline field points at the next replacement, and the last
+ * one at the target's one real trampoline. Calling on from a replacement
+ * is a single jump however many hooks share the target, and adding or
+ * removing a hook rewrites only the stub or one pointer.
+ */
+
+#include "dolhook.h"
+#include <string.h>
+
+/* Tests map target addresses into host memory */
+#ifndef HOOK_ADDR
+#define HOOK_ADDR(p) ((uint32_t)(uintptr_t)(p))
+#endif
+
+#define STUB_SIZE 16  /* Room for the absolute jump */
+
+typedef struct hook_site {
+    uint32_t  target;
+    dh_hook*  head;       /* Highest priority first; NULL once removed in a batch */
+    uint32_t* stub;       /* Jumps to head->replacement */
+    void*     original;   /* Relocated prologue + jump back */
+    uint32_t  patch_len;
+    uint8_t   saved[16];
+} hook_site;
+
+static hook_site g_sites[DH_HOOK_MAX_SITES];
+static unsigned g_site_count = 0;
+
+/* Index of the first entry at or after target */
+static unsigned lower_bound(uint32_t target) {
+    unsigned lo = 0;
+    unsigned hi = g_site_count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (g_sites[mid].target < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static hook_site* find_site(uint32_t target) {
+    unsigned i = lower_bound(target);
+    return i < g_site_count && g_sites[i].target == target ? &g_sites[i] : NULL;
+}
+
+/* Drop the entries of targets emptied in a batch, whose restore has been
+ * applied by now */
+static void prune(void) {
+    unsigned n = 0;
+    for (unsigned i = 0; i < g_site_count; i++) {
+        if (g_sites[i].head) {
+            g_sites[n++] = g_sites[i];
+        }
+    }
+    g_site_count = n;
+}
+
+/* Jump from the stub to the first hook (queued in a batch) */
+static void aim_stub(hook_site* s) {
+    uint32_t insn = dh_make_branch_imm(HOOK_ADDR(s->stub), HOOK_ADDR(s->head->replacement), 0);
+    if (insn) {
+        dh_write32(s->stub, insn);
+    } else {
+        dh_write_branch_abs(s->stub, s->head->replacement, 0);
+    }
+}
+
+/* Steal the target's prologue for a new entry at index i */
+static int open_site(unsigned i, dh_hook* h) {
+    uint32_t from = HOOK_ADDR(h->target);
+    
+    /* The stub is near the target when possible, so the patch is one b */
+    uint32_t* stub = (uint32_t*)dh_code_alloc(STUB_SIZE, h->target);
+    uint32_t patch_len = 4;
+    if (!stub) {
+        stub = (uint32_t*)dh_code_alloc(STUB_SIZE, NULL);
+        patch_len = 16;
+        if (!stub) {
+            return -1;
+        }
+    }
+    
+    /* Refuse code that is branched into mid-patch or can't be moved */
+    if (dh_check_stolen((const uint32_t*)h->target, from, patch_len) != 0 ||
+        dh_relocate(NULL, from, 0, (const uint32_t*)h->target, from, patch_len / 4) < 0) {
+        dh_code_free(stub);
+        return -2;
+    }
+    
+    void* original = dh_make_trampoline(h->target, patch_len);
+    if (!original) {
+        dh_code_free(stub);
+        return -1;
+    }
+    
+    for (unsigned j = g_site_count; j > i; j--) {
+        g_sites[j] = g_sites[j - 1];
+    }
+    g_site_count++;
+    
+    hook_site* s = &g_sites[i];
+    s->target = from;
+    s->head = h;
+    s->stub = stub;
+    s->original = original;
+    s->patch_len = patch_len;
+    memcpy(s->saved, h->target, 16);
+    
+    /* Stub first, then the branch into it (each write is atomic, or
+     * queued in a batch) */
+    h->next = NULL;
+    h->trampoline = original;
+    aim_stub(s);
+    if (patch_len == 4) {
+        dh_write32(h->target, dh_make_branch_imm(from, HOOK_ADDR(stub), 0));
+    } else {
+        dh_write_branch_abs(h->target, stub, 0);
+    }
+    return 0;
+}
+
+int dh_hook_install(dh_hook* h) {
+    if (!h || !h->target || !h->replacement) {
+        return -1;
+    }
+    
+    uint32_t from = HOOK_ADDR(h->target);
+    hook_site* s = find_site(from);
+    if (s && !s->head) {
+        /* Emptied earlier in this batch; its restore is still queued */
+        if (dh_batch_active()) {
+            return -1;
+        }
+        prune();
+        s = NULL;
+    }
+    
+    if (!s) {
+        if (g_site_count == DH_HOOK_MAX_SITES && !dh_batch_active()) {
+            prune();
+        }
+        if (g_site_count == DH_HOOK_MAX_SITES) {
+            return -1;
+        }
+        int rc = open_site(lower_bound(from), h);
+        if (rc != 0) {
+            return rc;
+        }
+        s = find_site(from);
+    } else {
+        /* Already chained here; behind every hook of equal or higher
+         * priority, so equal priorities run in install order */
+        for (dh_hook* p = s->head; p; p = p->next) {
+            if (p == h) {
+                return -1;
+            }
+        }
+        dh_hook* prev = NULL;
+        dh_hook* next = s->head;
+        while (next && next->priority >= h->priority) {
+            prev = next;
+            next = next->next;
+        }
+        
+        h->next = next;
+        h->trampoline = next ? next->replacement : s->original;
+        if (prev) {
+            /* The previous hook now calls on into this one */
+            prev->next = h;
+            prev->trampoline = h->replacement;
+        } else {
+            s->head = h;
+            aim_stub(s);
+        }
+    }
+    
+    memcpy(h->saved, s->saved, 16);
+    h->patch_len = s->patch_len;
+    return 0;
+}
+
+int dh_hook_remove(dh_hook* h) {
+    if (!h || !h->target) {
+        return -1;
+    }
+    
+    hook_site* s = find_site(HOOK_ADDR(h->target));
+    if (!s) {
+        return -1;
+    }
+    dh_hook* prev = NULL;
+    dh_hook* p = s->head;
+    while (p && p != h) {
+        prev = p;
+        p = p->next;
+    }
+    if (!p) {
+        return -1;
+    }
+    
+    /* The others are rewired around it; in a batch, h itself still calls
+     * on correctly until the stub write is applied */
+    if (prev) {
+        prev->trampoline = h->next ? h->next->replacement : s->original;
+        prev->next = h->next;
+    } else if (h->next) {
+        s->head = h->next;
+        aim_stub(s);
+    } else {
+        /* Last hook: restore the original bytes; in a batch, the stub and
+         * trampoline stay until the restore is applied */
+        s->head = NULL;
+        if (dh_batch_active()) {
+            uint32_t words[4];
+            memcpy(words, s->saved, s->patch_len);
+            dh_batch_stage_words(h->target, words, s->patch_len / 4);
+            dh_batch_free_code(s->stub);
+            dh_batch_free_code(s->original);
+        } else {
+            uint32_t msr = dh_suspend_interrupts();
+            memcpy(h->target, s->saved, s->patch_len);
+            dh_icache_sync_range(h->target, s->patch_len);
+            dh_restore_interrupts(msr);
+            dh_code_free(s->stub);
+            dh_code_free(s->original);
+            prune();
+        }
+    }
+    
+    h->next = NULL;
+    if (!dh_batch_active()) {
+        h->trampoline = NULL;
+    }
+    return 0;
+}
+
+dh_hook* dh_hook_chain(void* target) {
+    hook_site* s = find_site(HOOK_ADDR(target));
+    return s ? s->head : NULL;
+}
@@ -0,0 +1,195 @@
+/**
+ * DolHook Instruction Relocation
+ * Move stolen prologue instructions into a trampoline
+ *
+ * Only relative branches care where they run. Each one is re-aimed from
+ * its new address; when it can't reach any more it grows:
+ *
+ *   b/bl target      ->  lis r12,hi; ori r12,r12,lo; mtctr r12; bctr/bctrl
+ *
+ *   bc BO,BI,target  ->  bc BO,BI,island   (bcl: LR = the b below)
+ *                        b next
+ *               island:  b target          (or the absolute sequence)
+ *                 next:
+ *
+ * Branches between stolen instructions go to the moved copies.
+ */
+
+#include "dolhook.h"
+
+#define OP_BC 16
+#define OP_B  18
+
+#define REACH_B  0x2000000  /* ±32MB */
+#define REACH_BC 0x8000     /* ±32KB */
+
+static inline uint32_t opcode(uint32_t insn) {
+    return insn >> 26;
+}
+
+static inline int is_relative_branch(uint32_t insn) {
+    return (opcode(insn) == OP_B || opcode(insn) == OP_BC) && !(insn & 2);
+}
+
+static inline int32_t branch_offset(uint32_t insn) {
+    if (opcode(insn) == OP_B) {
+        return (int32_t)(insn << 6) >> 6 & ~3;
+    }
+    return (int16_t)(insn & 0xFFFC);
+}
+
+static inline int fits(int32_t offset, int32_t reach) {
+    return offset >= -reach && offset < reach;
+}
+
+static inline uint32_t encode_b(uint32_t from, uint32_t to, uint32_t lk) {
+    return (OP_B << 26) | ((to - from) & 0x03FFFFFC) | lk;
+}
+
+static inline uint32_t encode_bc(uint32_t insn, uint32_t from, uint32_t to) {
+    return (insn & 0xFFFF0003) | ((to - from) & 0xFFFC);
+}
+
+static void encode_abs(uint32_t* out, uint32_t to, uint32_t lk) {
+    out[0] = 0x3D800000 | (to >> 16);    /* lis r12, hi16(to) */
+    out[1] = 0x618C0000 | (to & 0xFFFF); /* ori r12, r12, lo16(to) */
+    out[2] = 0x7D8903A6;                 /* mtctr r12 */
+    out[3] = 0x4E800420 | lk;            /* bctr / bctrl */
+}
+
+/* Words instruction i becomes at out_pc, or -2 if it can't be moved */
+static int relocated_size(uint32_t insn, uint32_t src_pc, uint32_t out_pc,
+                          uint32_t in_addr, uint32_t count) {
+    if (!is_relative_branch(insn)) {
+        return 1;
+    }
+    
+    uint32_t dest = src_pc + (uint32_t)branch_offset(insn);
+    
+    /* bl/bcl to the next instruction reads the PC; moved, it reads ours */
+    if ((insn & 1) && dest == src_pc + 4) {
+        return -2;
+    }
+    
+    /* Internal: the moved copies are close together */
+    if (dest - in_addr < count * 4) {
+        return 1;
+    }
+    
+    if (opcode(insn) == OP_B) {
+        return fits((int32_t)(dest - out_pc), REACH_B) ? 1 : 4;
+    }
+    
+    if (fits((int32_t)(dest - out_pc), REACH_BC)) {
+        return 1;
+    }
+    if (fits((int32_t)(dest - (out_pc + 8)), REACH_B)) {
+        return 3;
+    }
+    
+    /* The absolute island overwrites CTR, which this bc just counted */
+    uint32_t bo = (insn >> 21) & 31;
+    if (!(bo & 4)) {
+        return -2;
+    }
+    return 6;
+}
+
+int dh_relocate(uint32_t* out, uint32_t out_addr, uint32_t out_words,
+                const uint32_t* in, uint32_t in_addr, uint32_t count) {
+    uint32_t offs[DH_RELOC_MAX_INSNS + 1];
+    if (count > DH_RELOC_MAX_INSNS) {
+        return -2;
+    }
+    
+    /* Lay out first, so internal branches know where their targets went */
+    offs[0] = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int n = relocated_size(in[i], in_addr + i * 4, out_addr + offs[i] * 4, in_addr, count);
+        if (n < 0) {
+            return n;
+        }
+        offs[i + 1] = offs[i] + (uint32_t)n;
+    }
+    
+    if (!out) {
+        return (int)offs[count];
+    }
+    if (offs[count] > out_words) {
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t insn = in[i];
+        uint32_t src_pc = in_addr + i * 4;
+        uint32_t pc = out_addr + offs[i] * 4;
+        uint32_t* o = out + offs[i];
+        uint32_t n = offs[i + 1] - offs[i];
+        
+        if (!is_relative_branch(insn)) {
+            o[0] = insn;
+            continue;
+        }
+        
+        uint32_t dest = src_pc + (uint32_t)branch_offset(insn);
+        if (dest - in_addr < count * 4) {
+            dest = out_addr + offs[(dest - in_addr) / 4] * 4;
+        }
+        
+        if (opcode(insn) == OP_B) {
+            if (n == 1) {
+                o[0] = encode_b(pc, dest, insn & 1);
+            } else {
+                encode_abs(o, dest, insn & 1);
+            }
+        } else if (n == 1) {
+            o[0] = encode_bc(insn, pc, dest);
+        } else {
+            /* Island two words down; the fall-through skips over it */
+            o[0] = encode_bc(insn, pc, pc + 8);
+            o[1] = encode_b(pc + 4, pc + n * 4, 0);
+            if (n == 3) {
+                o[2] = encode_b(pc + 8, dest, 0);
+            } else {
+                encode_abs(o + 2, dest, 0);
+            }
+        }
+    }
+    
+    return (int)offs[count];
+}
+
+int dh_check_stolen(const uint32_t* code, uint32_t addr, uint32_t stolen_len) {
+    uint32_t count = stolen_len / 4;
+    if (count == 0) {
+        return 0;
+    }
+    
+    /* Leaving before the last stolen word means the rest belongs to
+     * whatever follows, which is entered from elsewhere */
+    for (uint32_t i = 0; i + 1 < count; i++) {
+        uint32_t insn = code[i];
+        int leaves = (opcode(insn) == OP_B && !(insn & 1)) ||
+                     insn == 0x4E800020 || insn == 0x4E800420; /* blr, bctr */
+        if (leaves) {
+            return -2;
+        }
+    }
+    
+    /* Nothing in the rest of the function may land between the stolen
+     * words; it stops at the next stack frame setup (stwu r1,-N(r1)) */
+    for (uint32_t i = count; i < count + DH_RELOC_SCAN_WORDS; i++) {
+        uint32_t insn = code[i];
+        if ((insn & 0xFFFF8000) == 0x94218000) {
+            break;
+        }
+        if (is_relative_branch(insn)) {
+            uint32_t dest = addr + i * 4 + (uint32_t)branch_offset(insn);
+            if (dest - addr - 1 < stolen_len - 1) {
+                return -2;
+            }
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,197 @@
+/**
+ * Unit tests for batch patching (built for the host, with the cache and
+ * interrupt primitives recorded instead of executed)
+ */
+
+#include "../runtime/src/batch.c"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+static int g_irq_off = 0;
+static int g_windows = 0;
+static uint32_t g_clock = 0;
+static std::vector<std::pair<uintptr_t, unsigned>> g_flushed;
+static std::vector<std::pair<uintptr_t, unsigned>> g_invalidated;
+static int g_flashes = 0;
+static std::vector<void*> g_freed;
+
+extern "C" {
+uint32_t dh_suspend_interrupts(void) {
+    assert(!g_irq_off);
+    g_irq_off = 1;
+    g_windows++;
+    return 0x8000;
+}
+void dh_restore_interrupts(uint32_t msr) {
+    assert(g_irq_off && msr == 0x8000);
+    g_irq_off = 0;
+}
+void dh_dcache_flush_range(void* addr, unsigned len) {
+    assert(g_irq_off);
+    g_flushed.push_back({reinterpret_cast<uintptr_t>(addr), len});
+}
+void dh_icache_invalidate_range(void* addr, unsigned len) {
+    assert(g_irq_off);
+    g_invalidated.push_back({reinterpret_cast<uintptr_t>(addr), len});
+}
+void dh_icache_invalidate_all(void) {
+    g_flashes++;
+}
+void dh_cache_barrier(void) {}
+uint32_t dh_time_base(void) {
+    return g_clock += 81;
+}
+int dh_code_free(void* p) {
+    g_freed.push_back(p);
+    return 0;
+}
+}
+
+static void reset() {
+    g_windows = 0;
+    g_flashes = 0;
+    g_flushed.clear();
+    g_invalidated.clear();
+    g_freed.clear();
+}
+
+alignas(32) static uint32_t g_code[0x4000];
+
+void test_batch_merge() {
+    std::cout << "Testing batched writes... ";
+    reset();
+
+    dh_batch_begin();
+    assert(dh_batch_active());
+
+    // Lines 0-2 in pieces and out of order, line 8, and a trampoline
+    // spanning lines 2-3: three writes' worth of ranges, merged into two
+    dh_batch_stage(&g_code[17], 0x48000001, 4);
+    dh_batch_stage(&g_code[64], 0x60000000, 4);
+    dh_batch_stage(&g_code[0], 0x4BFFFFFC, 4);
+    dh_batch_stage(&g_code[8], 0x7C08, 2);
+    dh_batch_stage(reinterpret_cast<uint8_t*>(&g_code[9]) + 1, 0xAB, 1);
+    dh_batch_touch(&g_code[20], 40);
+    dh_batch_free_code(&g_code[100]);
+
+    // Nothing is written or synced before commit
+    assert(g_code[0] == 0 && g_code[17] == 0 && g_windows == 0 && g_freed.empty());
+
+    dh_batch_stats stats;
+    dh_batch_commit(&stats);
+    assert(!dh_batch_active());
+    assert(g_code[0] == 0x4BFFFFFC && g_code[17] == 0x48000001 && g_code[64] == 0x60000000);
+    uint16_t half;
+    std::memcpy(&half, &g_code[8], 2);
+    assert(half == 0x7C08);
+    assert(reinterpret_cast<uint8_t*>(&g_code[9])[1] == 0xAB);
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(g_code);
+    assert(g_windows == 1 && !g_irq_off);
+    assert(g_flushed.size() == 2);
+    assert(g_flushed[0] == std::make_pair(base, 128u));
+    assert(g_flushed[1] == std::make_pair(base + 256, 32u));
+    assert(g_invalidated == g_flushed && g_flashes == 0);
+    assert(g_freed.size() == 1 && g_freed[0] == &g_code[100]);
+
+    assert(stats.writes == 5 && stats.ranges == 2 && stats.lines == 5 && stats.windows == 1);
+    assert(stats.icache_flashes == 0 && stats.irq_off_ticks == 81 && stats.irq_off_us == 2);
+
+    // An empty batch opens no window
+    dh_batch_begin();
+    dh_batch_commit(&stats);
+    assert(g_windows == 1 && stats.windows == 0 && stats.writes == 0);
+
+    std::cout << "PASS\n";
+}
+
+void test_batch_large() {
+    std::cout << "Testing batches larger than the cache and the queue... ";
+    reset();
+
+    // 200 hooks 160 bytes apart, each with a 16-byte trampoline: the
+    // trampolines merge into one range, the targets stay a line each
+    dh_batch_begin();
+    for (int i = 0; i < 200; i++) {
+        dh_batch_touch(&g_code[0x3000 + i * 4], 16);
+        dh_batch_stage(&g_code[i * 40], 0x48000000 | i, 4);
+    }
+    dh_batch_stats stats;
+    dh_batch_commit(&stats);
+    assert(stats.windows == 1 && stats.writes == 200 && stats.ranges == 201 && stats.lines == 300);
+    assert(g_flashes == 0 && g_invalidated.size() == 201);
+    for (int i = 0; i < 200; i++) assert(g_code[i * 40] == (0x48000000u | i));
+
+    // More touched lines than the I-cache holds: one flash invalidate
+    reset();
+    dh_batch_begin();
+    dh_batch_touch(g_code, sizeof(g_code));
+    dh_batch_commit(&stats);
+    assert(stats.lines == sizeof(g_code) / 32 && stats.icache_flashes == 1);
+    assert(g_flashes == 1 && g_invalidated.empty() && g_flushed.size() == 1);
+
+    // A full queue is applied early, in order, and the batch carries on
+    reset();
+    dh_batch_begin();
+    for (int i = 0; i < BATCH_MAX_WRITES + 10; i++) dh_batch_stage(&g_code[5], i, 4);
+    assert(g_windows == 1 && g_code[5] == BATCH_MAX_WRITES - 1);
+    dh_batch_commit(&stats);
+    assert(stats.windows == 2 && stats.writes == BATCH_MAX_WRITES + 10);
+    assert(g_code[5] == BATCH_MAX_WRITES + 9);
+
+    std::cout << "PASS\n";
+}
+
+void test_batch_whole_patches() {
+    std::cout << "Testing early windows between whole patches... ";
+    reset();
+    std::memset(g_code, 0, sizeof(g_code));
+
+    // A full range table: the next write waits for the next window, where
+    // its line is synced with it
+    dh_batch_begin();
+    for (int i = 0; i < BATCH_MAX_RANGES - 1; i++) dh_batch_touch(&g_code[i * 16], 4);
+    dh_batch_stage(&g_code[(BATCH_MAX_RANGES - 1) * 16], 1, 4);
+    assert(g_windows == 0);
+    uint32_t* late = &g_code[BATCH_MAX_RANGES * 16];
+    dh_batch_stage(late, 2, 4);
+    assert(g_windows == 1 && g_code[(BATCH_MAX_RANGES - 1) * 16] == 1 && *late == 0);
+    size_t first = g_flushed.size();
+    dh_batch_stats stats;
+    dh_batch_commit(&stats);
+    assert(stats.windows == 2 && *late == 2);
+    assert(g_flushed.size() == first + 1 && g_flushed.back().first == reinterpret_cast<uintptr_t>(late));
+
+    // A multi-word patch that doesn't fit is applied whole in the next window
+    reset();
+    dh_batch_begin();
+    for (int i = 0; i < BATCH_MAX_WRITES - 2; i++) dh_batch_stage(&g_code[5], i, 4);
+    const uint32_t branch[4] = {0x3D808000, 0x618C1234, 0x7D8903A6, 0x4E800420};
+    dh_batch_stage_words(&g_code[0x100], branch, 4);
+    assert(g_windows == 1 && g_code[5] == BATCH_MAX_WRITES - 3);
+    assert(g_code[0x100] == 0 && g_code[0x103] == 0);
+    dh_batch_commit(&stats);
+    assert(stats.windows == 2 && stats.writes == BATCH_MAX_WRITES + 2);
+    assert(std::memcmp(&g_code[0x100], branch, sizeof(branch)) == 0);
+
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Batch Patching Tests ===\n\n";
+
+    try {
+        test_batch_merge();
+        test_batch_large();
+        test_batch_whole_patches();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
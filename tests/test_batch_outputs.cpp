@@ -0,0 +1,91 @@
+/**
+ * Unit tests for batch output naming
+ */
+
+#include "../tools/patchiso/batch.h"
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using namespace dolhook;
+
+namespace fs = std::filesystem;
+
+static void touch(const fs::path& path) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << "not an image";
+}
+
+static bool collided(const BatchEntry& e) {
+    return !e.result.ok && e.result.error.rfind("writes ", 0) == 0;
+}
+
+void test_batch_mirrored_outputs() {
+    std::cout << "Testing batch outputs mirror the input tree... ";
+    fs::remove_all("test_batch_out");
+    touch("test_batch_out/src/a/game.iso");
+    touch("test_batch_out/src/b/game.iso");
+
+    auto inputs = collect_batch_inputs("test_batch_out/src");
+    assert(inputs.size() == 2);
+
+    // Same file name, different directories: both patched (and fail as
+    // non-images), each with its own output directory
+    BatchOptions opts;
+    opts.out_dir = "test_batch_out/out";
+    opts.jobs = 2;
+    opts.patch.log_level = 0;
+    Payload payload;
+    auto entries = run_batch(inputs, opts, payload);
+    assert(entries.size() == 2);
+    assert(!entries[0].result.ok && !collided(entries[0]));
+    assert(!entries[1].result.ok && !collided(entries[1]));
+    assert(fs::is_directory("test_batch_out/out/a") && fs::is_directory("test_batch_out/out/b"));
+
+    fs::remove_all("test_batch_out");
+    std::cout << "PASS\n";
+}
+
+void test_batch_colliding_outputs() {
+    std::cout << "Testing batch outputs that would collide... ";
+    fs::remove_all("test_batch_out");
+    touch("test_batch_out/src/game.iso");
+    touch("test_batch_out/src/game.gcz");
+    touch("test_batch_out/src/other.iso");
+
+    // game.iso and game.gcz both make game.bps
+    BatchOptions opts;
+    opts.bps_dir = "test_batch_out/bps";
+    opts.patch.log_level = 0;
+    opts.patch.dry_run = true;
+    Payload payload;
+    auto entries = run_batch(collect_batch_inputs("test_batch_out/src"), opts, payload);
+    assert(entries.size() == 3);
+    assert(collided(entries[0]) && collided(entries[1]) && !collided(entries[2]));
+    assert(entries[0].result.error.find("game.bps") != std::string::npos);
+
+    // The same image listed twice, patched in place
+    std::vector<std::string> twice = {"test_batch_out/src/other.iso", "test_batch_out/src/./other.iso"};
+    opts.bps_dir.clear();
+    entries = run_batch(twice, opts, payload);
+    assert(collided(entries[0]) && collided(entries[1]));
+
+    fs::remove_all("test_batch_out");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Batch Output Tests ===\n\n";
+
+    try {
+        test_batch_mirrored_outputs();
+        test_batch_colliding_outputs();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
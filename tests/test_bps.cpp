@@ -0,0 +1,222 @@
+/**
+ * Unit tests for BPS patch output and application
+ */
+
+#include "../tools/patchiso/bps.h"
+#include "../tools/patchiso/gcm.h"
+#include "../tools/patchiso/hash.h"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x20000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x8000);
+    for (size_t i = 0x2440; i < img.size(); i++) img[i] = static_cast<uint8_t>(i * 13 + (i >> 9));
+    return img;
+}
+
+static std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+static void write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+void test_bps_roundtrip() {
+    std::cout << "Testing BPS write/apply... ";
+
+    auto img = make_image();
+    write_file("test_bps_src.iso", img);
+
+    GCMFile iso;
+    assert(iso.load("test_bps_src.iso"));
+
+    // Header byte, two nearby edits, and growth with a zero gap before it
+    std::memcpy(iso.header().game_code, "GXYZ01", 6);
+    assert(iso.write(0x3000, std::vector<uint8_t>(0x40, 0xEE)));
+    assert(iso.write(0x3100, std::vector<uint8_t>(0x10, 0x11)));
+    assert(iso.write(0x28000, std::vector<uint8_t>(0x300, 0x5A)));
+
+    BpsInfo info;
+    std::string error;
+    assert(write_bps(iso, "test_bps.bps", info, error));
+    assert(info.source_size == 0x20000 && info.target_size == 0x28300);
+    assert(info.patch_size < 0x600);
+    assert(info.source_crc == crc32(0, img.data(), img.size()));
+
+    assert(iso.save("test_bps_expect.iso"));
+    auto expect = read_file("test_bps_expect.iso");
+    assert(info.target_crc == crc32(0, expect.data(), expect.size()));
+
+    BpsInfo applied;
+    assert(apply_bps("test_bps.bps", "test_bps_src.iso", "test_bps_out.iso", applied, error));
+    assert(read_file("test_bps_out.iso") == expect);
+    assert(applied.target_crc == info.target_crc);
+
+    std::remove("test_bps_expect.iso");
+    std::remove("test_bps_out.iso");
+    std::cout << "PASS\n";
+}
+
+void test_bps_rejects() {
+    std::cout << "Testing BPS rejection... ";
+
+    std::string error;
+    BpsInfo info;
+
+    // Wrong source image
+    auto other = make_image();
+    other[0x5000] ^= 1;
+    write_file("test_bps_other.iso", other);
+    assert(!apply_bps("test_bps.bps", "test_bps_other.iso", "test_bps_out.iso", info, error));
+    assert(!error.empty());
+
+    // Damaged patch
+    auto patch = read_file("test_bps.bps");
+    patch[patch.size() / 2] ^= 0x40;
+    write_file("test_bps_bad.bps", patch);
+    assert(!apply_bps("test_bps_bad.bps", "test_bps_src.iso", "test_bps_out.iso", info, error));
+
+    // Never overwrite the source
+    assert(!apply_bps("test_bps.bps", "test_bps_src.iso", "test_bps_src.iso", info, error));
+    assert(read_file("test_bps_src.iso") == make_image());
+
+    std::ifstream out("test_bps_out.iso");
+    assert(!out.good());
+
+    for (const char* f : {"test_bps.bps", "test_bps_bad.bps", "test_bps_src.iso", "test_bps_other.iso"}) {
+        std::remove(f);
+    }
+    std::cout << "PASS\n";
+}
+
+static void put_vlq(std::vector<uint8_t>& out, uint64_t v) {
+    for (;;) {
+        uint8_t x = v & 0x7F;
+        v >>= 7;
+        if (v == 0) {
+            out.push_back(0x80 | x);
+            return;
+        }
+        out.push_back(x);
+        v--;
+    }
+}
+
+static void put_le32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((v >> (i * 8)) & 0xFF);
+}
+
+// A patch from source to target with the given actions
+static std::vector<uint8_t> make_patch(const std::vector<uint8_t>& source, const std::vector<uint8_t>& target,
+                                       const std::vector<uint8_t>& actions) {
+    std::vector<uint8_t> patch = {'B', 'P', 'S', '1'};
+    put_vlq(patch, source.size());
+    put_vlq(patch, target.size());
+    put_vlq(patch, 0);
+    patch.insert(patch.end(), actions.begin(), actions.end());
+    put_le32(patch, crc32(0, source.data(), source.size()));
+    put_le32(patch, crc32(0, target.data(), target.size()));
+    put_le32(patch, crc32(0, patch.data(), patch.size()));
+    return patch;
+}
+
+void test_bps_copy_after_zeros() {
+    std::cout << "Testing BPS TargetCopy after zero blocks... ";
+
+    // The source's trailing zero blocks become a hole, then are copied from
+    // far enough back to be read from the file
+    std::vector<uint8_t> source(0xC00000, 0);
+    source[0] = 1;
+    auto target = source;
+    target.resize(source.size() + 100, 0);
+
+    std::vector<uint8_t> actions;
+    put_vlq(actions, (source.size() - 1) << 2 | 0);  // SourceRead
+    put_vlq(actions, (100 - 1) << 2 | 3);     // TargetCopy
+    put_vlq(actions, 0x1FFF << 1);
+    write_file("test_bps_src.iso", source);
+    write_file("test_bps.bps", make_patch(source, target, actions));
+
+    BpsInfo info;
+    std::string error;
+    assert(apply_bps("test_bps.bps", "test_bps_src.iso", "test_bps_out.iso", info, error));
+    assert(read_file("test_bps_out.iso") == target);
+
+    for (const char* f : {"test_bps.bps", "test_bps_src.iso", "test_bps_out.iso"}) {
+        std::remove(f);
+    }
+    std::cout << "PASS\n";
+}
+
+void test_bps_long_runs() {
+    std::cout << "Testing BPS overlapping TargetCopy runs... ";
+
+    // Short periods repeated across several flushes, as write_bps emits for
+    // zero gaps and RLE patches use for fills
+    std::vector<uint8_t> source(0x3000);
+    for (size_t i = 0; i < source.size(); i++) source[i] = static_cast<uint8_t>(i * 7);
+    auto target = source;
+    std::vector<uint8_t> actions;
+    put_vlq(actions, (source.size() - 1) << 2 | 0);  // SourceRead
+
+    const uint8_t seed[3] = {'a', 'b', 'c'};
+    put_vlq(actions, (sizeof(seed) - 1) << 2 | 1);   // TargetRead
+    actions.insert(actions.end(), seed, seed + sizeof(seed));
+    const size_t run = 0xA00001;
+    put_vlq(actions, (run - 1) << 2 | 3);            // TargetCopy, period 3
+    put_vlq(actions, source.size() << 1);
+    for (size_t i = 0; i < sizeof(seed) + run; i++) target.push_back(seed[i % 3]);
+
+    // A period longer than the window, then a copy of the source again
+    put_vlq(actions, (0x500000 - 1) << 2 | 3);
+    put_vlq(actions, (source.size() + run) << 1 | 1);
+    target.insert(target.end(), target.begin(), target.begin() + 0x500000);
+    write_file("test_bps_src.iso", source);
+    write_file("test_bps.bps", make_patch(source, target, actions));
+
+    BpsInfo info;
+    std::string error;
+    assert(apply_bps("test_bps.bps", "test_bps_src.iso", "test_bps_out.iso", info, error));
+    assert(read_file("test_bps_out.iso") == target);
+
+    for (const char* f : {"test_bps.bps", "test_bps_src.iso", "test_bps_out.iso"}) {
+        std::remove(f);
+    }
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== BPS Tests ===\n\n";
+
+    try {
+        test_bps_roundtrip();
+        test_bps_rejects();
+        test_bps_copy_after_zeros();
+        test_bps_long_runs();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * Unit tests for the runtime code allocator (built for the host)
+ */
+
+#include "../runtime/src/codealloc.c"
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <vector>
+
+void test_code_reuse() {
+    std::cout << "Testing block reuse... ";
+
+    // Toggling hundreds of hooks keeps handing out the same blocks
+    std::vector<void*> first;
+    for (int round = 0; round < 1000; round++) {
+        std::vector<void*> blocks;
+        for (int i = 0; i < 300; i++) {
+            void* p = dh_code_alloc(i % 3 == 0 ? 20 : 8, nullptr);
+            assert(p != nullptr);
+            assert(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+            blocks.push_back(p);
+        }
+        if (round == 0) first = blocks;
+        assert(std::set<void*>(blocks.begin(), blocks.end()) == std::set<void*>(first.begin(), first.end()));
+        assert(dh_code_in_use() == 100 * 32 + 200 * 16);
+
+        for (void* p : blocks) assert(dh_code_free(p) == 0);
+        assert(dh_code_in_use() == 0);
+    }
+    assert(g_arena_count == 1 && g_arenas[0].top == 100 * 2 + 200);
+
+    // Not a live block
+    void* p = dh_code_alloc(16, nullptr);
+    assert(dh_code_free(static_cast<uint8_t*>(p) + 4) == -1);
+    assert(dh_code_free(p) == 0);
+    assert(dh_code_free(p) == -1);
+    int local;
+    assert(dh_code_free(&local) == -1);
+    assert(dh_code_free(nullptr) == 0);
+
+    assert(dh_code_alloc(0, nullptr) == nullptr);
+    assert(dh_code_alloc(DH_CODE_MAX_ALLOC + 1, nullptr) == nullptr);
+
+    std::cout << "PASS\n";
+}
+
+void test_code_growth() {
+    std::cout << "Testing arena growth... ";
+
+    // Fill the built-in arena, then grow into an added one
+    std::vector<void*> blocks;
+    while (void* p = dh_code_alloc(DH_CODE_MAX_ALLOC, nullptr)) blocks.push_back(p);
+    assert(dh_code_alloc(DH_CODE_MAX_ALLOC, nullptr) == nullptr);
+
+    static uint8_t extra[4096 + 3];
+    assert(dh_code_add_arena(extra + 3, 4096) == 0);
+    void* p = dh_code_alloc(DH_CODE_MAX_ALLOC, nullptr);
+    assert(p >= static_cast<void*>(extra) && p < static_cast<void*>(extra + sizeof(extra)));
+    assert(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+    assert(dh_code_free(p) == 0);
+
+    // Once both are full, a small request takes a larger free block
+    while (dh_code_alloc(16, nullptr)) {}
+    void* big = blocks.back();
+    uint32_t used = dh_code_in_use();
+    assert(dh_code_free(big) == 0);
+    assert(dh_code_alloc(16, nullptr) == big);
+    assert(dh_code_in_use() == used);
+
+    assert(dh_code_add_arena(extra, 8) == -1);
+    std::cout << "PASS\n";
+}
+
+void test_code_near() {
+    std::cout << "Testing near placement... ";
+
+    // Both arenas are full; free one block and ask for it from next door
+    void* block = g_arenas[1].base;
+    assert(dh_code_free(block) == 0);
+    const uint8_t* near = g_arenas[1].base + 0x1000000;
+    void* q = dh_code_alloc(16, near);
+    assert(q == block);
+
+    // Nothing lies within reach of an address far from every arena
+    const void* far = reinterpret_cast<const void*>(uintptr_t(0x10));
+    assert(dh_code_free(q) == 0);
+    assert(dh_code_alloc(16, far) == nullptr);
+    assert(dh_code_alloc(16, nullptr) == block);
+
+    // The reach of a b instruction, both ways
+    assert(in_reach(0x80000000, 16, 0x82000000));
+    assert(!in_reach(0x80000000, 16, 0x82000001));
+    assert(in_reach(0x81FFFFEF, 16, 0x80000000));
+    assert(!in_reach(0x81FFFFF0, 16, 0x80000000));
+
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Code Allocator Tests ===\n\n";
+
+    try {
+        test_code_reuse();
+        test_code_growth();
+        test_code_near();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,130 @@
+/**
+ * Unit tests for CISO/GCZ containers
+ */
+
+#include "../tools/patchiso/container.h"
+#include "../tools/patchiso/gcm.h"
+#include <cassert>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+// 256 KB image: text-like data, a noisy region, zeros from 0x10000 to 0x30000
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x40000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x3000);
+
+    uint32_t x = 12345;
+    for (size_t i = 0x2440; i < 0x10000; i++) {
+        x = x * 1103515245 + 12345;
+        img[i] = i < 0x8000 ? "dolhook "[i % 8] : static_cast<uint8_t>(x >> 16);
+    }
+    for (size_t i = 0x30000; i < img.size(); i++) img[i] = static_cast<uint8_t>(i / 7);
+    return img;
+}
+
+static void write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+static void cleanup(const std::string& path) {
+    for (const char* ext : {"", ".bak", ".tmp"}) std::remove((path + ext).c_str());
+}
+
+void test_ciso_roundtrip() {
+    std::cout << "Testing CISO roundtrip... ";
+
+    auto img = make_image();
+    write_file("test_container.iso", img);
+
+    GCMFile iso;
+    assert(iso.load("test_container.iso"));
+    assert(iso.save("test_container.ciso"));
+    assert(iso.container_stats().blocks == 8);
+
+    // Four all-zero blocks are left out
+    assert(std::filesystem::file_size("test_container.ciso") == 0x8000 + 4 * 0x8000);
+
+    GCMFile ciso;
+    assert(ciso.load("test_container.ciso"));
+    assert(std::string(ciso.backend()) == "ciso");
+    assert(ciso.size() == img.size());
+    assert(ciso.read(0, img.size()) == img);
+
+    // Reads straddling a block boundary
+    auto part = ciso.read(0x7FF0, 0x20);
+    assert(std::equal(part.begin(), part.end(), img.begin() + 0x7FF0));
+
+    cleanup("test_container.iso");
+    cleanup("test_container.ciso");
+    std::cout << "PASS\n";
+}
+
+#ifdef DOLHOOK_HAVE_ZLIB
+void test_gcz_patch_in_place() {
+    std::cout << "Testing GCZ patch in place... ";
+
+    auto img = make_image();
+    GCMFile raw;
+    assert(raw.load(img));
+    assert(raw.save("test_container.gcz"));
+    assert(std::filesystem::file_size("test_container.gcz") < img.size());
+
+    GCMFile gcz;
+    assert(gcz.load("test_container.gcz"));
+    assert(std::string(gcz.backend()) == "gcz");
+    assert(gcz.read(0, img.size()) == img);
+
+    // One changed block is re-encoded, the other seven pass through
+    std::vector<uint8_t> patch(0x40, 0xA5);
+    assert(gcz.write(0x9010, patch));
+    assert(gcz.create_backup() == GCMFile::BackupKind::Link);
+    assert(gcz.commit_in_place());
+    assert(gcz.container_stats().encoded == 1);
+    assert(gcz.container_stats().copied == 7);
+
+    std::memcpy(img.data() + 0x9010, patch.data(), patch.size());
+    GCMFile reloaded;
+    assert(reloaded.load("test_container.gcz"));
+    assert(reloaded.read(0, img.size()) == img);
+
+    // The hard link still holds the original
+    assert(GCMFile::restore_backup("test_container.gcz"));
+    assert(reloaded.load("test_container.gcz"));
+    assert(reloaded.read(0x9010, 0x40) != patch);
+
+    cleanup("test_container.gcz");
+    std::cout << "PASS\n";
+}
+#endif
+
+int main() {
+    std::cout << "=== Container Tests ===\n\n";
+
+    try {
+        test_ciso_roundtrip();
+#ifdef DOLHOOK_HAVE_ZLIB
+        test_gcz_patch_in_place();
+#endif
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,313 @@
+/**
+ * Unit tests for ELF payload loading and relocation
+ */
+
+#include "../tools/patchiso/elf.h"
+#include "../tools/patchiso/patcher.h"
+#include "../tools/patchiso/gcm.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be16(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 8) & 0xFF;
+    buf[off + 1] = v & 0xFF;
+}
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+static uint32_t get_be32(const std::vector<uint8_t>& buf, size_t off) {
+    return (uint32_t(buf[off]) << 24) | (uint32_t(buf[off + 1]) << 16) | (uint32_t(buf[off + 2]) << 8) |
+           buf[off + 3];
+}
+
+static uint32_t bl(uint32_t from, uint32_t to) {
+    return 0x48000001 | ((to - from) & 0x03FFFFFC);
+}
+
+// Payload linked at 0x80400000, as ld -q would leave it:
+//   0x00 lis r3,buffer@ha / addi r3,r3,buffer@l
+//   0x08 bl game_func (absolute 0x80003100) / bl 0x80400010 (internal)
+//   0x20 .long buffer+4
+//   0x30 __dolhook_original_entry (no placeholder value to scan for)
+//   .bss: buffer, 0x100 bytes at 0x80400040
+static std::vector<uint8_t> make_elf(bool with_relocs) {
+    const uint32_t base = 0x80400000;
+    std::vector<uint8_t> text(0x40, 0);
+    put_be32(text, 0x00, 0x3C608040);
+    put_be32(text, 0x04, 0x38630040);
+    put_be32(text, 0x08, bl(base + 0x08, 0x80003100));
+    put_be32(text, 0x0C, bl(base + 0x0C, base + 0x10));
+    put_be32(text, 0x10, 0x4E800020);
+    put_be32(text, 0x20, 0x80400044);
+    put_be32(text, 0x30, 0);
+
+    std::string strtab("\0__dolhook_entry\0__dolhook_original_entry\0game_func\0buffer\0", 59);
+    std::string shstrtab("\0.text\0.bss\0.symtab\0.strtab\0.rela.text\0.shstrtab\0", 50);
+
+    // name, value, info, shndx
+    struct Sym { uint32_t name, value; uint8_t info; uint16_t shndx; };
+    const Sym syms[] = {
+        {0, 0, 0, 0},
+        {0, base, 0x03, 1},            // .text section symbol
+        {1, base, 0x12, 1},            // __dolhook_entry (global func)
+        {17, base + 0x30, 0x11, 1},    // __dolhook_original_entry
+        {42, 0x80003100, 0x10, 0xFFF1},// game_func (absolute)
+        {52, base + 0x40, 0x11, 2},    // buffer
+    };
+    std::vector<uint8_t> symtab(sizeof(syms) / sizeof(syms[0]) * 16, 0);
+    for (size_t i = 0; i < sizeof(syms) / sizeof(syms[0]); i++) {
+        put_be32(symtab, i * 16, syms[i].name);
+        put_be32(symtab, i * 16 + 4, syms[i].value);
+        symtab[i * 16 + 12] = syms[i].info;
+        put_be16(symtab, i * 16 + 14, syms[i].shndx);
+    }
+
+    // offset, symbol, type, addend
+    struct Rela { uint32_t addr, sym, type; int32_t addend; };
+    const Rela relas[] = {
+        {base + 0x02, 5, 6, 0},        // ADDR16_HA buffer
+        {base + 0x06, 5, 4, 0},        // ADDR16_LO buffer
+        {base + 0x08, 4, 10, 0},       // REL24 game_func
+        {base + 0x0C, 1, 10, 0x10},    // REL24 .text+0x10
+        {base + 0x20, 5, 1, 4},        // ADDR32 buffer+4
+    };
+    std::vector<uint8_t> rela(with_relocs ? sizeof(relas) / sizeof(relas[0]) * 12 : 0, 0);
+    for (size_t i = 0; with_relocs && i < sizeof(relas) / sizeof(relas[0]); i++) {
+        put_be32(rela, i * 12, relas[i].addr);
+        put_be32(rela, i * 12 + 4, (relas[i].sym << 8) | relas[i].type);
+        put_be32(rela, i * 12 + 8, static_cast<uint32_t>(relas[i].addend));
+    }
+
+    // File: header, .text, .symtab, .strtab, .rela.text, .shstrtab, section headers
+    std::vector<uint8_t> elf(0x40, 0);
+    auto append = [&](const void* p, size_t n) {
+        size_t off = elf.size();
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        elf.insert(elf.end(), b, b + n);
+        while (elf.size() % 4) elf.push_back(0);
+        return static_cast<uint32_t>(off);
+    };
+    uint32_t text_off = append(text.data(), text.size());
+    uint32_t symtab_off = append(symtab.data(), symtab.size());
+    uint32_t strtab_off = append(strtab.data(), strtab.size());
+    uint32_t rela_off = append(rela.data(), rela.size());
+    uint32_t shstr_off = append(shstrtab.data(), shstrtab.size());
+
+    // name, type, flags, addr, offset, size, link, info
+    const uint32_t shdrs[7][8] = {
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 1, 0x6, base, text_off, 0x40, 0, 0},
+        {7, 8, 0x3, base + 0x40, 0, 0x100, 0, 0},
+        {12, 2, 0, 0, symtab_off, static_cast<uint32_t>(symtab.size()), 4, 2},
+        {20, 3, 0, 0, strtab_off, static_cast<uint32_t>(strtab.size()), 0, 0},
+        {28, 4, 0, 0, rela_off, static_cast<uint32_t>(rela.size()), 3, 1},
+        {39, 3, 0, 0, shstr_off, static_cast<uint32_t>(shstrtab.size()), 0, 0},
+    };
+    uint32_t shoff = static_cast<uint32_t>(elf.size());
+    elf.resize(elf.size() + 7 * 40, 0);
+    for (size_t i = 0; i < 7; i++) {
+        for (size_t f = 0; f < 8; f++) put_be32(elf, shoff + i * 40 + f * 4, shdrs[i][f]);
+    }
+
+    const uint8_t ident[] = {0x7F, 'E', 'L', 'F', 1, 2, 1};
+    std::memcpy(elf.data(), ident, sizeof(ident));
+    put_be16(elf, 16, 2);     // ET_EXEC
+    put_be16(elf, 18, 20);    // EM_PPC
+    put_be32(elf, 20, 1);
+    put_be32(elf, 24, base);
+    put_be32(elf, 32, shoff);
+    put_be16(elf, 40, 52);
+    put_be16(elf, 46, 40);
+    put_be16(elf, 48, 7);
+    put_be16(elf, 50, 6);
+    return elf;
+}
+
+void test_elf_relocate() {
+    std::cout << "Testing ELF relocation... ";
+
+    ElfImage elf;
+    std::string error;
+    assert(elf.load(make_elf(true), error));
+    assert(elf.base() == 0x80400000 && elf.footprint() == 0x140);
+    assert(elf.symbols().at("__dolhook_original_entry") == 0x80400030);
+
+    // At the link address nothing changes
+    std::vector<uint8_t> image;
+    std::map<std::string, uint32_t> symbols;
+    assert(elf.relocate(0x80400000, image, symbols, error));
+    assert(image.size() == 0x40 && get_be32(image, 0) == 0x3C608040);
+
+    assert(elf.relocate(0x80500000, image, symbols, error));
+    assert(get_be32(image, 0x00) == 0x3C608050);                        // buffer@ha
+    assert(get_be32(image, 0x04) == 0x38630040);                        // buffer@l
+    assert(get_be32(image, 0x08) == bl(0x80500008, 0x80003100));        // still reaches the game
+    assert(get_be32(image, 0x0C) == bl(0x8050000C, 0x80500010));        // internal, unchanged
+    assert(get_be32(image, 0x20) == 0x80500044);
+    assert(symbols.at("__dolhook_entry") == 0x80500000);
+    assert(symbols.at("__dolhook_original_entry") == 0x80500030);
+    assert(symbols.at("game_func") == 0x80003100);
+    assert(symbols.at("buffer") == 0x80500040);
+
+    // Carry from the low half into @ha
+    assert(elf.relocate(0x8040FFC0, image, symbols, error));
+    assert(get_be32(image, 0x00) == 0x3C608041 && get_be32(image, 0x04) == 0x38630000);
+
+    // Without relocations it can only stay put
+    ElfImage flat;
+    assert(flat.load(make_elf(false), error));
+    assert(flat.relocate(0x80400000, image, symbols, error));
+    assert(!flat.relocate(0x80500000, image, symbols, error));
+
+    std::vector<uint8_t> junk(64, 0);
+    assert(!flat.load(junk, error));
+
+    std::cout << "PASS\n";
+}
+
+// 64 KB image whose DOL has BSS covering 0x80400000-0x80420000
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x10000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x8000);
+    put_be32(img, 0x428, 0x0C);
+    put_be32(img, 0x42C, 0x0C);
+    img[0x8000] = 1;
+    put_be32(img, 0x8008, 1);
+
+    const size_t dol = 0x2440;
+    put_be32(img, dol + 0x00, 0x200);
+    put_be32(img, dol + 0x74, 0x80003100);
+    put_be32(img, dol + 0xE8, 0x100);
+    put_be32(img, dol + 0x15C, 0x80400000);
+    put_be32(img, dol + 0x160, 0x20000);
+    put_be32(img, dol + 0x164, 0x80003100);
+    return img;
+}
+
+void test_elf_patch_image() {
+    std::cout << "Testing patching with an ELF payload... ";
+
+    std::filesystem::create_directories("test_elf_payload");
+    {
+        auto elf = make_elf(true);
+        std::ofstream f("test_elf_payload/payload.elf", std::ios::binary);
+        f.write(reinterpret_cast<const char*>(elf.data()), elf.size());
+    }
+    {
+        auto img = make_image();
+        std::ofstream f("test_elf.iso", std::ios::binary);
+        f.write(reinterpret_cast<const char*>(img.data()), img.size());
+    }
+
+    std::ostringstream log;
+    Payload payload;
+    assert(payload.load("test_elf_payload", log));
+    assert(payload.elf);
+
+    PatchOptions opts;
+    opts.output = "test_elf_out.iso";
+    opts.log_level = 0;
+    PatchResult result = patch_image("test_elf.iso", opts, payload, log);
+    assert(result.ok);
+
+    // Moved past the game's BSS, entry and slot found through the symbols
+    assert(result.load_addr == 0x80420000);
+    assert(result.new_entry == 0x80420000);
+
+    GCMFile out;
+    assert(out.load("test_elf_out.iso"));
+    DOLFile dol = out.read_dol();
+    assert(dol.header().entry_point == 0x80420000);
+    DOLSection injected = dol.header().get_sections().back();
+    assert(injected.load_addr == 0x80420000);
+    ByteView code = dol.get_section_data(injected);
+    std::vector<uint8_t> bytes(code.begin(), code.end());
+    assert(get_be32(bytes, 0x00) == 0x3C608042);
+    assert(get_be32(bytes, 0x08) == bl(0x80420008, 0x80003100));
+    assert(get_be32(bytes, 0x20) == 0x80420044);
+    assert(get_be32(bytes, 0x30) == 0x80003100);
+
+    std::filesystem::remove_all("test_elf_payload");
+    std::remove("test_elf.iso");
+    std::remove("test_elf_out.iso");
+    std::cout << "PASS\n";
+}
+
+// payload.bin/payload.sym linked at base, entry slot in the last word
+static void write_flat_payload(uint32_t base) {
+    std::filesystem::remove_all("test_elf_payload");
+    std::filesystem::create_directories("test_elf_payload");
+    std::vector<uint8_t> code(0x40, 0);
+    put_be32(code, 0x3C, 0x80003100);
+    std::ofstream bin("test_elf_payload/payload.bin", std::ios::binary);
+    bin.write(reinterpret_cast<const char*>(code.data()), code.size());
+    std::ofstream sym("test_elf_payload/payload.sym");
+    sym << std::hex << "__dolhook_entry " << base << "\n"
+        << "__dolhook_start " << base << "\n"
+        << "__dolhook_original_entry " << base + 0x3C << "\n";
+}
+
+void test_flat_payload_placement() {
+    std::cout << "Testing flat payload placement... ";
+
+    {
+        auto img = make_image();
+        std::ofstream f("test_elf.iso", std::ios::binary);
+        f.write(reinterpret_cast<const char*>(img.data()), img.size());
+    }
+    std::ostringstream log;
+    PatchOptions opts;
+    opts.output = "test_elf_out.iso";
+    opts.log_level = 0;
+
+    // Linked where the game's BSS is: refused, since it can't be moved
+    write_flat_payload(0x80400000);
+    Payload overlapping;
+    assert(overlapping.load("test_elf_payload", log));
+    PatchResult result = patch_image("test_elf.iso", opts, overlapping, log);
+    assert(!result.ok);
+    assert(result.error.find("payload.bin is linked at 0x80400000") != std::string::npos);
+    assert(!std::filesystem::exists("test_elf_out.iso"));
+
+    // Linked past it: loaded there
+    write_flat_payload(0x80420000);
+    Payload clear;
+    assert(clear.load("test_elf_payload", log));
+    result = patch_image("test_elf.iso", opts, clear, log);
+    assert(result.ok && result.load_addr == 0x80420000 && result.new_entry == 0x80420000);
+
+    std::filesystem::remove_all("test_elf_payload");
+    std::remove("test_elf.iso");
+    std::remove("test_elf_out.iso");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== ELF Tests ===\n\n";
+
+    try {
+        test_elf_relocate();
+        test_elf_patch_image();
+        test_flat_payload_placement();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
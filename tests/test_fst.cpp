@@ -0,0 +1,163 @@
+/**
+ * Unit tests for the FST index and file extraction
+ */
+
+#include "../tools/patchiso/fst.h"
+#include "../tools/patchiso/gcm.h"
+#include <cassert>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+struct RawEntry {
+    bool dir;
+    const char* name;
+    uint32_t a;  // File offset / parent
+    uint32_t b;  // File size / end
+};
+
+// Root, audio/{bgm.adp, se/{hit.dsp}}, main.rel, Opening.bnr
+static const RawEntry TREE[] = {
+    {true, "audio", 0, 5},
+    {false, "bgm.adp", 0x9000, 0x300},
+    {true, "se", 1, 5},
+    {false, "hit.dsp", 0x9400, 0x80},
+    {false, "main.rel", 0x9800, 0x210},
+    {false, "Opening.bnr", 0x9C00, 0x40},
+};
+
+static std::vector<uint8_t> make_fst() {
+    const size_t count = 1 + sizeof(TREE) / sizeof(TREE[0]);
+    std::vector<uint8_t> fst(count * FstEntry::RAW_SIZE, 0);
+    std::string strings;
+
+    fst[0] = 1;
+    put_be32(fst, 8, static_cast<uint32_t>(count));
+    for (size_t i = 1; i < count; i++) {
+        const RawEntry& e = TREE[i - 1];
+        put_be32(fst, i * 12, (uint32_t(e.dir) << 24) | static_cast<uint32_t>(strings.size()));
+        put_be32(fst, i * 12 + 4, e.a);
+        put_be32(fst, i * 12 + 8, e.b);
+        strings += e.name;
+        strings += '\0';
+    }
+    fst.insert(fst.end(), strings.begin(), strings.end());
+    return fst;
+}
+
+// 64 KB image with the FST at 0x8000 and patterned file data
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x10000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    auto fst = make_fst();
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x8000);
+    put_be32(img, 0x428, static_cast<uint32_t>(fst.size()));
+    put_be32(img, 0x42C, static_cast<uint32_t>(fst.size()));
+    std::memcpy(img.data() + 0x8000, fst.data(), fst.size());
+    for (size_t i = 0x9000; i < img.size(); i++) img[i] = static_cast<uint8_t>(i * 7);
+    return img;
+}
+
+static std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+void test_fst_parse_and_lookup() {
+    std::cout << "Testing FST parse/lookup... ";
+
+    auto raw = make_fst();
+    FstIndex fst;
+    assert(fst.parse(raw.data(), raw.size()));
+    assert(fst.count() == 7);
+
+    assert(fst.path(4) == "audio/se/hit.dsp");
+    assert(fst.name(4) == "hit.dsp");
+    assert(fst.entry(4).parent == 3);
+    assert(fst.entry(4).offset == 0x9400 && fst.entry(4).size == 0x80);
+
+    assert(fst.find("/audio/se/hit.dsp") == 4);
+    assert(fst.find("AUDIO/SE/HIT.DSP") == 4);
+    assert(fst.find("audio/se/") == 3);
+    assert(fst.find("opening.bnr") == 6);
+    assert(fst.find("/") == 0);
+    assert(fst.find("audio/missing") == FstIndex::NOT_FOUND);
+    assert(fst.find("audio/se/hit") == FstIndex::NOT_FOUND);
+
+    auto root = fst.children(0);
+    assert(root.size() == 3 && root[0] == 1 && root[1] == 5 && root[2] == 6);
+    auto audio = fst.children(1);
+    assert(audio.size() == 2 && audio[0] == 2 && audio[1] == 3);
+    assert(fst.total_size(1) == 0x380);
+
+    // Corrupt: directory end past its parent, name escaping the tree
+    auto bad = raw;
+    put_be32(bad, 3 * 12 + 8, 9);
+    assert(!fst.parse(bad.data(), bad.size()));
+    bad = raw;
+    size_t str = 7 * 12;
+    std::memcpy(bad.data() + str, "..\0\0\0", 5);
+    assert(!fst.parse(bad.data(), bad.size()));
+
+    std::cout << "PASS\n";
+}
+
+void test_fst_extract() {
+    std::cout << "Testing FST extraction... ";
+
+    std::string path = "test_fst.iso";
+    std::string out_dir = "test_fst_out";
+    auto img = make_image();
+    {
+        std::ofstream f(path, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(img.data()), img.size());
+    }
+    std::filesystem::remove_all(out_dir);
+
+    GCMFile iso;
+    assert(iso.load(path));
+    FstIndex fst;
+    assert(fst.load(iso));
+
+    FstExtractor extractor;
+    assert(extractor.open(path));
+    assert(extractor.extract_tree(fst, fst.find("audio"), out_dir) == 2);
+    assert(extractor.extract_tree(fst, fst.find("main.rel"), out_dir) == 1);
+
+    auto hit = read_file(out_dir + "/audio/se/hit.dsp");
+    assert(hit.size() == 0x80);
+    assert(std::equal(hit.begin(), hit.end(), img.begin() + 0x9400));
+    assert(read_file(out_dir + "/main.rel").size() == 0x210);
+    assert(!std::filesystem::exists(out_dir + "/Opening.bnr"));
+
+    std::filesystem::remove_all(out_dir);
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== FST Tests ===\n\n";
+
+    try {
+        test_fst_parse_and_lookup();
+        test_fst_extract();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
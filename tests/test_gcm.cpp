@@ -0,0 +1,406 @@
+/**
+ * Unit tests for GCM image access
+ */
+
+#include "../tools/patchiso/gcm.h"
+#include "../tools/patchiso/journal.h"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+// 64 KB image: header, DOL at 0x2440 with one text section, FST at 0x8000
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x10000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    std::memcpy(img.data() + 0x20, "DolHook Test", 12);
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x8000);
+    put_be32(img, 0x428, 0x100);
+    put_be32(img, 0x42C, 0x100);
+
+    const size_t dol = 0x2440;
+    put_be32(img, dol + 0x00, 0x200);       // text[0] offset
+    put_be32(img, dol + 0x74, 0x80003100);  // text[0] addr
+    put_be32(img, dol + 0xE8, 0x100);       // text[0] size
+    put_be32(img, dol + 0x164, 0x80003100); // entry
+    for (size_t i = 0; i < 0x100; i++) img[dol + 0x200 + i] = static_cast<uint8_t>(i);
+
+    // Non-zero tail so growth and padding are observable
+    for (size_t i = 0x9000; i < img.size(); i++) img[i] = 0xA5;
+    return img;
+}
+
+static std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+static void write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+void test_gcm_load_and_read() {
+    std::cout << "Testing GCM load/read... ";
+
+    GCMFile iso;
+    assert(iso.load(make_image()));
+    assert(iso.size() == 0x10000);
+    assert(iso.header().dol_offset == 0x2440);
+
+    auto bytes = iso.read(0x2440 + 0x200, 4);
+    assert(bytes.size() == 4 && bytes[3] == 3);
+    assert(iso.read(0xFFFE, 4).empty());
+
+    DOLFile dol = iso.read_dol();
+    assert(dol.header().entry_point == 0x80003100);
+    assert(dol.size() == 0x300);
+
+    std::cout << "PASS\n";
+}
+
+void test_gcm_overlay_writes() {
+    std::cout << "Testing GCM overlay writes... ";
+
+    GCMFile iso;
+    assert(iso.load(make_image()));
+
+    // Overlapping and touching writes merge; newest bytes win
+    assert(iso.write(0x9000, {1, 2, 3, 4}));
+    assert(iso.write(0x9002, {9, 9, 9, 9}));
+    assert(iso.write(0x8FFE, {7, 7}));
+
+    auto bytes = iso.read(0x8FFE, 10);
+    const uint8_t expected[] = {7, 7, 1, 2, 9, 9, 9, 9, 0xA5, 0xA5};
+    assert(std::memcmp(bytes.data(), expected, sizeof(expected)) == 0);
+
+    // Writes past the end grow the image
+    assert(iso.write(0x10010, {0x42}));
+    assert(iso.size() == 0x10011);
+    bytes = iso.read(0x10000, 0x11);
+    assert(bytes[0] == 0 && bytes[0x10] == 0x42);
+
+    std::cout << "PASS\n";
+}
+
+void test_gcm_relocate_and_save() {
+    std::cout << "Testing GCM relocate/save... ";
+
+    std::string path = "test_gcm_tmp.iso";
+    write_file(path, make_image());
+
+    GCMFile iso;
+    assert(iso.load(path));
+
+    DOLFile dol = iso.read_dol();
+    dol.header().entry_point = 0x80003104;
+    assert(iso.relocate_dol(dol));
+    assert(iso.header().dol_offset == 0x10000);
+    assert(iso.size() == 0x10300);
+
+    // Saving over the mapped source must not corrupt it
+    assert(iso.save(path));
+
+    auto out = read_file(path);
+    assert(out.size() == 0x10300);
+    assert(out[0x420] == 0x00 && out[0x421] == 0x01 && out[0x422] == 0x00);
+    assert(out[0x10000 + 0x167] == 0x04);
+    assert(out[0x9000] == 0xA5);
+    assert(out[0x2440 + 0x203] == 3);
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_gcm_commit_in_place() {
+    std::cout << "Testing GCM in-place commit... ";
+
+    std::string path = "test_gcm_commit.iso";
+    write_file(path, make_image());
+
+    GCMFile iso;
+    assert(iso.load(path));
+
+    DOLFile dol = iso.read_dol();
+    dol.header().entry_point = 0x80003108;
+    assert(iso.write_dol(dol));
+    iso.header().fst_size = 0x200;
+
+    // Only bytes that differ from the image: one header byte, one entry byte
+    auto extents = iso.dirty_extents();
+    assert(extents.size() == 2);
+    assert(extents[0].offset == 0x42A && extents[0].size == 1);
+    assert(extents[1].offset == 0x2440 + 0x167 && extents[1].size == 1);
+
+    assert(iso.commit_in_place());
+    assert(iso.dirty_extents().empty());
+
+    auto out = read_file(path);
+    assert(out.size() == 0x10000);
+    assert(out[0x42A] == 0x02);
+    assert(out[0x2440 + 0x167] == 0x08);
+    assert(out[0x9000] == 0xA5);
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_gcm_output_matches() {
+    std::cout << "Testing GCM unchanged output detection... ";
+
+    std::string path = "test_gcm_match.iso";
+    std::string out_path = "test_gcm_match_out.iso";
+    write_file(path, make_image());
+
+    GCMFile iso;
+    assert(iso.load(path));
+    DOLFile dol = iso.read_dol();
+    dol.header().entry_point = 0x80003108;
+    assert(iso.write_dol(dol));
+
+    assert(!iso.output_matches(out_path));
+    assert(iso.save(out_path));
+    assert(iso.output_matches(out_path));
+    assert(!iso.output_matches(path));
+
+    // Rewriting identical bytes leaves nothing dirty
+    GCMFile same;
+    assert(same.load(out_path));
+    assert(same.write_dol(same.read_dol()));
+    assert(same.dirty_extents().empty());
+
+    dol.header().entry_point = 0x8000310C;
+    assert(iso.write_dol(dol));
+    assert(!iso.output_matches(out_path));
+
+    std::remove(path.c_str());
+    std::remove(out_path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_gcm_journal_recovery() {
+    std::cout << "Testing GCM journal recovery... ";
+
+    std::string path = "test_gcm_journal.iso";
+    write_file(path, make_image());
+
+    // Crash after the journal was written but before the image was touched
+    const uint8_t grown[] = {0x11, 0x22};
+    std::vector<ExtentSpan> spans = {{0x10000, grown, sizeof(grown)}};
+    assert(write_extent_log(path + ".journal", JOURNAL_MAGIC, 0x10000, 0x10002, spans));
+
+    GCMFile iso;
+    assert(iso.load(path));
+    assert(iso.size() == 0x10002);
+    assert(iso.read(0x10000, 2)[1] == 0x22);
+    assert(!std::ifstream(path + ".journal"));
+
+    // A torn journal is discarded without touching the image
+    write_file(path + ".journal", {'D', 'H', 'J', 'R', 'N', 'L', '0', '1', 0xFF});
+    assert(iso.load(path));
+    assert(iso.size() == 0x10002);
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_gcm_backup_and_restore() {
+    std::cout << "Testing GCM backup/restore... ";
+
+    std::string path = "test_gcm_backup.iso";
+    std::remove((path + ".bak").c_str());
+    std::remove((path + ".delta").c_str());
+    auto original = make_image();
+    write_file(path, original);
+
+    // Two separate in-place patches; the second grows the image
+    for (int round = 0; round < 2; round++) {
+        GCMFile iso;
+        assert(iso.load(path));
+
+        DOLFile dol = iso.read_dol();
+        dol.header().entry_point = 0x80003200 + round;
+        if (round == 0) {
+            assert(iso.write_dol(dol));
+        } else {
+            assert(iso.relocate_dol(dol));
+        }
+
+        auto kind = iso.create_backup();
+        assert(kind == GCMFile::BackupKind::Delta ||
+               kind == GCMFile::BackupKind::Clone ||
+               kind == GCMFile::BackupKind::Existing);
+        if (kind == GCMFile::BackupKind::Delta) {
+            // Delta costs O(patched bytes), not O(image)
+            assert(read_file(path + ".delta").size() < 0x1000);
+        }
+        assert(iso.commit_in_place());
+    }
+    assert(read_file(path) != original);
+
+    assert(GCMFile::restore_backup(path));
+    assert(read_file(path) == original);
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+static uint64_t allocated_bytes(const std::string& path) {
+    struct stat st;
+    assert(stat(path.c_str(), &st) == 0);
+    return static_cast<uint64_t>(st.st_blocks) * 512;
+}
+
+void test_gcm_sparse_output() {
+    std::cout << "Testing GCM sparse output... ";
+
+    // 1 MB image, zero padded after the 0xA5 tail
+    auto img = make_image();
+    img.resize(0x100000, 0);
+    GCMFile iso;
+    assert(iso.load(img));
+
+    std::string path = "test_gcm_sparse.iso";
+    assert(iso.save(path));
+    assert(read_file(path) == img);
+
+    // Filesystems without holes still get a correct, dense file
+    bool holes = allocated_bytes(path) < 0x80000;
+    if (holes) {
+        // Zeroing the tail in place punches it out
+        GCMFile patched;
+        assert(patched.load(path));
+        uint64_t before = allocated_bytes(path);
+        assert(patched.write(0x9000, std::vector<uint8_t>(0x7000, 0)));
+        assert(patched.commit_in_place());
+        assert(allocated_bytes(path) < before);
+
+        std::fill(img.begin() + 0x9000, img.begin() + 0x10000, 0);
+        assert(read_file(path) == img);
+    } else {
+        std::cout << "(no holes) ";
+    }
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_gcm_dol_views() {
+    std::cout << "Testing GCM DOL section views... ";
+
+    auto img = make_image();
+    std::string path = "test_gcm_views.iso";
+    write_file(path, img);
+
+    GCMFile iso;
+    assert(iso.load(path));
+    DOLFile dol = iso.read_dol();
+    DOLSection text = dol.header().get_sections()[0];
+
+    // Sections are views into the image until modified
+    ByteView view = dol.get_section_data(text);
+    assert(view.size == 0x100 && view[5] == 5);
+    uint8_t* code = dol.mutable_section_data(text);
+    assert(code && code != view.data);
+    code[5] = 0xEE;
+    assert(dol.source()[0x205] == 5);
+    assert(dol.get_section_data(text)[5] == 0xEE);
+
+    // Pieces concatenate to the saved DOL, injected sections included
+    assert(dol.inject_payload(std::vector<uint8_t>(0x40, 0x77), 0x80400000, true));
+    uint8_t header[DOLHeader::SIZE];
+    std::vector<uint8_t> joined;
+    for (const ByteView& piece : dol.gather(header)) joined.insert(joined.end(), piece.begin(), piece.end());
+    auto saved = dol.save();
+    assert(joined == saved && saved.size() == dol.size());
+    assert(saved[0x205] == 0xEE && saved[0x320] == 0x77);
+
+    // And land in the image as one write
+    assert(iso.write_dol(dol));
+    assert(iso.read(0x2440, static_cast<uint32_t>(saved.size())) == saved);
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_gcm_dol_repack() {
+    std::cout << "Testing DOL repack and load address... ";
+
+    // All 18 text slots used: 0x80-byte sections, touching in memory but
+    // 0x100 apart in the file, with BSS right at the usual payload base
+    std::vector<uint8_t> raw(0x200 + 18 * 0x100, 0);
+    for (uint32_t i = 0; i < 18; i++) {
+        put_be32(raw, i * 4, 0x200 + i * 0x100);
+        put_be32(raw, 0x74 + i * 4, 0x80003100 + i * 0x80);
+        put_be32(raw, 0xE8 + i * 4, 0x80);
+        std::memset(raw.data() + 0x200 + i * 0x100, i + 1, 0x80);
+    }
+    put_be32(raw, 0x15C, 0x80400000);
+    put_be32(raw, 0x160, 0x20000);
+    put_be32(raw, 0x164, 0x80003100);
+
+    DOLFile dol;
+    assert(dol.load(raw));
+    assert(!dol.header().has_free_slot(true));
+
+    uint32_t addr = dol.header().find_load_addr(0x1000, 0x80400000);
+    assert(addr == 0x80420000);
+    assert(dol.header().find_load_addr(0x1000, 0x80300000) == 0x80300000);
+
+    // Injecting merges the touching sections into one and drops the slack
+    assert(dol.inject_payload(std::vector<uint8_t>(0x40, 0x77), addr, true));
+    auto secs = dol.header().get_sections();
+    assert(secs.size() == 2);
+    assert(secs[0].load_addr == 0x80003100 && secs[0].size == 18 * 0x80 && secs[0].file_offset == 0x180);
+    ByteView text = dol.get_section_data(secs[0]);
+    for (uint32_t i = 0; i < 18; i++) assert(text[i * 0x80] == i + 1 && text[i * 0x80 + 0x7F] == i + 1);
+    assert(secs[1].load_addr == addr && dol.get_section_data(secs[1])[0x3F] == 0x77);
+    assert(dol.size() == 0xAC0);
+
+    // The saved DOL parses back to the same layout
+    DOLFile again;
+    assert(again.load(dol.save()));
+    assert(again.header().get_sections().size() == 2);
+    assert(again.get_section_data(again.header().get_sections()[0])[0x880] == 18);
+
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "Running GCM tests...\n\n";
+
+    try {
+        test_gcm_load_and_read();
+        test_gcm_overlay_writes();
+        test_gcm_relocate_and_save();
+        test_gcm_commit_in_place();
+        test_gcm_output_matches();
+        test_gcm_journal_recovery();
+        test_gcm_backup_and_restore();
+        test_gcm_sparse_output();
+        test_gcm_dol_views();
+        test_gcm_dol_repack();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "\nTest failed with exception: " << e.what() << "\n";
+        return 1;
+    } catch (...) {
+        std::cerr << "\nTest failed with unknown exception\n";
+        return 1;
+    }
+}
@@ -0,0 +1,494 @@
+/**
+ * Unit tests for Gecko code lists: the patcher's reader and the runtime
+ * engine (built for the host, with game RAM mapped into a buffer)
+ */
+
+#include <cstdint>
+
+alignas(32) static uint8_t g_ram[0x10000];  // 0x80000000..0x8000FFFF
+
+#define GECKO_PTR(a)  (static_cast<void*>(g_ram + ((a) - 0x80000000u)))
+#define GECKO_ADDR(p) (0x80000000u + static_cast<uint32_t>(static_cast<uint8_t*>(static_cast<void*>(p)) - g_ram))
+
+#include "../runtime/src/gecko.c"
+#include "../tools/patchiso/gecko.h"
+#include "../tools/patchiso/patcher.h"
+#include "../tools/patchiso/gcm.h"
+#include "../tools/patchiso/dol.h"
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace dolhook;
+
+static int g_batch = 0;
+static int g_write_calls = 0;
+static int g_syncs = 0;
+static int g_touches = 0;
+
+extern "C" {
+void dh_write8(volatile void* p, uint8_t v) {
+    g_write_calls++;
+    *static_cast<volatile uint8_t*>(p) = v;
+}
+void dh_write16(volatile void* p, uint16_t v) {
+    g_write_calls++;
+    *static_cast<volatile uint16_t*>(p) = v;
+}
+void dh_write32(volatile void* p, uint32_t v) {
+    g_write_calls++;
+    *static_cast<volatile uint32_t*>(p) = v;
+}
+int dh_batch_active(void) {
+    return g_batch;
+}
+void dh_batch_touch(void*, unsigned) {
+    g_touches++;
+}
+void dh_icache_sync_range(void*, unsigned) {
+    g_syncs++;
+}
+uint32_t dh_make_branch_imm(uint32_t from, uint32_t to, int link) {
+    int32_t offset = static_cast<int32_t>(to - from);
+    if (offset < -0x2000000 || offset > 0x1FFFFFF) return 0;
+    return 0x48000000 | (offset & 0x03FFFFFC) | (link ? 1 : 0);
+}
+void dh_log(const char*, ...) {}
+}
+
+static const uint32_t LIST_ADDR = 0x80008000;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+static uint32_t get_be32(const std::vector<uint8_t>& buf, size_t off) {
+    return (uint32_t(buf[off]) << 24) | (uint32_t(buf[off + 1]) << 16) | (uint32_t(buf[off + 2]) << 8) |
+           buf[off + 3];
+}
+
+static uint32_t& ram32(uint32_t addr) {
+    return *static_cast<uint32_t*>(GECKO_PTR(addr));
+}
+
+static uint16_t& ram16(uint32_t addr) {
+    return *static_cast<uint16_t*>(GECKO_PTR(addr));
+}
+
+static void reset() {
+    std::memset(g_ram, 0, sizeof(g_ram));
+    g_batch = 0;
+    g_write_calls = 0;
+    g_syncs = 0;
+    g_touches = 0;
+}
+
+// Read a text list as the patcher does and load it the way dh_init() does
+static int load_text(const std::string& text, dh_gecko_stats* stats) {
+    GeckoList list;
+    std::string error;
+    bool ok = list.parse(std::vector<uint8_t>(text.begin(), text.end()), error);
+    if (!ok) std::cerr << error << "\n";
+    assert(ok);
+
+    // The console reads the big-endian list as code words and string data
+    // as bytes; lay each out here the way it is read
+    const auto& bytes = list.bytes();
+    uint32_t* words = static_cast<uint32_t*>(GECKO_PTR(LIST_ADDR));
+    size_t raw_end = 0;
+    for (size_t i = 0; i < bytes.size() / 4; i++) {
+        if (i < raw_end) {
+            std::memcpy(&words[i], &bytes[i * 4], 4);
+            continue;
+        }
+        words[i] = (uint32_t(bytes[i * 4]) << 24) | (uint32_t(bytes[i * 4 + 1]) << 16) |
+                   (uint32_t(bytes[i * 4 + 2]) << 8) | bytes[i * 4 + 3];
+        if (i % 2 == 1 && (words[i - 1] >> 24 & 0xEE) == 0x06 && i >= raw_end) {
+            raw_end = i + 1 + (words[i] + 7) / 8 * 2;
+        }
+    }
+    return dh_gecko_load(words, static_cast<uint32_t>(bytes.size()), stats);
+}
+
+static bool parse_fails(const std::string& text, const std::string& message) {
+    GeckoList list;
+    std::string error;
+    return !list.parse(std::vector<uint8_t>(text.begin(), text.end()), error) &&
+           error.find(message) != std::string::npos;
+}
+
+void test_gecko_list() {
+    std::cout << "Testing code list reading... ";
+
+    GeckoList list;
+    std::string error;
+    std::string text =
+        "[Gecko]\n"
+        "$Infinite lives [someone]\n"
+        "04001234 00000063\n"
+        "*Needs the 1.01 disc\n"
+        "\n"
+        "$Moon jump\n"
+        "2800ABCD 00000100\n"
+        "0400F000 3F800000\n"
+        "E2000001 00000000\n";
+    assert(list.parse(std::vector<uint8_t>(text.begin(), text.end()), error));
+    assert(list.codes() == 4 && list.bytes().size() == 40);
+    assert(list.bytes()[0] == 0x04 && list.bytes()[3] == 0x34 && list.bytes()[7] == 0x63);
+    assert(list.bytes()[32] == 0xF0 && list.bytes()[39] == 0x00);
+
+    // The same list as a .gct: header, codes, terminator; anything after it is dropped
+    std::vector<uint8_t> gct(8 + list.bytes().size() + 8, 0);
+    put_be32(gct, 0, 0x00D0C0DE);
+    put_be32(gct, 4, 0x00D0C0DE);
+    std::copy(list.bytes().begin(), list.bytes().end(), gct.begin() + 8);
+    put_be32(gct, gct.size() - 8, 0x04000000);
+    GeckoList binary;
+    assert(binary.parse(gct, error));
+    assert(binary.bytes() == list.bytes() && binary.digest() == list.digest());
+
+    // Refused at patch time rather than at boot
+    assert(parse_fails("04001234 0063\n", "line 1: expected XXXXXXXX YYYYYYYY"));
+    assert(parse_fails("04001234 00000063\n48000000 80001000\n", "line 2 (48000000 80001000): unsupported code type 48"));
+    assert(parse_fails("C2001000 00000002\n60000000 00000000\n", "runs past the end"));
+    assert(parse_fails("C2001000 00000000\n", "no code lines"));
+    assert(parse_fails("08001000 00000000\n30010004 00000001\n", "serial write size"));
+    std::string deep;
+    for (int i = 0; i < 17; i++) deep += "20001000 00000000\n";
+    assert(parse_fails(deep, "nested deeper than 16"));
+    std::string big;
+    for (int i = 0; i < 400; i++) big += "20001000 00000000\n04001004 00000001\nE2000001 00000000\n";
+    assert(parse_fails(big, "per-frame program"));
+
+    std::cout << "PASS\n";
+}
+
+void test_gecko_writes() {
+    std::cout << "Testing one-time writes... ";
+    reset();
+
+    dh_gecko_stats stats;
+    assert(load_text(
+        "00001001 000A0077\n"   // 11 bytes of 0x77 from 0x80001001
+        "02001102 00040BEE\n"   // 5 halfwords from 0x80001102
+        "04001200 12345678\n"
+        "06001300 00000006\n"   // 6-byte string
+        "48656C6C 6F210000\n"
+        "08001400 00000010\n"   // 3 words: 0x10 at +0, 0x15 at +8, 0x1A at +16
+        "20020008 00000005\n"
+        "E0000000 80010000\n"   // ba = 0x80010000, po stays 0x80000000
+        "14001500 CAFEF00D\n",  // po-based
+        &stats) == 0);
+
+    for (uint32_t a = 0x80001001; a < 0x8000100C; a++) assert(g_ram[a - 0x80000000] == 0x77);
+    assert(g_ram[0x1000] == 0 && g_ram[0x100C] == 0);
+    for (uint32_t a = 0x80001102; a < 0x8000110C; a += 2) assert(ram16(a) == 0x0BEE);
+    assert(ram16(0x8000110C) == 0);
+    assert(ram32(0x80001200) == 0x12345678);
+    assert(std::memcmp(GECKO_PTR(0x80001300), "Hello!", 6) == 0 && g_ram[0x1306] == 0);
+    assert(ram32(0x80001400) == 0x10 && ram32(0x80001408) == 0x15 && ram32(0x80001410) == 0x1A);
+    assert(ram32(0x80001404) == 0);
+    assert(ram32(0x80001500) == 0xCAFEF00D);
+
+    // Through dh_write*() (so a batch takes them), whole words where aligned:
+    // 11 bytes = 3 + 2 words + 0, 5 halfwords = 1 + 2 words, 6 bytes = 1 word + 2
+    assert(stats.codes == 7 && stats.writes == 6 && stats.inserts == 0 && stats.frame_words == 0);
+    assert(g_write_calls == 5 + 3 + 1 + 3 + 3 + 1);
+
+    // Nothing left to do per frame
+    std::memset(GECKO_PTR(0x80001200), 0, 4);
+    dh_gecko_run_frame();
+    assert(ram32(0x80001200) == 0);
+
+    std::cout << "PASS\n";
+}
+
+void test_gecko_conditionals() {
+    std::cout << "Testing per-frame conditionals... ";
+    reset();
+
+    dh_gecko_stats stats;
+    assert(load_text(
+        "04003000 00000001\n"   // Once
+        "20002000 00000001\n"   // if [2000] == 1
+        "04003004 00000002\n"   //   [3004] = 2
+        "2A002010 FF000012\n"   //   if ([2010] & 0x00FF) != 0x12
+        "02003008 00000777\n"   //     [3008] = 0x777
+        "E2100000 00000000\n"   //   else
+        "02003008 00000888\n"   //     [3008] = 0x888
+        "E2000002 00000000\n"   // endif x2
+        "24002000 00000005\n"   // if [2000] > 5
+        "0400300C 00000003\n"   //   [300C] = 3
+        "26002001 00000008\n"   // endif; if [2000] < 8
+        "04003010 00000004\n"   //   [3010] = 4
+        "E0000000 00000000\n"
+        "04003014 00000005\n",  // Once
+        &stats) == 0);
+
+    // Only the unconditional writes happened at load
+    assert(ram32(0x80003000) == 1 && ram32(0x80003014) == 5);
+    assert(ram32(0x80003004) == 0 && ram32(0x80003010) == 0);
+    assert(stats.codes == 14 && stats.writes == 2);
+    assert(stats.frame_words == 4 * 3 + 5 * 3 + 1);  // Ifs, writes, the else jump
+
+    auto frame = [] {
+        std::memset(GECKO_PTR(0x80003004), 0, 16);
+        dh_gecko_run_frame();
+    };
+
+    // [2000] = 1: outer block, inner if taken ([2010] low byte 0x34 != 0x12)
+    ram32(0x80002000) = 1;
+    ram16(0x80002010) = 0xAB34;
+    frame();
+    assert(ram32(0x80003004) == 2 && ram16(0x80003008) == 0x777);
+    assert(ram32(0x8000300C) == 0 && ram32(0x80003010) == 4);
+
+    // The mask hides the high byte: else branch
+    ram16(0x80002010) = 0xAB12;
+    frame();
+    assert(ram32(0x80003004) == 2 && ram16(0x80003008) == 0x888);
+
+    // [2000] = 6: outer block skipped, both later ifs taken
+    ram32(0x80002000) = 6;
+    frame();
+    assert(ram32(0x80003004) == 0 && ram16(0x80003008) == 0);
+    assert(ram32(0x8000300C) == 3 && ram32(0x80003010) == 4);
+
+    // [2000] = 9: only > 5
+    ram32(0x80002000) = 9;
+    frame();
+    assert(ram32(0x8000300C) == 3 && ram32(0x80003010) == 0);
+    assert(g_write_calls == 2);
+
+    // Per-frame string and serial writes
+    assert(load_text(
+        "20002000 00000009\n"
+        "06003100 00000003\n"
+        "41424300 00000000\n"
+        "08003200 00000001\n"
+        "10020002 00000001\n"   // 16-bit: 1 at +0, 2 at +2, 3 at +4
+        "E2000001 00000000\n",
+        &stats) == 0);
+    dh_gecko_run_frame();
+    assert(std::memcmp(GECKO_PTR(0x80003100), "ABC", 3) == 0 && g_ram[0x3103] == 0);
+    assert(ram16(0x80003200) == 1 && ram16(0x80003202) == 2 && ram16(0x80003204) == 3);
+
+    std::cout << "PASS\n";
+}
+
+void test_gecko_inserts() {
+    std::cout << "Testing insert-asm codes... ";
+    reset();
+
+    // Game code to patch
+    ram32(0x80002000) = 0x7C0802A6;
+    ram32(0x80002100) = 0x38600000;
+
+    dh_gecko_stats stats;
+    g_batch = 1;
+    assert(load_text(
+        "C2002000 00000002\n"
+        "38600001 60000000\n"
+        "7C0802A6 00000000\n"
+        "20002200 00000001\n"
+        "C2002100 00000001\n"
+        "38600002 00000000\n"
+        "E2000001 00000000\n",
+        &stats) == 0);
+    assert(stats.codes == 4 && stats.inserts == 2 && stats.frame_words == 3 + 3);
+
+    // Blocks run in place in the list, their last word jumping back
+    uint32_t block = LIST_ADDR + 8;
+    assert(ram32(0x80002000) == dh_make_branch_imm(0x80002000, block, 0));
+    assert(ram32(block + 12) == dh_make_branch_imm(block + 12, 0x80002004, 0));
+    assert(ram32(block) == 0x38600001 && ram32(block + 8) == 0x7C0802A6);
+    assert(g_touches == 2 && g_syncs == 0);
+
+    // The conditional one is linked per frame, synced only when it changes
+    uint32_t block2 = LIST_ADDR + 40;
+    assert(ram32(block2 + 4) == dh_make_branch_imm(block2 + 4, 0x80002104, 0));
+    dh_gecko_run_frame();
+    assert(ram32(0x80002100) == 0x38600000 && g_syncs == 0);
+    ram32(0x80002200) = 1;
+    dh_gecko_run_frame();
+    dh_gecko_run_frame();
+    assert(ram32(0x80002100) == dh_make_branch_imm(0x80002100, block2, 0) && g_syncs == 1);
+
+    std::cout << "PASS\n";
+}
+
+void test_gecko_errors() {
+    std::cout << "Testing malformed lists at boot... ";
+    reset();
+
+    // Codes before an unsupported one stay applied; the program still runs
+    uint32_t* list = static_cast<uint32_t*>(GECKO_PTR(LIST_ADDR));
+    const uint32_t codes[] = {
+        0x00D0C0DE, 0x00D0C0DE,
+        0x04001000, 0x11111111,
+        0x20002000, 0x00000000,
+        0x04001004, 0x22222222,
+        0x48000000, 0x80001000,
+        0x04001008, 0x33333333,
+        0xF0000000, 0x00000000,
+    };
+    std::memcpy(list, codes, sizeof(codes));
+    dh_gecko_stats stats;
+    assert(dh_gecko_load(list, sizeof(codes), &stats) == -1);
+    assert(stats.codes == 3 && ram32(0x80001000) == 0x11111111 && ram32(0x80001008) == 0);
+    dh_gecko_run_frame();
+    assert(ram32(0x80001004) == 0x22222222);
+
+    // Truncated: C2 with more lines than the list holds
+    const uint32_t cut[] = {0xC2001000, 0x00000004, 0x60000000, 0x00000000};
+    std::memcpy(list, cut, sizeof(cut));
+    assert(dh_gecko_load(list, sizeof(cut), &stats) == -1 && stats.codes == 0);
+
+    // Too many conditional codes: nothing runs per frame
+    std::vector<uint32_t> many;
+    for (int i = 0; i < 400; i++) {
+        many.insert(many.end(), {0x20002000, 0x00000000, 0x04001010, 0x00000001, 0xE2000001, 0x00000000});
+    }
+    std::memcpy(list, many.data(), many.size() * 4);
+    assert(dh_gecko_load(list, static_cast<uint32_t>(many.size() * 4), &stats) == -2);
+    assert(stats.frame_words == 0);
+    dh_gecko_run_frame();
+    assert(ram32(0x80001010) == 0);
+
+    std::cout << "PASS\n";
+}
+
+// 64 KB image with a one-section DOL (entry 0x80003100) and BSS at
+// 0x80010000..0x80011000
+static void write_image(const std::string& path) {
+    std::vector<uint8_t> dol(0x200 + 0x40, 0);
+    put_be32(dol, 0x00, 0x200);
+    put_be32(dol, 0x74, 0x80003100);
+    put_be32(dol, 0xE8, 0x40);
+    put_be32(dol, 0x15C, 0x80010000);
+    put_be32(dol, 0x160, 0x1000);
+    put_be32(dol, 0x164, 0x80003100);
+
+    std::vector<uint8_t> img(0x10000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x8000);
+    put_be32(img, 0x428, 0x0C);
+    put_be32(img, 0x42C, 0x0C);
+    img[0x8000] = 1;
+    put_be32(img, 0x8008, 1);
+    std::copy(dol.begin(), dol.end(), img.begin() + 0x2440);
+
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(img.data()), img.size());
+}
+
+void test_gecko_patch() {
+    std::cout << "Testing code lists through the patcher... ";
+
+    // Flat payload: entry placeholder, the list descriptor, then 0x30 bytes of BSS
+    const uint32_t base = 0x80400000;
+    std::vector<uint8_t> code(16, 0);
+    put_be32(code, 0, 0x80003100);
+    std::filesystem::create_directories("test_gecko_payload");
+    {
+        std::ofstream bin("test_gecko_payload/payload.bin", std::ios::binary);
+        bin.write(reinterpret_cast<const char*>(code.data()), code.size());
+        std::ofstream sym("test_gecko_payload/payload.sym");
+        sym << std::hex << "__dolhook_entry " << base << "\n"
+            << "__dolhook_start " << base << "\n"
+            << "__dolhook_end " << base + 0x40 << "\n"
+            << "__dolhook_original_entry " << base << "\n"
+            << "__dolhook_gecko " << base + 4 << "\n";
+    }
+    Payload payload;
+    std::ostringstream log;
+    assert(payload.load("test_gecko_payload", log));
+
+    std::string text = "04001234 00000063\n";
+    GeckoList list;
+    std::string error;
+    assert(list.parse(std::vector<uint8_t>(text.begin(), text.end()), error));
+
+    write_image("test_gecko.iso");
+    PatchOptions opts;
+    opts.output = "test_gecko_out.iso";
+    opts.log_level = 0;
+    opts.gecko = &list;
+    PatchResult result = patch_image("test_gecko.iso", opts, payload, log);
+    assert(result.ok && result.load_addr == base);
+
+    // The list follows the BSS, and the descriptor points at it
+    GCMFile out;
+    assert(out.load("test_gecko_out.iso"));
+    DOLFile dol = out.read_dol();
+    DOLSection injected = dol.header().get_sections().back();
+    ByteView data = dol.get_section_data(injected);
+    std::vector<uint8_t> bytes(data.begin(), data.end());
+    assert(injected.load_addr == base && bytes.size() >= 0x50);
+    assert(get_be32(bytes, 4) == base + 0x40 && get_be32(bytes, 8) == 16);
+    assert(get_be32(bytes, 0x40) == 0x04001234 && get_be32(bytes, 0x48) == 0xF0000000);
+    assert(get_be32(bytes, 0x20) == 0);
+
+    // One-time writes into the game's BSS would be cleared by __start;
+    // conditional ones run every frame and are kept
+    std::filesystem::remove("test_gecko_out.iso");
+    text = "04001234 00000063\n"
+           "2000FFF0 00000000\n"
+           "04010010 00000001\n"   // Conditional
+           "E0000000 80010000\n"
+           "00000010 00030000\n"   // ba + 0x10, 4 bytes
+           "E0000000 80000000\n"
+           "0800F000 00000000\n"   // Ninth write lands at 0x80010000
+           "20080200 00000000\n"
+           "0400FFFC 00000000\n";  // Ends where the BSS starts
+    GeckoList lost;
+    assert(lost.parse(std::vector<uint8_t>(text.begin(), text.end()), error));
+    opts.gecko = &lost;
+    result = patch_image("test_gecko.iso", opts, payload, log);
+    assert(!result.ok && result.error.find("BSS") != std::string::npos);
+    assert(result.error.find("line 5 ") != std::string::npos && result.error.find("line 7 ") != std::string::npos);
+    for (const char* line : {"line 1 ", "line 3 ", "line 9 "}) {
+        assert(result.error.find(line) == std::string::npos);
+    }
+    assert(!std::filesystem::exists("test_gecko_out.iso"));
+    opts.gecko = &list;
+
+    // A payload without the engine is refused
+    payload.symbols.symbols.erase("__dolhook_gecko");
+    result = patch_image("test_gecko.iso", opts, payload, log);
+    assert(!result.ok && result.error.find("__dolhook_gecko") != std::string::npos);
+
+    std::filesystem::remove_all("test_gecko_payload");
+    std::remove("test_gecko.iso");
+    std::remove("test_gecko_out.iso");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Gecko Code Tests ===\n\n";
+
+    try {
+        test_gecko_list();
+        test_gecko_writes();
+        test_gecko_conditionals();
+        test_gecko_inserts();
+        test_gecko_errors();
+        test_gecko_patch();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,175 @@
+/**
+ * Unit tests for hashing and the patched DOL cache
+ */
+
+#include "../tools/patchiso/hash.h"
+#include "../tools/patchiso/dol_cache.h"
+#include "../tools/patchiso/verify.h"
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace dolhook;
+
+static std::string sha1_of(const std::string& s) {
+    Sha1 sha;
+    sha.update(s.data(), s.size());
+    return sha.hex_digest();
+}
+
+void test_sha1_vectors() {
+    std::cout << "Testing SHA-1 known answers... ";
+
+    assert(sha1_of("") == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    assert(sha1_of("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    assert(sha1_of("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+           "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+    // Split updates across block boundaries
+    std::string million(1000000, 'a');
+    Sha1 sha;
+    for (size_t pos = 0; pos < million.size(); pos += 777) {
+        sha.update(million.data() + pos, std::min<size_t>(777, million.size() - pos));
+    }
+    assert(sha.hex_digest() == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+    std::cout << "PASS\n";
+}
+
+void test_crc32_md5_vectors() {
+    std::cout << "Testing CRC32/MD5 known answers... ";
+
+    assert(crc32(0, "123456789", 9) == 0xCBF43926);
+    assert(crc32(0, "", 0) == 0);
+
+    // Accelerated bulk path, odd lengths/alignments and streaming must agree
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<uint8_t>(i * 131 + (i >> 7));
+    uint32_t whole = crc32(0, data.data(), data.size());
+    uint32_t streamed = 0;
+    for (size_t pos = 0; pos < data.size(); pos += 999) {
+        streamed = crc32(streamed, data.data() + pos, std::min<size_t>(999, data.size() - pos));
+    }
+    assert(streamed == whole);
+    for (size_t split : {0, 1, 63, 64, 4096, 99999}) {
+        uint32_t a = crc32(0, data.data(), split);
+        uint32_t b = crc32(0, data.data() + split, data.size() - split);
+        assert(crc32_combine(a, b, data.size() - split) == whole);
+    }
+
+    Md5 md5;
+    assert(md5.hex_digest() == "d41d8cd98f00b204e9800998ecf8427e");
+    md5.reset();
+    md5.update("abc", 3);
+    assert(md5.hex_digest() == "900150983cd24fb0d6963f7d28e17f72");
+    md5.reset();
+    std::string digits = "12345678901234567890123456789012345678901234567890123456789012345678901234567890";
+    md5.update(digits.data(), digits.size());
+    assert(md5.hex_digest() == "57edf4a22be3c955ac49da2e2107b67a");
+
+    std::cout << "PASS\n";
+}
+
+void test_hash_image_and_dat() {
+    std::cout << "Testing image hashing and DAT lookup... ";
+
+    // Several pipeline chunks plus a partial tail
+    std::vector<uint8_t> img((9 << 20) + 12345);
+    for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+
+    Md5 md5;
+    Sha1 sha1;
+    md5.update(img.data(), img.size());
+    sha1.update(img.data(), img.size());
+    uint32_t crc = crc32(0, img.data(), img.size());
+    std::string md5_hex = md5.hex_digest(), sha1_hex = sha1.hex_digest();
+
+    MemoryBlockDevice dev(img);
+    for (unsigned threads : {1u, 3u}) {
+        ImageDigest digest;
+        assert(hash_image(dev, digest, threads));
+        assert(digest.size == img.size());
+        assert(digest.crc32 == crc);
+        assert(digest.md5 == md5_hex);
+        assert(digest.sha1 == sha1_hex);
+    }
+
+    char crc_hex[9];
+    std::snprintf(crc_hex, sizeof(crc_hex), "%08X", crc);
+    std::string dat_path = "test_hash.dat";
+    {
+        std::ofstream dat(dat_path);
+        dat << "<?xml version=\"1.0\"?>\n<datafile>\n"
+            << "\t<game name=\"Test &amp; Game (USA)\">\n"
+            << "\t\t<rom name=\"test.iso\" size=\"" << img.size() << "\" crc=\"" << crc_hex
+            << "\" md5=\"" << md5_hex << "\" sha1=\"" << sha1_hex << "\"/>\n"
+            << "\t</game>\n</datafile>\n";
+    }
+
+    DumpDatabase db;
+    assert(db.load(dat_path));
+    assert(db.size() == 1);
+
+    ImageDigest digest;
+    assert(hash_image(dev, digest));
+    const DatRom* rom = db.find(digest);
+    assert(rom && rom->game == "Test & Game (USA)");
+
+    digest.sha1[0] = digest.sha1[0] == '0' ? '1' : '0';
+    assert(!db.find(digest));
+    assert(db.find_by_name("test.iso"));
+
+    std::remove(dat_path.c_str());
+    std::cout << "PASS\n";
+}
+
+void test_dol_cache_roundtrip() {
+    std::cout << "Testing DOL cache store/lookup... ";
+
+    std::string dir = "test_dol_cache";
+    std::filesystem::remove_all(dir);
+    DolCache cache(dir);
+
+    std::vector<uint8_t> original(0x400, 0x11), patched(0x600, 0x22);
+    std::string key = DolCache::key(original, "payload-a");
+    assert(key != DolCache::key(original, "payload-b"));
+
+    std::vector<uint8_t> got;
+    assert(!cache.lookup(key, got));
+    assert(cache.store(key, patched));
+    assert(cache.lookup(key, got));
+    assert(got == patched);
+
+    // A damaged entry reads as a miss
+    std::string entry = dir + "/" + key.substr(0, 2) + "/" + key + ".dol";
+    {
+        std::fstream f(entry, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(0x10);
+        f.put(0x33);
+    }
+    assert(!cache.lookup(key, got));
+
+    std::filesystem::remove_all(dir);
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Hash/Cache Tests ===\n\n";
+
+    try {
+        test_sha1_vectors();
+        test_crc32_md5_vectors();
+        test_hash_image_and_dat();
+        test_dol_cache_roundtrip();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
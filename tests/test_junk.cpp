@@ -0,0 +1,169 @@
+/**
+ * Unit tests for junk recognition and scrubbed containers
+ */
+
+#include "../tools/patchiso/junk.h"
+#include "../tools/patchiso/gcm.h"
+#include <cassert>
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+static void make_seed(uint32_t key, uint32_t seed[JunkGenerator::SEED_WORDS]) {
+    for (size_t i = 0; i < JunkGenerator::SEED_WORDS; i++) {
+        key = key * 0x5D588B65 + 1;
+        seed[i] = key;
+    }
+}
+
+// 1 MB image filled with junk, then overlaid with a DOL, an FST at 0x3000,
+// two files and a zeroed gap at 0xC0000-0xC8000
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x100000);
+    for (uint64_t block = 0; block < img.size() / JUNK_BLOCK; block++) {
+        uint32_t seed[JunkGenerator::SEED_WORDS];
+        make_seed(static_cast<uint32_t>(block) + 7, seed);
+        JunkGenerator gen;
+        gen.seed(seed);
+        gen.generate(img.data() + block * JUNK_BLOCK, JUNK_BLOCK);
+    }
+
+    std::memset(img.data(), 0, 0x2740);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    const size_t dol = 0x2440;
+    put_be32(img, dol + 0x00, 0x200);
+    put_be32(img, dol + 0x74, 0x80003100);
+    put_be32(img, dol + 0xE8, 0x100);
+    put_be32(img, dol + 0x164, 0x80003100);
+
+    // Root with a.bin at 0x8000 (0x1000 bytes) and b.bin at 0x50001 (0x2003 bytes)
+    std::vector<uint8_t> fst(3 * 12, 0);
+    fst[0] = 1;
+    put_be32(fst, 8, 3);
+    put_be32(fst, 12, 0);
+    put_be32(fst, 16, 0x8000);
+    put_be32(fst, 20, 0x1000);
+    put_be32(fst, 24, 6);
+    put_be32(fst, 28, 0x50001);
+    put_be32(fst, 32, 0x2003);
+    std::string names("a.bin\0b.bin", 12);
+    fst.insert(fst.end(), names.begin(), names.end());
+    std::memcpy(img.data() + 0x3000, fst.data(), fst.size());
+    std::memset(img.data() + 0x8000, 0x11, 0x1000);
+    std::memset(img.data() + 0x50001, 0x22, 0x2003);
+    std::memset(img.data() + 0xC0000, 0, 0x8000);
+
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x3000);
+    put_be32(img, 0x428, static_cast<uint32_t>(fst.size()));
+    put_be32(img, 0x42C, static_cast<uint32_t>(fst.size()));
+    return img;
+}
+
+void test_junk_seed_recovery() {
+    std::cout << "Testing junk seed recovery... ";
+
+    uint32_t seed[JunkGenerator::SEED_WORDS];
+    make_seed(42, seed);
+    std::vector<uint8_t> stream(JUNK_BLOCK);
+    JunkGenerator gen;
+    gen.seed(seed);
+    gen.generate(stream.data(), stream.size());
+
+    // Unaligned positions and positions deep into the stream
+    for (uint64_t position : {0ull, 3ull, 2084ull, 2084ull * 7 + 5, 0x3E001ull}) {
+        uint32_t found[JunkGenerator::SEED_WORDS];
+        assert(JunkGenerator::recover(stream.data() + position, stream.size() - position, position, found));
+
+        std::vector<uint8_t> again(stream.size() - position);
+        gen.seed(found, position);
+        gen.generate(again.data(), again.size());
+        assert(std::equal(again.begin(), again.end(), stream.begin() + position));
+    }
+
+    // Zeros and ordinary data are not junk
+    uint32_t found[JunkGenerator::SEED_WORDS];
+    std::vector<uint8_t> zeros(0x1000, 0);
+    assert(!JunkGenerator::recover(zeros.data(), zeros.size(), 0, found));
+    std::vector<uint8_t> text(0x1000);
+    for (size_t i = 0; i < text.size(); i++) text[i] = "dolhook "[i % 8];
+    assert(!JunkGenerator::recover(text.data(), text.size(), 0, found));
+
+    std::cout << "PASS\n";
+}
+
+void test_junk_scrubbed_container() {
+    std::cout << "Testing scrubbed container roundtrip... ";
+
+    auto img = make_image();
+    GCMFile iso;
+    assert(iso.load(img));
+    iso.set_scrub(true);
+    assert(iso.save("test_junk.ciso"));
+
+    // Blocks holding only junk or zeros are left out
+    assert(iso.container_stats().junk > 0xE0000);
+    assert(std::filesystem::file_size("test_junk.ciso") < 0x30000);
+
+    GCMFile scrubbed;
+    assert(scrubbed.load("test_junk.ciso"));
+    assert(scrubbed.read(0, img.size()) == img);
+
+    // Back to a raw image, bit for bit
+    assert(scrubbed.save("test_junk_out.iso"));
+    GCMFile raw;
+    assert(raw.load("test_junk_out.iso"));
+    assert(raw.read(0, img.size()) == img);
+
+    std::remove("test_junk_out.iso");
+    std::cout << "PASS\n";
+}
+
+void test_junk_patch_in_place() {
+    std::cout << "Testing patching over junk... ";
+
+    auto img = make_image();
+    GCMFile iso;
+    assert(iso.load("test_junk.ciso"));
+
+    // The patched bytes stop being junk; the rest stays recorded
+    std::vector<uint8_t> patch(0x100, 0x5A);
+    assert(iso.write(0x90010, patch));
+    assert(iso.commit_in_place());
+    assert(iso.container_stats().encoded == 1);
+    assert(iso.container_stats().junk > 0xE0000);
+
+    std::memcpy(img.data() + 0x90010, patch.data(), patch.size());
+    GCMFile reloaded;
+    assert(reloaded.load("test_junk.ciso"));
+    assert(reloaded.read(0, img.size()) == img);
+
+    std::remove("test_junk.ciso");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Junk Tests ===\n\n";
+
+    try {
+        test_junk_seed_recovery();
+        test_junk_scrubbed_container();
+        test_junk_patch_in_place();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
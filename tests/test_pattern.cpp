@@ -0,0 +1,273 @@
+/**
+ * Unit tests for runtime pattern scanning (built for the host)
+ */
+
+#include "../runtime/src/pattern.c"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+
+// Code-like words: prologue/epilogue instructions mixed with random ones
+static std::vector<uint32_t> make_text(size_t words, uint32_t seed) {
+    static const uint32_t common[] = {0x9421FFE0, 0x7C0802A6, 0x90010024, 0x93E1001C, 0x7C7F1B78,
+                                      0x80010024, 0x7C0803A6, 0x38210020, 0x4E800020, 0x60000000};
+    std::vector<uint32_t> text(words);
+    uint32_t x = seed;
+    for (auto& w : text) {
+        x = x * 1103515245 + 12345;
+        w = (x >> 28) < 5 ? common[(x >> 16) % 10] : (x ^ (x << 13));
+    }
+    return text;
+}
+
+// First word-aligned match, checked the obvious way
+static const uint32_t* reference_find(const std::vector<uint32_t>& text, const std::vector<dh_pword>& pat) {
+    for (size_t s = 0; s + pat.size() <= text.size(); s++) {
+        size_t j = 0;
+        while (j < pat.size() && ((text[s + j] ^ pat[j].value) & pat[j].mask) == 0) j++;
+        if (j == pat.size()) return &text[s];
+    }
+    return nullptr;
+}
+
+void test_pattern_compiled() {
+    std::cout << "Testing compiled patterns... ";
+
+    std::vector<uint32_t> text = make_text(0x4000, 1);
+    const size_t at = 0x3000;
+    const uint32_t planted[] = {0x9421FFD0, 0x7C0802A6, 0x90010034, 0xBF410018, 0x7C7A1B78, 0x3C608040};
+    std::memcpy(&text[at], planted, sizeof(planted));
+
+    dh_pattern p;
+    const dh_pword words[] = {
+        DH_MASKED(0x94210000, 0xFFFF0000), DH_WORD(0x7C0802A6), DH_ANY, DH_WORD(0xBF410018),
+        DH_ANY,                            DH_WORD(0x3C608040),
+    };
+    assert(dh_pattern_init(&p, words, 6) == 0);
+    assert(p.anchor == 5);  // lis beats stmw; mflr is everywhere
+    assert(dh_pattern_find(&p, text.data(), text.size() * 4) == &text[at]);
+
+    // Region boundaries: the match must fit entirely
+    assert(dh_pattern_find(&p, &text[at], 6 * 4) == &text[at]);
+    assert(dh_pattern_find(&p, &text[at], 6 * 4 - 1) == nullptr);
+    assert(dh_pattern_find(&p, &text[at + 1], 0x100) == nullptr);
+
+    // Unaligned start rounds up to the next word
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+    assert(dh_pattern_find(&p, bytes + at * 4 - 3, 6 * 4 + 3) == &text[at]);
+
+    // Byte form gives the same pattern
+    dh_pattern q;
+    char pat[24];
+    std::memcpy(pat, planted, sizeof(pat));
+    assert(dh_pattern_compile(&q, pat, "xx??xxxx????xxxx????xxxx") == 0);
+    assert(dh_pattern_find(&q, text.data(), text.size() * 4) == &text[at]);
+    assert(dh_find_pattern(text.data(), text.size() * 4, pat, "xx??xxxx????xxxx????xxxx") == &text[at]);
+
+    assert(dh_pattern_compile(&q, pat, "xxx") == -1);
+    assert(dh_pattern_compile(&q, pat, "") == -1);
+    assert(dh_pattern_init(&q, words, 0) == -1);
+    assert(dh_pattern_init(&q, words, DH_PATTERN_MAX_WORDS + 1) == -1);
+
+    std::cout << "PASS\n";
+}
+
+void test_pattern_random() {
+    std::cout << "Testing compiled patterns against a reference scan... ";
+
+    std::vector<uint32_t> text = make_text(0x2000, 7);
+    uint32_t x = 99;
+    for (int round = 0; round < 2000; round++) {
+        x = x * 1103515245 + 12345;
+        size_t n = 1 + (x >> 8) % DH_PATTERN_MAX_WORDS;
+        size_t at = (x >> 4) % (text.size() - n);
+
+        // Cut from the text, with some words wildcarded or partly masked
+        std::vector<dh_pword> pat(n);
+        for (size_t j = 0; j < n; j++) {
+            x = x * 1103515245 + 12345;
+            uint32_t mask = (x >> 29) == 0 ? 0 : (x >> 29) == 1 ? 0xFFFF0000 : 0xFFFFFFFF;
+            pat[j] = {text[at + j] & mask, mask};
+        }
+
+        dh_pattern p;
+        assert(dh_pattern_init(&p, pat.data(), static_cast<unsigned>(n)) == 0);
+        const uint32_t* expect = reference_find(text, pat);
+        assert(expect != nullptr && expect <= &text[at]);
+        assert(dh_pattern_find(&p, text.data(), text.size() * 4) == expect);
+
+        // And in a window around it that may cut it off
+        x = x * 1103515245 + 12345;
+        size_t lo = at - std::min<size_t>(at, (x >> 8) % 8);
+        size_t hi = std::min(text.size(), at + n - 2 + (x >> 16) % 12);
+        std::vector<uint32_t> window(text.begin() + lo, text.begin() + std::max(lo, hi));
+        const uint32_t* found = static_cast<const uint32_t*>(dh_pattern_find(&p, window.data(), window.size() * 4));
+        expect = reference_find(window, pat);
+        assert(found == expect);
+    }
+
+    std::cout << "PASS\n";
+}
+
+// Every word-aligned match: count and first address
+static std::pair<size_t, const uint32_t*> reference_count(const std::vector<uint32_t>& text,
+                                                          const std::vector<dh_pword>& pat) {
+    std::pair<size_t, const uint32_t*> r{0, nullptr};
+    for (size_t s = 0; s + pat.size() <= text.size(); s++) {
+        size_t j = 0;
+        while (j < pat.size() && ((text[s + j] ^ pat[j].value) & pat[j].mask) == 0) j++;
+        if (j == pat.size() && r.first++ == 0) r.second = &text[s];
+    }
+    return r;
+}
+
+void test_find_patterns() {
+    std::cout << "Testing multi-pattern scan... ";
+
+    std::vector<uint32_t> text = make_text(0x4000, 11);
+    const size_t npats = 300;
+    std::vector<std::vector<dh_pword>> words(npats);
+    std::vector<dh_pattern> compiled(npats);
+    std::vector<const dh_pattern*> pats(npats);
+
+    // Cut from the text (unique, ambiguous or, when edited, missing); some
+    // have no fully specified word at all and take the fallback scan
+    uint32_t x = 5;
+    for (size_t i = 0; i < npats; i++) {
+        x = x * 1103515245 + 12345;
+        size_t n = 1 + (x >> 8) % 8;
+        size_t at = (x >> 4) % (text.size() - n);
+        for (size_t j = 0; j < n; j++) {
+            x = x * 1103515245 + 12345;
+            uint32_t mask = (x >> 29) == 0 ? 0 : (x >> 29) == 1 || i % 10 == 0 ? 0xFFFF0000 : 0xFFFFFFFF;
+            words[i].push_back({text[at + j] & mask, mask});
+        }
+        if (i % 7 == 0 && words[i].back().mask) words[i].back().value ^= 0x00010000;
+        assert(dh_pattern_init(&compiled[i], words[i].data(), static_cast<unsigned>(n)) == 0);
+        pats[i] = &compiled[i];
+    }
+
+    std::vector<dh_match> found(npats);
+    int unique = dh_find_patterns(pats.data(), npats, text.data(), text.size() * 4, found.data());
+
+    int expect_unique = 0;
+    size_t missing = 0, ambiguous = 0;
+    for (size_t i = 0; i < npats; i++) {
+        auto [count, addr] = reference_count(text, words[i]);
+        assert(found[i].count == count);
+        assert(found[i].addr == addr);
+        expect_unique += count == 1;
+        missing += count == 0;
+        ambiguous += count > 1;
+    }
+    assert(unique == expect_unique);
+    assert(unique > 0 && missing > 0 && ambiguous > 0);
+
+    // Matches must fit in the region; an unaligned start rounds up
+    dh_pattern p;
+    const dh_pword two[] = {DH_WORD(text[0x100]), DH_WORD(text[0x101])};
+    assert(dh_pattern_init(&p, two, 2) == 0);
+    const dh_pattern* one[] = {&p};
+    dh_match m;
+    assert(dh_find_patterns(one, 1, &text[0x100], 8, &m) == 1 && m.addr == &text[0x100]);
+    assert(dh_find_patterns(one, 1, &text[0x100], 7, &m) == 0 && m.count == 0 && m.addr == nullptr);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+    assert(dh_find_patterns(one, 1, bytes + 0x100 * 4 - 1, 9, &m) == 1 && m.addr == &text[0x100]);
+    assert(dh_find_patterns(one, 1, bytes + 0x100 * 4 + 1, 100, &m) == 0);
+    assert(dh_find_patterns(one, 0, text.data(), 100, &m) == 0);
+    assert(dh_find_patterns(pats.data(), DH_FIND_PATTERNS_MAX + 1, text.data(), 100, found.data()) == -1);
+
+    std::cout << "PASS\n";
+}
+
+void test_pattern_speed() {
+    std::cout << "Testing compiled scan speed... ";
+
+    // 1 MB of code with an 8-word prologue near the end
+    std::vector<uint32_t> text = make_text(0x40000, 3);
+    const uint32_t planted[] = {0x9421FFC0, 0x7C0802A6, 0x90010044, 0xBF61002C,
+                                0x7C9B2378, 0x7C7A1B78, 0x3BA00000, 0x48012345};
+    std::memcpy(&text[text.size() - 0x100], planted, sizeof(planted));
+
+    char pat[32];
+    std::memcpy(pat, planted, sizeof(pat));
+    const char* mask = "xx??xxxxxx??xx??xxxxxxxxxxxxx???";
+    dh_pattern p;
+    assert(dh_pattern_compile(&p, pat, mask) == 0);
+
+    // Read through a volatile so each round really scans
+    const void* volatile region = text.data();
+    auto time = [](auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 20; i++) assert(fn() != nullptr);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 20;
+    };
+    double bytes = time([&] { return dh_find_pattern(region, text.size() * 4, pat, mask); });
+    double words = time([&] { return dh_pattern_find(&p, region, text.size() * 4); });
+
+    std::cout << std::fixed << std::setprecision(2) << bytes << " ms -> " << words << " ms ("
+              << std::setprecision(1) << bytes / words << "x) PASS\n";
+}
+
+void test_find_patterns_speed() {
+    std::cout << "Testing multi-pattern scan speed... ";
+
+    // 128 distinct 6-word signatures planted in 1 MB of code
+    std::vector<uint32_t> text = make_text(0x40000, 9);
+    const size_t npats = 128;
+    std::vector<dh_pattern> compiled(npats);
+    std::vector<const dh_pattern*> pats(npats);
+    for (size_t i = 0; i < npats; i++) {
+        size_t at = 0x100 + i * (text.size() - 0x200) / npats;
+        const dh_pword words[] = {
+            DH_MASKED(0x94210000, 0xFFFF0000), DH_WORD(0x7C0802A6), DH_ANY,
+            DH_WORD(0x3C608000 + i),           DH_ANY,              DH_WORD(0x48000001 + i * 4),
+        };
+        text[at] = 0x9421FFE0;
+        text[at + 1] = 0x7C0802A6;
+        text[at + 3] = 0x3C608000 + static_cast<uint32_t>(i);
+        text[at + 5] = 0x48000001 + static_cast<uint32_t>(i) * 4;
+        assert(dh_pattern_init(&compiled[i], words, 6) == 0);
+        pats[i] = &compiled[i];
+    }
+
+    const void* volatile region = text.data();
+    auto time = [](auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 5; i++) fn();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 5;
+    };
+    double single = time([&] { assert(dh_pattern_find(pats[npats - 1], region, text.size() * 4)); });
+    double separate = time([&] {
+        for (const dh_pattern* p : pats) assert(dh_pattern_find(p, region, text.size() * 4));
+    });
+    std::vector<dh_match> found(npats);
+    double together = time([&] {
+        assert(dh_find_patterns(pats.data(), npats, region, text.size() * 4, found.data()) == npats);
+    });
+
+    std::cout << std::fixed << std::setprecision(2) << "one " << single << " ms, " << npats
+              << " separately " << separate << " ms, " << npats << " together " << together << " ms PASS\n";
+}
+
+int main() {
+    std::cout << "=== Pattern Tests ===\n\n";
+
+    try {
+        test_pattern_compiled();
+        test_pattern_random();
+        test_find_patterns();
+        test_pattern_speed();
+        test_find_patterns_speed();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * Unit tests for pipelined image streaming
+ */
+
+#include "../tools/patchiso/pipeline.h"
+#include "../tools/patchiso/hash.h"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace dolhook;
+
+// Patterned data with zero runs, some block aligned and some not
+static std::vector<uint8_t> make_image(size_t size) {
+    std::vector<uint8_t> img(size);
+    uint32_t x = 0x12345678;
+    for (auto& b : img) {
+        x = x * 1103515245 + 12345;
+        b = static_cast<uint8_t>(x >> 24);
+    }
+    std::memset(img.data() + 0x3000, 0, 0x5000);
+    std::memset(img.data() + 0x10123, 0, 0x2345);
+    std::memset(img.data() + size - 0x6000, 0, 0x6000);
+    return img;
+}
+
+static std::vector<uint8_t> read_file(const char* path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+static bool stream_to(const char* path, const std::vector<uint8_t>& img, const StreamOptions& opts,
+                      StreamStats& stats) {
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    auto reader = [&](uint64_t offset, void* out, size_t len) {
+        std::memcpy(out, img.data() + offset, len);
+        return true;
+    };
+    bool ok = stream_image(fd, img.size(), reader, opts, &stats) && finish_sparse(fd, img.size());
+    ::close(fd);
+    return ok;
+}
+
+void test_pipeline_writers() {
+    std::cout << "Testing streaming through both writers... ";
+
+    auto img = make_image(0x2F001);
+    for (bool uring : {true, false}) {
+        StreamOptions opts;
+        opts.chunk = 0x4000;
+        opts.depth = 3;
+        opts.readers = 2;
+        opts.uring = uring;
+
+        StreamStats stats;
+        assert(stream_to("test_pipeline.iso", img, opts, stats));
+        assert(read_file("test_pipeline.iso") == img);
+        assert(stats.bytes == img.size());
+        assert(stats.crc32 == crc32(0, img.data(), img.size()));
+        if (!uring) assert(std::strcmp(stats.writer, "thread") == 0);
+    }
+
+    std::remove("test_pipeline.iso");
+    std::cout << "PASS\n";
+}
+
+void test_pipeline_read_error() {
+    std::cout << "Testing streaming read failure... ";
+
+    std::vector<uint8_t> img(0x40000, 0x77);
+    StreamOptions opts;
+    opts.chunk = 0x1000;
+    opts.depth = 4;
+
+    int fd = ::open("test_pipeline_err.iso", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    auto reader = [&](uint64_t offset, void* out, size_t len) {
+        std::memcpy(out, img.data() + offset, len);
+        return offset != 0x20000;
+    };
+    assert(!stream_image(fd, img.size(), reader, opts));
+    ::close(fd);
+
+    std::remove("test_pipeline_err.iso");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Pipeline Tests ===\n\n";
+
+    try {
+        test_pipeline_writers();
+        test_pipeline_read_error();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
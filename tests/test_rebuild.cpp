@@ -0,0 +1,204 @@
+/**
+ * Unit tests for free-space allocation and disc rebuilds
+ */
+
+#include "../tools/patchiso/rebuild.h"
+#include "../tools/patchiso/gcm.h"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+struct TestFile {
+    const char* name;
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Root files only; see make_image() for the resulting gaps
+static const TestFile FILES[] = {
+    {"near.bin", 0x2800, 0x100},
+    {"a.bin", 0x4000, 0x100},
+    {"b.bin", 0x4200, 0x100},
+    {"c.bin", 0x6000, 0x100},
+    {"d.bin", 0x6400, 0x100},
+};
+static const size_t FILE_COUNT = sizeof(FILES) / sizeof(FILES[0]);
+
+// 64 KB image: DOL 0x2440-0x2740, FST at 0x3000. Free gaps: 0x2740-0x2800,
+// 0x2900-0x3000, 0x306E-0x4000, 0x4100-0x4200, 0x4300-0x6000,
+// 0x6100-0x6400, 0x6500 onwards.
+static std::vector<uint8_t> make_image() {
+    std::vector<uint8_t> img(0x10000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+
+    const size_t dol = 0x2440;
+    put_be32(img, dol + 0x00, 0x200);
+    put_be32(img, dol + 0x74, 0x80003100);
+    put_be32(img, dol + 0xE8, 0x100);
+    put_be32(img, dol + 0x164, 0x80003100);
+
+    std::vector<uint8_t> fst((1 + FILE_COUNT) * 12, 0);
+    std::string strings;
+    fst[0] = 1;
+    put_be32(fst, 8, 1 + FILE_COUNT);
+    for (size_t i = 0; i < FILE_COUNT; i++) {
+        put_be32(fst, (i + 1) * 12, static_cast<uint32_t>(strings.size()));
+        put_be32(fst, (i + 1) * 12 + 4, FILES[i].offset);
+        put_be32(fst, (i + 1) * 12 + 8, FILES[i].size);
+        strings += FILES[i].name;
+        strings += '\0';
+        std::memset(img.data() + FILES[i].offset, 0x10 + static_cast<int>(i), FILES[i].size);
+    }
+    fst.insert(fst.end(), strings.begin(), strings.end());
+    std::memcpy(img.data() + 0x3000, fst.data(), fst.size());
+
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x3000);
+    put_be32(img, 0x428, static_cast<uint32_t>(fst.size()));
+    put_be32(img, 0x42C, static_cast<uint32_t>(fst.size()));
+    return img;
+}
+
+void test_free_space_map() {
+    std::cout << "Testing free space best-fit... ";
+
+    FreeSpaceMap space(0x10000);
+    space.reserve(0x0000, 0x1000);
+    space.reserve(0x1100, 0x0F00);  // Gap 0x1000-0x1100
+    space.reserve(0x2400, 0x0C00);  // Gap 0x2000-0x2400
+    space.reserve(0x3080, 0xCF80);  // Gap 0x3000-0x3080
+    assert(space.free_bytes(0x10000) == 0x100 + 0x400 + 0x80);
+
+    uint64_t off = 0;
+    assert(space.allocate(0x80, 32, off) && off == 0x3000);   // Exact fit
+    assert(space.allocate(0xF0, 32, off) && off == 0x1000);   // Smallest that fits
+    assert(space.allocate(0x100, 32, off) && off == 0x2000);
+    assert(!space.allocate(0x400, 32, off));
+
+    // Release coalesces neighbours; take() claims an exact range
+    space.release(0x1000, 0xF0);
+    space.release(0x10F0, 0x10);
+    assert(space.extents().count(0x1000) && space.extents().at(0x1000) == 0x100);
+    assert(!space.take(0x1080, 0x100));
+    assert(space.take(0x1080, 0x80));
+    assert(space.extents().at(0x1000) == 0x80);
+
+    std::cout << "PASS\n";
+}
+
+void test_rebuild_replace_and_add() {
+    std::cout << "Testing rebuild replace/add... ";
+
+    auto img = make_image();
+    GCMFile iso;
+    assert(iso.load(img));
+
+    DiscRebuilder rb(iso);
+    std::string err;
+    assert(rb.init(err));
+
+    // Grows into the free space right behind it
+    std::vector<uint8_t> a(0x180, 0xAA);
+    assert(rb.replace_file("a.bin", a, err));
+
+    // Its old slot plus the following gap is enough
+    std::vector<uint8_t> c(0x280, 0xCC);
+    assert(rb.replace_file("/C.BIN", c, err));
+
+    // Too big for any nearby space: best fit is the gap after the FST
+    std::vector<uint8_t> near(0x900, 0xEE);
+    assert(rb.replace_file("near.bin", near, err));
+
+    // Smallest gap that fits is what c.bin left behind
+    std::vector<uint8_t> added(0xB0, 0x55);
+    assert(rb.add_file("mods/extra.bin", added, err));
+    assert(!rb.add_file("mods/extra.bin", added, err));
+    assert(!rb.replace_file("missing.bin", added, err));
+
+    assert(rb.commit(err));
+    assert(iso.size() == 0x10000);
+
+    FstIndex fst;
+    assert(fst.load(iso));
+    assert(fst.entry(fst.find("a.bin")).offset == 0x4000);
+    assert(fst.entry(fst.find("c.bin")).offset == 0x6000);
+    assert(fst.entry(fst.find("near.bin")).offset == 0x3080);
+    assert(fst.entry(fst.find("mods/extra.bin")).offset == 0x6280);
+    assert(fst.entry(fst.find("mods/extra.bin")).size == 0xB0);
+    assert(fst.entry(fst.find("b.bin")).offset == 0x4200);
+    assert(fst.entry(fst.find("mods")).is_dir);
+
+    // The grown FST no longer fits before near.bin; next best gap follows extra.bin
+    assert(iso.header().fst_offset == 0x6340);
+    assert(iso.header().fst_size == 0x90);
+
+    auto got = iso.read(0x3080, 0x900);
+    assert(got == near);
+    got = iso.read(0x4200, 0x100);
+    assert(got == std::vector<uint8_t>(0x100, 0x12));
+
+    std::cout << "PASS\n";
+}
+
+void test_relocate_dol_into_gap() {
+    std::cout << "Testing DOL relocation into a gap... ";
+
+    std::string path = "test_rebuild.iso";
+    {
+        auto img = make_image();
+        std::ofstream f(path, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(img.data()), img.size());
+    }
+
+    GCMFile iso;
+    assert(iso.load(path));
+
+    // 0x500 bytes: no longer fits before near.bin, best gap is 0x2900
+    DOLFile dol = iso.read_dol();
+    auto raw = dol.save();
+    raw.resize(0x500, 0x77);
+    put_be32(raw, 0xE8, 0x300);
+    assert(dol.load(raw));
+
+    assert(!iso.write_dol(dol));
+    assert(iso.relocate_dol(dol));
+    assert(iso.header().dol_offset == 0x2900);
+    assert(iso.size() == 0x10000);
+    assert(iso.save(path));
+
+    GCMFile reloaded;
+    assert(reloaded.load(path));
+    assert(reloaded.size() == 0x10000);
+    assert(reloaded.dol_size() == 0x500);
+    assert(reloaded.read(0x2800, 0x100) == std::vector<uint8_t>(0x100, 0x10));
+
+    std::remove(path.c_str());
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Rebuild Tests ===\n\n";
+
+    try {
+        test_free_space_map();
+        test_rebuild_replace_and_add();
+        test_relocate_dol_into_gap();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
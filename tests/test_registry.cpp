@@ -0,0 +1,359 @@
+/**
+ * Unit tests for the hook registry (built for the host, with game RAM
+ * mapped into a buffer and code allocation, relocation and writes stubbed)
+ */
+
+#include <cstdint>
+
+alignas(32) static uint8_t g_ram[0x10000];  // 0x80000000..0x8000FFFF
+alignas(32) static uint8_t g_far[0x100];    // 0x90000000, out of b range
+
+static uint32_t host_addr(const volatile void* p) {
+    const volatile uint8_t* b = static_cast<const volatile uint8_t*>(p);
+    if (b >= g_far && b < g_far + sizeof(g_far)) return 0x90000000u + static_cast<uint32_t>(b - g_far);
+    return 0x80000000u + static_cast<uint32_t>(b - g_ram);
+}
+
+#define HOOK_ADDR(p) host_addr(p)
+
+#include "../runtime/src/registry.c"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+static const uint32_t TARGETS = 0x80001000;
+static const uint32_t REPLACEMENTS = 0x8000C000;
+static const uint32_t CODE = 0x80008000;
+
+static int g_batch = 0;
+static int g_no_near = 0;
+static int g_unsafe = 0;
+static uint32_t g_next_code = CODE;
+static int g_trampolines = 0;
+static std::vector<std::pair<uint32_t, uint32_t>> g_writes;  // Live or staged, in order
+static std::vector<std::pair<uint32_t, uint32_t>> g_staged;
+static std::vector<uint32_t> g_freed;
+static std::vector<uint32_t> g_deferred;
+
+static void* ptr(uint32_t addr) {
+    return addr >= 0x90000000u ? static_cast<void*>(g_far + (addr - 0x90000000u))
+                               : static_cast<void*>(g_ram + (addr - 0x80000000u));
+}
+
+static uint32_t& ram32(uint32_t addr) {
+    return *static_cast<uint32_t*>(ptr(addr));
+}
+
+static void store(uint32_t addr, uint32_t v) {
+    g_writes.push_back({addr, v});
+    if (g_batch) {
+        g_staged.push_back({addr, v});
+    } else {
+        ram32(addr) = v;
+    }
+}
+
+extern "C" {
+void* dh_code_alloc(uint32_t size, const void* near) {
+    if (near && g_no_near) return nullptr;
+    void* p = ptr(g_next_code);
+    g_next_code += (size + 15) & ~15u;
+    return p;
+}
+int dh_code_free(void* p) {
+    g_freed.push_back(host_addr(p));
+    return 0;
+}
+void* dh_make_trampoline(void* target, uint32_t) {
+    g_trampolines++;
+    void* t = dh_code_alloc(32, target);
+    return t ? t : dh_code_alloc(32, nullptr);
+}
+int dh_check_stolen(const uint32_t*, uint32_t, uint32_t) {
+    return g_unsafe ? -2 : 0;
+}
+int dh_relocate(uint32_t*, uint32_t, uint32_t, const uint32_t*, uint32_t, uint32_t count) {
+    return static_cast<int>(count);
+}
+uint32_t dh_make_branch_imm(uint32_t from, uint32_t to, int link) {
+    int32_t offset = static_cast<int32_t>(to - from);
+    if (offset < -0x2000000 || offset > 0x1FFFFFF) return 0;
+    return 0x48000000 | (offset & 0x03FFFFFC) | (link ? 1 : 0);
+}
+void dh_write32(volatile void* p, uint32_t v) {
+    store(host_addr(p), v);
+}
+void dh_write_branch_abs(void* at, void* to, int) {
+    uint32_t addr = host_addr(at);
+    uint32_t dest = host_addr(to);
+    store(addr, 0x3D800000 | (dest >> 16));
+    store(addr + 4, 0x618C0000 | (dest & 0xFFFF));
+    store(addr + 8, 0x7D8903A6);
+    store(addr + 12, 0x4E800420);
+}
+int dh_batch_active(void) {
+    return g_batch;
+}
+void dh_batch_stage_words(volatile void* p, const uint32_t* words, unsigned count) {
+    for (unsigned i = 0; i < count; i++) store(host_addr(p) + i * 4, words[i]);
+}
+void dh_batch_free_code(void* block) {
+    g_deferred.push_back(host_addr(block));
+}
+uint32_t dh_suspend_interrupts(void) {
+    return 0;
+}
+void dh_restore_interrupts(uint32_t) {}
+void dh_icache_sync_range(void*, unsigned) {}
+}
+
+static void reset() {
+    std::memset(g_ram, 0, sizeof(g_ram));
+    for (uint32_t a = TARGETS; a < CODE; a += 4) ram32(a) = 0x60000000;  // nop
+    g_site_count = 0;
+    g_batch = 0;
+    g_no_near = 0;
+    g_unsafe = 0;
+    g_next_code = CODE;
+    g_trampolines = 0;
+    g_writes.clear();
+    g_staged.clear();
+    g_freed.clear();
+    g_deferred.clear();
+}
+
+static void commit() {
+    for (const auto& w : g_staged) ram32(w.first) = w.second;
+    g_freed.insert(g_freed.end(), g_deferred.begin(), g_deferred.end());
+    g_staged.clear();
+    g_deferred.clear();
+    g_batch = 0;
+}
+
+// Where the instruction(s) at addr jump: b, or lis/ori/mtctr/bctr
+static uint32_t jump(uint32_t addr) {
+    uint32_t w = ram32(addr);
+    if ((w >> 26) == 18) {
+        int32_t offset = static_cast<int32_t>(w << 6) >> 6;
+        return addr + static_cast<uint32_t>(offset & ~3);
+    }
+    assert((w & 0xFFFF0000) == 0x3D800000);
+    return (w & 0xFFFF) << 16 | (ram32(addr + 4) & 0xFFFF);
+}
+
+// What a call to target runs first
+static uint32_t entered(uint32_t target) {
+    return jump(jump(target));
+}
+
+static size_t writes_to(uint32_t addr) {
+    return static_cast<size_t>(std::count_if(g_writes.begin(), g_writes.end(),
+                                             [&](const std::pair<uint32_t, uint32_t>& w) { return w.first == addr; }));
+}
+
+static dh_hook make_hook(uint32_t target, uint32_t replacement, int32_t priority) {
+    dh_hook h;
+    std::memset(&h, 0, sizeof(h));
+    h.target = ptr(target);
+    h.replacement = ptr(replacement);
+    h.priority = priority;
+    return h;
+}
+
+void test_registry_chain() {
+    std::cout << "Testing hooks chained on one target... ";
+    reset();
+
+    const uint32_t target = TARGETS;
+    ram32(target) = 0x9421FFE0;  // stwu r1,-32(r1)
+    dh_hook a = make_hook(target, REPLACEMENTS, 0);
+    dh_hook b = make_hook(target, REPLACEMENTS + 0x10, 10);
+    dh_hook c = make_hook(target, REPLACEMENTS + 0x20, 0);
+
+    const uint32_t prologue = ram32(target);
+    assert(dh_hook_install(&a) == 0);
+    assert(a.patch_len == 4 && std::memcmp(a.saved, &prologue, 4) == 0);
+    assert(entered(target) == REPLACEMENTS);
+    uint32_t original = host_addr(a.trampoline);
+
+    // b outranks a; c ties with a and goes after it
+    assert(dh_hook_install(&b) == 0);
+    assert(dh_hook_install(&c) == 0);
+    assert(dh_hook_install(&b) == -1);
+    assert(entered(target) == REPLACEMENTS + 0x10);
+    assert(host_addr(b.trampoline) == REPLACEMENTS);
+    assert(host_addr(a.trampoline) == REPLACEMENTS + 0x20);
+    assert(host_addr(c.trampoline) == original);
+    assert(dh_hook_chain(ptr(target)) == &b && b.next == &a && a.next == &c && !c.next);
+
+    // One stolen prologue and one patch at the target for all three; the
+    // later hooks see the original bytes, not the first hook's branch
+    assert(g_trampolines == 1);
+    assert(writes_to(target) == 1);
+    assert(std::memcmp(c.saved, a.saved, 16) == 0 && c.patch_len == 4);
+
+    std::cout << "PASS\n";
+}
+
+void test_registry_remove() {
+    std::cout << "Testing removing one hook of a chain... ";
+    reset();
+
+    const uint32_t target = TARGETS + 0x40;
+    ram32(target) = 0x7C0802A6;  // mflr r0
+    dh_hook hooks[3] = {make_hook(target, REPLACEMENTS, 3), make_hook(target, REPLACEMENTS + 0x10, 2),
+                        make_hook(target, REPLACEMENTS + 0x20, 1)};
+    for (dh_hook& h : hooks) assert(dh_hook_install(&h) == 0);
+    uint32_t stub = jump(target);
+    uint32_t original = host_addr(hooks[2].trampoline);
+    size_t target_writes = writes_to(target);
+
+    // Middle: its neighbours are joined, nothing is written to code
+    size_t before = g_writes.size();
+    assert(dh_hook_remove(&hooks[1]) == 0);
+    assert(g_writes.size() == before && !hooks[1].trampoline);
+    assert(host_addr(hooks[0].trampoline) == REPLACEMENTS + 0x20 && hooks[0].next == &hooks[2]);
+    assert(dh_hook_remove(&hooks[1]) == -1);
+
+    // First: the stub moves on to the next hook
+    assert(dh_hook_remove(&hooks[0]) == 0);
+    assert(entered(target) == REPLACEMENTS + 0x20 && jump(target) == stub);
+    assert(host_addr(hooks[2].trampoline) == original);
+    assert(writes_to(target) == target_writes);
+
+    // Re-adding one in the middle of the priorities
+    assert(dh_hook_install(&hooks[1]) == 0);
+    assert(entered(target) == REPLACEMENTS + 0x10 && host_addr(hooks[1].trampoline) == REPLACEMENTS + 0x20);
+
+    // Last: original bytes back, stub and trampoline freed
+    assert(dh_hook_remove(&hooks[1]) == 0);
+    assert(dh_hook_remove(&hooks[2]) == 0);
+    assert(ram32(target) == 0x7C0802A6);
+    assert(g_freed.size() == 2 && g_freed[0] == stub && g_freed[1] == original);
+    assert(!dh_hook_chain(ptr(target)) && g_site_count == 0);
+
+    std::cout << "PASS\n";
+}
+
+void test_registry_lookup() {
+    std::cout << "Testing registry lookup... ";
+    reset();
+
+    // Installed out of order, kept sorted by target
+    std::vector<dh_hook> hooks;
+    for (uint32_t i = 0; i < 64; i++) {
+        uint32_t slot = (i * 37) % 64;
+        hooks.push_back(make_hook(TARGETS + slot * 0x40, REPLACEMENTS + slot * 0x10, 0));
+    }
+    for (dh_hook& h : hooks) assert(dh_hook_install(&h) == 0);
+    assert(g_site_count == 64);
+    for (unsigned i = 1; i < g_site_count; i++) assert(g_sites[i - 1].target < g_sites[i].target);
+
+    for (const dh_hook& h : hooks) {
+        assert(dh_hook_chain(h.target) == &h);
+        assert(entered(host_addr(h.target)) == host_addr(h.replacement));
+    }
+    assert(!dh_hook_chain(ptr(TARGETS + 4)));
+    assert(!dh_hook_chain(ptr(TARGETS - 0x40)));
+
+    for (size_t i = 0; i < hooks.size(); i += 2) assert(dh_hook_remove(&hooks[i]) == 0);
+    assert(g_site_count == 32);
+    for (size_t i = 0; i < hooks.size(); i++) {
+        assert(dh_hook_chain(hooks[i].target) == (i % 2 ? &hooks[i] : nullptr));
+    }
+
+    std::cout << "PASS\n";
+}
+
+void test_registry_batch() {
+    std::cout << "Testing hooks in a batch... ";
+    reset();
+
+    const uint32_t target = TARGETS + 0x80;
+    ram32(target) = 0x9421FFF0;
+    dh_hook a = make_hook(target, REPLACEMENTS, 0);
+    dh_hook b = make_hook(target, REPLACEMENTS + 0x10, 1);
+
+    // Both queued; the second doesn't read the still unpatched target
+    g_batch = 1;
+    assert(dh_hook_install(&a) == 0);
+    assert(dh_hook_install(&b) == 0);
+    assert(ram32(target) == 0x9421FFF0 && g_trampolines == 1);
+    commit();
+    assert(entered(target) == REPLACEMENTS + 0x10);
+
+    // Removing the last hook queues the restore and defers the frees; h
+    // keeps calling on until then, and the target can't be hooked again
+    g_batch = 1;
+    assert(dh_hook_remove(&b) == 0);
+    assert(dh_hook_remove(&a) == 0);
+    assert(a.trampoline && g_freed.empty() && g_deferred.size() == 2);
+    assert(!dh_hook_chain(ptr(target)) && g_site_count == 1);
+    assert(dh_hook_install(&a) == -1);
+    commit();
+    assert(ram32(target) == 0x9421FFF0 && g_freed.size() == 2);
+
+    // After the commit it can
+    assert(dh_hook_install(&a) == 0);
+    assert(g_site_count == 1 && g_trampolines == 2 && entered(target) == REPLACEMENTS);
+
+    std::cout << "PASS\n";
+}
+
+void test_registry_far() {
+    std::cout << "Testing far stubs and failures... ";
+    reset();
+
+    // No code space near the target: 16-byte absolute patch to the stub
+    const uint32_t target = TARGETS;
+    g_no_near = 1;
+    dh_hook a = make_hook(target, REPLACEMENTS, 0);
+    assert(dh_hook_install(&a) == 0);
+    assert(a.patch_len == 16 && ram32(target + 12) == 0x4E800420);
+    assert(entered(target) == REPLACEMENTS);
+    g_no_near = 0;
+
+    // A replacement out of the stub's reach gets the absolute jump too
+    dh_hook far = make_hook(target, 0x90000000u, 5);
+    assert(dh_hook_install(&far) == 0);
+    assert(entered(target) == 0x90000000u && host_addr(far.trampoline) == REPLACEMENTS);
+    assert(dh_hook_remove(&far) == 0 && entered(target) == REPLACEMENTS);
+
+    // Unsafe prologue: refused, stub returned
+    g_unsafe = 1;
+    dh_hook bad = make_hook(TARGETS + 0x40, REPLACEMENTS, 0);
+    assert(dh_hook_install(&bad) == -2);
+    assert(g_freed.size() == 1 && g_site_count == 1);
+    g_unsafe = 0;
+
+    // Full table
+    for (unsigned i = 1; i < DH_HOOK_MAX_SITES; i++) {
+        g_sites[i] = g_sites[0];
+        g_sites[i].target = 0x80100000u + i * 4;
+    }
+    g_site_count = DH_HOOK_MAX_SITES;
+    assert(dh_hook_install(&bad) == -1);
+
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Hook Registry Tests ===\n\n";
+
+    try {
+        test_registry_chain();
+        test_registry_remove();
+        test_registry_lookup();
+        test_registry_batch();
+        test_registry_far();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,162 @@
+/**
+ * Unit tests for stolen instruction relocation (built for the host)
+ */
+
+#include "../runtime/src/relocate.c"
+#include <cassert>
+#include <iostream>
+
+static const uint32_t SRC = 0x80010000;
+
+// Where a relative branch at pc goes
+static uint32_t dest_of(uint32_t insn, uint32_t pc) {
+    return pc + static_cast<uint32_t>(branch_offset(insn));
+}
+
+// Where lis/ori at p[0..1] point
+static uint32_t abs_of(const uint32_t* p) {
+    assert((p[0] & 0xFFFF0000) == 0x3D800000 && (p[1] & 0xFFFF0000) == 0x618C0000);
+    assert(p[2] == 0x7D8903A6);
+    return (p[0] << 16) | (p[1] & 0xFFFF);
+}
+
+static uint32_t b(uint32_t from, uint32_t to, uint32_t lk = 0) {
+    return encode_b(from, to, lk);
+}
+
+static uint32_t bc(uint32_t bo, uint32_t bi, uint32_t from, uint32_t to, uint32_t lk = 0) {
+    return (OP_BC << 26) | (bo << 21) | (bi << 16) | ((to - from) & 0xFFFC) | lk;
+}
+
+void test_relocate_branches() {
+    std::cout << "Testing branch relocation... ";
+
+    uint32_t out[64];
+    const uint32_t near = SRC + 0x100000;  // Trampoline 1 MB away
+    const uint32_t far = SRC + 0x4000000;  // 64 MB away
+
+    // Plain instructions are copied as they are
+    const uint32_t plain[] = {0x9421FFE0, 0x7C0802A6, 0x90010024, 0x4E800020};
+    assert(dh_relocate(out, near, 64, plain, SRC, 4) == 4);
+    for (int i = 0; i < 4; i++) assert(out[i] == plain[i]);
+
+    // b/bl re-aimed, or made absolute when out of reach
+    const uint32_t calls[] = {b(SRC, 0x80300000, 1), b(SRC + 4, 0x80300040)};
+    assert(dh_relocate(out, near, 64, calls, SRC, 2) == 2);
+    assert(out[0] & 1 && dest_of(out[0], near) == 0x80300000);
+    assert(!(out[1] & 1) && dest_of(out[1], near + 4) == 0x80300040);
+
+    assert(dh_relocate(nullptr, far, 0, calls, SRC, 2) == 8);
+    assert(dh_relocate(out, far, 64, calls, SRC, 2) == 8);
+    assert(abs_of(out) == 0x80300000 && out[3] == 0x4E800421);
+    assert(abs_of(out + 4) == 0x80300040 && out[7] == 0x4E800420);
+
+    // Absolute branches go anywhere already
+    const uint32_t ba[] = {0x48000102};
+    assert(dh_relocate(out, far, 64, ba, SRC, 1) == 1 && out[0] == ba[0]);
+
+    // bc within ±32KB is re-aimed; beyond that it gets an island
+    const uint32_t cond[] = {bc(12, 2, SRC, SRC + 0x40), 0x60000000};
+    assert(dh_relocate(out, SRC + 0x1000, 64, cond, SRC, 2) == 2);
+    assert(dest_of(out[0], SRC + 0x1000) == SRC + 0x40 && (out[0] & 0xFFFF0003) == (cond[0] & 0xFFFF0003));
+
+    assert(dh_relocate(out, near, 64, cond, SRC, 2) == 4);
+    assert((out[0] & 0xFFFF0003) == (cond[0] & 0xFFFF0003) && dest_of(out[0], near) == near + 8);
+    assert(dest_of(out[1], near + 4) == near + 12);
+    assert(dest_of(out[2], near + 8) == SRC + 0x40);
+    assert(out[3] == 0x60000000);
+
+    // bcl: the link lands on the b that skips the island
+    const uint32_t condcall[] = {bc(12, 2, SRC, SRC + 0x40, 1)};
+    assert(dh_relocate(out, near, 64, condcall, SRC, 1) == 3);
+    assert((out[0] & 1) && dest_of(out[0], near) == near + 8 && dest_of(out[1], near + 4) == near + 12);
+    assert(!(out[2] & 1));
+
+    // Out of b range: absolute island, unless it would clobber a counted CTR
+    assert(dh_relocate(out, far, 64, cond, SRC, 2) == 7);
+    assert(dest_of(out[1], far + 4) == far + 24 && abs_of(out + 2) == SRC + 0x40 && out[5] == 0x4E800420);
+    const uint32_t bdnz[] = {bc(16, 0, SRC, SRC + 0x40)};
+    assert(dh_relocate(out, near, 64, bdnz, SRC, 1) == 3);
+    assert(dh_relocate(out, far, 64, bdnz, SRC, 1) == -2);
+
+    std::cout << "PASS\n";
+}
+
+void test_relocate_internal() {
+    std::cout << "Testing branches between stolen instructions... ";
+
+    uint32_t out[64];
+    const uint32_t far = SRC + 0x4000000;
+
+    // The first instruction grows to 4 words; the loop back still finds it
+    // and the forward bc lands on the moved third instruction
+    const uint32_t code[] = {b(SRC, 0x80300000, 1), bc(4, 2, SRC + 4, SRC + 12), bc(16, 0, SRC + 8, SRC), 0x60000000};
+    assert(dh_relocate(out, far, 64, code, SRC, 4) == 7);
+    assert(dest_of(out[4], far + 16) == far + 24);
+    assert(dest_of(out[5], far + 20) == far);
+    assert(out[6] == 0x60000000);
+
+    // Reading the PC can't be moved
+    const uint32_t getpc[] = {bc(20, 31, SRC, SRC + 4, 1), 0x7C6802A6};
+    assert(dh_relocate(out, far, 64, getpc, SRC, 2) == -2);
+    const uint32_t getpc2[] = {b(SRC, SRC + 4, 1)};
+    assert(dh_relocate(out, far, 64, getpc2, SRC, 1) == -2);
+
+    // Room is checked before anything is written
+    out[0] = 0xDEADBEEF;
+    assert(dh_relocate(out, far, 6, code, SRC, 4) == -1 && out[0] == 0xDEADBEEF);
+    assert(dh_relocate(out, far, 64, code, SRC, DH_RELOC_MAX_INSNS + 1) == -2);
+
+    std::cout << "PASS\n";
+}
+
+void test_check_stolen() {
+    std::cout << "Testing stolen range checks... ";
+
+    // A function with a loop back to its second instruction
+    uint32_t fn[64];
+    for (uint32_t& w : fn) w = 0x60000000;
+    fn[0] = 0x38600000;                        // li r3,0
+    fn[1] = 0x38630001;                        // addi r3,r3,1
+    fn[2] = 0x2C030010;                        // cmpwi r3,16
+    fn[3] = bc(12, 0, SRC + 12, SRC + 4);      // blt loop
+    fn[4] = b(SRC + 16, SRC);                  // b start: fine
+    fn[5] = 0x4E800020;                        // blr
+    fn[63] = 0x9421FFF0;                       // stwu r1,-16(r1): next function
+    assert(dh_check_stolen(fn, SRC, 4) == 0);
+    assert(dh_check_stolen(fn, SRC, 8) == -2);
+    assert(dh_check_stolen(fn, SRC, 12) == -2);
+
+    // Taking the loop whole is fine: it is relocated along with its target
+    assert(dh_check_stolen(fn, SRC, 16) == 0);
+
+    // The next function's branches into its own start don't count
+    fn[3] = 0x60000000;
+    fn[6] = 0x9421FFF0;
+    fn[7] = bc(12, 0, SRC + 28, SRC + 4);
+    assert(dh_check_stolen(fn, SRC, 16) == 0);
+
+    // A patch running past the end of the function
+    fn[1] = 0x4E800020;
+    assert(dh_check_stolen(fn, SRC, 16) == -2);
+    assert(dh_check_stolen(fn, SRC, 8) == 0);
+    assert(dh_check_stolen(fn, SRC, 0) == 0);
+
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Relocation Tests ===\n\n";
+
+    try {
+        test_relocate_branches();
+        test_relocate_internal();
+        test_check_stolen();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,251 @@
+/**
+ * Unit tests for patch-time signature resolution
+ */
+
+#include "../tools/patchiso/signatures.h"
+#include "../tools/patchiso/symbols.h"
+#include "../tools/patchiso/patcher.h"
+#include "../tools/patchiso/gcm.h"
+#include "../tools/patchiso/dol.h"
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+
+using namespace dolhook;
+
+static void put_be32(std::vector<uint8_t>& buf, size_t off, uint32_t v) {
+    buf[off + 0] = (v >> 24) & 0xFF;
+    buf[off + 1] = (v >> 16) & 0xFF;
+    buf[off + 2] = (v >> 8) & 0xFF;
+    buf[off + 3] = v & 0xFF;
+}
+
+static uint32_t get_be32(const std::vector<uint8_t>& buf, size_t off) {
+    return (uint32_t(buf[off]) << 24) | (uint32_t(buf[off + 1]) << 16) | (uint32_t(buf[off + 2]) << 8) |
+           buf[off + 3];
+}
+
+// Game text at 0x80003100: one unique prologue and two identical ones
+static const uint32_t TEXT[] = {
+    0x9421FFE0, 0x7C0802A6, 0x90010024, 0x93E1001C, 0x7C7F1B78, 0x4E800020, 0, 0,
+    0x9421FFF0, 0x7C0802A6, 0x90010014, 0x4E800020, 0, 0, 0, 0,
+    0x9421FFF0, 0x7C0802A6, 0x90010014, 0x4E800020, 0, 0, 0, 0,
+};
+
+// DOL: header, then TEXT at 0x200 as text section 0
+static std::vector<uint8_t> make_dol() {
+    std::vector<uint8_t> dol(0x200 + sizeof(TEXT), 0);
+    put_be32(dol, 0x00, 0x200);
+    put_be32(dol, 0x74, 0x80003100);
+    put_be32(dol, 0xE8, sizeof(TEXT));
+    put_be32(dol, 0x15C, 0x80100000);
+    put_be32(dol, 0x160, 0x1000);
+    put_be32(dol, 0x164, 0x80003140);
+    for (size_t i = 0; i < sizeof(TEXT) / 4; i++) put_be32(dol, 0x200 + i * 4, TEXT[i]);
+    return dol;
+}
+
+// Payload image at 0x80400000: dh_sig records, then their strings and patterns
+struct SigSpec {
+    const char* name;
+    const char* mask;
+    std::vector<uint8_t> pat;
+};
+
+static const uint32_t PAYLOAD_BASE = 0x80400000;
+
+static std::vector<uint8_t> make_payload(const std::vector<SigSpec>& specs, size_t tail = 0) {
+    std::vector<uint8_t> img(specs.size() * 16, 0);
+    auto add = [&](const void* p, size_t n) {
+        uint32_t addr = PAYLOAD_BASE + static_cast<uint32_t>(img.size());
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        img.insert(img.end(), b, b + n);
+        while (img.size() % 4) img.push_back(0);
+        return addr;
+    };
+    for (size_t i = 0; i < specs.size(); i++) {
+        put_be32(img, i * 16 + 0, add(specs[i].name, std::strlen(specs[i].name) + 1));
+        put_be32(img, i * 16 + 4, specs[i].pat.empty() ? 0 : add(specs[i].pat.data(), specs[i].pat.size()));
+        put_be32(img, i * 16 + 8, add(specs[i].mask, std::strlen(specs[i].mask) + 1));
+    }
+    img.resize(img.size() + tail, 0);
+    return img;
+}
+
+static const std::vector<SigSpec> GOOD = {
+    {"unique", "xxxxxxxxxxxxxxxx",
+     {0x94, 0x21, 0xFF, 0xE0, 0x7C, 0x08, 0x02, 0xA6, 0x90, 0x01, 0x00, 0x24, 0x93, 0xE1, 0x00, 0x1C}},
+    {"no_anchor", "?xxx", {0x00, 0x21, 0xFF, 0xE0}},
+    {"OSReport", "", {}},
+};
+
+void test_signatures_resolve() {
+    std::cout << "Testing signature resolution... ";
+
+    DOLFile dol;
+    assert(dol.load(make_dol()));
+
+    std::vector<uint8_t> img = make_payload(GOOD);
+    std::vector<Signature> sigs;
+    std::string error;
+    assert(read_signatures(img, PAYLOAD_BASE, PAYLOAD_BASE, PAYLOAD_BASE + 48, sigs, error));
+    assert(sigs.size() == 3);
+    assert(sigs[0].name == "unique" && sigs[0].bytes.size() == 16);
+    assert(sigs[1].mask[0] == 0x00 && sigs[1].mask[1] == 0xFF);
+    assert(sigs[2].name == "OSReport" && sigs[2].mask.empty());
+
+    SymbolIndex map;
+    map.parse("OSReport 80005620\n");
+    assert(resolve_signatures(dol, &map, sigs, error));
+    assert(sigs[0].addr == 0x80003100);
+    assert(sigs[1].addr == 0x80003100);
+    assert(sigs[2].addr == 0x80005620);
+
+    write_signatures(img, PAYLOAD_BASE, sigs);
+    assert(get_be32(img, 12) == 0x80003100);
+    assert(get_be32(img, 44) == 0x80005620);
+
+    // An empty table is fine, anywhere
+    assert(read_signatures(img, PAYLOAD_BASE, 0x1000, 0x1000, sigs, error) && sigs.empty());
+
+    std::cout << "PASS\n";
+}
+
+void test_signatures_failures() {
+    std::cout << "Testing unresolvable signatures... ";
+
+    DOLFile dol;
+    assert(dol.load(make_dol()));
+
+    // Ambiguous, missing and by-name without a map are all reported at once
+    std::vector<uint8_t> img = make_payload({
+        {"twice", "xx??xxxx", {0x94, 0x21, 0x00, 0x00, 0x7C, 0x08, 0x02, 0xA6}},
+        {"absent", "xxxx", {0xDE, 0xAD, 0xBE, 0xEF}},
+        {"OSReport", "", {}},
+    });
+    std::vector<Signature> sigs;
+    std::string error;
+    assert(read_signatures(img, PAYLOAD_BASE, PAYLOAD_BASE, PAYLOAD_BASE + 48, sigs, error));
+    assert(!resolve_signatures(dol, nullptr, sigs, error));
+    assert(error.find("twice is ambiguous (3 matches: 0x80003100, 0x80003120, ...)") != std::string::npos);
+    assert(error.find("absent not found") != std::string::npos);
+    assert(error.find("OSReport is looked up by name and needs a game map") != std::string::npos);
+
+    SymbolIndex map;
+    map.parse("OSInit 80005600\n");
+    assert(!resolve_signatures(dol, &map, sigs, error));
+    assert(error.find("OSReport is not in the game map") != std::string::npos);
+
+    // Malformed records
+    std::vector<uint8_t> bad = make_payload({{"bad", "xy", {0x94, 0x21}}});
+    assert(!read_signatures(bad, PAYLOAD_BASE, PAYLOAD_BASE, PAYLOAD_BASE + 16, sigs, error));
+    bad = make_payload({{"wild", "????", {0, 0, 0, 0}}});
+    assert(!read_signatures(bad, PAYLOAD_BASE, PAYLOAD_BASE, PAYLOAD_BASE + 16, sigs, error));
+    assert(!read_signatures(bad, PAYLOAD_BASE, PAYLOAD_BASE, PAYLOAD_BASE + 12, sigs, error));
+    assert(!read_signatures(bad, PAYLOAD_BASE, PAYLOAD_BASE, PAYLOAD_BASE + 0x1000, sigs, error));
+
+    std::cout << "PASS\n";
+}
+
+// 64 KB image around make_dol()
+static void write_image(const std::string& path) {
+    std::vector<uint8_t> img(0x10000, 0);
+    std::memcpy(img.data(), "GTSTDH", 6);
+    put_be32(img, 0x420, 0x2440);
+    put_be32(img, 0x424, 0x8000);
+    put_be32(img, 0x428, 0x0C);
+    put_be32(img, 0x42C, 0x0C);
+    img[0x8000] = 1;
+    put_be32(img, 0x8008, 1);
+    std::vector<uint8_t> dol = make_dol();
+    std::copy(dol.begin(), dol.end(), img.begin() + 0x2440);
+
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(img.data()), img.size());
+}
+
+// Flat payload: signature table, then the entry placeholder word
+static void write_payload(const std::vector<SigSpec>& specs) {
+    std::vector<uint8_t> code = make_payload(specs, 4);
+    uint32_t slot = static_cast<uint32_t>(code.size() - 4);
+    put_be32(code, slot, 0x80003100);
+
+    std::filesystem::create_directories("test_sig_payload");
+    std::ofstream bin("test_sig_payload/payload.bin", std::ios::binary);
+    bin.write(reinterpret_cast<const char*>(code.data()), code.size());
+    std::ofstream sym("test_sig_payload/payload.sym");
+    sym << std::hex << "__dolhook_entry " << PAYLOAD_BASE << "\n"
+        << "__dolhook_start " << PAYLOAD_BASE << "\n"
+        << "__dolhook_sigs_start " << PAYLOAD_BASE << "\n"
+        << "__dolhook_sigs_end " << PAYLOAD_BASE + specs.size() * 16 << "\n"
+        << "__dolhook_original_entry " << PAYLOAD_BASE + slot << "\n";
+}
+
+void test_signatures_patch() {
+    std::cout << "Testing signatures through the patcher... ";
+
+    write_image("test_sig.iso");
+    std::ostringstream log;
+
+    // Unresolvable: nothing is written
+    write_payload({{"twice", "xx??xxxx", {0x94, 0x21, 0x00, 0x00, 0x7C, 0x08, 0x02, 0xA6}}});
+    Payload bad;
+    assert(bad.load("test_sig_payload", log));
+
+    PatchOptions opts;
+    opts.output = "test_sig_out.iso";
+    opts.log_level = 0;
+    PatchResult result = patch_image("test_sig.iso", opts, bad, log);
+    assert(!result.ok);
+    assert(result.error.find("twice is ambiguous") != std::string::npos);
+    assert(!std::filesystem::exists("test_sig_out.iso"));
+
+    // Resolved addresses land in the injected payload; the entry slot is
+    // still found by its placeholder, which is also a resolved address
+    write_payload(GOOD);
+    Payload good;
+    assert(good.load("test_sig_payload", log));
+    SymbolIndex map;
+    map.parse("OSReport 80005620\n");
+    opts.game_symbols = &map;
+    result = patch_image("test_sig.iso", opts, good, log);
+    assert(result.ok);
+    assert(result.load_addr == PAYLOAD_BASE && result.original_entry == 0x80003140);
+
+    GCMFile out;
+    assert(out.load("test_sig_out.iso"));
+    DOLFile dol = out.read_dol();
+    DOLSection injected = dol.header().get_sections().back();
+    assert(injected.load_addr == PAYLOAD_BASE);
+    ByteView code = dol.get_section_data(injected);
+    std::vector<uint8_t> bytes(code.begin(), code.end());
+    assert(get_be32(bytes, 12) == 0x80003100);
+    assert(get_be32(bytes, 28) == 0x80003100);
+    assert(get_be32(bytes, 44) == 0x80005620);
+    assert(get_be32(bytes, good.code.size() - 4) == 0x80003140);
+
+    std::filesystem::remove_all("test_sig_payload");
+    std::remove("test_sig.iso");
+    std::remove("test_sig_out.iso");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Signature Tests ===\n\n";
+
+    try {
+        test_signatures_resolve();
+        test_signatures_failures();
+        test_signatures_patch();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,176 @@
+/**
+ * Unit tests for game symbol map import
+ */
+
+#include "../tools/patchiso/symbols.h"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+using namespace dolhook;
+
+static const char* CW_MAP =
+    ".init section layout\n"
+    "  Starting        Virtual  File\n"
+    "  address  Size   address  offset\n"
+    "  ---------------------------------\n"
+    "  00000000 0003a4 80003100 00000100  1 .init \tos.a __start.o\n"
+    "  00000000 0000ec 80003100 00000100  4 __start \tos.a __start.o\n"
+    "  000000ec 000060 800031ec 000001ec  4 __init_registers \tos.a __start.o\n"
+    "  UNUSED   000070 ........ ........    __set_debug_bba os.a __start.o\n"
+    "\n"
+    ".text section layout\n"
+    "  00000000 000020 80005600 00002600  4 OSInit \tos.a OS.c\r\n"
+    "  00000020 000040 80005620 00002620  4 OSReport \tos.a OSError.c\r\n"
+    "  00000060 000010 80005660 00002660  4 OSPanic \tos.a OSError.c\r\n"
+    "\n"
+    "Memory map:\n"
+    "                   Starting Size     File\n"
+    "           .init   80003100 000023a0 00000100\n";
+
+static const char* DOLPHIN_MAP =
+    ".text section layout\n"
+    "80005600 00000020 80005600 0 OSInit\n"
+    "80010000 00000100 80010000 0 GXInit\n"
+    "80010100 00000000 80010100 0 GXLabel\n";
+
+void test_symbols_parse() {
+    std::cout << "Testing map parsing... ";
+
+    SymbolIndex index;
+    assert(index.parse(CW_MAP) == 5);
+    assert(index.size() == 5);
+
+    SymbolInfo sym;
+    assert(index.find("OSReport", sym));
+    assert(sym.addr == 0x80005620 && sym.size == 0x40 && sym.name == "OSReport");
+    assert(!index.find(".init", sym));
+    assert(!index.find("__set_debug_bba", sym));
+    assert(!index.find("OSRep", sym));
+
+    // Dolphin maps merge in; OSInit is listed by both and kept once
+    assert(index.parse(DOLPHIN_MAP) == 3);
+    assert(index.size() == 7);
+    assert(index.find("OSInit", sym) && sym.addr == 0x80005600);
+    assert(index.find("GXInit", sym) && sym.size == 0x100);
+
+    // Plain "name address" lists
+    assert(index.parse("# payload\nmy_hook 0x80400000\n") == 1);
+    assert(index.find("my_hook", sym) && sym.addr == 0x80400000 && sym.size == 0);
+
+    std::cout << "PASS\n";
+}
+
+void test_symbols_lookup() {
+    std::cout << "Testing address and prefix lookup... ";
+
+    SymbolIndex index;
+    index.parse(CW_MAP);
+    index.parse(DOLPHIN_MAP);
+
+    SymbolInfo sym;
+    assert(index.lookup(0x80005620, sym) && sym.name == "OSReport");
+    assert(index.lookup(0x8000565F, sym) && sym.name == "OSReport");
+    assert(index.lookup(0x80005660, sym) && sym.name == "OSPanic");
+    assert(!index.lookup(0x80005670, sym));
+    assert(!index.lookup(0x80000000, sym));
+    assert(index.lookup(0x80003100, sym) && sym.name == "__start");
+
+    // Unknown size: the nearest symbol below
+    assert(index.lookup(0x80010180, sym) && sym.name == "GXLabel");
+
+    auto os = index.with_prefix("OS");
+    assert(os.size() == 3);
+    assert(os[0].name == "OSInit" && os[1].name == "OSPanic" && os[2].name == "OSReport");
+    assert(index.with_prefix("OS", 2).size() == 2);
+    assert(index.with_prefix("__").size() == 2);
+    assert(index.with_prefix("VI").empty());
+
+    // The same name at two addresses: find() gives the lower one
+    index.parse("dup 80020000\ndup 80001000\n");
+    assert(index.find("dup", sym) && sym.addr == 0x80001000);
+    assert(index.with_prefix("dup").size() == 2);
+
+    std::cout << "PASS\n";
+}
+
+void test_symbols_prefix_names() {
+    std::cout << "Testing names that extend an 8 or 16 byte name... ";
+
+    // Each longer name sits below the name it extends, and the shorter
+    // one leads its tied run
+    SymbolIndex index;
+    assert(index.parse("OSReport 80001080\n"
+                       "OSReportInit 80001040\n"
+                       "OSReportX 80001000\n"
+                       "__ct__8CPlayerFv 80002040\n"
+                       "__ct__8CPlayerFvi 80002000\n") == 5);
+
+    SymbolInfo sym;
+    assert(index.find("OSReport", sym) && sym.addr == 0x80001080);
+    assert(index.find("OSReportInit", sym) && sym.addr == 0x80001040);
+    assert(index.find("OSReportX", sym) && sym.addr == 0x80001000);
+    assert(index.find("__ct__8CPlayerFv", sym) && sym.addr == 0x80002040);
+    assert(index.find("__ct__8CPlayerFvi", sym) && sym.addr == 0x80002000);
+
+    auto os = index.with_prefix("OSReport");
+    assert(os.size() == 3);
+    assert(os[0].name == "OSReport" && os[1].name == "OSReportInit" && os[2].name == "OSReportX");
+
+    std::cout << "PASS\n";
+}
+
+void test_symbols_load() {
+    std::cout << "Testing map file loading... ";
+
+    // A large generated map; every symbol must come back by name and address
+    {
+        std::ofstream f("test_symbols.map");
+        f << ".text section layout\n";
+        char line[128];
+        for (uint32_t i = 0; i < 50000; i++) {
+            std::snprintf(line, sizeof(line), "  %08x %06x %08x %08x  4 func_%05u \tgame.a f.c\n", i * 0x20, 0x20,
+                          0x80004000 + i * 0x20, 0x100 + i * 0x20, i);
+            f << line;
+        }
+    }
+
+    SymbolIndex index;
+    std::string error;
+    assert(index.load("test_symbols.map", error));
+    assert(index.size() == 50000);
+
+    SymbolInfo sym;
+    assert(index.find("func_12345", sym) && sym.addr == 0x80004000 + 12345 * 0x20);
+    assert(index.lookup(0x80004000 + 777 * 0x20 + 0x1C, sym) && sym.name == "func_00777");
+    assert(index.with_prefix("func_0001").size() == 10);
+
+    assert(!index.load("test_symbols_missing.map", error));
+    {
+        std::ofstream f("test_symbols.map");
+        f << "nothing to see here\n";
+    }
+    assert(!index.load("test_symbols.map", error));
+    assert(index.size() == 50000);
+
+    std::remove("test_symbols.map");
+    std::cout << "PASS\n";
+}
+
+int main() {
+    std::cout << "=== Symbol Map Tests ===\n\n";
+
+    try {
+        test_symbols_parse();
+        test_symbols_lookup();
+        test_symbols_prefix_names();
+        test_symbols_load();
+
+        std::cout << "\nAll tests passed!\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,187 @@
+/**
+ * Batch Patching Implementation
+ */
+
+#include "batch.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace dolhook {
+
+namespace fs = std::filesystem;
+
+static bool is_image_path(const fs::path& p) {
+    std::string ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".iso" || ext == ".gcm" || ext == ".gcz" || ext == ".ciso";
+}
+
+static fs::path normalized(const std::string& path) {
+    std::error_code ec;
+    fs::path abs = fs::absolute(path, ec);
+    return (ec ? fs::path(path) : abs).lexically_normal();
+}
+
+// Deepest directory holding every input; outputs mirror the tree below it
+static fs::path common_root(const std::vector<std::string>& inputs) {
+    fs::path root;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        fs::path dir = normalized(inputs[i]).parent_path();
+        if (i == 0) {
+            root = dir;
+            continue;
+        }
+        fs::path common;
+        for (auto a = root.begin(), b = dir.begin(); a != root.end() && b != dir.end() && *a == *b; ++a, ++b) {
+            common /= *a;
+        }
+        root = common;
+    }
+    return root;
+}
+
+std::vector<std::string> collect_batch_inputs(const std::string& source) {
+    std::vector<std::string> inputs;
+    std::error_code ec;
+
+    if (fs::is_directory(source, ec)) {
+        for (const auto& entry : fs::recursive_directory_iterator(source, ec)) {
+            if (entry.is_regular_file(ec) && is_image_path(entry.path())) {
+                inputs.push_back(entry.path().string());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+        return inputs;
+    }
+
+    std::ifstream list(source);
+    std::string line;
+    while (std::getline(list, line)) {
+        // Trim, skip blanks and comments
+        size_t b = line.find_first_not_of(" \t\r");
+        size_t e = line.find_last_not_of(" \t\r");
+        if (b == std::string::npos || line[b] == '#') continue;
+        inputs.push_back(line.substr(b, e - b + 1));
+    }
+    return inputs;
+}
+
+std::vector<BatchEntry> run_batch(const std::vector<std::string>& inputs,
+                                  const BatchOptions& opts, const Payload& payload) {
+    std::vector<BatchEntry> entries(inputs.size());
+
+    unsigned jobs = opts.jobs ? opts.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min<unsigned>(jobs, std::max<size_t>(1, inputs.size()));
+
+    // Name every output up front: <dir>/<path below the inputs' common
+    // root>, so a/game.iso and b/game.iso stay apart. Inputs that would
+    // still write the same file (game.iso and game.gcz with --bps, or an
+    // image listed twice) fail instead of racing each other.
+    std::vector<PatchOptions> patches(inputs.size(), opts.patch);
+    fs::path root = common_root(inputs);
+    std::map<fs::path, size_t> written;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        entries[i].input = inputs[i];
+        fs::path rel = normalized(inputs[i]).lexically_relative(root);
+        if (!opts.out_dir.empty()) {
+            patches[i].output = (fs::path(opts.out_dir) / rel).string();
+        }
+        if (!opts.bps_dir.empty()) {
+            patches[i].bps_output = (fs::path(opts.bps_dir) / rel).replace_extension(".bps").string();
+        }
+
+        const std::string& target = !patches[i].bps_output.empty() ? patches[i].bps_output
+                                    : !patches[i].output.empty()   ? patches[i].output
+                                                                   : inputs[i];
+        auto claim = written.emplace(normalized(target), i);
+        if (!claim.second) {
+            size_t other = claim.first->second;
+            entries[i].result.error = "writes " + target + ", as does " + inputs[other];
+            if (entries[other].result.error.empty()) {
+                entries[other].result.error = "writes " + target + ", as does " + inputs[i];
+            }
+        } else if (!opts.patch.dry_run && target != inputs[i]) {
+            std::error_code ec;
+            fs::create_directories(fs::path(target).parent_path(), ec);
+        }
+    }
+
+    MemoryBudget budget(opts.mem_limit);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex log_mutex;
+
+    auto worker = [&]() {
+        for (;;) {
+            size_t i = next.fetch_add(1);
+            if (i >= inputs.size()) return;
+
+            BatchEntry& entry = entries[i];
+            PatchOptions& patch = patches[i];
+            patch.budget = &budget;
+
+            // Buffer per-file logs so concurrent jobs don't interleave
+            std::ostringstream log;
+            if (entry.result.error.empty()) {
+                auto start = std::chrono::steady_clock::now();
+                entry.result = patch_image(inputs[i], patch, payload, log);
+                entry.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            std::lock_guard<std::mutex> lock(log_mutex);
+            size_t n = ++done;
+            if (opts.patch.log_level >= 2) {
+                std::cout << log.str() << "\n";
+            }
+            if (opts.patch.log_level >= 1) {
+                std::cout << "[" << n << "/" << inputs.size() << "] "
+                          << (entry.result.ok ? "OK   " : "FAIL ") << inputs[i] << "\n";
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < jobs; t++) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+
+    return entries;
+}
+
+std::string format_batch_summary(const std::vector<BatchEntry>& entries) {
+    std::ostringstream oss;
+    size_t ok = 0;
+    uint64_t written = 0;
+    double total = 0.0;
+
+    oss << "\nBatch Summary:\n";
+    oss << "  Status  Time(s)   Written  Image\n";
+    for (const auto& e : entries) {
+        oss << "  " << std::left << std::setw(6) << (e.result.ok ? "OK" : "FAIL") << std::right
+            << std::fixed << std::setprecision(2) << std::setw(9) << e.seconds
+            << std::setw(10) << e.result.bytes_written << "  " << e.input;
+        if (!e.result.ok) oss << " (" << e.result.error << ")";
+        else if (e.result.up_to_date) oss << " (up to date)";
+        else if (e.result.relocated) oss << " (DOL relocated)";
+        if (e.result.ok && e.result.cache_hit) oss << " (cached)";
+        oss << "\n";
+
+        ok += e.result.ok;
+        written += e.result.bytes_written;
+        total += e.seconds;
+    }
+
+    oss << "\n  " << ok << "/" << entries.size() << " patched, "
+        << written << " bytes written, " << std::fixed << std::setprecision(2)
+        << total << "s total job time\n";
+    return oss.str();
+}
+
+} // namespace dolhook
@@ -0,0 +1,40 @@
+/**
+ * Batch Patching
+ * Patches many images on a bounded worker pool with one shared payload
+ */
+
+#pragma once
+
+#include "patcher.h"
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+struct BatchOptions {
+    std::string out_dir;         // Empty = patch each image in place
+    std::string bps_dir;         // Non-empty: write <name>.bps patches here instead
+                                 // (both mirror the inputs' directory tree)
+    unsigned jobs = 0;           // 0 = hardware concurrency
+    uint64_t mem_limit = 512ull << 20;
+    PatchOptions patch;
+};
+
+struct BatchEntry {
+    std::string input;
+    PatchResult result;
+    double seconds = 0.0;
+};
+
+// Expand a directory (*.iso, *.gcm, *.gcz, *.ciso) or a list file (one path per line)
+std::vector<std::string> collect_batch_inputs(const std::string& source);
+
+// Patch all inputs; per-file logs are flushed whole as jobs finish.
+// Inputs whose outputs would be the same file fail without patching.
+std::vector<BatchEntry> run_batch(const std::vector<std::string>& inputs,
+                                  const BatchOptions& opts, const Payload& payload);
+
+// Per-file result table plus totals
+std::string format_batch_summary(const std::vector<BatchEntry>& entries);
+
+} // namespace dolhook
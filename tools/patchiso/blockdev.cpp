@@ -0,0 +1,297 @@
+/**
+ * Block Device Implementation
+ */
+
+#include "blockdev.h"
+#include "container.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+namespace dolhook {
+
+static int open_readonly(const std::string& path, uint64_t& size) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return -1;
+    }
+
+    size = static_cast<uint64_t>(st.st_size);
+    return fd;
+}
+
+bool pread_full(int fd, uint64_t offset, void* dst, size_t len) {
+    uint8_t* out = static_cast<uint8_t*>(dst);
+
+    while (len > 0) {
+        ssize_t n = ::pread(fd, out, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        out += n;
+        offset += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+bool copy_fd_range(int in_fd, uint64_t in_off, int out_fd, uint64_t len) {
+    off_t pos = static_cast<off_t>(in_off);
+
+#ifdef __linux__
+    // In-kernel copy; reflinks/server-side copy where the filesystem can
+    while (len > 0) {
+        ssize_t n = copy_file_range(in_fd, &pos, out_fd, nullptr, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len -= n;
+    }
+
+    // Cross-filesystem or unsupported: page cache to file
+    while (len > 0) {
+        ssize_t n = sendfile(out_fd, in_fd, &pos, std::min<uint64_t>(len, 1u << 30));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len -= n;
+    }
+#endif
+
+    std::vector<uint8_t> buf;
+    while (len > 0) {
+        buf.resize(std::min<uint64_t>(len, 1 << 20));
+        ssize_t n = pread(in_fd, buf.data(), buf.size(), pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out_fd, buf.data() + done, n - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            done += w;
+        }
+        pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool all_zero(const uint8_t* data, size_t len) {
+    return len == 0 || (data[0] == 0 && std::memcmp(data, data + 1, len - 1) == 0);
+}
+
+bool pwrite_all(int fd, uint64_t offset, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::pwrite(fd, data, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool punch_hole(int fd, uint64_t offset, uint64_t len) {
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     static_cast<off_t>(offset), static_cast<off_t>(len)) == 0;
+#else
+    (void)fd;
+    (void)offset;
+    (void)len;
+    return false;
+#endif
+}
+
+std::vector<Extent> data_runs(uint64_t offset, const uint8_t* data, size_t len) {
+    std::vector<Extent> runs;
+    size_t run = 0;  // Start of the pending data run
+    size_t i = 0;
+
+    while (i < len) {
+        uint64_t pos = offset + i;
+        size_t n = static_cast<size_t>(std::min<uint64_t>(len - i, SPARSE_BLOCK - pos % SPARSE_BLOCK));
+        if (n < SPARSE_BLOCK || !all_zero(data + i, n)) {
+            i += n;
+            continue;
+        }
+
+        // Whole zero blocks from i on
+        size_t zeros = i + n;
+        while (len - zeros >= SPARSE_BLOCK && all_zero(data + zeros, SPARSE_BLOCK)) zeros += SPARSE_BLOCK;
+
+        if (i > run) runs.push_back({run, i - run});
+        i = run = zeros;
+    }
+
+    if (len > run) runs.push_back({run, len - run});
+    return runs;
+}
+
+bool pwrite_sparse(int fd, uint64_t offset, const uint8_t* data, size_t len, bool fresh) {
+    size_t at = 0;
+    auto zeros_to = [&](size_t end) {
+        if (fresh || end == at || punch_hole(fd, offset + at, end - at)) return true;
+        return pwrite_all(fd, offset + at, data + at, end - at);
+    };
+
+    for (const Extent& run : data_runs(offset, data, len)) {
+        if (!zeros_to(run.offset)) return false;
+        if (!pwrite_all(fd, offset + run.offset, data + run.offset, run.size)) return false;
+        at = run.offset + run.size;
+    }
+    return zeros_to(len);
+}
+
+bool finish_sparse(int fd, uint64_t size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    if (static_cast<uint64_t>(st.st_size) >= size) return true;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) return true;
+
+    // Dense fallback
+    static const uint8_t zeros[SPARSE_BLOCK] = {};
+    for (uint64_t pos = st.st_size; pos < size; pos += SPARSE_BLOCK) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(SPARSE_BLOCK, size - pos));
+        if (!pwrite_all(fd, pos, zeros, n)) return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * MmapBlockDevice
+ * ========================================================================= */
+
+MmapBlockDevice::~MmapBlockDevice() {
+    if (base_) munmap(const_cast<uint8_t*>(base_), size_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+std::unique_ptr<MmapBlockDevice> MmapBlockDevice::open(const std::string& path) {
+    uint64_t size = 0;
+    int fd = open_readonly(path, size);
+    if (fd < 0) return nullptr;
+
+    if (size == 0) {
+        ::close(fd);
+        return nullptr; // Nothing to map
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<MmapBlockDevice> dev(new MmapBlockDevice());
+    dev->fd_ = fd;
+    dev->base_ = static_cast<const uint8_t*>(base);
+    dev->size_ = size;
+    return dev;
+}
+
+bool MmapBlockDevice::read(uint64_t offset, void* dst, size_t len) const {
+    const uint8_t* src = view(offset, len);
+    if (!src) return false;
+
+    std::memcpy(dst, src, len);
+    return true;
+}
+
+const uint8_t* MmapBlockDevice::view(uint64_t offset, size_t len) const {
+    if (offset > size_ || len > size_ - offset) return nullptr;
+    return base_ + offset;
+}
+
+void MmapBlockDevice::prefetch(uint64_t offset, size_t len) const {
+    if (offset >= size_) return;
+    len = static_cast<size_t>(std::min<uint64_t>(len, size_ - offset));
+
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset & ~(page - 1);
+    madvise(const_cast<uint8_t*>(base_) + start, len + (offset - start), MADV_WILLNEED);
+}
+
+/* ============================================================================
+ * PreadBlockDevice
+ * ========================================================================= */
+
+PreadBlockDevice::~PreadBlockDevice() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+std::unique_ptr<PreadBlockDevice> PreadBlockDevice::open(const std::string& path) {
+    uint64_t size = 0;
+    int fd = open_readonly(path, size);
+    if (fd < 0) return nullptr;
+
+    std::unique_ptr<PreadBlockDevice> dev(new PreadBlockDevice());
+    dev->fd_ = fd;
+    dev->size_ = size;
+    return dev;
+}
+
+bool PreadBlockDevice::read(uint64_t offset, void* dst, size_t len) const {
+    if (offset > size_ || len > size_ - offset) return false;
+    return pread_full(fd_, offset, dst, len);
+}
+
+void PreadBlockDevice::prefetch(uint64_t offset, size_t len) const {
+    posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(len), POSIX_FADV_WILLNEED);
+}
+
+/* ============================================================================
+ * MemoryBlockDevice
+ * ========================================================================= */
+
+bool MemoryBlockDevice::read(uint64_t offset, void* dst, size_t len) const {
+    const uint8_t* src = view(offset, len);
+    if (!src) return false;
+
+    std::memcpy(dst, src, len);
+    return true;
+}
+
+const uint8_t* MemoryBlockDevice::view(uint64_t offset, size_t len) const {
+    if (offset > data_.size() || len > data_.size() - offset) return nullptr;
+    return data_.data() + offset;
+}
+
+/* ============================================================================
+ * Factory
+ * ========================================================================= */
+
+std::shared_ptr<BlockDevice> open_block_device(const std::string& path) {
+    if (auto dev = ContainerBlockDevice::open(path)) {
+        return std::shared_ptr<BlockDevice>(std::move(dev));
+    }
+
+    if (auto dev = MmapBlockDevice::open(path)) {
+        return std::shared_ptr<BlockDevice>(std::move(dev));
+    }
+
+    if (auto dev = PreadBlockDevice::open(path)) {
+        return std::shared_ptr<BlockDevice>(std::move(dev));
+    }
+
+    return nullptr;
+}
+
+} // namespace dolhook
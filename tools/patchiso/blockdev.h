@@ -0,0 +1,141 @@
+/**
+ * Block Device Abstraction
+ * Lazily paged, read-only access to disc images
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+// Byte range of an image
+struct Extent {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Logical image bytes; may be called from several threads at once
+using ImageReader = std::function<bool(uint64_t offset, void* dst, size_t len)>;
+
+class BlockDevice {
+public:
+    virtual ~BlockDevice() = default;
+
+    // Total size in bytes
+    virtual uint64_t size() const = 0;
+
+    // Copy bytes out of the device (false on short read)
+    virtual bool read(uint64_t offset, void* dst, size_t len) const = 0;
+
+    // Direct pointer into mapped storage, or nullptr if not mapped
+    virtual const uint8_t* view(uint64_t offset, size_t len) const {
+        (void)offset;
+        (void)len;
+        return nullptr;
+    }
+
+    // Hint that a range will be read soon (readahead); optional
+    virtual void prefetch(uint64_t offset, size_t len) const {
+        (void)offset;
+        (void)len;
+    }
+
+    // Backend name for logging
+    virtual const char* name() const = 0;
+};
+
+// Read-only mmap of an image file; pages are faulted in on access
+class MmapBlockDevice : public BlockDevice {
+public:
+    ~MmapBlockDevice() override;
+
+    static std::unique_ptr<MmapBlockDevice> open(const std::string& path);
+
+    uint64_t size() const override { return size_; }
+    bool read(uint64_t offset, void* dst, size_t len) const override;
+    const uint8_t* view(uint64_t offset, size_t len) const override;
+    void prefetch(uint64_t offset, size_t len) const override;
+    const char* name() const override { return "mmap"; }
+
+private:
+    MmapBlockDevice() = default;
+
+    int fd_ = -1;
+    const uint8_t* base_ = nullptr;
+    uint64_t size_ = 0;
+};
+
+// Plain pread() fallback for files that cannot be mapped
+class PreadBlockDevice : public BlockDevice {
+public:
+    ~PreadBlockDevice() override;
+
+    static std::unique_ptr<PreadBlockDevice> open(const std::string& path);
+
+    uint64_t size() const override { return size_; }
+    bool read(uint64_t offset, void* dst, size_t len) const override;
+    void prefetch(uint64_t offset, size_t len) const override;
+    const char* name() const override { return "pread"; }
+
+private:
+    PreadBlockDevice() = default;
+
+    int fd_ = -1;
+    uint64_t size_ = 0;
+};
+
+// In-memory image (tests, freshly built images)
+class MemoryBlockDevice : public BlockDevice {
+public:
+    explicit MemoryBlockDevice(std::vector<uint8_t> data) : data_(std::move(data)) {}
+
+    uint64_t size() const override { return data_.size(); }
+    bool read(uint64_t offset, void* dst, size_t len) const override;
+    const uint8_t* view(uint64_t offset, size_t len) const override;
+    const char* name() const override { return "memory"; }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+// Open an image: CISO/GCZ containers are decoded, raw images are mapped
+// with a pread fallback
+std::shared_ptr<BlockDevice> open_block_device(const std::string& path);
+
+// pread exactly len bytes (false on EOF or error)
+bool pread_full(int fd, uint64_t offset, void* dst, size_t len);
+
+// Copy len bytes at in_off to the current position of out_fd
+// (copy_file_range, then sendfile, then a pread/write loop)
+bool copy_fd_range(int in_fd, uint64_t in_off, int out_fd, uint64_t len);
+
+// True if all len bytes are zero
+bool all_zero(const uint8_t* data, size_t len);
+
+// Granularity of holes left by pwrite_sparse()
+constexpr uint64_t SPARSE_BLOCK = 4096;
+
+// pwrite len bytes, retrying short writes
+bool pwrite_all(int fd, uint64_t offset, const uint8_t* data, size_t len);
+
+// The parts of data (offsets relative to it) that are not aligned all-zero
+// SPARSE_BLOCKs when placed at offset; what pwrite_sparse() writes
+std::vector<Extent> data_runs(uint64_t offset, const uint8_t* data, size_t len);
+
+// pwrite len bytes, turning aligned all-zero blocks into holes. With fresh
+// set the range already reads as zero (new file, past EOF) and those blocks
+// are simply skipped; otherwise they are punched out, or written as zeros
+// where the filesystem can't punch holes.
+bool pwrite_sparse(int fd, uint64_t offset, const uint8_t* data, size_t len, bool fresh);
+
+// Set the final size of a file written with pwrite_sparse(); a trailing hole
+// is written out as zeros if the file can't be extended with ftruncate()
+bool finish_sparse(int fd, uint64_t size);
+
+} // namespace dolhook
@@ -0,0 +1,423 @@
+/**
+ * BPS Patch Implementation
+ *
+ * Layout:
+ *   "BPS1" source_size:vlq target_size:vlq metadata_size:vlq metadata
+ *   actions, each vlq((length - 1) << 2 | kind) followed by:
+ *     SourceRead   -              source bytes at the current output offset
+ *     TargetRead   bytes[length]
+ *     SourceCopy   delta:svlq     source bytes at a relative cursor
+ *     TargetCopy   delta:svlq     earlier output bytes; may overlap (RLE)
+ *   source_crc:u32 target_crc:u32 patch_crc:u32 (CRC-32, little-endian)
+ */
+
+#include "bps.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dolhook {
+
+namespace {
+
+enum BpsAction : uint64_t {
+    SOURCE_READ = 0,
+    TARGET_READ = 1,
+    SOURCE_COPY = 2,
+    TARGET_COPY = 3
+};
+
+constexpr char BPS_MAGIC[4] = {'B', 'P', 'S', '1'};
+constexpr size_t BPS_FOOTER = 12;
+constexpr size_t CHUNK = 4 << 20;
+
+} // namespace
+
+static void put_le32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((v >> (i * 8)) & 0xFF);
+}
+
+static uint32_t get_le32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+// Bijective base-128, last byte flagged with 0x80
+static void put_vlq(std::vector<uint8_t>& out, uint64_t v) {
+    for (;;) {
+        uint8_t x = v & 0x7F;
+        v >>= 7;
+        if (v == 0) {
+            out.push_back(0x80 | x);
+            return;
+        }
+        out.push_back(x);
+        v--;
+    }
+}
+
+static bool get_vlq(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    uint64_t shift = 1;
+    while (p < end) {
+        uint8_t x = *p++;
+        v += (x & 0x7F) * shift;
+        if (x & 0x80) return true;
+        shift <<= 7;
+        if (shift > (1ull << 56)) return false; // Would overflow 64 bits
+        v += shift;
+    }
+    return false;
+}
+
+static void put_action(std::vector<uint8_t>& out, BpsAction kind, uint64_t len) {
+    put_vlq(out, ((len - 1) << 2) | kind);
+}
+
+// Signed cursor moves: magnitude << 1 | sign
+static void put_delta(std::vector<uint8_t>& out, uint64_t from, uint64_t to) {
+    put_vlq(out, to >= from ? (to - from) << 1 : ((from - to) << 1) | 1);
+}
+
+static bool apply_delta(uint64_t& cursor, uint64_t encoded) {
+    uint64_t magnitude = encoded >> 1;
+    if (encoded & 1) {
+        if (magnitude > cursor) return false;
+        cursor -= magnitude;
+    } else {
+        cursor += magnitude;
+    }
+    return true;
+}
+
+// CRC of len zero bytes, by doubling
+static uint32_t crc32_zeros(uint64_t len) {
+    static const uint8_t zero = 0;
+    uint32_t result = 0;
+    uint32_t block = crc32(0, &zero, 1);
+    for (uint64_t block_len = 1; len; len >>= 1, block_len <<= 1) {
+        if (len & 1) result = crc32_combine(result, block, block_len);
+        block = crc32_combine(block, block, block_len);
+    }
+    return result;
+}
+
+static bool source_crc32(const GCMFile& iso, uint32_t& crc) {
+    const uint64_t size = iso.source_size();
+    std::vector<uint8_t> buf(static_cast<size_t>(std::min<uint64_t>(CHUNK, size)));
+
+    crc = 0;
+    iso.prefetch_source(0, 2 * CHUNK);
+    for (uint64_t pos = 0; pos < size; pos += CHUNK) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK, size - pos));
+        iso.prefetch_source(pos + 2 * CHUNK, CHUNK);
+        if (!iso.read_source(pos, buf.data(), n)) return false;
+        crc = crc32(crc, buf.data(), n);
+    }
+    return true;
+}
+
+bool write_bps(GCMFile& iso, const std::string& patch_path, BpsInfo& info, std::string& error) {
+    const auto dirty = iso.dirty_extents();
+    const uint64_t src_size = iso.source_size();
+    const uint64_t tgt_size = iso.size();
+    info = BpsInfo{};
+    info.source_size = src_size;
+    info.target_size = tgt_size;
+
+    if (tgt_size < src_size) {
+        error = "image is smaller than its source";
+        return false;
+    }
+    if (!source_crc32(iso, info.source_crc)) {
+        error = "failed to read source image";
+        return false;
+    }
+
+    std::vector<uint8_t> patch(BPS_MAGIC, BPS_MAGIC + sizeof(BPS_MAGIC));
+    put_vlq(patch, src_size);
+    put_vlq(patch, tgt_size);
+    put_vlq(patch, 0); // No metadata
+
+    // Target CRC without reading the unchanged bytes: CRC is affine, so
+    // crc(T) = crc(S) ^ crc(S ^ T) ^ crc(zeros) over the source's length,
+    // and S ^ T is zero outside the dirty extents. Past the source the
+    // target is appended as-is.
+    uint32_t delta_crc = 0;
+    uint32_t tail_crc = 0;
+    uint64_t crc_pos = 0;
+    auto crc_zeros_to = [&](uint64_t to) {
+        if (crc_pos < std::min(to, src_size)) {
+            uint64_t n = std::min(to, src_size) - crc_pos;
+            delta_crc = crc32_combine(delta_crc, crc32_zeros(n), n);
+            crc_pos += n;
+        }
+        if (crc_pos < to) {
+            // Gaps past the source read back as zero, same as the XOR
+            tail_crc = crc32_combine(tail_crc, crc32_zeros(to - crc_pos), to - crc_pos);
+            crc_pos = to;
+        }
+    };
+
+    uint64_t target_cursor = 0;
+    auto emit_gap = [&](uint64_t from, uint64_t to) {
+        if (from < std::min(to, src_size)) {
+            put_action(patch, SOURCE_READ, std::min(to, src_size) - from);
+        }
+        from = std::max(from, src_size);
+        if (from < to) {
+            // Zero fill: one literal byte, then an overlapping copy of it
+            put_action(patch, TARGET_READ, 1);
+            patch.push_back(0);
+            if (to - from > 1) {
+                put_action(patch, TARGET_COPY, to - from - 1);
+                put_delta(patch, target_cursor, from);
+                target_cursor = from + (to - from - 1);
+            }
+        }
+        crc_zeros_to(to);
+    };
+
+    std::vector<uint8_t> target, source;
+    uint64_t pos = 0;
+    for (const auto& ext : dirty) {
+        emit_gap(pos, ext.offset);
+        put_action(patch, TARGET_READ, ext.size);
+
+        for (uint64_t off = ext.offset; off < ext.offset + ext.size; off += CHUNK) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK, ext.offset + ext.size - off));
+            target.resize(n);
+            if (!iso.read_into(off, target.data(), n)) {
+                error = "failed to read modified data";
+                return false;
+            }
+            patch.insert(patch.end(), target.begin(), target.end());
+
+            size_t in_source = off < src_size ? static_cast<size_t>(std::min<uint64_t>(n, src_size - off)) : 0;
+            if (in_source) {
+                source.resize(in_source);
+                if (!iso.read_source(off, source.data(), in_source)) {
+                    error = "failed to read source image";
+                    return false;
+                }
+                for (size_t i = 0; i < in_source; i++) source[i] ^= target[i];
+                delta_crc = crc32(delta_crc, source.data(), in_source);
+            }
+            tail_crc = crc32(tail_crc, target.data() + in_source, n - in_source);
+            crc_pos = off + n;
+        }
+        pos = ext.offset + ext.size;
+    }
+    emit_gap(pos, tgt_size);
+
+    uint32_t prefix_crc = info.source_crc ^ delta_crc ^ crc32_zeros(src_size);
+    info.target_crc = crc32_combine(prefix_crc, tail_crc, tgt_size - src_size);
+
+    put_le32(patch, info.source_crc);
+    put_le32(patch, info.target_crc);
+    put_le32(patch, crc32(0, patch.data(), patch.size()));
+    info.patch_size = patch.size();
+
+    std::ofstream out(patch_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(patch.data()), patch.size());
+    if (!out.good()) {
+        error = "failed to write " + patch_path;
+        return false;
+    }
+    return true;
+}
+
+bool apply_bps(const std::string& patch_path, const std::string& source_path,
+               const std::string& target_path, BpsInfo& info, std::string& error) {
+    info = BpsInfo{};
+
+    std::ifstream in(patch_path, std::ios::binary);
+    std::vector<uint8_t> patch(std::istreambuf_iterator<char>(in), {});
+    if (patch.size() < sizeof(BPS_MAGIC) + 3 + BPS_FOOTER ||
+        std::memcmp(patch.data(), BPS_MAGIC, sizeof(BPS_MAGIC)) != 0) {
+        error = patch_path + " is not a BPS patch";
+        return false;
+    }
+    info.patch_size = patch.size();
+
+    const uint8_t* end = patch.data() + patch.size() - BPS_FOOTER;
+    if (crc32(0, patch.data(), patch.size() - 4) != get_le32(end + 8)) {
+        error = patch_path + " is corrupt (checksum mismatch)";
+        return false;
+    }
+    info.source_crc = get_le32(end);
+    info.target_crc = get_le32(end + 4);
+
+    const uint8_t* p = patch.data() + sizeof(BPS_MAGIC);
+    uint64_t meta_size = 0;
+    if (!get_vlq(p, end, info.source_size) || !get_vlq(p, end, info.target_size) ||
+        !get_vlq(p, end, meta_size) || meta_size > uint64_t(end - p)) {
+        error = patch_path + " has a malformed header";
+        return false;
+    }
+    p += meta_size;
+
+    auto source = open_block_device(source_path);
+    if (!source) {
+        error = "cannot open " + source_path;
+        return false;
+    }
+    if (source->size() != info.source_size) {
+        error = source_path + " is " + std::to_string(source->size()) + " bytes, patch expects " +
+                std::to_string(info.source_size);
+        return false;
+    }
+
+    // Reject the wrong source before writing anything
+    std::vector<uint8_t> buf(CHUNK);
+    uint32_t crc = 0;
+    source->prefetch(0, 2 * CHUNK);
+    for (uint64_t pos = 0; pos < info.source_size; pos += CHUNK) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK, info.source_size - pos));
+        source->prefetch(pos + 2 * CHUNK, CHUNK);
+        if (!source->read(pos, buf.data(), n)) {
+            error = "failed to read " + source_path;
+            return false;
+        }
+        crc = crc32(crc, buf.data(), n);
+    }
+    if (crc != info.source_crc) {
+        error = source_path + " is not the image this patch was made from";
+        return false;
+    }
+
+    std::error_code ec;
+    if (std::filesystem::equivalent(source_path, target_path, ec)) {
+        error = "output must differ from the source image";
+        return false;
+    }
+
+    int fd = ::open(target_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "cannot create " + target_path;
+        return false;
+    }
+
+    // Output is buffered in a window that also keeps the last CHUNK flushed
+    // bytes, so TargetCopy only reads back from the file beyond that
+    std::vector<uint8_t> window;
+    uint64_t window_start = 0;
+    uint64_t flushed = 0;
+    uint64_t out_pos = 0;
+    uint32_t out_crc = 0;
+    bool ok = true;
+
+    auto flush = [&]() {
+        size_t at = static_cast<size_t>(flushed - window_start);
+        ok = ok && pwrite_sparse(fd, flushed, window.data() + at, window.size() - at, true);
+        flushed = out_pos;
+        if (window.size() > CHUNK) {
+            window_start += window.size() - CHUNK;
+            window.erase(window.begin(), window.end() - CHUNK);
+        }
+        // Skipped zero blocks at the end leave the file short, and
+        // TargetCopy reads back up to flushed
+        return ok = ok && finish_sparse(fd, flushed);
+    };
+    // The window's last n bytes are new output
+    auto emitted = [&](size_t n) {
+        out_crc = crc32(out_crc, window.data() + window.size() - n, n);
+        out_pos += n;
+        return out_pos - flushed < CHUNK || flush();
+    };
+    auto emit = [&](const uint8_t* data, size_t n) {
+        window.insert(window.end(), data, data + n);
+        return emitted(n);
+    };
+    auto copy_source = [&](uint64_t offset, uint64_t len) {
+        while (len > 0 && ok) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK, len));
+            ok = source->read(offset, buf.data(), n) && emit(buf.data(), n);
+            offset += n;
+            len -= n;
+        }
+        return ok;
+    };
+    auto copy_target = [&](uint64_t from, size_t n) {
+        if (from < window_start) {
+            return flush() && pread_full(fd, from, buf.data(), n) && emit(buf.data(), n);
+        }
+        size_t at = static_cast<size_t>(from - window_start);
+        size_t end = window.size();
+        window.resize(end + n);
+        std::memcpy(window.data() + end, window.data() + at, n);
+        return emitted(n);
+    };
+
+    uint64_t source_cursor = 0;
+    uint64_t target_cursor = 0;
+    while (p < end && ok) {
+        uint64_t action = 0;
+        if (!get_vlq(p, end, action)) {
+            ok = false;
+            break;
+        }
+        uint64_t len = (action >> 2) + 1;
+        if (len > info.target_size - out_pos) {
+            ok = false;
+            break;
+        }
+
+        uint64_t delta = 0;
+        switch (action & 3) {
+        case SOURCE_READ:
+            ok = out_pos + len <= info.source_size && copy_source(out_pos, len);
+            break;
+        case TARGET_READ:
+            ok = len <= uint64_t(end - p) && emit(p, static_cast<size_t>(len));
+            p += ok ? len : 0;
+            break;
+        case SOURCE_COPY:
+            ok = get_vlq(p, end, delta) && apply_delta(source_cursor, delta) &&
+                 source_cursor + len <= info.source_size && copy_source(source_cursor, len);
+            source_cursor += len;
+            break;
+        case TARGET_COPY:
+            ok = get_vlq(p, end, delta) && apply_delta(target_cursor, delta) && target_cursor < out_pos;
+            if (ok) {
+                // An overlapping run repeats with period out_pos - start, so
+                // each pass copies from the earliest point in phase that is
+                // still in the window, doubling what the next pass can use
+                const uint64_t start = target_cursor;
+                const uint64_t period = out_pos - start;
+                while (ok && len > 0) {
+                    uint64_t low = std::max(start, window_start);
+                    uint64_t from = target_cursor;
+                    if (from >= low) from -= (from - low) / period * period;
+                    size_t n = static_cast<size_t>(std::min<uint64_t>({len, out_pos - from, CHUNK}));
+                    ok = copy_target(from, n);
+                    target_cursor += n;
+                    len -= n;
+                }
+            }
+            break;
+        }
+    }
+
+    ok = ok && flush() && out_pos == info.target_size && finish_sparse(fd, out_pos);
+    if (!ok) {
+        error = "patch is malformed or could not be written";
+    } else if (out_crc != info.target_crc) {
+        error = "patched image does not match the patch's target checksum";
+        ok = false;
+    }
+
+    if (::close(fd) != 0 && ok) {
+        error = "failed to write " + target_path;
+        ok = false;
+    }
+    if (!ok) std::remove(target_path.c_str());
+    return ok;
+}
+
+} // namespace dolhook
@@ -0,0 +1,32 @@
+/**
+ * BPS Patches
+ * Binary patches built from an image's dirty extents, and their application
+ */
+
+#pragma once
+
+#include "gcm.h"
+#include <cstdint>
+#include <string>
+
+namespace dolhook {
+
+struct BpsInfo {
+    uint64_t source_size = 0;
+    uint64_t target_size = 0;
+    uint32_t source_crc = 0;
+    uint32_t target_crc = 0;
+    uint64_t patch_size = 0;
+};
+
+// Write a BPS patch from iso's source file to its current contents.
+// Unchanged ranges become SourceRead actions and dirty extents TargetRead;
+// the source is read once for its CRC and the target CRC is derived from it.
+bool write_bps(GCMFile& iso, const std::string& patch_path, BpsInfo& info, std::string& error);
+
+// Apply patch_path to source_path, streaming a raw image to target_path.
+// The source and the result are both checked against the patch CRCs.
+bool apply_bps(const std::string& patch_path, const std::string& source_path,
+               const std::string& target_path, BpsInfo& info, std::string& error);
+
+} // namespace dolhook
@@ -0,0 +1,630 @@
+/**
+ * Compressed Container Implementation
+ *
+ * CISO (little-endian):
+ *   "CISO" block_size:u32 map[0x7FF8]   (1 = block stored)
+ *   stored blocks in map order from 0x8000, block_size bytes each
+ *
+ * GCZ (little-endian):
+ *   magic:u32 (0xB10BC001) sub_type:u32 compressed_size:u64 data_size:u64
+ *   block_size:u32 block_count:u32
+ *   pointers:u64[block_count]  (offset into the data; bit 63 = stored raw)
+ *   hashes:u32[block_count]    (Adler-32 of the stored bytes)
+ *   data
+ *
+ * Junk trailer (optional, after the data of either format):
+ *   regions[count]: offset:u64 size:u64 position:u64 seed:u32[17]
+ *   count:u32 crc32:u32 (of the regions) "DHJUNK01"
+ *   Junk bytes are stored as zeros and regenerated on read.
+ */
+
+#include "container.h"
+#include "gcm.h"
+#include "hash.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef DOLHOOK_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace dolhook {
+
+static constexpr char CISO_MAGIC[4] = {'C', 'I', 'S', 'O'};
+static constexpr size_t CISO_HEADER_SIZE = 0x8000;
+static constexpr size_t CISO_MAP_SIZE = CISO_HEADER_SIZE - 8;
+static constexpr uint32_t CISO_MIN_BLOCK = 0x8000;
+
+static constexpr uint32_t GCZ_MAGIC = 0xB10BC001;
+static constexpr size_t GCZ_HEADER_SIZE = 32;
+static constexpr uint64_t GCZ_RAW_BLOCK = 1ull << 63;
+static constexpr uint32_t GCZ_DEFAULT_BLOCK = 0x8000;
+
+static constexpr uint32_t MAX_BLOCK = 64 << 20;
+
+static constexpr char JUNK_MAGIC[8] = {'D', 'H', 'J', 'U', 'N', 'K', '0', '1'};
+static constexpr size_t JUNK_ENTRY_SIZE = 24 + JunkGenerator::SEED_WORDS * 4;
+static constexpr size_t JUNK_FOOTER_SIZE = 16;
+
+static uint32_t get_le32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint64_t get_le64(const uint8_t* p) {
+    return uint64_t(get_le32(p)) | (uint64_t(get_le32(p + 4)) << 32);
+}
+
+static void put_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (i * 8)) & 0xFF;
+}
+
+static void put_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (v >> (i * 8)) & 0xFF;
+}
+
+static uint32_t adler32_of(const uint8_t* p, size_t len) {
+    uint32_t a = 1, b = 0;
+    while (len > 0) {
+        // Largest run before b can overflow 32 bits
+        size_t n = std::min<size_t>(len, 5552);
+        len -= n;
+        while (n--) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+ContainerFormat container_format_for(const std::string& path) {
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string::npos || path[dot] != '.') return ContainerFormat::Raw;
+
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "ciso") return ContainerFormat::Ciso;
+    if (ext == "gcz") return ContainerFormat::Gcz;
+    return ContainerFormat::Raw;
+}
+
+bool container_supported(ContainerFormat format) {
+#ifdef DOLHOOK_HAVE_ZLIB
+    return format != ContainerFormat::Raw;
+#else
+    return format == ContainerFormat::Ciso;
+#endif
+}
+
+/* ============================================================================
+ * ContainerBlockDevice
+ * ========================================================================= */
+
+ContainerBlockDevice::~ContainerBlockDevice() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+std::unique_ptr<ContainerBlockDevice> ContainerBlockDevice::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    std::unique_ptr<ContainerBlockDevice> dev(new ContainerBlockDevice());
+    dev->fd_ = fd;
+
+    struct stat st;
+    uint8_t magic[4];
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !pread_full(fd, 0, magic, sizeof(magic))) {
+        return nullptr;
+    }
+
+    uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    if (std::memcmp(magic, CISO_MAGIC, sizeof(magic)) == 0) {
+        dev->format_ = ContainerFormat::Ciso;
+        if (!dev->parse_ciso(file_size)) return nullptr;
+    } else if (get_le32(magic) == GCZ_MAGIC) {
+        dev->format_ = ContainerFormat::Gcz;
+        if (!dev->parse_gcz(file_size)) return nullptr;
+    } else {
+        return nullptr;
+    }
+
+    if (!dev->parse_junk(file_size)) return nullptr;
+    return dev;
+}
+
+bool ContainerBlockDevice::parse_ciso(uint64_t file_size) {
+    std::vector<uint8_t> hdr(CISO_HEADER_SIZE);
+    if (file_size < hdr.size() || !pread_full(fd_, 0, hdr.data(), hdr.size())) return false;
+
+    block_size_ = get_le32(hdr.data() + 4);
+    if (block_size_ == 0 || block_size_ > MAX_BLOCK) return false;
+
+    const uint8_t* map = hdr.data() + 8;
+    size_t count = CISO_MAP_SIZE;
+    while (count > 0 && map[count - 1] != 1) count--;
+    if (count == 0) return false;
+
+    blocks_.resize(count);
+    uint64_t pos = CISO_HEADER_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        if (map[i] != 1) continue;
+        blocks_[i].offset = pos;
+        blocks_[i].size = block_size_;
+        pos += block_size_;
+    }
+    if (pos > file_size) return false;
+    data_end_ = pos;
+
+    // No length field: the image ends with its last stored block, except
+    // that a full disc ends inside it
+    size_ = uint64_t(count) * block_size_;
+    if (size_ > GCM_DISC_SIZE && size_ - block_size_ < GCM_DISC_SIZE) size_ = GCM_DISC_SIZE;
+    return true;
+}
+
+bool ContainerBlockDevice::parse_gcz(uint64_t file_size) {
+    uint8_t hdr[GCZ_HEADER_SIZE];
+    if (!pread_full(fd_, 0, hdr, sizeof(hdr))) return false;
+
+    uint64_t packed_size = get_le64(hdr + 8);
+    uint64_t data_size = get_le64(hdr + 16);
+    block_size_ = get_le32(hdr + 24);
+    uint32_t count = get_le32(hdr + 28);
+    if (block_size_ == 0 || block_size_ > MAX_BLOCK) return false;
+    if (count != (data_size + block_size_ - 1) / block_size_) return false;
+
+    uint64_t data_offset = GCZ_HEADER_SIZE + uint64_t(count) * 12;
+    if (data_offset > file_size || packed_size > file_size - data_offset) return false;
+
+    std::vector<uint8_t> table(size_t(count) * 12);
+    if (!pread_full(fd_, GCZ_HEADER_SIZE, table.data(), table.size())) return false;
+    const uint8_t* hashes = table.data() + size_t(count) * 8;
+
+    // Stored sizes follow from the next pointer; blocks are laid out in order
+    blocks_.resize(count);
+    const uint64_t slack = block_size_ / 8 + 64;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t ptr = get_le64(table.data() + size_t(i) * 8);
+        uint64_t start = ptr & ~GCZ_RAW_BLOCK;
+        uint64_t end = i + 1 < count ? get_le64(table.data() + size_t(i + 1) * 8) & ~GCZ_RAW_BLOCK : packed_size;
+        if (start >= end || end > packed_size || end - start > block_size_ + slack) return false;
+
+        StoredBlock& blk = blocks_[i];
+        blk.offset = data_offset + start;
+        blk.size = static_cast<uint32_t>(end - start);
+        blk.hash = get_le32(hashes + size_t(i) * 4);
+        blk.compressed = (ptr & GCZ_RAW_BLOCK) == 0;
+        if (!blk.compressed && blk.size > block_size_) return false;
+#ifndef DOLHOOK_HAVE_ZLIB
+        if (blk.compressed) return false;
+#endif
+    }
+
+    size_ = data_size;
+    data_end_ = data_offset + packed_size;
+    return true;
+}
+
+bool ContainerBlockDevice::parse_junk(uint64_t file_size) {
+    uint8_t footer[JUNK_FOOTER_SIZE];
+    if (file_size - data_end_ < sizeof(footer) ||
+        !pread_full(fd_, file_size - sizeof(footer), footer, sizeof(footer)) ||
+        std::memcmp(footer + 8, JUNK_MAGIC, sizeof(JUNK_MAGIC)) != 0) {
+        return true;  // No junk recorded
+    }
+
+    uint64_t count = get_le32(footer);
+    uint64_t table_size = count * JUNK_ENTRY_SIZE;
+    if (table_size > file_size - data_end_ - sizeof(footer)) return false;
+
+    std::vector<uint8_t> table(static_cast<size_t>(table_size));
+    if (!pread_full(fd_, file_size - sizeof(footer) - table_size, table.data(), table.size()) ||
+        crc32(0, table.data(), table.size()) != get_le32(footer + 4)) {
+        return false;
+    }
+
+    junk_.resize(static_cast<size_t>(count));
+    uint64_t prev_end = 0;
+    for (size_t i = 0; i < junk_.size(); i++) {
+        const uint8_t* p = table.data() + i * JUNK_ENTRY_SIZE;
+        JunkRegion& r = junk_[i];
+        r.offset = get_le64(p);
+        r.size = get_le64(p + 8);
+        r.position = get_le64(p + 16);
+        for (size_t w = 0; w < JunkGenerator::SEED_WORDS; w++) r.seed[w] = get_le32(p + 24 + w * 4);
+
+        // Sorted, disjoint and inside the image
+        if (r.offset < prev_end || r.size == 0 || r.offset > size_ || r.size > size_ - r.offset) return false;
+        prev_end = r.offset + r.size;
+    }
+    return true;
+}
+
+static std::vector<uint8_t> encode_junk(const std::vector<JunkRegion>& regions) {
+    std::vector<uint8_t> out(regions.size() * JUNK_ENTRY_SIZE + JUNK_FOOTER_SIZE);
+    for (size_t i = 0; i < regions.size(); i++) {
+        uint8_t* p = out.data() + i * JUNK_ENTRY_SIZE;
+        put_le64(p, regions[i].offset);
+        put_le64(p + 8, regions[i].size);
+        put_le64(p + 16, regions[i].position);
+        for (size_t w = 0; w < JunkGenerator::SEED_WORDS; w++) put_le32(p + 24 + w * 4, regions[i].seed[w]);
+    }
+
+    uint8_t* footer = out.data() + regions.size() * JUNK_ENTRY_SIZE;
+    put_le32(footer, static_cast<uint32_t>(regions.size()));
+    put_le32(footer + 4, crc32(0, out.data(), regions.size() * JUNK_ENTRY_SIZE));
+    std::memcpy(footer + 8, JUNK_MAGIC, sizeof(JUNK_MAGIC));
+    return out;
+}
+
+bool ContainerBlockDevice::read_block(uint64_t block, uint8_t* out) const {
+    if (!decode_block(block, out)) return false;
+    if (!junk_.empty()) fill_junk(junk_, block * block_size_, out, block_size_);
+    return true;
+}
+
+bool ContainerBlockDevice::decode_block(uint64_t block, uint8_t* out) const {
+    if (block >= blocks_.size() || blocks_[block].size == 0) {
+        std::memset(out, 0, block_size_);
+        return true;
+    }
+
+    const StoredBlock& blk = blocks_[block];
+    if (!blk.compressed) {
+        if (!pread_full(fd_, blk.offset, out, blk.size)) return false;
+        std::memset(out + blk.size, 0, block_size_ - blk.size);
+        return true;
+    }
+
+#ifdef DOLHOOK_HAVE_ZLIB
+    thread_local std::vector<uint8_t> packed;
+    packed.resize(blk.size);
+    if (!pread_full(fd_, blk.offset, packed.data(), packed.size())) return false;
+
+    uLongf out_len = block_size_;
+    if (uncompress(out, &out_len, packed.data(), packed.size()) != Z_OK) return false;
+    std::memset(out + out_len, 0, block_size_ - out_len);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ContainerBlockDevice::read(uint64_t offset, void* dst, size_t len) const {
+    if (offset > size_ || len > size_ - offset) return false;
+
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    while (len > 0) {
+        uint64_t block = offset / block_size_;
+        size_t in_block = static_cast<size_t>(offset % block_size_);
+        size_t n = std::min<size_t>(block_size_ - in_block, len);
+
+        // Whole blocks decode straight into the caller's buffer
+        if (n == block_size_) {
+            if (!read_block(block, out)) return false;
+        } else {
+            std::lock_guard<std::mutex> lock(cache_mutex_);
+            if (cached_block_ != block) {
+                cache_.resize(block_size_);
+                cached_block_ = ~uint64_t(0);
+                if (!read_block(block, cache_.data())) return false;
+                cached_block_ = block;
+            }
+            std::memcpy(out, cache_.data() + in_block, n);
+        }
+
+        out += n;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+void ContainerBlockDevice::prefetch(uint64_t offset, size_t len) const {
+    if (offset >= size_ || len == 0) return;
+
+    uint64_t first = offset / block_size_;
+    uint64_t last = std::min<uint64_t>((offset + len - 1) / block_size_, blocks_.size() - 1);
+    uint64_t lo = ~uint64_t(0), hi = 0;
+    for (uint64_t b = first; b <= last; b++) {
+        if (blocks_[b].size == 0) continue;
+        lo = std::min(lo, blocks_[b].offset);
+        hi = std::max(hi, blocks_[b].offset + blocks_[b].size);
+    }
+    if (lo < hi) {
+        posix_fadvise(fd_, static_cast<off_t>(lo), static_cast<off_t>(hi - lo), POSIX_FADV_WILLNEED);
+    }
+}
+
+/* ============================================================================
+ * Writer
+ * ========================================================================= */
+
+namespace {
+
+constexpr size_t NO_BLOCK = ~size_t(0);
+
+// One encoded block waiting for the writer
+struct EncodeSlot {
+    std::vector<uint8_t> data;  // Empty: CISO zero block, not stored
+    uint32_t hash = 0;
+    bool compressed = false;
+    size_t index = NO_BLOCK;
+};
+
+} // namespace
+
+static bool write_all(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static uint32_t default_block_size(ContainerFormat format, uint64_t size) {
+    if (format == ContainerFormat::Gcz) return GCZ_DEFAULT_BLOCK;
+
+    // Smallest power of two that fits the image in the CISO map
+    uint32_t block_size = CISO_MIN_BLOCK;
+    while ((size + block_size - 1) / block_size > CISO_MAP_SIZE) block_size *= 2;
+    return block_size;
+}
+
+// data holds block_size bytes (zero padded); keep forces a CISO block to be stored
+static bool encode_block(ContainerFormat format, const uint8_t* data, uint32_t block_size,
+                         bool keep, EncodeSlot& out) {
+    out.compressed = false;
+    out.hash = 0;
+
+    if (format == ContainerFormat::Ciso) {
+        if (!keep && all_zero(data, block_size)) {
+            out.data.clear();
+        } else {
+            out.data.assign(data, data + block_size);
+        }
+        return true;
+    }
+
+#ifdef DOLHOOK_HAVE_ZLIB
+    // Zero blocks (padding, scrubbed junk) all compress the same way
+    thread_local std::vector<uint8_t> zero_packed;
+    thread_local uint32_t zero_block_size = 0;
+    bool zero = all_zero(data, block_size);
+    if (zero && zero_block_size == block_size) {
+        out.data = zero_packed;
+        out.compressed = true;
+        out.hash = adler32_of(out.data.data(), out.data.size());
+        return true;
+    }
+
+    uLongf packed = compressBound(block_size);
+    out.data.resize(packed);
+    if (compress2(out.data.data(), &packed, data, block_size, Z_DEFAULT_COMPRESSION) == Z_OK &&
+        packed < block_size) {
+        out.data.resize(packed);
+        out.compressed = true;
+        if (zero) {
+            zero_packed = out.data;
+            zero_block_size = block_size;
+        }
+    } else {
+        out.data.assign(data, data + block_size); // Incompressible
+    }
+    out.hash = adler32_of(out.data.data(), out.data.size());
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool write_container(const std::string& path, ContainerFormat format, uint32_t block_size,
+                     uint64_t size, const ImageReader& read,
+                     const ContainerBlockDevice* source, const std::vector<Extent>& dirty,
+                     const std::vector<JunkRegion>& junk, unsigned threads,
+                     ContainerWriteStats* stats) {
+    if (!container_supported(format) || size == 0) return false;
+
+    if (source && source->format() != format) source = nullptr;
+    if (block_size == 0) block_size = source ? source->block_size() : default_block_size(format, size);
+    if (block_size > MAX_BLOCK) return false;
+    if (source && source->block_size() != block_size) source = nullptr;
+
+    const uint64_t count = (size + block_size - 1) / block_size;
+    if (format == ContainerFormat::Ciso && count > CISO_MAP_SIZE) return false;
+    if (format == ContainerFormat::Gcz && count > UINT32_MAX) return false;
+
+    // Pass a source block through when it holds exactly the bytes wanted
+    std::vector<uint8_t> encode(count, 1);
+    if (source) {
+        uint64_t shared = std::min<uint64_t>(count, source->block_count());
+        for (uint64_t b = 0; b < shared; b++) {
+            uint64_t end = std::min<uint64_t>((b + 1) * block_size, size);
+            encode[b] = end != std::min<uint64_t>((b + 1) * block_size, source->size()) ||
+                        !same_junk_coverage(junk, source->junk(), b * block_size, end);
+        }
+        for (const auto& ext : dirty) {
+            if (ext.size == 0 || ext.offset >= size) continue;
+            uint64_t last = std::min<uint64_t>((ext.offset + ext.size - 1) / block_size, count - 1);
+            for (uint64_t b = ext.offset / block_size; b <= last; b++) encode[b] = 1;
+        }
+        // The last CISO block must be stored; it defines the image size
+        if (format == ContainerFormat::Ciso && source->stored(count - 1).size == 0) {
+            encode[count - 1] = 1;
+        }
+    }
+
+    std::vector<uint64_t> todo;
+    for (uint64_t b = 0; b < count; b++) {
+        if (encode[b]) todo.push_back(b);
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    const uint64_t header_size = format == ContainerFormat::Ciso ? CISO_HEADER_SIZE
+                                                                 : GCZ_HEADER_SIZE + count * 12;
+    bool ok = lseek(fd, static_cast<off_t>(header_size), SEEK_SET) >= 0;
+
+    // Encoders run at most window blocks ahead of the writer
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, todo.size()));
+    const size_t window = std::max<size_t>(8, size_t(threads) * 4);
+
+    std::vector<EncodeSlot> slots(window);
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool failed = !ok;
+    size_t consumed = 0;
+    std::atomic<size_t> next{0};
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back([&] {
+            std::vector<uint8_t> buf(block_size);
+            for (;;) {
+                size_t k = next.fetch_add(1);
+                if (k >= todo.size()) return;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return failed || k < consumed + window; });
+                    if (failed) return;
+                }
+
+                uint64_t b = todo[k];
+                uint64_t offset = b * block_size;
+                size_t n = static_cast<size_t>(std::min<uint64_t>(block_size, size - offset));
+                bool good = read(offset, buf.data(), n);
+                std::memset(buf.data() + n, 0, block_size - n);
+                clear_junk(junk, offset, buf.data(), n);
+
+                EncodeSlot& slot = slots[k % window];
+                good = good && encode_block(format, buf.data(), block_size, b == count - 1, slot);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (good) {
+                    slot.index = k;
+                } else {
+                    failed = true;
+                }
+                cv.notify_all();
+            }
+        });
+    }
+
+    // Writer: blocks in order; runs of untouched source blocks are copied in one go
+    std::vector<uint8_t> ciso_map(CISO_MAP_SIZE, 0);
+    std::vector<uint64_t> pointers(format == ContainerFormat::Gcz ? count : 0);
+    std::vector<uint32_t> hashes(pointers.size());
+    uint64_t data_size = 0;
+    uint64_t run_offset = 0, run_len = 0;
+    ContainerWriteStats local;
+    local.blocks = count;
+
+    auto flush_run = [&]() {
+        bool good = run_len == 0 || copy_fd_range(source->fd(), run_offset, fd, run_len);
+        run_len = 0;
+        return good;
+    };
+    auto record = [&](uint64_t b, size_t stored, bool compressed, uint32_t hash) {
+        if (format == ContainerFormat::Ciso) {
+            ciso_map[b] = stored ? 1 : 0;
+        } else {
+            pointers[b] = data_size | (compressed ? 0 : GCZ_RAW_BLOCK);
+            hashes[b] = hash;
+        }
+        data_size += stored;
+    };
+
+    size_t k = 0;
+    for (uint64_t b = 0; b < count && ok; b++) {
+        if (!encode[b]) {
+            const StoredBlock& blk = source->stored(b);
+            if (blk.size) {
+                if (run_len && blk.offset != run_offset + run_len) ok = flush_run();
+                if (!run_len) run_offset = blk.offset;
+                run_len += blk.size;
+            }
+            record(b, blk.size, blk.compressed, blk.hash);
+            local.copied++;
+            continue;
+        }
+
+        ok = flush_run();
+        EncodeSlot& slot = slots[k % window];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return failed || slot.index == k; });
+            if (failed) ok = false;
+        }
+        if (!ok) break;
+
+        record(b, slot.data.size(), slot.compressed, slot.hash);
+        ok = write_all(fd, slot.data.data(), slot.data.size());
+        local.encoded++;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.index = NO_BLOCK;
+        consumed = ++k;
+        cv.notify_all();
+    }
+    ok = ok && flush_run();
+
+    std::vector<uint8_t> trailer;
+    if (!junk.empty()) {
+        trailer = encode_junk(junk);
+        ok = ok && write_all(fd, trailer.data(), trailer.size());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) failed = true;
+        cv.notify_all();
+    }
+    for (auto& t : pool) t.join();
+
+    // Header last, now that every block's place is known
+    std::vector<uint8_t> hdr(header_size, 0);
+    if (format == ContainerFormat::Ciso) {
+        std::memcpy(hdr.data(), CISO_MAGIC, sizeof(CISO_MAGIC));
+        put_le32(hdr.data() + 4, block_size);
+        std::memcpy(hdr.data() + 8, ciso_map.data(), ciso_map.size());
+    } else {
+        put_le32(hdr.data(), GCZ_MAGIC);
+        put_le64(hdr.data() + 8, data_size);
+        put_le64(hdr.data() + 16, size);
+        put_le32(hdr.data() + 24, block_size);
+        put_le32(hdr.data() + 28, static_cast<uint32_t>(count));
+        for (uint64_t b = 0; b < count; b++) {
+            put_le64(hdr.data() + GCZ_HEADER_SIZE + b * 8, pointers[b]);
+            put_le32(hdr.data() + GCZ_HEADER_SIZE + count * 8 + b * 4, hashes[b]);
+        }
+    }
+
+    ok = ok && lseek(fd, 0, SEEK_SET) == 0 && write_all(fd, hdr.data(), hdr.size()) && fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok) {
+        std::remove(path.c_str());
+        return false;
+    }
+
+    local.bytes = header_size + data_size + trailer.size();
+    local.junk = junk_bytes(junk);
+    if (stats) *stats = local;
+    return true;
+}
+
+} // namespace dolhook
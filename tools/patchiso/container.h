@@ -0,0 +1,107 @@
+/**
+ * Compressed Disc Containers
+ * Block-based CISO and GCZ images behind the BlockDevice interface
+ */
+
+#pragma once
+
+#include "blockdev.h"
+#include "junk.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+enum class ContainerFormat {
+    Raw,
+    Ciso,  // Uncompressed blocks, all-zero blocks omitted
+    Gcz    // zlib-compressed blocks
+};
+
+// Format implied by an output name: .ciso, .gcz, anything else is Raw
+ContainerFormat container_format_for(const std::string& path);
+
+// False for GCZ when built without zlib
+bool container_supported(ContainerFormat format);
+
+// Where one block lives in the container file
+struct StoredBlock {
+    uint64_t offset = 0;
+    uint32_t size = 0;         // 0: not stored, reads as zeros (CISO)
+    uint32_t hash = 0;         // Adler-32 of the stored bytes (GCZ)
+    bool compressed = false;
+};
+
+// Read-only view of a container's logical (decompressed) image, with any
+// recorded junk regenerated
+class ContainerBlockDevice : public BlockDevice {
+public:
+    ~ContainerBlockDevice() override;
+
+    // nullptr if path is not a CISO/GCZ image this build can decode
+    static std::unique_ptr<ContainerBlockDevice> open(const std::string& path);
+
+    uint64_t size() const override { return size_; }
+    bool read(uint64_t offset, void* dst, size_t len) const override;
+    void prefetch(uint64_t offset, size_t len) const override;
+    const char* name() const override { return format_ == ContainerFormat::Gcz ? "gcz" : "ciso"; }
+
+    ContainerFormat format() const { return format_; }
+    uint32_t block_size() const { return block_size_; }
+    uint64_t block_count() const { return blocks_.size(); }
+    const StoredBlock& stored(uint64_t block) const { return blocks_[block]; }
+    int fd() const { return fd_; }
+
+    // Junk left out of the stored blocks (sorted)
+    const std::vector<JunkRegion>& junk() const { return junk_; }
+
+    // Decode one block into out (block_size() bytes)
+    bool read_block(uint64_t block, uint8_t* out) const;
+
+private:
+    ContainerBlockDevice() = default;
+
+    bool parse_ciso(uint64_t file_size);
+    bool parse_gcz(uint64_t file_size);
+    bool parse_junk(uint64_t file_size);
+
+    // Stored bytes only, junk left as zeros
+    bool decode_block(uint64_t block, uint8_t* out) const;
+
+    int fd_ = -1;
+    ContainerFormat format_ = ContainerFormat::Raw;
+    uint32_t block_size_ = 0;
+    uint64_t size_ = 0;
+    uint64_t data_end_ = 0;  // End of the block data in the file
+    std::vector<StoredBlock> blocks_;
+    std::vector<JunkRegion> junk_;
+
+    // Last partially read block
+    mutable std::mutex cache_mutex_;
+    mutable uint64_t cached_block_ = ~uint64_t(0);
+    mutable std::vector<uint8_t> cache_;
+};
+
+struct ContainerWriteStats {
+    uint64_t blocks = 0;
+    uint64_t copied = 0;    // Passed through from the source as stored
+    uint64_t encoded = 0;   // Compressed (or zero-checked) afresh
+    uint64_t bytes = 0;     // Container file size
+    uint64_t junk = 0;      // Junk recorded as regions instead of stored
+};
+
+// Write size bytes from read as a container and fsync it. Blocks of source
+// (same format and block size) that no dirty extent touches are copied as
+// stored; the rest are encoded on threads workers (0 = CPU count).
+// block_size 0 keeps the source's, else picks the format default.
+// junk (sorted) is stored as zeros and recorded in a trailer.
+bool write_container(const std::string& path, ContainerFormat format, uint32_t block_size,
+                     uint64_t size, const ImageReader& read,
+                     const ContainerBlockDevice* source, const std::vector<Extent>& dirty,
+                     const std::vector<JunkRegion>& junk, unsigned threads,
+                     ContainerWriteStats* stats = nullptr);
+
+} // namespace dolhook
@@ -139,6 +139,28 @@ uint32_t DOLHeader::get_highest_addr() const {
     return highest;
 }
 
+uint32_t DOLHeader::find_load_addr(uint32_t size, uint32_t base) const {
+    constexpr uint64_t MEM1_END = 0x81800000;
+    
+    std::vector<std::pair<uint64_t, uint64_t>> used;
+    for (const auto& sec : get_sections()) {
+        used.push_back({sec.load_addr, uint64_t(sec.load_addr) + sec.size});
+    }
+    if (bss_size > 0) {
+        used.push_back({bss_addr, uint64_t(bss_addr) + bss_size});
+    }
+    std::sort(used.begin(), used.end());
+    
+    // First fit: step past every range the candidate collides with
+    uint64_t addr = (uint64_t(base) + 0xFF) & ~uint64_t(0xFF);
+    for (const auto& [start, end] : used) {
+        if (start >= addr + size) break;
+        if (end > addr) addr = (end + 0xFF) & ~uint64_t(0xFF);
+    }
+    
+    return addr + size <= MEM1_END ? static_cast<uint32_t>(addr) : 0;
+}
+
 bool DOLHeader::is_valid() const {
     // Entry point should be in valid range
     if (entry_point < 0x80000000 || entry_point > 0x81800000) {
@@ -179,55 +201,130 @@ bool DOLHeader::add_section(const DOLSection& sec) {
     return false; // No free slots
 }
 
+bool DOLHeader::has_free_slot(bool is_text) const {
+    const uint32_t* sizes = is_text ? text_sizes : data_sizes;
+    size_t count = is_text ? MAX_TEXT_SECTIONS : MAX_DATA_SECTIONS;
+    return std::find(sizes, sizes + count, 0u) != sizes + count;
+}
+
 bool DOLFile::load(const std::vector<uint8_t>& data) {
-    if (data.size() < 0x100) {
+    return load(std::vector<uint8_t>(data));
+}
+
+bool DOLFile::load(std::vector<uint8_t>&& data) {
+    auto owned = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+    return load(ByteView(*owned), owned);
+}
+
+bool DOLFile::load(ByteView bytes, std::shared_ptr<const void> owner) {
+    if (bytes.size < DOLHeader::SIZE) {
         return false;
     }
     
-    if (!header_.parse(data.data())) {
+    if (!header_.parse(bytes.data)) {
         return false;
     }
     
-    data_ = data;
+    owner_ = std::move(owner);
+    source_ = bytes;
+    tail_.clear();
+    copies_.clear();
     return true;
 }
 
+std::vector<ByteView> DOLFile::gather(uint8_t header[DOLHeader::SIZE]) const {
+    header_.serialize(header);
+    std::vector<ByteView> pieces{{header, DOLHeader::SIZE}};
+    
+    // Source bytes with modified sections swapped in. The header wins over
+    // anything overlapping it, as does an earlier copy over a later one.
+    size_t pos = DOLHeader::SIZE;
+    for (const auto& [offset, bytes] : copies_) {
+        size_t end = offset + bytes.size();
+        if (end <= pos) continue;
+        size_t start = std::max<size_t>(offset, pos);
+        if (start > pos) pieces.push_back({source_.data + pos, start - pos});
+        pieces.push_back({bytes.data() + (start - offset), end - start});
+        pos = end;
+    }
+    if (pos < source_.size) pieces.push_back({source_.data + pos, source_.size - pos});
+    if (!tail_.empty()) pieces.push_back(tail_);
+    
+    return pieces;
+}
+
 std::vector<uint8_t> DOLFile::save() const {
-    std::vector<uint8_t> result = data_;
+    uint8_t header[DOLHeader::SIZE];
+    std::vector<uint8_t> result;
+    result.reserve(size());
     
-    // Ensure header is at least 0x100 bytes
-    if (result.size() < 0x100) {
-        result.resize(0x100);
+    for (const ByteView& piece : gather(header)) {
+        result.insert(result.end(), piece.begin(), piece.end());
     }
     
-    // Write header
-    header_.serialize(result.data());
-    
     return result;
 }
 
-std::vector<uint8_t> DOLFile::get_section_data(const DOLSection& sec) const {
-    if (sec.file_offset + sec.size > data_.size()) {
+ByteView DOLFile::get_section_data(const DOLSection& sec) const {
+    uint64_t end = uint64_t(sec.file_offset) + sec.size;
+    if (end > size()) {
         return {};
     }
     
-    return std::vector<uint8_t>(
-        data_.begin() + sec.file_offset,
-        data_.begin() + sec.file_offset + sec.size
-    );
+    auto copy = copies_.find(sec.file_offset);
+    if (copy != copies_.end() && copy->second.size() == sec.size) {
+        return copy->second;
+    }
+    if (sec.file_offset >= source_.size) {
+        return {tail_.data() + (sec.file_offset - source_.size), sec.size};
+    }
+    if (end <= source_.size) {
+        return {source_.data + sec.file_offset, sec.size};
+    }
+    return {}; // Straddles source and appended bytes
+}
+
+uint8_t* DOLFile::mutable_section_data(const DOLSection& sec) {
+    uint64_t end = uint64_t(sec.file_offset) + sec.size;
+    if (end > size()) {
+        return nullptr;
+    }
+    
+    // Appended bytes are ours already
+    if (sec.file_offset >= source_.size) {
+        return tail_.data() + (sec.file_offset - source_.size);
+    }
+    if (end > source_.size) {
+        return nullptr;
+    }
+    
+    auto& copy = copies_[sec.file_offset];
+    if (copy.size() != sec.size) {
+        // New copy, or the section was resized: keep what was modified
+        std::vector<uint8_t> fresh(source_.data + sec.file_offset, source_.data + end);
+        size_t keep = std::min(copy.size(), fresh.size());
+        std::copy(copy.begin(), copy.begin() + keep, fresh.begin());
+        copy = std::move(fresh);
+    }
+    return copy.data();
 }
 
 bool DOLFile::inject_payload(const std::vector<uint8_t>& payload,
                              uint32_t load_addr,
                              bool is_text) {
+    // Merging touching sections is the only way to get a slot back
+    if (!header_.has_free_slot(is_text)) {
+        repack(true);
+    }
+    
     // Align file offset
-    uint32_t file_offset = (data_.size() + 31) & ~31;
+    uint32_t file_offset = (size() + 31) & ~31;
     
-    // Expand data buffer
-    data_.resize(file_offset + payload.size());
+    // Expand appended bytes (padding is zero)
+    tail_.resize(file_offset - source_.size + payload.size());
     
     // Copy payload
-    std::memcpy(data_.data() + file_offset, payload.data(), payload.size());
+    std::memcpy(tail_.data() + (file_offset - source_.size), payload.data(), payload.size());
     
     // Add section to header
     DOLSection sec;
@@ -239,6 +336,110 @@ bool DOLFile::inject_payload(const std::vector<uint8_t>& payload,
     return header_.add_section(sec);
 }
 
+size_t DOLFile::repack(bool merge) {
+    static const uint8_t zeros[FILE_ALIGN] = {};
+    auto align = [](uint64_t v) { return (v + FILE_ALIGN - 1) & ~uint64_t(FILE_ALIGN - 1); };
+    
+    // Sections in header slot order, with the bytes they will hold
+    struct Part {
+        DOLSection sec;
+        std::vector<ByteView> bytes;
+        uint32_t order;  // File position to keep relative to the others
+        bool gone;
+    };
+    std::vector<Part> parts;
+    for (const DOLSection& sec : header_.get_sections()) {
+        ByteView bytes = get_section_data(sec);
+        if (bytes.size != sec.size) return 0; // Leave odd layouts alone
+        parts.push_back({sec, {bytes}, sec.file_offset, false});
+    }
+    
+    size_t merged = 0;
+    if (merge) {
+        // A gap between merged sections becomes zeros, so nothing may use it
+        auto unused = [&](uint64_t lo, uint64_t hi) {
+            if (lo == hi) return true;
+            for (const Part& p : parts) {
+                if (p.sec.load_addr < hi && uint64_t(p.sec.load_addr) + p.sec.size > lo) return false;
+            }
+            return header_.bss_size == 0 || header_.bss_addr >= hi ||
+                   uint64_t(header_.bss_addr) + header_.bss_size <= lo;
+        };
+        
+        std::vector<size_t> by_addr(parts.size());
+        for (size_t i = 0; i < parts.size(); i++) by_addr[i] = i;
+        std::sort(by_addr.begin(), by_addr.end(), [&](size_t a, size_t b) {
+            if (parts[a].sec.is_text != parts[b].sec.is_text) return parts[a].sec.is_text;
+            return parts[a].sec.load_addr < parts[b].sec.load_addr;
+        });
+        
+        for (size_t i = 0; i < by_addr.size();) {
+            Part& head = parts[by_addr[i]];
+            size_t j = i + 1;
+            for (; j < by_addr.size(); j++) {
+                Part& next = parts[by_addr[j]];
+                uint64_t end = uint64_t(head.sec.load_addr) + head.sec.size;
+                if (next.sec.is_text != head.sec.is_text || next.sec.load_addr < end ||
+                    next.sec.load_addr - end >= FILE_ALIGN || !unused(end, next.sec.load_addr)) {
+                    break;
+                }
+                
+                size_t gap = next.sec.load_addr - end;
+                if (gap) head.bytes.push_back({zeros, gap});
+                head.bytes.insert(head.bytes.end(), next.bytes.begin(), next.bytes.end());
+                head.sec.size = next.sec.load_addr + next.sec.size - head.sec.load_addr;
+                head.order = std::min(head.order, next.order);
+                next.gone = true;
+                merged++;
+            }
+            i = j;
+        }
+        parts.erase(std::remove_if(parts.begin(), parts.end(), [](const Part& p) { return p.gone; }),
+                    parts.end());
+    }
+    
+    // Back to back in the old file order
+    std::vector<size_t> by_file(parts.size());
+    for (size_t i = 0; i < parts.size(); i++) by_file[i] = i;
+    std::stable_sort(by_file.begin(), by_file.end(),
+                     [&](size_t a, size_t b) { return parts[a].order < parts[b].order; });
+    
+    uint64_t pos = align(DOLHeader::SIZE);
+    for (size_t i : by_file) {
+        parts[i].sec.file_offset = static_cast<uint32_t>(pos);
+        pos = align(pos + parts[i].sec.size);
+    }
+    
+    uint64_t end = DOLHeader::SIZE;
+    for (const Part& p : parts) end = std::max<uint64_t>(end, uint64_t(p.sec.file_offset) + p.sec.size);
+    std::vector<uint8_t> image(end, 0);
+    for (const Part& p : parts) {
+        uint8_t* dst = image.data() + p.sec.file_offset;
+        for (const ByteView& b : p.bytes) {
+            std::memcpy(dst, b.data, b.size);
+            dst += b.size;
+        }
+    }
+    
+    // Slots are refilled in their old order, free ones last
+    std::fill(std::begin(header_.text_offsets), std::end(header_.text_offsets), 0);
+    std::fill(std::begin(header_.text_addrs), std::end(header_.text_addrs), 0);
+    std::fill(std::begin(header_.text_sizes), std::end(header_.text_sizes), 0);
+    std::fill(std::begin(header_.data_offsets), std::end(header_.data_offsets), 0);
+    std::fill(std::begin(header_.data_addrs), std::end(header_.data_addrs), 0);
+    std::fill(std::begin(header_.data_sizes), std::end(header_.data_sizes), 0);
+    for (const Part& p : parts) header_.add_section(p.sec);
+    header_.serialize(image.data());
+    
+    // The old bytes are no longer referenced
+    auto owned = std::make_shared<const std::vector<uint8_t>>(std::move(image));
+    owner_ = owned;
+    source_ = ByteView(*owned);
+    tail_.clear();
+    copies_.clear();
+    return merged;
+}
+
 std::string DOLFile::format_header() const {
     std::ostringstream oss;
     oss << std::hex << std::setfill('0');
@@ -6,11 +6,28 @@
 #pragma once
 
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <vector>
 #include <string>
 
 namespace dolhook {
 
+// Non-owning view of bytes; valid while whatever owns them is
+struct ByteView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    
+    ByteView() = default;
+    ByteView(const uint8_t* d, size_t n) : data(d), size(n) {}
+    ByteView(const std::vector<uint8_t>& v) : data(v.data()), size(v.size()) {}
+    
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+    bool empty() const { return size == 0; }
+    uint8_t operator[](size_t i) const { return data[i]; }
+};
+
 struct DOLSection {
     uint32_t file_offset;  // Offset in DOL file
     uint32_t load_addr;    // Virtual address to load at
@@ -21,6 +38,7 @@ struct DOLSection {
 struct DOLHeader {
     static constexpr size_t MAX_TEXT_SECTIONS = 18;
     static constexpr size_t MAX_DATA_SECTIONS = 11;
+    static constexpr size_t SIZE = 0x168;  // Serialized bytes, up to the entry point
     
     uint32_t text_offsets[MAX_TEXT_SECTIONS];
     uint32_t data_offsets[MAX_DATA_SECTIONS];
@@ -44,42 +62,76 @@ struct DOLHeader {
     // Find highest address used
     uint32_t get_highest_addr() const;
     
+    // Lowest 0x100-aligned address from base on where size bytes overlap no
+    // section and no BSS, or 0 if MEM1 has no such room
+    uint32_t find_load_addr(uint32_t size, uint32_t base) const;
+    
     // Validation
     bool is_valid() const;
     
     // Add new section
     bool add_section(const DOLSection& sec);
+    bool has_free_slot(bool is_text) const;
 };
 
+// Sections are views into the loaded bytes; a section is copied only when
+// it is modified, and injected sections are appended after the source.
 class DOLFile {
 public:
     DOLFile() = default;
     
     // Load from buffer
     bool load(const std::vector<uint8_t>& data);
+    bool load(std::vector<uint8_t>&& data);
+    
+    // Load without copying; owner keeps bytes alive (a device, mapping, ...)
+    bool load(ByteView bytes, std::shared_ptr<const void> owner);
     
     // Save to buffer
     std::vector<uint8_t> save() const;
     
+    // The saved DOL as consecutive pieces, starting with header (serialized
+    // into the caller's buffer). Valid until the DOL is modified.
+    std::vector<ByteView> gather(uint8_t header[DOLHeader::SIZE]) const;
+    
     // Getters
     const DOLHeader& header() const { return header_; }
     DOLHeader& header() { return header_; }
-    const std::vector<uint8_t>& data() const { return data_; }
+    size_t size() const { return source_.size + tail_.size(); }
+    
+    // Bytes as loaded, without later modifications
+    ByteView source() const { return source_; }
+    
+    // Get section data (empty if out of range)
+    ByteView get_section_data(const DOLSection& sec) const;
     
-    // Get section data
-    std::vector<uint8_t> get_section_data(const DOLSection& sec) const;
+    // Writable section data, copied out of the source on first use
+    uint8_t* mutable_section_data(const DOLSection& sec);
     
-    // Inject new code/data sections
+    // Inject new code/data sections (repacking with merges if the header
+    // has no free slot of that kind)
     bool inject_payload(const std::vector<uint8_t>& payload,
                        uint32_t load_addr,
                        bool is_text);
     
+    // Rewrite the file image with sections back to back at FILE_ALIGN, in
+    // file order, dropping slack between them. With merge, sections of one
+    // kind that (nearly) touch in memory become one, freeing header slots.
+    // Returns the number of sections merged away.
+    size_t repack(bool merge);
+    
+    // Section file alignment kept by repack() (DVD DMA granularity)
+    static constexpr uint32_t FILE_ALIGN = 32;
+    
     // Print header for debugging
     std::string format_header() const;
     
 private:
     DOLHeader header_;
-    std::vector<uint8_t> data_;
+    std::shared_ptr<const void> owner_;
+    ByteView source_;
+    std::vector<uint8_t> tail_;                         // Bytes after source_
+    std::map<uint32_t, std::vector<uint8_t>> copies_;  // Modified sections by file offset
 };
 
 } // namespace dolhook
\ No newline at end of file
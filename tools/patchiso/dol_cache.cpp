@@ -0,0 +1,106 @@
+/**
+ * Patched DOL Cache Implementation
+ *
+ * Entries live at <dir>/<key[0:2]>/<key>.dol and end with the SHA-1 of
+ * their contents, so a truncated or damaged entry reads as a miss.
+ */
+
+#include "dol_cache.h"
+#include "hash.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace dolhook {
+
+namespace fs = std::filesystem;
+
+// Bump when the patch pipeline changes what it produces
+static const char CACHE_VERSION[] = "dolhook-dol-cache-v1";
+
+std::string DolCache::default_dir() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        if (*xdg) return std::string(xdg) + "/dolhook";
+    }
+    if (const char* home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/dolhook";
+    }
+    return ".dolhook-cache";
+}
+
+std::string DolCache::key(ByteView original_dol, const std::string& payload_digest) {
+    Sha1 sha;
+    sha.update(CACHE_VERSION, sizeof(CACHE_VERSION));
+    sha.update(payload_digest.data(), payload_digest.size());
+    sha.update(original_dol.data, original_dol.size);
+    return sha.hex_digest();
+}
+
+std::string DolCache::path_for(const std::string& key) const {
+    return dir_ + "/" + key.substr(0, 2) + "/" + key + ".dol";
+}
+
+bool DolCache::lookup(const std::string& key, std::vector<uint8_t>& patched_dol) const {
+    std::ifstream file(path_for(key), std::ios::binary);
+    if (!file) return false;
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), {});
+    if (data.size() < Sha1::DIGEST_SIZE) return false;
+
+    size_t body = data.size() - Sha1::DIGEST_SIZE;
+    uint8_t digest[Sha1::DIGEST_SIZE];
+    Sha1 sha;
+    sha.update(data.data(), body);
+    sha.finish(digest);
+    if (std::memcmp(digest, data.data() + body, sizeof(digest)) != 0) return false;
+
+    data.resize(body);
+    patched_dol = std::move(data);
+    return true;
+}
+
+bool DolCache::store(const std::string& key, const std::vector<ByteView>& patched_dol) const {
+    static std::atomic<unsigned> counter{0};
+
+    std::string path = path_for(key);
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    if (ec) return false;
+
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << getpid() << "." << std::hash<std::thread::id>()(std::this_thread::get_id())
+        << "." << counter++;
+
+    uint8_t digest[Sha1::DIGEST_SIZE];
+    Sha1 sha;
+    for (const ByteView& piece : patched_dol) sha.update(piece.data, piece.size);
+    sha.finish(digest);
+
+    {
+        std::ofstream file(tmp.str(), std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        for (const ByteView& piece : patched_dol) {
+            file.write(reinterpret_cast<const char*>(piece.data), piece.size);
+        }
+        file.write(reinterpret_cast<const char*>(digest), sizeof(digest));
+        if (!file.good()) {
+            fs::remove(tmp.str(), ec);
+            return false;
+        }
+    }
+
+    fs::rename(tmp.str(), path, ec);
+    if (ec) {
+        fs::remove(tmp.str(), ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace dolhook
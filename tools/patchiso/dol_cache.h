@@ -0,0 +1,43 @@
+/**
+ * Patched DOL Cache
+ * Content-addressed store of previously produced DOLs
+ */
+
+#pragma once
+
+#include "dol.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+class DolCache {
+public:
+    explicit DolCache(std::string dir) : dir_(std::move(dir)) {}
+
+    // $XDG_CACHE_HOME/dolhook, or ~/.cache/dolhook
+    static std::string default_dir();
+
+    // Key over the original DOL and the payload digest
+    static std::string key(ByteView original_dol, const std::string& payload_digest);
+
+    bool lookup(const std::string& key, std::vector<uint8_t>& patched_dol) const;
+
+    // Atomic (write to temp, then rename); safe across threads/processes
+    bool store(const std::string& key, const std::vector<uint8_t>& patched_dol) const {
+        return store(key, std::vector<ByteView>{patched_dol});
+    }
+    
+    // Same, written from consecutive pieces (DOLFile::gather())
+    bool store(const std::string& key, const std::vector<ByteView>& patched_dol) const;
+
+    const std::string& dir() const { return dir_; }
+
+private:
+    std::string path_for(const std::string& key) const;
+
+    std::string dir_;
+};
+
+} // namespace dolhook
@@ -0,0 +1,318 @@
+/**
+ * ELF Payload Loader Implementation
+ *
+ * Only what a linked payload needs: allocated sections, .symtab and the
+ * SHT_RELA sections --emit-relocs leaves for them. A relocation is redone
+ * only when moving changes its result: absolute fields against symbols in
+ * the image, and PC-relative fields against absolute symbols.
+ */
+
+#include "elf.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace dolhook {
+
+namespace {
+
+constexpr uint16_t ET_EXEC = 2;
+constexpr uint16_t EM_PPC = 20;
+
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_RELA = 4;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint32_t SHF_ALLOC = 0x2;
+
+constexpr uint16_t SHN_UNDEF = 0;
+constexpr uint16_t SHN_LORESERVE = 0xFF00;
+
+constexpr uint8_t STT_SECTION = 3;
+constexpr uint8_t STT_FILE = 4;
+
+enum PpcReloc : uint32_t {
+    R_PPC_NONE = 0,
+    R_PPC_ADDR32 = 1,
+    R_PPC_ADDR24 = 2,
+    R_PPC_ADDR16 = 3,
+    R_PPC_ADDR16_LO = 4,
+    R_PPC_ADDR16_HI = 5,
+    R_PPC_ADDR16_HA = 6,
+    R_PPC_ADDR14 = 7,
+    R_PPC_ADDR14_BRTAKEN = 8,
+    R_PPC_ADDR14_BRNTAKEN = 9,
+    R_PPC_REL24 = 10,
+    R_PPC_REL14 = 11,
+    R_PPC_REL14_BRTAKEN = 12,
+    R_PPC_REL14_BRNTAKEN = 13,
+    R_PPC_UADDR32 = 24,
+    R_PPC_UADDR16 = 25,
+    R_PPC_REL32 = 26,
+    R_PPC_EMB_SDA21 = 109
+};
+
+struct Section {
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t link;
+    uint32_t info;
+};
+
+} // namespace
+
+static uint16_t read_be16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static void write_be16(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
+}
+
+static void write_be32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static std::string hex(uint32_t v) {
+    std::ostringstream oss;
+    oss << "0x" << std::hex << v;
+    return oss.str();
+}
+
+bool ElfImage::load(const std::vector<uint8_t>& data, std::string& error) {
+    const uint8_t* d = data.data();
+    if (data.size() < 52 || d[0] != 0x7F || d[1] != 'E' || d[2] != 'L' || d[3] != 'F') {
+        error = "not an ELF file";
+        return false;
+    }
+    if (d[4] != 1 || d[5] != 2) {
+        error = "not a 32-bit big-endian ELF";
+        return false;
+    }
+    if (read_be16(d + 16) != ET_EXEC || read_be16(d + 18) != EM_PPC) {
+        error = "not a linked PowerPC executable";
+        return false;
+    }
+
+    uint32_t shoff = read_be32(d + 32);
+    uint16_t shentsize = read_be16(d + 46);
+    uint16_t shnum = read_be16(d + 48);
+    if (shentsize < 40 || uint64_t(shoff) + uint64_t(shnum) * shentsize > data.size()) {
+        error = "section headers out of range";
+        return false;
+    }
+
+    std::vector<Section> sections(shnum);
+    for (uint16_t i = 0; i < shnum; i++) {
+        const uint8_t* sh = d + shoff + size_t(i) * shentsize;
+        Section& s = sections[i];
+        s.type = read_be32(sh + 4);
+        s.flags = read_be32(sh + 8);
+        s.addr = read_be32(sh + 12);
+        s.offset = read_be32(sh + 16);
+        s.size = read_be32(sh + 20);
+        s.link = read_be32(sh + 24);
+        s.info = read_be32(sh + 28);
+        if (s.type != SHT_NOBITS && uint64_t(s.offset) + s.size > data.size()) {
+            error = "section " + std::to_string(i) + " out of range";
+            return false;
+        }
+    }
+
+    // Allocated extent; the image holds everything up to the last PROGBITS
+    uint64_t lo = UINT64_MAX, hi = 0, init_hi = 0;
+    for (const Section& s : sections) {
+        if (!(s.flags & SHF_ALLOC) || s.size == 0) continue;
+        lo = std::min<uint64_t>(lo, s.addr);
+        hi = std::max<uint64_t>(hi, uint64_t(s.addr) + s.size);
+        if (s.type != SHT_NOBITS) init_hi = std::max<uint64_t>(init_hi, uint64_t(s.addr) + s.size);
+    }
+    if (init_hi == 0 || hi > UINT32_MAX) {
+        error = "no loadable sections";
+        return false;
+    }
+    base_ = static_cast<uint32_t>(lo);
+    end_ = static_cast<uint32_t>(hi);
+
+    image_.assign(init_hi - lo, 0);
+    for (const Section& s : sections) {
+        if (!(s.flags & SHF_ALLOC) || s.type == SHT_NOBITS || s.size == 0) continue;
+        std::copy(d + s.offset, d + s.offset + s.size, image_.begin() + (s.addr - base_));
+    }
+
+    // Symbols: "movable" ones live in a section of the image
+    symtab_.clear();
+    named_.clear();
+    for (const Section& s : sections) {
+        if (s.type != SHT_SYMTAB) continue;
+        if (s.link >= shnum) {
+            error = "symbol table without string table";
+            return false;
+        }
+        const Section& strtab = sections[s.link];
+        for (uint32_t off = 0; off + 16 <= s.size; off += 16) {
+            const uint8_t* sym = d + s.offset + off;
+            uint32_t name = read_be32(sym);
+            uint32_t value = read_be32(sym + 4);
+            uint8_t type = sym[12] & 0xF;
+            uint16_t shndx = read_be16(sym + 14);
+            bool movable = shndx != SHN_UNDEF && shndx < SHN_LORESERVE && shndx < shnum &&
+                           (sections[shndx].flags & SHF_ALLOC);
+            symtab_.push_back({value, movable});
+
+            if (name == 0 || name >= strtab.size || type == STT_SECTION || type == STT_FILE) continue;
+            const char* str = reinterpret_cast<const char*>(d + strtab.offset + name);
+            std::string label(str, strnlen(str, strtab.size - name));
+            if (label.empty() || shndx == SHN_UNDEF) continue;
+            named_[label] = {value, movable};
+        }
+        break;
+    }
+
+    // Relocations against the image itself; debug sections are left alone
+    relocs_.clear();
+    for (const Section& s : sections) {
+        if (s.type != SHT_RELA || s.info >= shnum) continue;
+        const Section& target = sections[s.info];
+        if (!(target.flags & SHF_ALLOC) || target.type == SHT_NOBITS) continue;
+
+        for (uint32_t off = 0; off + 12 <= s.size; off += 12) {
+            const uint8_t* rela = d + s.offset + off;
+            uint32_t info = read_be32(rela + 4);
+            Reloc r{read_be32(rela), info & 0xFF, info >> 8, static_cast<int32_t>(read_be32(rela + 8))};
+            if (r.type == R_PPC_NONE) continue;
+            if (r.symbol >= symtab_.size()) {
+                error = "relocation against unknown symbol " + std::to_string(r.symbol);
+                return false;
+            }
+            relocs_.push_back(r);
+        }
+    }
+
+    return true;
+}
+
+std::map<std::string, uint32_t> ElfImage::symbols() const {
+    std::map<std::string, uint32_t> out;
+    for (const auto& [name, sym] : named_) out[name] = sym.value;
+    return out;
+}
+
+bool ElfImage::relocate(uint32_t load_addr, std::vector<uint8_t>& image,
+                        std::map<std::string, uint32_t>& symbols, std::string& error) const {
+    const uint32_t delta = load_addr - base_;
+    image = image_;
+    symbols.clear();
+    for (const auto& [name, sym] : named_) {
+        symbols[name] = sym.value + (sym.movable ? delta : 0);
+    }
+    if (delta == 0) return true;
+
+    if (relocs_.empty()) {
+        error = "linked at " + hex(base_) + " without relocations (link with -Wl,-q to move it)";
+        return false;
+    }
+
+    for (const Reloc& r : relocs_) {
+        const Symbol& sym = symtab_[r.symbol];
+        bool half = r.type >= R_PPC_ADDR16 && r.type <= R_PPC_ADDR16_HA;
+        half = half || r.type == R_PPC_UADDR16;
+        if (r.addr < base_ || uint64_t(r.addr - base_) + (half ? 2 : 4) > image.size()) {
+            error = "relocation outside the image at " + hex(r.addr);
+            return false;
+        }
+
+        uint8_t* field = image.data() + (r.addr - base_);
+        const uint32_t target = sym.value + r.addend + (sym.movable ? delta : 0);
+        const uint32_t place = r.addr + delta;
+
+        switch (r.type) {
+            case R_PPC_ADDR32:
+            case R_PPC_UADDR32:
+                if (sym.movable) write_be32(field, target);
+                break;
+
+            case R_PPC_ADDR16:
+            case R_PPC_UADDR16:
+            case R_PPC_ADDR16_LO:
+                if (sym.movable) write_be16(field, target & 0xFFFF);
+                break;
+
+            case R_PPC_ADDR16_HI:
+                if (sym.movable) write_be16(field, target >> 16);
+                break;
+
+            case R_PPC_ADDR16_HA:
+                if (sym.movable) write_be16(field, (target + 0x8000) >> 16);
+                break;
+
+            case R_PPC_ADDR24:
+                if (sym.movable) {
+                    write_be32(field, (read_be32(field) & 0xFC000003) | (target & 0x03FFFFFC));
+                }
+                break;
+
+            case R_PPC_ADDR14:
+            case R_PPC_ADDR14_BRTAKEN:
+            case R_PPC_ADDR14_BRNTAKEN:
+                if (sym.movable) {
+                    write_be32(field, (read_be32(field) & 0xFFFF0003) | (target & 0xFFFC));
+                }
+                break;
+
+            case R_PPC_REL24:
+                if (!sym.movable) {
+                    int32_t disp = static_cast<int32_t>(target - place);
+                    if (disp < -0x2000000 || disp >= 0x2000000) {
+                        error = "branch at " + hex(r.addr) + " out of range once moved";
+                        return false;
+                    }
+                    write_be32(field, (read_be32(field) & 0xFC000003) | (disp & 0x03FFFFFC));
+                }
+                break;
+
+            case R_PPC_REL14:
+            case R_PPC_REL14_BRTAKEN:
+            case R_PPC_REL14_BRNTAKEN:
+                if (!sym.movable) {
+                    int32_t disp = static_cast<int32_t>(target - place);
+                    if (disp < -0x8000 || disp >= 0x8000) {
+                        error = "branch at " + hex(r.addr) + " out of range once moved";
+                        return false;
+                    }
+                    write_be32(field, (read_be32(field) & 0xFFFF0003) | (disp & 0xFFFC));
+                }
+                break;
+
+            case R_PPC_REL32:
+                if (!sym.movable) write_be32(field, target - place);
+                break;
+
+            case R_PPC_EMB_SDA21:
+                // Relative to _SDA_BASE_, which moves with the image
+                if (!sym.movable) {
+                    error = "small data reference to an absolute symbol at " + hex(r.addr);
+                    return false;
+                }
+                break;
+
+            default:
+                error = "unsupported relocation type " + std::to_string(r.type) + " at " + hex(r.addr);
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace dolhook
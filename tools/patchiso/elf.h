@@ -0,0 +1,59 @@
+/**
+ * ELF Payload Loader
+ * Big-endian 32-bit PowerPC executables, relocated to a chosen load address
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+// A linked payload. Moving it needs the relocations the linker keeps with
+// --emit-relocs (-q); without them it can only load at its link address.
+class ElfImage {
+public:
+    // Parse an ET_EXEC for EM_PPC; error says why not
+    bool load(const std::vector<uint8_t>& data, std::string& error);
+
+    // Link address of the lowest allocated section
+    uint32_t base() const { return base_; }
+
+    // Bytes from base() to the end of the last allocated section, BSS included
+    uint32_t footprint() const { return end_ - base_; }
+
+    bool has_relocations() const { return !relocs_.empty(); }
+
+    // Named symbols at their link-time values
+    std::map<std::string, uint32_t> symbols() const;
+
+    // The initialized image (as objcopy -O binary would extract it) moved to
+    // load_addr, and the symbols moved with it
+    bool relocate(uint32_t load_addr, std::vector<uint8_t>& image,
+                  std::map<std::string, uint32_t>& symbols, std::string& error) const;
+
+private:
+    struct Symbol {
+        uint32_t value;
+        bool movable;  // Defined in a section, so it moves with the image
+    };
+
+    struct Reloc {
+        uint32_t addr;  // Field address at link time
+        uint32_t type;
+        uint32_t symbol;
+        int32_t addend;
+    };
+
+    std::vector<uint8_t> image_;   // Initialized bytes from base_
+    std::vector<Symbol> symtab_;   // By symbol index
+    std::map<std::string, Symbol> named_;
+    std::vector<Reloc> relocs_;
+    uint32_t base_ = 0;
+    uint32_t end_ = 0;
+};
+
+} // namespace dolhook
@@ -0,0 +1,246 @@
+/**
+ * FST Implementation
+ */
+
+#include "fst.h"
+#include "container.h"
+#include "gcm.h"
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dolhook {
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Case-insensitive ordering of two path slices
+static int path_compare(const char* a, size_t a_len, const char* b, size_t b_len) {
+    size_t n = std::min(a_len, b_len);
+    for (size_t i = 0; i < n; i++) {
+        int ca = std::tolower(static_cast<unsigned char>(a[i]));
+        int cb = std::tolower(static_cast<unsigned char>(b[i]));
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+/* ============================================================================
+ * FstIndex
+ * ========================================================================= */
+
+bool FstIndex::parse(const uint8_t* data, size_t size) {
+    entries_.clear();
+    pool_.clear();
+    sorted_.clear();
+
+    if (size < FstEntry::RAW_SIZE || data[0] != 1) return false;
+
+    uint32_t count = read_be32(data + 8);
+    if (count == 0 || count > size / FstEntry::RAW_SIZE) return false;
+
+    const char* strings = reinterpret_cast<const char*>(data) + size_t(count) * FstEntry::RAW_SIZE;
+    size_t strings_size = size - size_t(count) * FstEntry::RAW_SIZE;
+
+    entries_.reserve(count);
+    entries_.push_back({true, 0, count, 0, 0, 0, 0, 0});
+
+    // Open directories, innermost last
+    std::vector<uint32_t> dirs = {0};
+
+    for (uint32_t i = 1; i < count; i++) {
+        const uint8_t* raw = data + size_t(i) * FstEntry::RAW_SIZE;
+        while (entries_[dirs.back()].end <= i) dirs.pop_back();  // Root never closes early
+
+        uint32_t name_off = read_be32(raw) & 0xFFFFFF;
+        if (name_off >= strings_size) return false;
+        const char* name = strings + name_off;
+        size_t name_len = strnlen(name, strings_size - name_off);
+        if (name_off + name_len >= strings_size || name_len == 0) return false;
+
+        // Names become host paths on extraction; never let one climb out
+        std::string_view name_view(name, name_len);
+        if (name_view == "." || name_view == ".." || name_view.find('/') != std::string_view::npos) {
+            return false;
+        }
+
+        FstEntry e{};
+        e.is_dir = raw[0] != 0;
+        e.parent = dirs.back();
+        if (e.is_dir) {
+            e.end = read_be32(raw + 8);
+            if (e.end <= i || e.end > entries_[e.parent].end) return false;
+        } else {
+            e.end = i + 1;
+            e.offset = read_be32(raw + 4);
+            e.size = read_be32(raw + 8);
+        }
+
+        // Full path = parent path + '/' + name
+        const FstEntry& parent = entries_[e.parent];
+        e.path_offset = static_cast<uint32_t>(pool_.size());
+        if (parent.path_len) {
+            std::string prefix = pool_.substr(parent.path_offset, parent.path_len);
+            pool_ += prefix;
+            pool_ += '/';
+        }
+        pool_.append(name, name_len);
+        e.path_len = static_cast<uint32_t>(pool_.size() - e.path_offset);
+        e.name_len = static_cast<uint32_t>(name_len);
+
+        entries_.push_back(e);
+        if (e.is_dir) dirs.push_back(i);
+    }
+
+    sorted_.resize(count - 1);
+    for (uint32_t i = 1; i < count; i++) sorted_[i - 1] = i;
+    std::sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b) {
+        return path_compare(path_data(a), entries_[a].path_len, path_data(b), entries_[b].path_len) < 0;
+    });
+
+    return true;
+}
+
+bool FstIndex::load(const GCMFile& iso) {
+    const GCMHeader& hdr = iso.header();
+    if (hdr.fst_size == 0 || uint64_t(hdr.fst_offset) + hdr.fst_size > iso.size()) return false;
+
+    std::vector<uint8_t> raw(hdr.fst_size);
+    if (!iso.read_into(hdr.fst_offset, raw.data(), raw.size())) return false;
+    return parse(raw.data(), raw.size());
+}
+
+std::string FstIndex::path(uint32_t index) const {
+    return std::string(path_data(index), entries_[index].path_len);
+}
+
+std::string FstIndex::name(uint32_t index) const {
+    const FstEntry& e = entries_[index];
+    return std::string(path_data(index) + e.path_len - e.name_len, e.name_len);
+}
+
+uint32_t FstIndex::find(const std::string& path) const {
+    size_t begin = path.find_first_not_of('/');
+    if (begin == std::string::npos) return entries_.empty() ? NOT_FOUND : 0;
+    size_t end = path.find_last_not_of('/') + 1;
+
+    const char* key = path.data() + begin;
+    size_t key_len = end - begin;
+
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), 0u, [&](uint32_t idx, uint32_t) {
+        return path_compare(path_data(idx), entries_[idx].path_len, key, key_len) < 0;
+    });
+    if (it == sorted_.end()) return NOT_FOUND;
+    if (path_compare(path_data(*it), entries_[*it].path_len, key, key_len) != 0) return NOT_FOUND;
+    return *it;
+}
+
+std::vector<uint32_t> FstIndex::children(uint32_t dir) const {
+    std::vector<uint32_t> out;
+    if (dir >= entries_.size() || !entries_[dir].is_dir) return out;
+
+    // Skip over each child's subtree
+    for (uint32_t i = dir + 1; i < entries_[dir].end; i = entries_[i].end) {
+        out.push_back(i);
+    }
+    return out;
+}
+
+uint64_t FstIndex::total_size(uint32_t index) const {
+    uint64_t total = 0;
+    for (uint32_t i = index; i < entries_[index].end; i++) {
+        if (!entries_[i].is_dir) total += entries_[i].size;
+    }
+    return total;
+}
+
+/* ============================================================================
+ * FstExtractor
+ * ========================================================================= */
+
+FstExtractor::~FstExtractor() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool FstExtractor::open(const std::string& image_path) {
+    if (fd_ >= 0) ::close(fd_);
+    container_ = ContainerBlockDevice::open(image_path);
+    fd_ = ::open(image_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return false;
+
+    off_t end = lseek(fd_, 0, SEEK_END);
+    if (end < 0) return false;
+    size_ = container_ ? container_->size() : static_cast<uint64_t>(end);
+    return true;
+}
+
+// Decoded bytes of a container image to the current position of out_fd
+static bool copy_decoded(const BlockDevice& dev, uint64_t offset, int out_fd, uint64_t len) {
+    std::vector<uint8_t> buf;
+    while (len > 0) {
+        buf.resize(std::min<uint64_t>(len, 1 << 20));
+        if (!dev.read(offset, buf.data(), buf.size())) return false;
+
+        for (size_t done = 0; done < buf.size();) {
+            ssize_t w = write(out_fd, buf.data() + done, buf.size() - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            done += w;
+        }
+        offset += buf.size();
+        len -= buf.size();
+    }
+    return true;
+}
+
+bool FstExtractor::extract(const FstEntry& entry, const std::string& out_path) const {
+    if (fd_ < 0 || entry.is_dir) return false;
+    if (uint64_t(entry.offset) + entry.size > size_) return false;
+
+    int out = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) return false;
+
+    bool ok = container_ ? copy_decoded(*container_, entry.offset, out, entry.size)
+                         : copy_fd_range(fd_, entry.offset, out, entry.size);
+    ok = (::close(out) == 0) && ok;
+    if (!ok) std::remove(out_path.c_str());
+    return ok;
+}
+
+long FstExtractor::extract_tree(const FstIndex& fst, uint32_t index, const std::string& out_dir) const {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    long files = 0;
+
+    const FstEntry& top = fst.entry(index);
+    if (!top.is_dir) {
+        fs::path out = fs::path(out_dir) / fst.path(index);
+        fs::create_directories(out.parent_path(), ec);
+        return extract(top, out.string()) ? 1 : -1;
+    }
+
+    fs::create_directories(fs::path(out_dir) / fst.path(index), ec);
+    if (ec) return -1;
+
+    // Pre-order: every directory is created before its contents
+    for (uint32_t i = index + 1; i < top.end; i++) {
+        fs::path out = fs::path(out_dir) / fst.path(i);
+        if (fst.entry(i).is_dir) {
+            fs::create_directories(out, ec);
+            if (ec) return -1;
+        } else {
+            if (!extract(fst.entry(i), out.string())) return -1;
+            files++;
+        }
+    }
+    return files;
+}
+
+} // namespace dolhook
@@ -0,0 +1,95 @@
+/**
+ * FST (File System Table)
+ * Flat index over the disc file system with sorted path lookup
+ */
+
+#pragma once
+
+#include "blockdev.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+class GCMFile;
+
+struct FstEntry {
+    static constexpr size_t RAW_SIZE = 12;
+
+    bool is_dir;
+    uint32_t parent;       // Index of the containing directory (root = 0)
+    uint32_t end;          // One past the last descendant (file: index + 1)
+    uint32_t offset;       // File: disc offset
+    uint32_t size;         // File: length in bytes
+    uint32_t path_offset;  // Full path ("dir/file.ext") in the path pool
+    uint32_t path_len;
+    uint32_t name_len;     // Trailing component of the path
+};
+
+// Entries stay in on-disc (pre-order) order, so a directory's subtree is
+// the contiguous range [index + 1, end). Paths live in one pool and a
+// case-insensitive sorted permutation gives O(log n) lookup.
+class FstIndex {
+public:
+    static constexpr uint32_t NOT_FOUND = ~0u;
+
+    // Parse a raw FST (big-endian entries followed by the string table)
+    bool parse(const uint8_t* data, size_t size);
+
+    // Read and parse the FST named by the image header
+    bool load(const GCMFile& iso);
+
+    size_t count() const { return entries_.size(); }
+    const FstEntry& entry(uint32_t index) const { return entries_[index]; }
+
+    // "dir/file.ext"; the root is ""
+    std::string path(uint32_t index) const;
+    std::string name(uint32_t index) const;
+
+    // Case-insensitive, leading '/' optional; NOT_FOUND if absent
+    uint32_t find(const std::string& path) const;
+
+    // Direct children of a directory, in disc order
+    std::vector<uint32_t> children(uint32_t dir) const;
+
+    // Total bytes of the files under a directory (or one file)
+    uint64_t total_size(uint32_t index) const;
+
+private:
+    const char* path_data(uint32_t index) const { return pool_.data() + entries_[index].path_offset; }
+
+    std::vector<FstEntry> entries_;
+    std::string pool_;
+    std::vector<uint32_t> sorted_;  // Entry indices ordered by path
+};
+
+// Copies file ranges out of an image without staging them in memory
+// (copy_file_range, then sendfile, then a pread/write loop). Containers
+// are decoded through their block device instead.
+class FstExtractor {
+public:
+    FstExtractor() = default;
+    ~FstExtractor();
+
+    FstExtractor(const FstExtractor&) = delete;
+    FstExtractor& operator=(const FstExtractor&) = delete;
+
+    bool open(const std::string& image_path);
+
+    // Write one file entry to out_path
+    bool extract(const FstEntry& entry, const std::string& out_path) const;
+
+    // Extract a file or a whole directory tree below out_dir; returns the
+    // number of files written, or -1 on the first failure
+    long extract_tree(const FstIndex& fst, uint32_t index, const std::string& out_dir) const;
+
+private:
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    std::shared_ptr<BlockDevice> container_;
+};
+
+} // namespace dolhook
@@ -3,12 +3,21 @@
  */
 
 #include "gcm.h"
+#include "journal.h"
+#include "rebuild.h"
 #include <fstream>
 #include <cstring>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 namespace dolhook {
 
@@ -64,11 +73,9 @@ bool GCMHeader::is_valid() const {
     // Check magic/game code sanity
     if (game_code[0] == 0) return false;
     
-    // DOL offset should be reasonable
-    if (dol_offset < SIZE || dol_offset > 0x10000000) return false;
-    
-    // FST offset should be after DOL
-    if (fst_offset < dol_offset || fst_offset > 0x10000000) return false;
+    // DOL and FST live past the boot block; a rebuild may place either first
+    if (dol_offset < SIZE || dol_offset >= GCM_DISC_SIZE) return false;
+    if (fst_offset < SIZE || fst_offset >= GCM_DISC_SIZE) return false;
     
     return true;
 }
@@ -86,135 +93,648 @@ std::string GCMHeader::format() const {
     return oss.str();
 }
 
+static bool same_file(const std::string& a, const std::string& b) {
+    std::error_code ec;
+    return !a.empty() && std::filesystem::equivalent(a, b, ec);
+}
+
+static std::string journal_path(const std::string& path) {
+    return path + ".journal";
+}
+
 bool GCMFile::load(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file) return false;
+    // Finish an interrupted in-place commit before looking at the image
+    ExtentLog pending;
+    if (read_extent_log(journal_path(path), JOURNAL_MAGIC, pending)) {
+        if (!apply_extent_log(path, pending)) return false;
+    }
+    std::remove(journal_path(path).c_str());
     
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    path_ = path;
+    if (!reopen()) return false;
+    if (size_ < GCMHeader::SIZE) return false;
     
-    data_.resize(size);
-    file.read(reinterpret_cast<char*>(data_.data()), size);
+    // Only the header is touched here; everything else is paged on demand
+    uint8_t hdr[GCMHeader::SIZE];
+    if (!device_->read(0, hdr, sizeof(hdr))) return false;
     
-    if (!file) return false;
+    return header_.parse(hdr);
+}
+
+bool GCMFile::reopen() {
+    device_ = open_block_device(path_);
+    if (!device_) return false;
     
-    path_ = path;
-    return header_.parse(data_.data());
+    overlay_.clear();
+    size_ = device_->size();
+    return true;
+}
+
+const ContainerBlockDevice* GCMFile::container() const {
+    return dynamic_cast<const ContainerBlockDevice*>(device_.get());
+}
+
+bool GCMFile::load(std::vector<uint8_t> image) {
+    device_ = std::make_shared<MemoryBlockDevice>(std::move(image));
+    overlay_.clear();
+    size_ = device_->size();
+    path_.clear();
+    
+    if (size_ < GCMHeader::SIZE) return false;
+    return header_.parse(device_->view(0, GCMHeader::SIZE));
 }
 
+void GCMFile::flush_header() {
+    uint8_t cur[GCMHeader::SIZE];
+    if (!read_into(0, cur, sizeof(cur))) return;
+    
+    uint8_t hdr[GCMHeader::SIZE];
+    std::memcpy(hdr, cur, sizeof(hdr));
+    header_.serialize(hdr);
+    
+    // Usually only dol_offset changes; don't dirty the whole header
+    size_t i = 0;
+    while (i < sizeof(hdr)) {
+        if (hdr[i] == cur[i]) {
+            i++;
+            continue;
+        }
+        size_t run = i;
+        while (run < sizeof(hdr) && hdr[run] != cur[run]) run++;
+        overlay_write(i, hdr + i, run - i);
+        i = run;
+    }
+}
+
+void GCMFile::compact_overlay() {
+    // Runs closer than this stay merged; one pwrite beats several tiny ones
+    constexpr uint64_t MERGE_GAP = 64;
+    
+    uint64_t dev_size = device_ ? device_->size() : 0;
+    std::map<uint64_t, std::vector<uint8_t>> compacted;
+    std::vector<uint8_t> orig;
+    
+    for (auto& ext : overlay_) {
+        const uint64_t off = ext.first;
+        std::vector<uint8_t>& data = ext.second;
+        
+        // Growth past the source is always dirty
+        if (off >= dev_size) {
+            compacted.emplace(off, std::move(data));
+            continue;
+        }
+        
+        size_t cmp_len = static_cast<size_t>(std::min<uint64_t>(data.size(), dev_size - off));
+        const uint8_t* src = device_->view(off, cmp_len);
+        if (!src) {
+            orig.resize(cmp_len);
+            if (!device_->read(off, orig.data(), cmp_len)) {
+                compacted.emplace(off, std::move(data));
+                continue;
+            }
+            src = orig.data();
+        }
+        
+        // Differing runs; a tail past the source extends the last run
+        size_t i = 0;
+        bool have_run = false;
+        size_t run_start = 0, run_end = 0;
+        auto emit = [&]() {
+            compacted.emplace(off + run_start,
+                              std::vector<uint8_t>(data.begin() + run_start, data.begin() + run_end));
+        };
+        
+        while (i < data.size()) {
+            if (i < cmp_len && data[i] == src[i]) {
+                i++;
+                continue;
+            }
+            size_t j = i;
+            while (j < data.size() && (j >= cmp_len || data[j] != src[j])) j++;
+            
+            if (have_run && i - run_end < MERGE_GAP) {
+                run_end = j;
+            } else {
+                if (have_run) emit();
+                run_start = i;
+                run_end = j;
+                have_run = true;
+            }
+            i = j;
+        }
+        if (have_run) emit();
+    }
+    
+    overlay_ = std::move(compacted);
+}
+
+bool GCMFile::output_matches(const std::string& path) {
+    if (path_.empty() || same_file(path, path_)) return false;
+    
+    // Untouched ranges were copied from the source; only trust fresh outputs
+    std::error_code ec_in, ec_out;
+    auto t_in = std::filesystem::last_write_time(path_, ec_in);
+    auto t_out = std::filesystem::last_write_time(path, ec_out);
+    if (ec_in || ec_out || t_out < t_in) return false;
+    
+    auto out = open_block_device(path);
+    if (!out || out->size() != size_) return false;
+    
+    flush_header();
+    
+    std::vector<std::pair<uint64_t, uint64_t>> ranges = {{0, GCMHeader::SIZE}};
+    for (const auto& ext : overlay_) {
+        ranges.emplace_back(ext.first, ext.second.size());
+    }
+    
+    constexpr size_t CHUNK = 1 << 20;
+    std::vector<uint8_t> want, have;
+    for (const auto& r : ranges) {
+        for (uint64_t pos = r.first; pos < r.first + r.second; pos += CHUNK) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK, r.first + r.second - pos));
+            want.resize(n);
+            have.resize(n);
+            if (!read_into(pos, want.data(), n) || !out->read(pos, have.data(), n)) return false;
+            if (want != have) return false;
+        }
+    }
+    
+    return true;
+}
+
+std::vector<Extent> GCMFile::dirty_extents() {
+    flush_header();
+    compact_overlay();
+    
+    std::vector<Extent> out;
+    out.reserve(overlay_.size());
+    for (const auto& ext : overlay_) {
+        out.push_back({ext.first, ext.second.size()});
+    }
+    return out;
+}
+
+uint64_t GCMFile::dirty_bytes() {
+    uint64_t total = 0;
+    for (const auto& ext : dirty_extents()) total += ext.size;
+    return total;
+}
+
+bool GCMFile::commit_in_place() {
+    if (path_.empty() || !device_) return false;
+    
+    flush_header();
+    compact_overlay();
+    uint64_t base_size = device_->size();
+    if (overlay_.empty() && size_ == base_size) {
+        return true; // Nothing to do
+    }
+    
+    // Containers can't take pwrites: rewrite with only the dirty blocks
+    // re-encoded, then swap the new file in atomically
+    if (const ContainerBlockDevice* src = container()) {
+        std::string tmp = path_ + ".tmp";
+        if (!write_container_to(tmp, src->format())) return false;
+        
+        std::error_code ec;
+        std::filesystem::rename(tmp, path_, ec);
+        if (ec) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        sync_parent_dir(path_);
+        return reopen();
+    }
+    
+    std::vector<ExtentSpan> spans;
+    spans.reserve(overlay_.size());
+    for (const auto& ext : overlay_) {
+        spans.push_back({ext.first, ext.second.data(), ext.second.size()});
+    }
+    
+    // 1. Durable redo journal; until it is complete the image is untouched
+    std::string jpath = journal_path(path_);
+    if (!write_extent_log(jpath, JOURNAL_MAGIC, base_size, size_, spans)) {
+        std::remove(jpath.c_str());
+        return false;
+    }
+    
+    // 2. pwrite just the dirty extents and fsync
+    ExtentLog log;
+    log.from_size = base_size;
+    log.to_size = size_;
+    for (auto& ext : overlay_) {
+        log.extents.emplace_back(ext.first, std::move(ext.second));
+    }
+    overlay_.clear();
+    
+    if (!apply_extent_log(path_, log)) {
+        return false; // Journal stays; next load() finishes the job
+    }
+    
+    // 3. Retire the journal
+    std::remove(jpath.c_str());
+    sync_parent_dir(jpath);
+    
+    return reopen();
+}
+
+
 bool GCMFile::save(const std::string& path) {
     // Update header in data
-    if (data_.size() < GCMHeader::SIZE) {
+    if (size_ < GCMHeader::SIZE) {
         return false;
     }
-    header_.serialize(data_.data());
+    flush_header();
+    
+    // The source is still mapped, so never truncate it underneath ourselves
+    bool in_place = same_file(path, path_);
+    std::string out_path = in_place ? path + ".tmp" : path;
     
-    std::ofstream file(path, std::ios::binary);
-    if (!file) return false;
+    ContainerFormat format = container_format_for(path);
+    if (format != ContainerFormat::Raw) {
+        if (!write_container_to(out_path, format)) return false;
+    } else {
+        int fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        
+        // Reads, hashing and writes overlap; zero padding is left as holes
+        auto reader = [this](uint64_t offset, void* out, size_t len) {
+            return read_into(offset, out, len);
+        };
+        stream_stats_ = StreamStats();
+        bool ok = stream_image(fd, size_, reader, StreamOptions(), &stream_stats_);
+        ok = ok && finish_sparse(fd, size_);
+        if (::close(fd) != 0) ok = false;
+        if (!ok) return false;
+    }
     
-    file.write(reinterpret_cast<const char*>(data_.data()), data_.size());
+    if (in_place) {
+        std::error_code ec;
+        std::filesystem::rename(out_path, path, ec);
+        if (ec) return false;
+    }
     
-    return file.good();
+    return true;
 }
 
-bool GCMFile::create_backup(const std::string& original_path) {
-    std::string backup_path = original_path + ".bak";
+bool GCMFile::write_container_to(const std::string& path, ContainerFormat format) {
+    auto dirty = dirty_extents();
+    auto reader = [this](uint64_t offset, void* dst, size_t len) {
+        return read_into(offset, dst, len);
+    };
     
-    try {
-        std::filesystem::copy_file(
-            original_path,
-            backup_path,
-            std::filesystem::copy_options::skip_existing
-        );
-        return true;
-    } catch (...) {
+    // Junk only ever lies in space no file, DOL or FST claims
+    std::vector<JunkRegion> junk;
+    FstIndex fst;
+    FreeSpaceMap space;
+    if (scrub_ && fst.load(*this) && build_free_space(*this, fst, space)) {
+        std::vector<Extent> gaps;
+        for (const auto& gap : space.extents()) {
+            if (gap.first >= size_) break;
+            gaps.push_back({gap.first, std::min(gap.second, size_ - gap.first)});
+        }
+        junk = find_junk(reader, gaps, 0);
+    } else if (container()) {
+        junk = clip_junk(container()->junk(), dirty, size_);
+    }
+    
+    return write_container(path, format, 0, size_, reader, container(), dirty, junk, 0, &container_stats_);
+}
+
+// Reflink clone: shares all blocks with the source until either is written
+static bool clone_file(const std::string& from, const std::string& to) {
+#ifdef FICLONE
+    int src = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) return false;
+    
+    int dst = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (dst < 0) {
+        ::close(src);
         return false;
     }
+    
+    bool ok = ioctl(dst, FICLONE, src) == 0 && fsync(dst) == 0;
+    ::close(dst);
+    ::close(src);
+    
+    if (!ok) std::remove(to.c_str());
+    return ok;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
 }
 
-DOLFile GCMFile::read_dol() const {
-    DOLFile dol;
+GCMFile::BackupKind GCMFile::create_backup() {
+    if (path_.empty() || !device_) return BackupKind::Failed;
+    
+    std::string bak = path_ + ".bak";
+    std::string delta = path_ + ".delta";
     
-    // Read DOL data starting at offset
+    std::error_code ec;
+    if (std::filesystem::exists(bak, ec)) {
+        return BackupKind::Existing;
+    }
+    
+    // A container is replaced on commit, never written through, so the
+    // original inode survives as the backup. Deltas don't apply to it.
+    if (container()) {
+        if (::link(path_.c_str(), bak.c_str()) == 0) {
+            sync_parent_dir(bak);
+            return BackupKind::Link;
+        }
+        if (clone_file(path_, bak)) return BackupKind::Clone;
+        std::filesystem::copy_file(path_, bak, ec);
+        return ec ? BackupKind::Failed : BackupKind::Copy;
+    }
+    
+    if (!std::filesystem::exists(delta, ec) && clone_file(path_, bak)) {
+        return BackupKind::Clone;
+    }
+    
+    // An earlier delta already holds the original bytes for its ranges,
+    // and everything outside them is still original on disk
+    ExtentLog log;
+    bool have_old = read_extent_log(delta, DELTA_MAGIC, log);
+    uint64_t original_size = have_old ? log.to_size : device_->size();
+    uint64_t limit = std::min(original_size, device_->size());
+    
+    std::vector<Extent> covered;
+    for (const auto& ext : log.extents) {
+        covered.push_back({ext.first, ext.second.size()});
+    }
+    
+    for (const auto& ext : dirty_extents()) {
+        uint64_t pos = ext.offset;
+        uint64_t end = std::min(ext.offset + ext.size, limit);
+        
+        // Subtract already-covered ranges (covered is sorted, disjoint)
+        for (const auto& c : covered) {
+            if (pos >= end) break;
+            if (c.offset + c.size <= pos || c.offset >= end) continue;
+            if (c.offset > pos) {
+                std::vector<uint8_t> orig(c.offset - pos);
+                if (!device_->read(pos, orig.data(), orig.size())) return BackupKind::Failed;
+                log.extents.emplace_back(pos, std::move(orig));
+            }
+            pos = c.offset + c.size;
+        }
+        
+        if (pos < end) {
+            std::vector<uint8_t> orig(end - pos);
+            if (!device_->read(pos, orig.data(), orig.size())) return BackupKind::Failed;
+            log.extents.emplace_back(pos, std::move(orig));
+        }
+    }
+    
+    std::sort(log.extents.begin(), log.extents.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    
+    std::vector<ExtentSpan> spans;
+    for (const auto& ext : log.extents) {
+        spans.push_back({ext.first, ext.second.data(), ext.second.size()});
+    }
+    
+    // Replace atomically so a crash never loses the previous delta
+    std::string tmp = delta + ".tmp";
+    if (!write_extent_log(tmp, DELTA_MAGIC, size_, original_size, spans)) {
+        std::remove(tmp.c_str());
+        return BackupKind::Failed;
+    }
+    std::filesystem::rename(tmp, delta, ec);
+    if (ec) return BackupKind::Failed;
+    
+    sync_parent_dir(delta);
+    return BackupKind::Delta;
+}
+
+bool GCMFile::restore_backup(const std::string& path) {
+    std::string bak = path + ".bak";
+    std::string delta = path + ".delta";
+    std::error_code ec;
+    
+    ExtentLog log;
+    if (read_extent_log(delta, DELTA_MAGIC, log)) {
+        if (!apply_extent_log(path, log)) return false;
+        std::remove(delta.c_str());
+        return sync_parent_dir(delta);
+    }
+    
+    if (std::filesystem::exists(bak, ec)) {
+        std::filesystem::rename(bak, path, ec);
+        return !ec && sync_parent_dir(path);
+    }
+    
+    return false;
+}
+
+uint32_t GCMFile::dol_size() const {
     uint32_t dol_start = header_.dol_offset;
     
     // Read at least header first
-    if (dol_start + 0x100 > data_.size()) {
-        return dol;
+    if (uint64_t(dol_start) + DOLHeader::SIZE > size_) {
+        return 0;
     }
     
     // Parse header to determine full size
+    uint8_t hdr[0x200] = {};
+    size_t hdr_len = static_cast<size_t>(std::min<uint64_t>(sizeof(hdr), size_ - dol_start));
+    if (!read_into(dol_start, hdr, hdr_len)) {
+        return 0;
+    }
+    
     DOLHeader temp_header;
-    if (!temp_header.parse(data_.data() + dol_start)) {
-        return dol;
+    if (!temp_header.parse(hdr)) {
+        return 0;
     }
     
     // Find end of DOL (highest file offset + size)
-    uint32_t dol_end = 0x100; // At least header
+    uint32_t dol_end = DOLHeader::SIZE; // At least header
     auto sections = temp_header.get_sections();
     for (const auto& sec : sections) {
         uint32_t sec_end = sec.file_offset + sec.size;
         if (sec_end > dol_end) dol_end = sec_end;
     }
+    return dol_end;
+}
+
+DOLFile GCMFile::read_dol() const {
+    DOLFile dol;
     
-    // Extract DOL data
-    std::vector<uint8_t> dol_data(
-        data_.begin() + dol_start,
-        data_.begin() + dol_start + dol_end
-    );
+    uint32_t dol_start = header_.dol_offset;
+    uint32_t dol_end = dol_size();
+    if (dol_end == 0 || uint64_t(dol_start) + dol_end > size_) {
+        return dol;
+    }
+    
+    // Unmodified mapped bytes are viewed in place; the device stays alive
+    // for as long as the DOL does
+    if (device_ && !overlay_touches(dol_start, dol_end)) {
+        if (const uint8_t* mapped = device_->view(dol_start, dol_end)) {
+            dol.load(ByteView(mapped, dol_end), device_);
+            return dol;
+        }
+    }
     
-    dol.load(dol_data);
+    // Page in only the DOL range
+    std::vector<uint8_t> dol_data(dol_end);
+    if (!read_into(dol_start, dol_data.data(), dol_data.size())) {
+        return dol;
+    }
+    
+    dol.load(std::move(dol_data));
     return dol;
 }
 
 bool GCMFile::write_dol(const DOLFile& dol) {
-    auto dol_data = dol.save();
     uint32_t dol_start = header_.dol_offset;
     
-    // Check if it fits in place
-    uint32_t available = header_.fst_offset - dol_start;
-    if (dol_data.size() > available) {
+    // Check if it fits in place: nothing else may live in the bytes it grows
+    // into. Without a readable FST, assume the FST directly follows the DOL.
+    uint64_t placed = 0;
+    bool fits;
+    if (place_dol(*this, dol.size(), placed)) {
+        fits = placed == dol_start;
+    } else {
+        fits = header_.fst_offset > dol_start && dol.size() <= header_.fst_offset - dol_start;
+    }
+    if (!fits) {
         return false; // Need to relocate
     }
     
-    // Write in place
-    std::memcpy(data_.data() + dol_start, dol_data.data(), dol_data.size());
+    // Write in place, straight from the DOL's pieces
+    uint8_t dol_header[DOLHeader::SIZE];
+    overlay_write(dol_start, dol.gather(dol_header));
     
     return true;
 }
 
 bool GCMFile::relocate_dol(const DOLFile& dol) {
-    auto dol_data = dol.save();
-    
-    // Align to 0x8000 boundary at end of ISO
-    uint32_t new_offset = (data_.size() + 0x7FFF) & ~0x7FFF;
+
+    // Best-fit gap (or grow in place) when the FST can be mapped; otherwise
+    // align to 0x8000 boundary at end of ISO
+    uint64_t new_offset = 0;
+    if (!place_dol(*this, dol.size(), new_offset)) {
+        new_offset = (size_ + 0x7FFF) & ~uint64_t(0x7FFF);
+    }
     
-    // Expand ISO
-    data_.resize(new_offset + dol_data.size());
+    // Expand ISO if needed (padding reads back as zero)
+    size_ = std::max<uint64_t>(size_, new_offset + dol.size());
     
     // Write DOL
-    std::memcpy(data_.data() + new_offset, dol_data.data(), dol_data.size());
+    uint8_t dol_header[DOLHeader::SIZE];
+    overlay_write(new_offset, dol.gather(dol_header));
     
     // Update header
-    header_.dol_offset = new_offset;
+    header_.dol_offset = static_cast<uint32_t>(new_offset);
     
     return true;
 }
 
 std::vector<uint8_t> GCMFile::read(uint32_t offset, uint32_t size) const {
-    if (offset + size > data_.size()) {
+    std::vector<uint8_t> out(size);
+    if (!read_into(offset, out.data(), size)) {
         return {};
     }
-    return std::vector<uint8_t>(data_.begin() + offset, data_.begin() + offset + size);
+    return out;
+}
+
+bool GCMFile::read_into(uint64_t offset, void* dst, size_t len) const {
+    if (offset > size_ || len > size_ - offset) {
+        return false;
+    }
+    
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    uint64_t end = offset + len;
+    
+    // Original bytes; anything past the device (growth) is zero
+    uint64_t dev_size = device_ ? device_->size() : 0;
+    uint64_t dev_end = std::min(end, dev_size);
+    if (offset < dev_end) {
+        if (!device_->read(offset, out, dev_end - offset)) return false;
+    }
+    if (end > std::max(offset, dev_size)) {
+        uint64_t zero_from = std::max(offset, dev_size);
+        std::memset(out + (zero_from - offset), 0, end - zero_from);
+    }
+    
+    // Pending modifications
+    auto it = overlay_.upper_bound(offset);
+    if (it != overlay_.begin()) --it;
+    
+    for (; it != overlay_.end() && it->first < end; ++it) {
+        uint64_t ext_end = it->first + it->second.size();
+        if (ext_end <= offset) continue;
+        
+        uint64_t from = std::max(offset, it->first);
+        uint64_t to = std::min(end, ext_end);
+        std::memcpy(out + (from - offset), it->second.data() + (from - it->first), to - from);
+    }
+    
+    return true;
+}
+
+bool GCMFile::read_source(uint64_t offset, void* dst, size_t len) const {
+    return device_ && device_->read(offset, dst, len);
 }
 
 bool GCMFile::write(uint32_t offset, const std::vector<uint8_t>& data) {
-    if (offset + data.size() > data_.size()) {
-        data_.resize(offset + data.size());
+    if (offset + data.size() > size_) {
+        size_ = offset + data.size();
     }
-    std::memcpy(data_.data() + offset, data.data(), data.size());
+    overlay_write(offset, data.data(), data.size());
     return true;
 }
 
+void GCMFile::overlay_write(uint64_t offset, const uint8_t* src, size_t len) {
+    overlay_write(offset, std::vector<ByteView>{{src, len}});
+}
+
+void GCMFile::overlay_write(uint64_t offset, const std::vector<ByteView>& pieces) {
+    size_t len = 0;
+    for (const ByteView& piece : pieces) len += piece.size;
+    if (len == 0) return;
+    
+    uint64_t start = offset;
+    uint64_t end = offset + len;
+    
+    // First extent that overlaps or touches [offset, end)
+    auto first = overlay_.upper_bound(offset);
+    if (first != overlay_.begin()) {
+        auto prev = std::prev(first);
+        if (prev->first + prev->second.size() >= offset) first = prev;
+    }
+    
+    auto last = first;
+    while (last != overlay_.end() && last->first <= end) {
+        start = std::min(start, last->first);
+        end = std::max<uint64_t>(end, last->first + last->second.size());
+        ++last;
+    }
+    
+    // Union of touching extents is contiguous; newest bytes win
+    std::vector<uint8_t> merged(end - start);
+    for (auto it = first; it != last; ++it) {
+        std::memcpy(merged.data() + (it->first - start), it->second.data(), it->second.size());
+    }
+    uint8_t* dst = merged.data() + (offset - start);
+    for (const ByteView& piece : pieces) {
+        if (piece.size) std::memcpy(dst, piece.data, piece.size);
+        dst += piece.size;
+    }
+    
+    overlay_.erase(first, last);
+    overlay_.emplace(start, std::move(merged));
+}
+
+bool GCMFile::overlay_touches(uint64_t offset, uint64_t len) const {
+    auto it = overlay_.upper_bound(offset);
+    if (it != overlay_.begin() && std::prev(it)->first + std::prev(it)->second.size() > offset) {
+        return true;
+    }
+    return it != overlay_.end() && it->first < offset + len;
+}
+
 } // namespace dolhook
\ No newline at end of file
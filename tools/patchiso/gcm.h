@@ -7,10 +7,18 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
 #include "dol.h"
+#include "blockdev.h"
+#include "container.h"
+#include "pipeline.h"
 
 namespace dolhook {
 
+// Full GameCube disc; space past a trimmed image's end may still be used
+constexpr uint64_t GCM_DISC_SIZE = 0x57058000;
+
 struct GCMHeader {
     static constexpr size_t SIZE = 0x2440;
     
@@ -44,39 +52,123 @@ class GCMFile {
 public:
     GCMFile() = default;
     
-    // Load from file
+    // Open image; only the header is read up front
     bool load(const std::string& path);
     
-    // Save to file
+    // Open an in-memory image
+    bool load(std::vector<uint8_t> image);
+    
+    // Save to file; a .gcz/.ciso name writes that container
     bool save(const std::string& path);
     
-    // Create backup
-    bool create_backup(const std::string& original_path);
+    // Write only the dirty extents back to the loaded file.
+    // A redo journal (<path>.journal) makes the update crash-safe;
+    // load() replays a complete journal left behind by a crash.
+    // CISO/GCZ images are rewritten with only the dirty blocks re-encoded
+    // and atomically renamed over the original.
+    bool commit_in_place();
+    
+    // Extents that differ from the loaded file (header included)
+    std::vector<Extent> dirty_extents();
+    uint64_t dirty_bytes();
+    
+    // True if path already holds what save(path) would write: same size,
+    // not older than the source, identical header and modified ranges
+    bool output_matches(const std::string& path);
+    
+    // How create_backup() preserved the original
+    enum class BackupKind {
+        Failed,
+        Existing,  // <path>.bak already present
+        Clone,     // Reflink copy in <path>.bak
+        Link,      // Hard link in <path>.bak (containers are replaced, not modified)
+        Copy,      // Full copy of a container in <path>.bak
+        Delta      // Original bytes of the dirty extents in <path>.delta
+    };
+    
+    // Back up the loaded file before commit_in_place(). Tries a reflink
+    // clone first, then records only the bytes about to be overwritten.
+    BackupKind create_backup();
+    
+    // Undo in-place patching from <path>.delta or <path>.bak
+    static bool restore_backup(const std::string& path);
     
     // Getters
     const GCMHeader& header() const { return header_; }
     GCMHeader& header() { return header_; }
-    size_t size() const { return data_.size(); }
+    size_t size() const { return size_; }
+    const char* backend() const { return device_ ? device_->name() : "none"; }
+    
+    // Block counts of the last container written by save()/commit_in_place()
+    const ContainerWriteStats& container_stats() const { return container_stats_; }
+    
+    // Bytes, CRC32 and writer of the last raw image written by save()
+    const StreamStats& stream_stats() const { return stream_stats_; }
+    
+    // Look for junk in unused disc space when writing a container, and keep
+    // it as regenerable regions instead of stored data. Junk already recorded
+    // in a loaded container is carried over either way.
+    void set_scrub(bool scrub) { scrub_ = scrub; }
     
     // Read DOL from ISO
     DOLFile read_dol() const;
     
+    // Byte length of the DOL from its section table (0 if unreadable)
+    uint32_t dol_size() const;
+    
     // Write DOL back to ISO
     bool write_dol(const DOLFile& dol);
     
-    // Write DOL to new location (end of ISO)
+    // Write DOL to a new location: the best-fitting free gap, or the end of the ISO
     bool relocate_dol(const DOLFile& dol);
     
     // Read arbitrary data
     std::vector<uint8_t> read(uint32_t offset, uint32_t size) const;
     
+    // Read into caller buffer, including pending modifications
+    bool read_into(uint64_t offset, void* dst, size_t len) const;
+    
+    // The loaded image as it is on disk, without pending modifications
+    uint64_t source_size() const { return device_ ? device_->size() : 0; }
+    bool read_source(uint64_t offset, void* dst, size_t len) const;
+    void prefetch_source(uint64_t offset, size_t len) const {
+        if (device_) device_->prefetch(offset, len);
+    }
+    
     // Write arbitrary data
     bool write(uint32_t offset, const std::vector<uint8_t>& data);
     
 private:
+    // Record modified bytes, merging with touching extents
+    void overlay_write(uint64_t offset, const uint8_t* src, size_t len);
+    void overlay_write(uint64_t offset, const std::vector<ByteView>& pieces);
+    
+    // True if any modified extent intersects [offset, offset + len)
+    bool overlay_touches(uint64_t offset, uint64_t len) const;
+    
+    // Serialize header_, marking only changed bytes dirty
+    void flush_header();
+    
+    // Split extents down to the bytes that really differ from the source
+    void compact_overlay();
+    
+    // Reopen the device after the file changed underneath it
+    bool reopen();
+    
+    // Loaded container, or nullptr for raw images
+    const ContainerBlockDevice* container() const;
+    
+    // Write the current image as a container, passing clean blocks through
+    bool write_container_to(const std::string& path, ContainerFormat format);
+    
     GCMHeader header_;
-    std::vector<uint8_t> data_;
+    std::shared_ptr<BlockDevice> device_;
+    std::map<uint64_t, std::vector<uint8_t>> overlay_; // Modified extents, non-overlapping
+    uint64_t size_ = 0;
     std::string path_;
+    ContainerWriteStats container_stats_;
+    StreamStats stream_stats_;
+    bool scrub_ = false;
 };
 
 } // namespace dolhook
\ No newline at end of file
@@ -0,0 +1,238 @@
+/**
+ * Gecko Code Lists Implementation
+ *
+ * The runtime reads the list once at boot, so everything it would refuse
+ * there (unknown code types, truncated codes, too deep nesting) is refused
+ * here instead, at patch time.
+ */
+
+#include "gecko.h"
+#include "hash.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+namespace dolhook {
+
+namespace {
+
+constexpr uint32_t GCT_MAGIC = 0x00D0C0DE;
+constexpr uint32_t END_CODE = 0xF0000000;
+constexpr uint32_t MAX_DEPTH = 16;  // DH_GECKO_MAX_DEPTH
+constexpr size_t MAX_FRAME_WORDS = 1024;  // DH_GECKO_MAX_FRAME_WORDS
+
+} // namespace
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static void write_be32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static std::string hex8(uint32_t v) {
+    std::ostringstream oss;
+    oss << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << v;
+    return oss.str();
+}
+
+static bool parse_hex8(const std::string& token, uint32_t& out) {
+    if (token.size() != 8) return false;
+    out = 0;
+    for (char ch : token) {
+        if (!std::isxdigit(static_cast<unsigned char>(ch))) return false;
+        out = out << 4 | static_cast<uint32_t>(std::isdigit(static_cast<unsigned char>(ch))
+                                                   ? ch - '0' : std::tolower(ch) - 'a' + 10);
+    }
+    return true;
+}
+
+bool GeckoList::load(const std::string& path, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot read " + path;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), {});
+    if (!parse(data, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool GeckoList::parse(const std::vector<uint8_t>& data, std::string& error) {
+    std::vector<uint32_t> words;
+    std::vector<size_t> lines;  // Text line of each code line
+
+    if (data.size() >= 8 && read_be32(data.data()) == GCT_MAGIC && read_be32(data.data() + 4) == GCT_MAGIC) {
+        if (data.size() % 8 != 0) {
+            error = "GCT size is not a whole number of code lines";
+            return false;
+        }
+        for (size_t i = 8; i < data.size(); i += 4) {
+            words.push_back(read_be32(data.data() + i));
+        }
+    } else {
+        std::istringstream text(std::string(data.begin(), data.end()));
+        std::string line;
+        for (size_t number = 1; std::getline(text, line); number++) {
+            std::istringstream iss(line);
+            std::string first, second, rest;
+            if (!(iss >> first) || first[0] == '$' || first[0] == '*' || first[0] == '[' || first[0] == '#') {
+                continue;
+            }
+            uint32_t w0, w1;
+            if (!(iss >> second) || (iss >> rest) || !parse_hex8(first, w0) || !parse_hex8(second, w1)) {
+                error = "line " + std::to_string(number) + ": expected XXXXXXXX YYYYYYYY";
+                return false;
+            }
+            if (w0 == GCT_MAGIC && w1 == GCT_MAGIC) continue;
+            words.push_back(w0);
+            words.push_back(w1);
+            lines.push_back(number);
+        }
+    }
+
+    return check(words, lines, error);
+}
+
+// Walk the codes the way the runtime will, counting the words of its
+// per-frame program (everything inside a conditional) and resolving the
+// addresses of the writes it applies once
+bool GeckoList::check(const std::vector<uint32_t>& words, const std::vector<size_t>& lines, std::string& error) {
+    size_t count = 0;
+    size_t end = words.size();
+    size_t frame_words = 1;  // END
+    uint32_t depth = 0;
+    uint32_t ba = 0x80000000;
+    uint32_t po = 0x80000000;
+    std::vector<GeckoWrite> writes;
+
+    // E0/E2: ba and po take VVVV0000/WWWW0000 when those are non-zero
+    auto set_bases = [&](uint32_t w) {
+        if (w >> 16) ba = w & 0xFFFF0000;
+        if (w & 0xFFFF) po = w << 16;
+    };
+
+    for (size_t i = 0; i + 2 <= words.size();) {
+        uint32_t w0 = words[i];
+        uint32_t w1 = words[i + 1];
+        uint32_t top = w0 >> 24;
+        uint32_t type = top & 0xEE;
+        size_t size = 2;
+
+        auto where = [&]() {
+            std::string at = lines.empty() ? "offset 0x" + hex8(static_cast<uint32_t>(8 + i * 4))
+                                           : "line " + std::to_string(lines[i / 2]);
+            return at + " (" + hex8(w0) + " " + hex8(w1) + ")";
+        };
+
+        if (w0 == END_CODE) {
+            end = i;
+            break;
+        }
+
+        uint32_t addr = ((top & 0x10) ? po : ba) + (w0 & 0x01FFFFFF);
+        auto write_once = [&](uint32_t size, uint32_t count, uint32_t step) {
+            if (depth == 0) writes.push_back({addr, size, count, step, where()});
+        };
+
+        if (top == 0xE0) {
+            depth = 0;
+            set_bases(w1);
+        } else if (top == 0xE2) {
+            depth -= std::min(depth, w0 & 0xFF);
+            if (depth > 0 && ((w0 >> 20) & 0xF) == 1) frame_words += 1;
+            set_bases(w1);
+        } else if (top >= 0xE0) {
+            error = where() + ": unsupported code type " + hex8(top).substr(6);
+            return false;
+        } else if (type == 0x06) {
+            size += (static_cast<size_t>(w1) + 7) / 8 * 2;
+            if (depth > 0) frame_words += 2 + (static_cast<size_t>(w1) + 3) / 4;
+            write_once(w1, 1, 0);
+        } else if (type == 0x08) {
+            size = 4;
+            if (depth > 0) frame_words += 5;
+            if (i + 4 <= words.size() && (words[i + 2] >> 28) > 2) {
+                error = where() + ": serial write size must be 0, 1 or 2";
+                return false;
+            }
+            if (i + 4 <= words.size()) {
+                write_once(1u << (words[i + 2] >> 28), ((words[i + 2] >> 16) & 0xFFF) + 1, words[i + 2] & 0xFFFF);
+            }
+        } else if (type >= 0x20 && type <= 0x2E) {
+            if (w0 & 1) depth -= std::min<uint32_t>(depth, 1);
+            if (++depth > MAX_DEPTH) {
+                error = where() + ": conditionals nested deeper than " + std::to_string(MAX_DEPTH);
+                return false;
+            }
+            frame_words += 3;
+        } else if (type == 0xC2) {
+            if (w1 == 0) {
+                error = where() + ": insert has no code lines";
+                return false;
+            }
+            size += static_cast<size_t>(w1) * 2;
+            if (depth > 0) frame_words += 3;
+        } else if (type == 0x00 || type == 0x02 || type == 0x04) {
+            if (depth > 0) frame_words += 3;
+            // 00/02 fill (w1 >> 16) + 1 bytes or halfwords
+            uint32_t len = type == 0x04 ? 4 : (type == 0x02 ? 2 : 1) * ((w1 >> 16) + 1);
+            write_once(len, 1, 0);
+        } else {
+            error = where() + ": unsupported code type " + hex8(top).substr(6);
+            return false;
+        }
+
+        if (frame_words > MAX_FRAME_WORDS) {
+            error = where() + ": conditional codes exceed the runtime's " + std::to_string(MAX_FRAME_WORDS) +
+                    "-word per-frame program";
+            return false;
+        }
+
+        if (size > words.size() - i) {
+            error = where() + ": code runs past the end of the list";
+            return false;
+        }
+        i += size;
+        count++;
+    }
+
+    bytes_.assign(end * 4 + 8, 0);
+    for (size_t i = 0; i < end; i++) write_be32(&bytes_[i * 4], words[i]);
+    write_be32(&bytes_[end * 4], END_CODE);
+    writes_ = std::move(writes);
+    codes_ = count;
+    return true;
+}
+
+std::vector<GeckoWrite> GeckoList::writes_in(uint32_t start, uint32_t end) const {
+    std::vector<GeckoWrite> hits;
+    for (const auto& w : writes_) {
+        for (uint32_t n = 0; n < w.count; n++) {
+            uint64_t at = uint64_t(w.addr) + uint64_t(n) * w.step;
+            if (at < end && at + w.size > start) {
+                hits.push_back(w);
+                break;
+            }
+        }
+    }
+    return hits;
+}
+
+std::string GeckoList::digest() const {
+    Sha1 sha;
+    sha.update(bytes_.data(), bytes_.size());
+    return sha.hex_digest();
+}
+
+} // namespace dolhook
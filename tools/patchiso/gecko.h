@@ -0,0 +1,52 @@
+/**
+ * Gecko Code Lists
+ * Code lists embedded in the payload for the runtime's code engine
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+// A write the runtime applies once, at load (outside any conditional)
+struct GeckoWrite {
+    uint32_t addr = 0;
+    uint32_t size = 0;   // Bytes per write
+    uint32_t count = 1;
+    uint32_t step = 0;   // Address step between writes (serial writes)
+    std::string where;   // Line or offset and the code, for errors
+};
+
+// Codes checked against what runtime/src/gecko.c runs, stored as the
+// big-endian words it reads, ending with F0000000 00000000
+class GeckoList {
+public:
+    // A .gct file, or text with a "XXXXXXXX YYYYYYYY" line per code line
+    // ($names, *notes, [sections] and # comments are skipped)
+    bool load(const std::string& path, std::string& error);
+
+    // Same, from a file's contents
+    bool parse(const std::vector<uint8_t>& data, std::string& error);
+
+    size_t codes() const { return codes_; }
+
+    // The one-time writes that touch [start, end)
+    std::vector<GeckoWrite> writes_in(uint32_t start, uint32_t end) const;
+
+    const std::vector<uint8_t>& bytes() const { return bytes_; }
+
+    // SHA-1 over the list, for cache keys
+    std::string digest() const;
+
+private:
+    bool check(const std::vector<uint32_t>& words, const std::vector<size_t>& lines, std::string& error);
+
+    std::vector<uint8_t> bytes_;
+    std::vector<GeckoWrite> writes_;
+    size_t codes_ = 0;
+};
+
+} // namespace dolhook
@@ -0,0 +1,616 @@
+/**
+ * Hash Function Implementation
+ */
+
+#include "hash.h"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DOLHOOK_HASH_X86 1
+#endif
+
+namespace dolhook {
+
+static inline uint32_t rol32(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+static inline uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+std::string to_hex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(len * 2, '0');
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0xF];
+    }
+    return out;
+}
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+/* ============================================================================
+ * CRC-32
+ *
+ * Slicing-by-8 tables for the portable path; on x86-64 with PCLMULQDQ the
+ * bulk is folded 64 bytes at a time (Intel, "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction").
+ * ========================================================================= */
+
+static constexpr uint32_t CRC_POLY = 0xEDB88320;
+
+namespace {
+
+struct CrcTables {
+    uint32_t t[8][256];
+    uint32_t x2n[32]; // x^(2^n) mod P, for crc32_combine
+
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ CRC_POLY : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+
+        uint32_t p = 1u << 30; // x^1
+        x2n[0] = p;
+        for (int n = 1; n < 32; n++) x2n[n] = p = multmodp(p, p);
+    }
+
+    // a * b mod P in the reflected domain
+    static uint32_t multmodp(uint32_t a, uint32_t b) {
+        uint32_t m = 1u << 31, p = 0;
+        for (;;) {
+            if (a & m) {
+                p ^= b;
+                if ((a & (m - 1)) == 0) break;
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ CRC_POLY : b >> 1;
+        }
+        return p;
+    }
+};
+
+const CrcTables& crc_tables() {
+    static const CrcTables tables;
+    return tables;
+}
+
+} // namespace
+
+static uint32_t crc32_slice8(uint32_t c, const uint8_t* p, size_t len) {
+    const auto& t = crc_tables().t;
+
+    while (len && (reinterpret_cast<uintptr_t>(p) & 7)) {
+        c = t[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+        len--;
+    }
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t lo = load_le32(p) ^ c;
+        uint32_t hi = load_le32(p + 4);
+        c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    while (len--) c = t[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c;
+}
+
+#ifdef DOLHOOK_HASH_X86
+// len >= 64 and a multiple of 16; c is the pre-inverted running CRC
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t c, const uint8_t* p, size_t len) {
+    alignas(16) static const uint64_t k1k2[2] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[2] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[2] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[2] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(c)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    p += 64;
+    len -= 64;
+
+    // Four independent 128-bit lanes, 64 bytes per step
+    for (; len >= 64; p += 64, len -= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30)));
+    }
+
+    // Fold the lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    for (__m128i next : {x2, x3, x4}) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+    }
+
+    for (; len >= 16; p += 16, len -= 16) {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+#endif
+
+bool crc32_accelerated() {
+#ifdef DOLHOOK_HASH_X86
+    static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t c = ~crc;
+
+#ifdef DOLHOOK_HASH_X86
+    if (len >= 64 && crc32_accelerated()) {
+        size_t bulk = len & ~size_t(15);
+        c = crc32_pclmul(c, p, bulk);
+        p += bulk;
+        len -= bulk;
+    }
+#endif
+
+    return ~crc32_slice8(c, p, len);
+}
+
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    const auto& tables = crc_tables();
+
+    // x^(8 * len_b) mod P, by squaring
+    uint32_t xn = 1u << 31;
+    unsigned k = 3;
+    for (uint64_t n = len_b; n; n >>= 1, k++) {
+        if (n & 1) xn = CrcTables::multmodp(tables.x2n[k & 31], xn);
+    }
+    return CrcTables::multmodp(xn, crc_a) ^ crc_b;
+}
+
+/* ============================================================================
+ * MD5 (RFC 1321)
+ * ========================================================================= */
+
+void Md5::reset() {
+    h_[0] = 0x67452301;
+    h_[1] = 0xEFCDAB89;
+    h_[2] = 0x98BADCFE;
+    h_[3] = 0x10325476;
+    buf_len_ = 0;
+    total_ = 0;
+}
+
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, k, s) \
+    a = rol32(a + f(b, c, d) + (x) + (k), s) + b
+
+void Md5::block(const uint8_t* p) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) m[i] = load_le32(p + i * 4);
+
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3];
+
+    MD5_STEP(MD5_F, a, b, c, d, m[ 0], 0xd76aa478,  7);
+    MD5_STEP(MD5_F, d, a, b, c, m[ 1], 0xe8c7b756, 12);
+    MD5_STEP(MD5_F, c, d, a, b, m[ 2], 0x242070db, 17);
+    MD5_STEP(MD5_F, b, c, d, a, m[ 3], 0xc1bdceee, 22);
+    MD5_STEP(MD5_F, a, b, c, d, m[ 4], 0xf57c0faf,  7);
+    MD5_STEP(MD5_F, d, a, b, c, m[ 5], 0x4787c62a, 12);
+    MD5_STEP(MD5_F, c, d, a, b, m[ 6], 0xa8304613, 17);
+    MD5_STEP(MD5_F, b, c, d, a, m[ 7], 0xfd469501, 22);
+    MD5_STEP(MD5_F, a, b, c, d, m[ 8], 0x698098d8,  7);
+    MD5_STEP(MD5_F, d, a, b, c, m[ 9], 0x8b44f7af, 12);
+    MD5_STEP(MD5_F, c, d, a, b, m[10], 0xffff5bb1, 17);
+    MD5_STEP(MD5_F, b, c, d, a, m[11], 0x895cd7be, 22);
+    MD5_STEP(MD5_F, a, b, c, d, m[12], 0x6b901122,  7);
+    MD5_STEP(MD5_F, d, a, b, c, m[13], 0xfd987193, 12);
+    MD5_STEP(MD5_F, c, d, a, b, m[14], 0xa679438e, 17);
+    MD5_STEP(MD5_F, b, c, d, a, m[15], 0x49b40821, 22);
+    MD5_STEP(MD5_G, a, b, c, d, m[ 1], 0xf61e2562,  5);
+    MD5_STEP(MD5_G, d, a, b, c, m[ 6], 0xc040b340,  9);
+    MD5_STEP(MD5_G, c, d, a, b, m[11], 0x265e5a51, 14);
+    MD5_STEP(MD5_G, b, c, d, a, m[ 0], 0xe9b6c7aa, 20);
+    MD5_STEP(MD5_G, a, b, c, d, m[ 5], 0xd62f105d,  5);
+    MD5_STEP(MD5_G, d, a, b, c, m[10], 0x02441453,  9);
+    MD5_STEP(MD5_G, c, d, a, b, m[15], 0xd8a1e681, 14);
+    MD5_STEP(MD5_G, b, c, d, a, m[ 4], 0xe7d3fbc8, 20);
+    MD5_STEP(MD5_G, a, b, c, d, m[ 9], 0x21e1cde6,  5);
+    MD5_STEP(MD5_G, d, a, b, c, m[14], 0xc33707d6,  9);
+    MD5_STEP(MD5_G, c, d, a, b, m[ 3], 0xf4d50d87, 14);
+    MD5_STEP(MD5_G, b, c, d, a, m[ 8], 0x455a14ed, 20);
+    MD5_STEP(MD5_G, a, b, c, d, m[13], 0xa9e3e905,  5);
+    MD5_STEP(MD5_G, d, a, b, c, m[ 2], 0xfcefa3f8,  9);
+    MD5_STEP(MD5_G, c, d, a, b, m[ 7], 0x676f02d9, 14);
+    MD5_STEP(MD5_G, b, c, d, a, m[12], 0x8d2a4c8a, 20);
+    MD5_STEP(MD5_H, a, b, c, d, m[ 5], 0xfffa3942,  4);
+    MD5_STEP(MD5_H, d, a, b, c, m[ 8], 0x8771f681, 11);
+    MD5_STEP(MD5_H, c, d, a, b, m[11], 0x6d9d6122, 16);
+    MD5_STEP(MD5_H, b, c, d, a, m[14], 0xfde5380c, 23);
+    MD5_STEP(MD5_H, a, b, c, d, m[ 1], 0xa4beea44,  4);
+    MD5_STEP(MD5_H, d, a, b, c, m[ 4], 0x4bdecfa9, 11);
+    MD5_STEP(MD5_H, c, d, a, b, m[ 7], 0xf6bb4b60, 16);
+    MD5_STEP(MD5_H, b, c, d, a, m[10], 0xbebfbc70, 23);
+    MD5_STEP(MD5_H, a, b, c, d, m[13], 0x289b7ec6,  4);
+    MD5_STEP(MD5_H, d, a, b, c, m[ 0], 0xeaa127fa, 11);
+    MD5_STEP(MD5_H, c, d, a, b, m[ 3], 0xd4ef3085, 16);
+    MD5_STEP(MD5_H, b, c, d, a, m[ 6], 0x04881d05, 23);
+    MD5_STEP(MD5_H, a, b, c, d, m[ 9], 0xd9d4d039,  4);
+    MD5_STEP(MD5_H, d, a, b, c, m[12], 0xe6db99e5, 11);
+    MD5_STEP(MD5_H, c, d, a, b, m[15], 0x1fa27cf8, 16);
+    MD5_STEP(MD5_H, b, c, d, a, m[ 2], 0xc4ac5665, 23);
+    MD5_STEP(MD5_I, a, b, c, d, m[ 0], 0xf4292244,  6);
+    MD5_STEP(MD5_I, d, a, b, c, m[ 7], 0x432aff97, 10);
+    MD5_STEP(MD5_I, c, d, a, b, m[14], 0xab9423a7, 15);
+    MD5_STEP(MD5_I, b, c, d, a, m[ 5], 0xfc93a039, 21);
+    MD5_STEP(MD5_I, a, b, c, d, m[12], 0x655b59c3,  6);
+    MD5_STEP(MD5_I, d, a, b, c, m[ 3], 0x8f0ccc92, 10);
+    MD5_STEP(MD5_I, c, d, a, b, m[10], 0xffeff47d, 15);
+    MD5_STEP(MD5_I, b, c, d, a, m[ 1], 0x85845dd1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, m[ 8], 0x6fa87e4f,  6);
+    MD5_STEP(MD5_I, d, a, b, c, m[15], 0xfe2ce6e0, 10);
+    MD5_STEP(MD5_I, c, d, a, b, m[ 6], 0xa3014314, 15);
+    MD5_STEP(MD5_I, b, c, d, a, m[13], 0x4e0811a1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, m[ 4], 0xf7537e82,  6);
+    MD5_STEP(MD5_I, d, a, b, c, m[11], 0xbd3af235, 10);
+    MD5_STEP(MD5_I, c, d, a, b, m[ 2], 0x2ad7d2bb, 15);
+    MD5_STEP(MD5_I, b, c, d, a, m[ 9], 0xeb86d391, 21);
+
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+}
+
+void Md5::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    total_ += len;
+
+    if (buf_len_) {
+        size_t take = std::min(len, sizeof(buf_) - buf_len_);
+        std::memcpy(buf_ + buf_len_, p, take);
+        buf_len_ += take;
+        p += take;
+        len -= take;
+        if (buf_len_ < sizeof(buf_)) return;
+        block(buf_);
+        buf_len_ = 0;
+    }
+
+    for (; len >= 64; p += 64, len -= 64) block(p);
+
+    std::memcpy(buf_, p, len);
+    buf_len_ = len;
+}
+
+void Md5::finish(uint8_t out[DIGEST_SIZE]) {
+    uint64_t bits = total_ * 8;
+
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (buf_len_ < 56) ? 56 - buf_len_ : 120 - buf_len_;
+    for (int i = 0; i < 8; i++) pad[pad_len + i] = uint8_t(bits >> (i * 8));
+    update(pad, pad_len + 8);
+
+    for (int i = 0; i < 4; i++) {
+        out[i * 4 + 0] = uint8_t(h_[i]);
+        out[i * 4 + 1] = uint8_t(h_[i] >> 8);
+        out[i * 4 + 2] = uint8_t(h_[i] >> 16);
+        out[i * 4 + 3] = uint8_t(h_[i] >> 24);
+    }
+}
+
+std::string Md5::hex_digest() {
+    uint8_t digest[DIGEST_SIZE];
+    finish(digest);
+    return to_hex(digest, sizeof(digest));
+}
+
+/* ============================================================================
+ * SHA-1 (FIPS 180-4)
+ * ========================================================================= */
+
+void Sha1::reset() {
+    h_[0] = 0x67452301;
+    h_[1] = 0xEFCDAB89;
+    h_[2] = 0x98BADCFE;
+    h_[3] = 0x10325476;
+    h_[4] = 0xC3D2E1F0;
+    buf_len_ = 0;
+    total_ = 0;
+}
+
+#define SHA1_F0(b, c, d) (((b) & (c)) | (~(b) & (d)))
+#define SHA1_F1(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_F2(b, c, d) (((b) & (c)) | ((b) & (d)) | ((c) & (d)))
+#define SHA1_F3(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_F0_K 0x5A827999
+#define SHA1_F1_K 0x6ED9EBA1
+#define SHA1_F2_K 0x8F1BBCDC
+#define SHA1_F3_K 0xCA62C1D6
+// 16-word rolling message schedule
+#define SHA1_W(i) (w[(i) & 15] = rol32(w[((i) - 3) & 15] ^ w[((i) - 8) & 15] ^ \
+                                       w[((i) - 14) & 15] ^ w[(i) & 15], 1))
+#define SHA1_STEP(f, a, b, c, d, e, x)                        \
+    do {                                                      \
+        e += rol32(a, 5) + f(b, c, d) + f##_K + (x);          \
+        b = rol32(b, 30);                                     \
+    } while (0)
+
+#ifdef DOLHOOK_HASH_X86
+// Four rounds with the SHA extensions; registers rotate between steps
+#define SHA1NI_STEP(ea, eb, m0, m1, m2, m3, f) \
+    ea = _mm_sha1nexte_epu32(ea, m0);          \
+    eb = abcd;                                 \
+    m1 = _mm_sha1msg2_epu32(m1, m0);           \
+    abcd = _mm_sha1rnds4_epu32(abcd, ea, f);   \
+    m3 = _mm_sha1msg1_epu32(m3, m0);           \
+    m2 = _mm_xor_si128(m2, m0)
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_blocks_ni(uint32_t h[5], const uint8_t* p, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)), 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(h[4]), 0, 0, 0);
+    __m128i e1, m0, m1, m2, m3;
+
+    for (; blocks; blocks--, p += 64) {
+        __m128i abcd_save = abcd, e0_save = e0;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0)), mask);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), mask);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), mask);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), mask);
+
+        // Rounds 0-11 prime the schedule
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        // Rounds 12-79
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 0);
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 0);
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 1);
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 1);
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 1);
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 1);
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 1);
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 2);
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 2);
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 2);
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 2);
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 2);
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 3);
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 3);
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 3);
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 3);
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(h), _mm_shuffle_epi32(abcd, 0x1B));
+    h[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+static bool sha1_accelerated() {
+    static const bool supported = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+    return supported;
+}
+#endif
+
+void Sha1::block(const uint8_t* p) {
+#ifdef DOLHOOK_HASH_X86
+    if (sha1_accelerated()) {
+        sha1_blocks_ni(h_, p, 1);
+        return;
+    }
+#endif
+
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) w[i] = read_be32(p + i * 4);
+
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+
+    SHA1_STEP(SHA1_F0, a, b, c, d, e, w[ 0]);
+    SHA1_STEP(SHA1_F0, e, a, b, c, d, w[ 1]);
+    SHA1_STEP(SHA1_F0, d, e, a, b, c, w[ 2]);
+    SHA1_STEP(SHA1_F0, c, d, e, a, b, w[ 3]);
+    SHA1_STEP(SHA1_F0, b, c, d, e, a, w[ 4]);
+    SHA1_STEP(SHA1_F0, a, b, c, d, e, w[ 5]);
+    SHA1_STEP(SHA1_F0, e, a, b, c, d, w[ 6]);
+    SHA1_STEP(SHA1_F0, d, e, a, b, c, w[ 7]);
+    SHA1_STEP(SHA1_F0, c, d, e, a, b, w[ 8]);
+    SHA1_STEP(SHA1_F0, b, c, d, e, a, w[ 9]);
+    SHA1_STEP(SHA1_F0, a, b, c, d, e, w[10]);
+    SHA1_STEP(SHA1_F0, e, a, b, c, d, w[11]);
+    SHA1_STEP(SHA1_F0, d, e, a, b, c, w[12]);
+    SHA1_STEP(SHA1_F0, c, d, e, a, b, w[13]);
+    SHA1_STEP(SHA1_F0, b, c, d, e, a, w[14]);
+    SHA1_STEP(SHA1_F0, a, b, c, d, e, w[15]);
+    SHA1_STEP(SHA1_F0, e, a, b, c, d, SHA1_W(16));
+    SHA1_STEP(SHA1_F0, d, e, a, b, c, SHA1_W(17));
+    SHA1_STEP(SHA1_F0, c, d, e, a, b, SHA1_W(18));
+    SHA1_STEP(SHA1_F0, b, c, d, e, a, SHA1_W(19));
+    SHA1_STEP(SHA1_F1, a, b, c, d, e, SHA1_W(20));
+    SHA1_STEP(SHA1_F1, e, a, b, c, d, SHA1_W(21));
+    SHA1_STEP(SHA1_F1, d, e, a, b, c, SHA1_W(22));
+    SHA1_STEP(SHA1_F1, c, d, e, a, b, SHA1_W(23));
+    SHA1_STEP(SHA1_F1, b, c, d, e, a, SHA1_W(24));
+    SHA1_STEP(SHA1_F1, a, b, c, d, e, SHA1_W(25));
+    SHA1_STEP(SHA1_F1, e, a, b, c, d, SHA1_W(26));
+    SHA1_STEP(SHA1_F1, d, e, a, b, c, SHA1_W(27));
+    SHA1_STEP(SHA1_F1, c, d, e, a, b, SHA1_W(28));
+    SHA1_STEP(SHA1_F1, b, c, d, e, a, SHA1_W(29));
+    SHA1_STEP(SHA1_F1, a, b, c, d, e, SHA1_W(30));
+    SHA1_STEP(SHA1_F1, e, a, b, c, d, SHA1_W(31));
+    SHA1_STEP(SHA1_F1, d, e, a, b, c, SHA1_W(32));
+    SHA1_STEP(SHA1_F1, c, d, e, a, b, SHA1_W(33));
+    SHA1_STEP(SHA1_F1, b, c, d, e, a, SHA1_W(34));
+    SHA1_STEP(SHA1_F1, a, b, c, d, e, SHA1_W(35));
+    SHA1_STEP(SHA1_F1, e, a, b, c, d, SHA1_W(36));
+    SHA1_STEP(SHA1_F1, d, e, a, b, c, SHA1_W(37));
+    SHA1_STEP(SHA1_F1, c, d, e, a, b, SHA1_W(38));
+    SHA1_STEP(SHA1_F1, b, c, d, e, a, SHA1_W(39));
+    SHA1_STEP(SHA1_F2, a, b, c, d, e, SHA1_W(40));
+    SHA1_STEP(SHA1_F2, e, a, b, c, d, SHA1_W(41));
+    SHA1_STEP(SHA1_F2, d, e, a, b, c, SHA1_W(42));
+    SHA1_STEP(SHA1_F2, c, d, e, a, b, SHA1_W(43));
+    SHA1_STEP(SHA1_F2, b, c, d, e, a, SHA1_W(44));
+    SHA1_STEP(SHA1_F2, a, b, c, d, e, SHA1_W(45));
+    SHA1_STEP(SHA1_F2, e, a, b, c, d, SHA1_W(46));
+    SHA1_STEP(SHA1_F2, d, e, a, b, c, SHA1_W(47));
+    SHA1_STEP(SHA1_F2, c, d, e, a, b, SHA1_W(48));
+    SHA1_STEP(SHA1_F2, b, c, d, e, a, SHA1_W(49));
+    SHA1_STEP(SHA1_F2, a, b, c, d, e, SHA1_W(50));
+    SHA1_STEP(SHA1_F2, e, a, b, c, d, SHA1_W(51));
+    SHA1_STEP(SHA1_F2, d, e, a, b, c, SHA1_W(52));
+    SHA1_STEP(SHA1_F2, c, d, e, a, b, SHA1_W(53));
+    SHA1_STEP(SHA1_F2, b, c, d, e, a, SHA1_W(54));
+    SHA1_STEP(SHA1_F2, a, b, c, d, e, SHA1_W(55));
+    SHA1_STEP(SHA1_F2, e, a, b, c, d, SHA1_W(56));
+    SHA1_STEP(SHA1_F2, d, e, a, b, c, SHA1_W(57));
+    SHA1_STEP(SHA1_F2, c, d, e, a, b, SHA1_W(58));
+    SHA1_STEP(SHA1_F2, b, c, d, e, a, SHA1_W(59));
+    SHA1_STEP(SHA1_F3, a, b, c, d, e, SHA1_W(60));
+    SHA1_STEP(SHA1_F3, e, a, b, c, d, SHA1_W(61));
+    SHA1_STEP(SHA1_F3, d, e, a, b, c, SHA1_W(62));
+    SHA1_STEP(SHA1_F3, c, d, e, a, b, SHA1_W(63));
+    SHA1_STEP(SHA1_F3, b, c, d, e, a, SHA1_W(64));
+    SHA1_STEP(SHA1_F3, a, b, c, d, e, SHA1_W(65));
+    SHA1_STEP(SHA1_F3, e, a, b, c, d, SHA1_W(66));
+    SHA1_STEP(SHA1_F3, d, e, a, b, c, SHA1_W(67));
+    SHA1_STEP(SHA1_F3, c, d, e, a, b, SHA1_W(68));
+    SHA1_STEP(SHA1_F3, b, c, d, e, a, SHA1_W(69));
+    SHA1_STEP(SHA1_F3, a, b, c, d, e, SHA1_W(70));
+    SHA1_STEP(SHA1_F3, e, a, b, c, d, SHA1_W(71));
+    SHA1_STEP(SHA1_F3, d, e, a, b, c, SHA1_W(72));
+    SHA1_STEP(SHA1_F3, c, d, e, a, b, SHA1_W(73));
+    SHA1_STEP(SHA1_F3, b, c, d, e, a, SHA1_W(74));
+    SHA1_STEP(SHA1_F3, a, b, c, d, e, SHA1_W(75));
+    SHA1_STEP(SHA1_F3, e, a, b, c, d, SHA1_W(76));
+    SHA1_STEP(SHA1_F3, d, e, a, b, c, SHA1_W(77));
+    SHA1_STEP(SHA1_F3, c, d, e, a, b, SHA1_W(78));
+    SHA1_STEP(SHA1_F3, b, c, d, e, a, SHA1_W(79));
+
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+}
+
+void Sha1::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    total_ += len;
+
+    if (buf_len_) {
+        size_t take = std::min(len, sizeof(buf_) - buf_len_);
+        std::memcpy(buf_ + buf_len_, p, take);
+        buf_len_ += take;
+        p += take;
+        len -= take;
+        if (buf_len_ < sizeof(buf_)) return;
+        block(buf_);
+        buf_len_ = 0;
+    }
+
+#ifdef DOLHOOK_HASH_X86
+    if (len >= 64 && sha1_accelerated()) {
+        sha1_blocks_ni(h_, p, len / 64);
+        p += len & ~size_t(63);
+        len &= 63;
+    }
+#endif
+    for (; len >= 64; p += 64, len -= 64) block(p);
+
+    std::memcpy(buf_, p, len);
+    buf_len_ = len;
+}
+
+void Sha1::finish(uint8_t out[DIGEST_SIZE]) {
+    uint64_t bits = total_ * 8;
+
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (buf_len_ < 56) ? 56 - buf_len_ : 120 - buf_len_;
+    for (int i = 0; i < 8; i++) pad[pad_len + i] = uint8_t(bits >> (56 - i * 8));
+    update(pad, pad_len + 8);
+
+    for (int i = 0; i < 5; i++) {
+        out[i * 4 + 0] = uint8_t(h_[i] >> 24);
+        out[i * 4 + 1] = uint8_t(h_[i] >> 16);
+        out[i * 4 + 2] = uint8_t(h_[i] >> 8);
+        out[i * 4 + 3] = uint8_t(h_[i]);
+    }
+}
+
+std::string Sha1::hex_digest() {
+    uint8_t digest[DIGEST_SIZE];
+    finish(digest);
+    return to_hex(digest, sizeof(digest));
+}
+
+} // namespace dolhook
@@ -0,0 +1,70 @@
+/**
+ * Hash Functions
+ * Digests used for caching and image verification
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace dolhook {
+
+// CRC-32 (IEEE, reflected); pass the previous result to continue a stream
+uint32_t crc32(uint32_t crc, const void* data, size_t len);
+
+// CRC of A||B from crc(A), crc(B) and len(B), without touching the data
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+// True when crc32() uses carry-less multiply (PCLMULQDQ)
+bool crc32_accelerated();
+
+class Md5 {
+public:
+    static constexpr size_t DIGEST_SIZE = 16;
+
+    Md5() { reset(); }
+
+    void reset();
+    void update(const void* data, size_t len);
+    void finish(uint8_t out[DIGEST_SIZE]);
+
+    // finish() and format as lowercase hex
+    std::string hex_digest();
+
+private:
+    void block(const uint8_t* p);
+
+    uint32_t h_[4];
+    uint8_t buf_[64];
+    size_t buf_len_;
+    uint64_t total_;
+};
+
+class Sha1 {
+public:
+    static constexpr size_t DIGEST_SIZE = 20;
+
+    Sha1() { reset(); }
+
+    void reset();
+    void update(const void* data, size_t len);
+    void finish(uint8_t out[DIGEST_SIZE]);
+
+    // finish() and format as lowercase hex
+    std::string hex_digest();
+
+private:
+    void block(const uint8_t* p);
+
+    uint32_t h_[5];
+    uint8_t buf_[64];
+    size_t buf_len_;
+    uint64_t total_;
+};
+
+// Lowercase hex of a byte string
+std::string to_hex(const uint8_t* data, size_t len);
+
+} // namespace dolhook
@@ -0,0 +1,167 @@
+/**
+ * Extent Log Implementation
+ *
+ * Layout (little-endian):
+ *   magic[8] from_size:u64 to_size:u64 count:u64
+ *   count * { offset:u64 size:u64 bytes[size] }
+ *   checksum:u64 (FNV-1a over everything above)
+ */
+
+#include "journal.h"
+#include "blockdev.h"
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace dolhook {
+
+static constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+static constexpr uint64_t FNV_PRIME = 0x100000001B3ull;
+
+static uint64_t fnv1a(uint64_t h, const uint8_t* p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static void put_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (v >> (i * 8)) & 0xFF;
+}
+
+static uint64_t get_le64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= uint64_t(p[i]) << (i * 8);
+    return v;
+}
+
+static bool write_full(int fd, const uint8_t* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool sync_parent_dir(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool write_extent_log(const std::string& path, const char (&magic)[8],
+                      uint64_t from_size, uint64_t to_size,
+                      const std::vector<ExtentSpan>& extents) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    uint64_t sum = FNV_OFFSET;
+    auto emit = [&](const uint8_t* p, size_t len) {
+        sum = fnv1a(sum, p, len);
+        return write_full(fd, p, len);
+    };
+
+    uint8_t hdr[32];
+    std::memcpy(hdr, magic, 8);
+    put_le64(hdr + 8, from_size);
+    put_le64(hdr + 16, to_size);
+    put_le64(hdr + 24, extents.size());
+    bool ok = emit(hdr, sizeof(hdr));
+
+    for (const auto& ext : extents) {
+        if (!ok) break;
+        uint8_t rec[16];
+        put_le64(rec, ext.offset);
+        put_le64(rec + 8, ext.size);
+        ok = emit(rec, sizeof(rec)) && emit(ext.data, ext.size);
+    }
+
+    uint8_t tail[8];
+    put_le64(tail, sum);
+    ok = ok && write_full(fd, tail, sizeof(tail)) && fsync(fd) == 0;
+
+    ::close(fd);
+    return ok && sync_parent_dir(path);
+}
+
+bool read_extent_log(const std::string& path, const char (&magic)[8], ExtentLog& out) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    std::vector<uint8_t> buf;
+    if (fstat(fd, &st) == 0) {
+        buf.resize(st.st_size);
+        size_t got = 0;
+        while (got < buf.size()) {
+            ssize_t n = ::read(fd, buf.data() + got, buf.size() - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += n;
+        }
+        buf.resize(got);
+    }
+    ::close(fd);
+
+    if (buf.size() < 40 || std::memcmp(buf.data(), magic, 8) != 0) return false;
+
+    // Torn write: checksum won't match
+    size_t body = buf.size() - 8;
+    if (fnv1a(FNV_OFFSET, buf.data(), body) != get_le64(buf.data() + body)) return false;
+
+    out.from_size = get_le64(buf.data() + 8);
+    out.to_size = get_le64(buf.data() + 16);
+    uint64_t count = get_le64(buf.data() + 24);
+
+    out.extents.clear();
+    size_t pos = 32;
+    for (uint64_t i = 0; i < count; i++) {
+        if (body - pos < 16) return false;
+        uint64_t offset = get_le64(buf.data() + pos);
+        uint64_t size = get_le64(buf.data() + pos + 8);
+        pos += 16;
+        if (size > body - pos) return false;
+
+        out.extents.emplace_back(offset, std::vector<uint8_t>(buf.begin() + pos, buf.begin() + pos + size));
+        pos += size;
+    }
+
+    return pos == body;
+}
+
+bool apply_extent_log(const std::string& image_path, const ExtentLog& log) {
+    int fd = ::open(image_path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    // Replays are idempotent, so a half-applied image is fine too
+    struct stat st;
+    uint64_t lo = std::min(log.from_size, log.to_size);
+    uint64_t hi = std::max(log.from_size, log.to_size);
+    bool ok = fstat(fd, &st) == 0 &&
+              static_cast<uint64_t>(st.st_size) >= lo &&
+              static_cast<uint64_t>(st.st_size) <= hi;
+
+    for (const auto& ext : log.extents) {
+        if (!ok) break;
+        ok = pwrite_sparse(fd, ext.first, ext.second.data(), ext.second.size(), false);
+    }
+
+    ok = ok && ftruncate(fd, static_cast<off_t>(log.to_size)) == 0 && fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+} // namespace dolhook
@@ -0,0 +1,46 @@
+/**
+ * Extent Log Files
+ * Checksummed lists of (offset, bytes) records applied to an image
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+// Borrowed byte range to be logged
+struct ExtentSpan {
+    uint64_t offset;
+    const uint8_t* data;
+    size_t size;
+};
+
+struct ExtentLog {
+    uint64_t from_size = 0;  // Image size the log applies to
+    uint64_t to_size = 0;    // Image size after applying
+    std::vector<std::pair<uint64_t, std::vector<uint8_t>>> extents;
+};
+
+// Magic tags for the log kinds
+constexpr char JOURNAL_MAGIC[8] = {'D', 'H', 'J', 'R', 'N', 'L', '0', '1'};
+constexpr char DELTA_MAGIC[8] = {'D', 'H', 'D', 'E', 'L', 'T', '0', '1'};
+
+// Write and fsync a log; the file is only valid once complete
+bool write_extent_log(const std::string& path, const char (&magic)[8],
+                      uint64_t from_size, uint64_t to_size,
+                      const std::vector<ExtentSpan>& extents);
+
+// Read a log, rejecting torn or foreign files
+bool read_extent_log(const std::string& path, const char (&magic)[8], ExtentLog& out);
+
+// pwrite all extents, set final size and fsync
+bool apply_extent_log(const std::string& image_path, const ExtentLog& log);
+
+// fsync the directory containing path (makes create/unlink durable)
+bool sync_parent_dir(const std::string& path);
+
+} // namespace dolhook
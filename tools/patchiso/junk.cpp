@@ -0,0 +1,325 @@
+/**
+ * Disc Junk Implementation
+ *
+ * Generator (K = 521, J = 32): seed words x[0..16] are extended by
+ *   x[i] = (x[i - 17] << 23) ^ (x[i - 16] >> 9) ^ x[i - 1]
+ * to K words, which are output big-endian with bits 16-17 dropped (bits
+ * 18-25 move down to 16-23). The state is advanced by x[i] ^= x[i - J]
+ * (circularly) four times before the first output, and once per K words.
+ * Everything after seeding is linear, so it can be run backwards.
+ */
+
+#include "junk.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace dolhook {
+
+namespace {
+
+constexpr uint64_t MIN_JUNK = 0x800;      // Shorter runs aren't worth a descriptor
+constexpr uint64_t RETRY_ALIGN = 0x8000;  // Where to look again after a miss
+
+} // namespace
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// v with its bytes in big-endian memory order
+static uint32_t to_be32(uint32_t v) {
+    uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+    uint32_t w;
+    std::memcpy(&w, b, sizeof(w));
+    return w;
+}
+
+/* ============================================================================
+ * JunkGenerator
+ * ========================================================================= */
+
+void JunkGenerator::seed(const uint32_t seed[SEED_WORDS], uint64_t position) {
+    uint32_t x[K];
+    std::copy(seed, seed + SEED_WORDS, x);
+    for (size_t i = SEED_WORDS; i < K; i++) {
+        x[i] = (x[i - 17] << 23) ^ (x[i - 16] >> 9) ^ x[i - 1];
+    }
+    for (size_t i = 0; i < K; i++) {
+        state_[i] = to_be32((x[i] & 0xFF00FFFF) | ((x[i] >> 2) & 0x00FF0000));
+    }
+    for (int i = 0; i < 4; i++) forward();
+
+    pos_ = 0;
+    skip(position);
+}
+
+void JunkGenerator::forward() {
+    for (size_t i = 0; i < J; i++) state_[i] ^= state_[i + K - J];
+
+    // Each row of J words only reads the row before, so rows vectorize
+    for (size_t i = J; i < K; i += J) {
+        uint32_t* row = state_ + i;
+        const uint32_t* prev = row - J;
+        size_t n = std::min(J, K - i);
+        for (size_t j = 0; j < n; j++) row[j] ^= prev[j];
+    }
+}
+
+void JunkGenerator::generate(uint8_t* out, size_t len) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(state_);
+    while (len > 0) {
+        size_t n = std::min(len, K * 4 - pos_);
+        std::memcpy(out, bytes + pos_, n);
+        out += n;
+        len -= n;
+        pos_ += n;
+        if (pos_ == K * 4) {
+            forward();
+            pos_ = 0;
+        }
+    }
+}
+
+void JunkGenerator::skip(uint64_t len) {
+    uint64_t target = pos_ + len;
+    for (uint64_t n = target / (K * 4); n > 0; n--) forward();
+    pos_ = static_cast<size_t>(target % (K * 4));
+}
+
+bool JunkGenerator::recover(const uint8_t* data, size_t len, uint64_t position,
+                            uint32_t seed[SEED_WORDS]) {
+    // Whole output words only; zeros would give the (useless) zero seed
+    size_t lead = static_cast<size_t>((4 - position % 4) % 4);
+    if (len < lead + K * 4 || all_zero(data + lead, K * 4)) return false;
+    data += lead;
+    position += lead;
+
+    // Output bits 22-23 repeat bits 24-25
+    uint32_t y[K];
+    for (size_t i = 0; i < K; i++) {
+        y[i] = read_be32(data + i * 4);
+        if ((y[i] & 0x00C00000) != ((y[i] >> 2) & 0x00C00000)) return false;
+    }
+
+    // The words are [r, K) of state q followed by [0, r) of state q + 1
+    uint64_t word = position / 4;
+    size_t r = static_cast<size_t>(word % K);
+    uint64_t q = word / K;
+
+    uint32_t b[K];
+    std::copy(y, y + K - r, b + r);
+    std::copy(y + K - r, y + K, b);
+
+    // Step [0, r) back to state q, then everything back to the seeding
+    for (size_t i = r; i-- > 0;) b[i] ^= i >= J ? b[i - J] : b[i + K - J];
+    for (uint64_t n = 0; n < q + 4; n++) {
+        for (size_t i = K; i-- > J;) b[i] ^= b[i - J];
+        for (size_t i = J; i-- > 0;) b[i] ^= b[i + K - J];
+    }
+
+    // The dropped bits 16-17 of x[i] reappear as bits 7-8 of x[i + 16]
+    for (size_t i = 0; i < SEED_WORDS; i++) {
+        seed[i] = (b[i] & 0xFF00FFFF) | ((b[i] << 2) & 0x00FC0000) |
+                  (((b[i + 16] ^ b[i + 15]) << 9) & 0x00030000);
+    }
+
+    JunkGenerator gen;
+    gen.seed(seed, position);
+    uint8_t check[K * 4];
+    gen.generate(check, sizeof(check));
+    return std::memcmp(check, data, sizeof(check)) == 0;
+}
+
+/* ============================================================================
+ * Detection
+ * ========================================================================= */
+
+// Leading bytes of data that match gen's output
+static size_t matching_prefix(JunkGenerator& gen, const uint8_t* data, size_t len) {
+    uint8_t buf[0x1000];
+    size_t done = 0;
+    while (done < len) {
+        size_t n = std::min(sizeof(buf), len - done);
+        gen.generate(buf, n);
+        if (std::memcmp(buf, data + done, n) != 0) {
+            size_t i = 0;
+            while (buf[i] == data[done + i]) i++;
+            return done + i;
+        }
+        done += n;
+    }
+    return done;
+}
+
+// pieces all lie in one JUNK_BLOCK, so they share a seed
+static bool scan_block(const ImageReader& read, const std::vector<Extent>& pieces,
+                       std::vector<JunkRegion>& out) {
+    std::vector<uint8_t> buf;
+    uint32_t seed[JunkGenerator::SEED_WORDS];
+    bool have_seed = false;
+    JunkGenerator gen;
+
+    for (const Extent& piece : pieces) {
+        buf.resize(static_cast<size_t>(piece.size));
+        if (!read(piece.offset, buf.data(), buf.size())) return false;
+
+        uint64_t end = piece.offset + piece.size;
+        for (uint64_t at = piece.offset; end - at >= MIN_JUNK;) {
+            const uint8_t* data = buf.data() + (at - piece.offset);
+            size_t avail = static_cast<size_t>(end - at);
+            uint64_t position = at % JUNK_BLOCK;
+
+            size_t run = 0;
+            if (!have_seed) have_seed = JunkGenerator::recover(data, avail, position, seed);
+            if (have_seed) {
+                gen.seed(seed, position);
+                run = matching_prefix(gen, data, avail);
+            }
+            if (run >= MIN_JUNK) {
+                JunkRegion region;
+                region.offset = at;
+                region.size = run;
+                region.position = position;
+                std::copy(seed, seed + JunkGenerator::SEED_WORDS, region.seed);
+                out.push_back(region);
+            }
+
+            uint64_t next = (at + std::max<size_t>(run, 1) + RETRY_ALIGN - 1) / RETRY_ALIGN * RETRY_ALIGN;
+            at = std::min(next, end);
+        }
+    }
+    return true;
+}
+
+std::vector<JunkRegion> find_junk(const ImageReader& read, const std::vector<Extent>& gaps,
+                                  unsigned threads) {
+    // Split the gaps at generator block boundaries
+    std::vector<std::vector<Extent>> blocks;
+    uint64_t current = ~uint64_t(0);
+    for (const Extent& gap : gaps) {
+        uint64_t end = gap.offset + gap.size;
+        for (uint64_t at = gap.offset; at < end;) {
+            uint64_t block = at / JUNK_BLOCK;
+            uint64_t stop = std::min(end, (block + 1) * JUNK_BLOCK);
+            if (stop - at >= MIN_JUNK) {
+                if (block != current) blocks.emplace_back();
+                blocks.back().push_back({at, stop - at});
+                current = block;
+            }
+            at = stop;
+        }
+    }
+    if (blocks.empty()) return {};
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, blocks.size()));
+
+    std::vector<std::vector<JunkRegion>> found(blocks.size());
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back([&] {
+            for (;;) {
+                size_t i = next.fetch_add(1);
+                if (failed || i >= blocks.size()) return;
+                if (!scan_block(read, blocks[i], found[i])) failed = true;
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+
+    // An unreadable image has no junk to speak of; the write will fail on it
+    std::vector<JunkRegion> regions;
+    if (failed) return regions;
+    for (const auto& list : found) regions.insert(regions.end(), list.begin(), list.end());
+    return regions;
+}
+
+/* ============================================================================
+ * Region tables
+ * ========================================================================= */
+
+// Calls fn(lo, hi, region) for every region overlapping [offset, offset + len)
+template <typename Fn>
+static void for_each_overlap(const std::vector<JunkRegion>& regions, uint64_t offset, uint64_t len, Fn fn) {
+    uint64_t end = offset + len;
+    auto it = std::partition_point(regions.begin(), regions.end(), [&](const JunkRegion& r) {
+        return r.offset + r.size <= offset;
+    });
+    for (; it != regions.end() && it->offset < end; ++it) {
+        fn(std::max(offset, it->offset), std::min(end, it->offset + it->size), *it);
+    }
+}
+
+void fill_junk(const std::vector<JunkRegion>& regions, uint64_t offset, uint8_t* buf, size_t len) {
+    JunkGenerator gen;
+    for_each_overlap(regions, offset, len, [&](uint64_t lo, uint64_t hi, const JunkRegion& r) {
+        gen.seed(r.seed, r.position + (lo - r.offset));
+        gen.generate(buf + (lo - offset), static_cast<size_t>(hi - lo));
+    });
+}
+
+void clear_junk(const std::vector<JunkRegion>& regions, uint64_t offset, uint8_t* buf, size_t len) {
+    for_each_overlap(regions, offset, len, [&](uint64_t lo, uint64_t hi, const JunkRegion&) {
+        std::memset(buf + (lo - offset), 0, static_cast<size_t>(hi - lo));
+    });
+}
+
+static std::vector<Extent> coverage(const std::vector<JunkRegion>& regions, uint64_t lo, uint64_t hi) {
+    std::vector<Extent> out;
+    for_each_overlap(regions, lo, hi - lo, [&](uint64_t a, uint64_t b, const JunkRegion&) {
+        if (!out.empty() && out.back().offset + out.back().size == a) {
+            out.back().size += b - a;
+        } else {
+            out.push_back({a, b - a});
+        }
+    });
+    return out;
+}
+
+bool same_junk_coverage(const std::vector<JunkRegion>& a, const std::vector<JunkRegion>& b,
+                        uint64_t lo, uint64_t hi) {
+    auto ca = coverage(a, lo, hi);
+    auto cb = coverage(b, lo, hi);
+    return std::equal(ca.begin(), ca.end(), cb.begin(), cb.end(), [](const Extent& x, const Extent& y) {
+        return x.offset == y.offset && x.size == y.size;
+    });
+}
+
+std::vector<JunkRegion> clip_junk(const std::vector<JunkRegion>& regions,
+                                  const std::vector<Extent>& dirty, uint64_t size) {
+    std::vector<JunkRegion> out;
+    size_t first = 0;
+
+    for (const JunkRegion& r : regions) {
+        uint64_t at = r.offset;
+        uint64_t end = std::min(r.offset + r.size, size);
+        while (first < dirty.size() && dirty[first].offset + dirty[first].size <= at) first++;
+
+        for (size_t k = first; at < end; k++) {
+            uint64_t stop = k < dirty.size() ? std::min(end, dirty[k].offset) : end;
+            if (stop > at) {
+                JunkRegion piece = r;
+                piece.offset = at;
+                piece.size = stop - at;
+                piece.position = r.position + (at - r.offset);
+                out.push_back(piece);
+            }
+            if (k >= dirty.size()) break;
+            at = std::max(at, dirty[k].offset + dirty[k].size);
+        }
+    }
+    return out;
+}
+
+uint64_t junk_bytes(const std::vector<JunkRegion>& regions) {
+    uint64_t total = 0;
+    for (const auto& r : regions) total += r.size;
+    return total;
+}
+
+} // namespace dolhook
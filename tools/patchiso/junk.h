@@ -0,0 +1,72 @@
+/**
+ * Disc Junk
+ * Recognition and regeneration of the pseudo-random padding in unused disc space
+ */
+
+#pragma once
+
+#include "blockdev.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dolhook {
+
+// Retail discs fill unused space with lagged Fibonacci generator output,
+// reseeded every JUNK_BLOCK bytes of disc
+constexpr uint64_t JUNK_BLOCK = 0x40000;
+
+class JunkGenerator {
+public:
+    static constexpr size_t SEED_WORDS = 17;
+
+    // Restart from seed, then skip to byte position of the stream
+    void seed(const uint32_t seed[SEED_WORDS], uint64_t position = 0);
+
+    void generate(uint8_t* out, size_t len);
+    void skip(uint64_t len);
+
+    // Recover the seed of data that is generator output from stream byte
+    // position on. Needs a little over 2 KiB; false if data isn't junk.
+    static bool recover(const uint8_t* data, size_t len, uint64_t position, uint32_t seed[SEED_WORDS]);
+
+private:
+    static constexpr size_t K = 521;  // Long lag, in words
+    static constexpr size_t J = 32;   // Short lag
+
+    void forward();
+
+    uint32_t state_[K];  // Output words, stored big-endian
+    size_t pos_ = 0;     // Next output byte in state_
+};
+
+// A run of junk, regenerated from its seed
+struct JunkRegion {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t position = 0;  // Stream position of the byte at offset
+    uint32_t seed[JunkGenerator::SEED_WORDS] = {};
+};
+
+// Junk inside gaps (sorted, non-overlapping), found by regenerating the
+// stream and comparing. read is called from threads workers (0 = CPU count).
+std::vector<JunkRegion> find_junk(const ImageReader& read, const std::vector<Extent>& gaps,
+                                  unsigned threads);
+
+// Regenerate the junk of regions (sorted) that falls in [offset, offset + len)
+void fill_junk(const std::vector<JunkRegion>& regions, uint64_t offset, uint8_t* buf, size_t len);
+
+// Zero the junk of regions that falls in [offset, offset + len)
+void clear_junk(const std::vector<JunkRegion>& regions, uint64_t offset, uint8_t* buf, size_t len);
+
+// True if a and b cover the same bytes of [lo, hi)
+bool same_junk_coverage(const std::vector<JunkRegion>& a, const std::vector<JunkRegion>& b,
+                        uint64_t lo, uint64_t hi);
+
+// regions without the bytes of dirty (sorted) or anything from size on
+std::vector<JunkRegion> clip_junk(const std::vector<JunkRegion>& regions,
+                                  const std::vector<Extent>& dirty, uint64_t size);
+
+uint64_t junk_bytes(const std::vector<JunkRegion>& regions);
+
+} // namespace dolhook
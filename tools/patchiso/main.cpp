@@ -5,10 +5,21 @@
 
 #include "gcm.h"
 #include "dol.h"
-#include <iostream>
+#include "patcher.h"
+#include "batch.h"
+#include "dol_cache.h"
+#include "verify.h"
+#include "fst.h"
+#include "rebuild.h"
+#include "bps.h"
+#include "gecko.h"
+#include "symbols.h"
+#include <chrono>
+#include <filesystem>
 #include <fstream>
-#include <sstream>
-#include <map>
+#include <iomanip>
+#include <iterator>
+#include <iostream>
 #include <cstring>
 
 using namespace dolhook;
@@ -17,266 +28,673 @@ struct PatcherConfig {
     std::string input_iso;
     std::string output_iso;
     std::string game_id;
+    std::string batch_source;
+    std::string cache_dir;  // Empty = DolCache::default_dir()
+    std::string bps_output;
+    std::vector<std::string> maps;  // Game symbol maps (--map)
+    std::string gecko;              // Gecko code list (--gecko)
+    unsigned jobs = 0;
+    uint64_t mem_limit_mb = 512;
     int log_level = 1; // 0=errors, 1=info, 2=debug
     bool dry_run = false;
     bool print_dol = false;
-};
-
-struct SymbolMap {
-    std::map<std::string, uint32_t> symbols;
-    
-    bool load(const std::string& path) {
-        std::ifstream file(path);
-        if (!file) return false;
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            if (line.empty() || line[0] == '#') continue;
-            
-            std::istringstream iss(line);
-            std::string name;
-            uint32_t addr;
-            
-            if (iss >> name >> std::hex >> addr) {
-                symbols[name] = addr;
-            }
-        }
-        
-        return !symbols.empty();
-    }
-    
-    bool has(const std::string& name) const {
-        return symbols.find(name) != symbols.end();
-    }
-    
-    uint32_t get(const std::string& name) const {
-        auto it = symbols.find(name);
-        return it != symbols.end() ? it->second : 0;
-    }
+    bool restore = false;
+    bool no_cache = false;
 };
 
 void print_usage(const char* prog) {
     std::cout << "DolHook ISO Patcher v1.0\n\n";
-    std::cout << "Usage: " << prog << " INPUT.iso [OPTIONS]\n\n";
+    std::cout << "Usage: " << prog << " INPUT.iso [OPTIONS]\n";
+    std::cout << "       " << prog << " --batch DIR|LIST [OPTIONS]\n";
+    std::cout << "       " << prog << " verify [--dat FILE]... [--jobs N] IMAGE|DIR...\n";
+    std::cout << "       " << prog << " extract IMAGE [PATH...] [--out DIR] [--list]\n";
+    std::cout << "       " << prog << " rebuild IMAGE [--replace|--add DISC=HOST]... [--out FILE]\n";
+    std::cout << "       " << prog << " apply PATCH.bps SOURCE.iso --out TARGET.iso\n";
+    std::cout << "       " << prog << " convert IMAGE --out FILE [--scrub]\n";
+    std::cout << "       " << prog << " symbols MAP [NAME|PREFIX*|0xADDR]...\n\n";
     std::cout << "Options:\n";
     std::cout << "  --out FILE        Output ISO path (default: modify input after backup)\n";
+    std::cout << "                    A .gcz or .ciso name writes that container format\n";
+    std::cout << "                    With --batch: output directory\n";
+    std::cout << "  --bps FILE        Write a BPS patch against the input instead of an image\n";
+    std::cout << "                    With --batch: directory for <name>.bps patches\n";
     std::cout << "  --id GAMEID       Override game ID\n";
+    std::cout << "  --map FILE        Game symbol map (CodeWarrior/Dolphin .map, repeatable)\n";
+    std::cout << "  --gecko FILE      Gecko code list (.gct or text) for the runtime to apply\n";
     std::cout << "  --log LEVEL       Log level: 0=errors, 1=info, 2=debug (default: 1)\n";
     std::cout << "  --dry-run         Parse only, don't write\n";
     std::cout << "  --print-dol       Display DOL section table\n";
-    std::cout << "  --help            Show this help\n";
+    std::cout << "  --restore         Undo an in-place patch from its .delta/.bak backup\n";
+    std::cout << "  --batch SRC       Patch every image in a directory or list file\n";
+    std::cout << "  --jobs N          Batch worker threads (default: CPU count)\n";
+    std::cout << "  --mem-limit MB    Batch memory budget (default: 512)\n";
+    std::cout << "  --cache DIR       Patched DOL cache (default: ~/.cache/dolhook)\n";
+    std::cout << "  --no-cache        Don't read or write the DOL cache\n";
+    std::cout << "  --help            Show this help\n\n";
+    std::cout << "Verify options:\n";
+    std::cout << "  --dat FILE        Redump-style XML DAT to match against (repeatable)\n";
+    std::cout << "  --jobs N          CRC worker threads (default: CPU count)\n";
+    std::cout << "  --log LEVEL       0 = one line per image\n\n";
+    std::cout << "Extract options:\n";
+    std::cout << "  PATH              File or directory on the disc (default: everything)\n";
+    std::cout << "  --out DIR         Destination directory (default: .)\n";
+    std::cout << "  --list            List entries instead of extracting\n\n";
+    std::cout << "Rebuild options:\n";
+    std::cout << "  --replace D=H     Replace disc file D with host file H\n";
+    std::cout << "  --add D=H         Add host file H as disc path D\n";
+    std::cout << "  --out FILE        Write a new image (default: modify input after backup)\n\n";
+    std::cout << "Convert options:\n";
+    std::cout << "  --out FILE        Output image; .gcz/.ciso write a container, else raw\n";
+    std::cout << "  --scrub           Record junk padding as seeds instead of data (containers)\n\n";
+    std::cout << "Symbols queries:\n";
+    std::cout << "  NAME              Exact symbol name\n";
+    std::cout << "  PREFIX*           Every symbol starting with PREFIX\n";
+    std::cout << "  0xADDR            Symbol containing ADDR\n";
 }
 
 bool parse_args(int argc, char** argv, PatcherConfig& cfg) {
     if (argc < 2) return false;
     
-    cfg.input_iso = argv[1];
-    
-    for (int i = 2; i < argc; i++) {
+    for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         
         if (arg == "--help") {
             return false;
         } else if (arg == "--out" && i + 1 < argc) {
             cfg.output_iso = argv[++i];
+        } else if (arg == "--bps" && i + 1 < argc) {
+            cfg.bps_output = argv[++i];
         } else if (arg == "--id" && i + 1 < argc) {
             cfg.game_id = argv[++i];
+        } else if (arg == "--map" && i + 1 < argc) {
+            cfg.maps.push_back(argv[++i]);
+        } else if (arg == "--gecko" && i + 1 < argc) {
+            cfg.gecko = argv[++i];
         } else if (arg == "--log" && i + 1 < argc) {
             cfg.log_level = std::atoi(argv[++i]);
         } else if (arg == "--dry-run") {
             cfg.dry_run = true;
         } else if (arg == "--print-dol") {
             cfg.print_dol = true;
+        } else if (arg == "--restore") {
+            cfg.restore = true;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            cfg.batch_source = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            cfg.jobs = std::atoi(argv[++i]);
+        } else if (arg == "--mem-limit" && i + 1 < argc) {
+            cfg.mem_limit_mb = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cfg.cache_dir = argv[++i];
+        } else if (arg == "--no-cache") {
+            cfg.no_cache = true;
+        } else if (arg[0] != '-' && cfg.input_iso.empty()) {
+            cfg.input_iso = arg;
         } else {
             std::cerr << "Unknown option: " << arg << "\n";
             return false;
         }
     }
     
-    return true;
+    return !cfg.input_iso.empty() || !cfg.batch_source.empty();
 }
 
-static void write_be32(uint8_t* p, uint32_t v) {
-    p[0] = (v >> 24) & 0xFF;
-    p[1] = (v >> 16) & 0xFF;
-    p[2] = (v >> 8) & 0xFF;
-    p[3] = v & 0xFF;
+static int run_batch_mode(const PatcherConfig& cfg, const Payload& payload,
+                          const DolCache* cache, const SymbolIndex* symbols, const GeckoList* gecko) {
+    auto inputs = collect_batch_inputs(cfg.batch_source);
+    if (inputs.empty()) {
+        std::cerr << "Error: No images found in " << cfg.batch_source << "\n";
+        return 1;
+    }
+    
+    BatchOptions opts;
+    opts.out_dir = cfg.output_iso;
+    opts.bps_dir = cfg.bps_output;
+    opts.jobs = cfg.jobs;
+    opts.mem_limit = cfg.mem_limit_mb << 20;
+    opts.patch.log_level = cfg.log_level;
+    opts.patch.dry_run = cfg.dry_run;
+    opts.patch.print_dol = cfg.print_dol;
+    opts.patch.cache = cache;
+    opts.patch.game_symbols = symbols;
+    opts.patch.gecko = gecko;
+    
+    if (cfg.log_level >= 1) {
+        std::cout << "Batch patching " << inputs.size() << " image(s)\n";
+    }
+    
+    auto entries = run_batch(inputs, opts, payload);
+    std::cout << format_batch_summary(entries);
+    
+    for (const auto& e : entries) {
+        if (!e.result.ok) return 1;
+    }
+    return 0;
 }
 
-int main(int argc, char** argv) {
-    PatcherConfig cfg;
+// patchiso verify: hash images and look them up in DAT files
+static int run_verify(int argc, char** argv) {
+    std::vector<std::string> inputs;
+    std::vector<std::string> dats;
+    unsigned jobs = 0;
+    int log_level = 1;
     
-    if (!parse_args(argc, argv, cfg)) {
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dat" && i + 1 < argc) {
+            dats.push_back(argv[++i]);
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::atoi(argv[++i]);
+        } else if (arg == "--log" && i + 1 < argc) {
+            log_level = std::atoi(argv[++i]);
+        } else if (arg[0] != '-') {
+            if (std::filesystem::is_directory(arg)) {
+                auto found = collect_batch_inputs(arg);
+                inputs.insert(inputs.end(), found.begin(), found.end());
+            } else {
+                inputs.push_back(arg);
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (inputs.empty()) {
         print_usage(argv[0]);
         return 1;
     }
     
-    // Load ISO
-    if (cfg.log_level >= 1) {
-        std::cout << "Loading ISO: " << cfg.input_iso << "\n";
+    DumpDatabase db;
+    for (const auto& dat : dats) {
+        if (!db.load(dat)) {
+            std::cerr << "Error: No ROM entries in DAT " << dat << "\n";
+            return 1;
+        }
+    }
+    
+    int failures = 0;
+    for (const auto& input : inputs) {
+        auto dev = open_block_device(input);
+        ImageDigest digest;
+        auto start = std::chrono::steady_clock::now();
+        
+        if (!dev || !hash_image(*dev, digest, jobs)) {
+            std::cerr << "Error: Failed to read " << input << "\n";
+            failures++;
+            continue;
+        }
+        
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        // No DAT: report hashes only; otherwise every image must match
+        std::string status = "HASHED";
+        std::string detail;
+        if (db.size() > 0) {
+            if (const DatRom* rom = db.find(digest)) {
+                status = "OK";
+                detail = rom->game.empty() ? rom->name : rom->game;
+            } else if (const DatRom* named = db.find_by_name(std::filesystem::path(input).filename().string())) {
+                status = "BAD";
+                detail = "hashes differ from " + named->game;
+                failures++;
+            } else {
+                status = "UNKNOWN";
+                detail = "not in DAT";
+                failures++;
+            }
+        }
+        
+        if (log_level >= 1) {
+            std::cout << input << "\n";
+            std::cout << "  Size:   " << digest.size << "\n";
+            std::cout << "  CRC32:  " << std::hex << std::setw(8) << std::setfill('0')
+                      << digest.crc32 << std::dec << std::setfill(' ') << "\n";
+            std::cout << "  MD5:    " << digest.md5 << "\n";
+            std::cout << "  SHA-1:  " << digest.sha1 << "\n";
+            std::cout << "  Time:   " << std::fixed << std::setprecision(2) << seconds << "s ("
+                      << (seconds > 0 ? digest.size / seconds / (1 << 20) : 0.0) << " MiB/s)\n";
+            std::cout << "  Status: " << status << (detail.empty() ? "" : " - " + detail) << "\n\n";
+        } else {
+            std::cout << std::left << std::setw(8) << status << std::right << input
+                      << (detail.empty() ? "" : " (" + detail + ")") << "\n";
+        }
+    }
+    
+    return failures ? 1 : 0;
+}
+
+// patchiso extract: copy files out of the disc file system
+static int run_extract(int argc, char** argv) {
+    std::string image;
+    std::string out_dir = ".";
+    std::vector<std::string> paths;
+    bool list = false;
+    
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--list") {
+            list = true;
+        } else if (arg[0] != '-' && image.empty()) {
+            image = arg;
+        } else if (arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (image.empty()) {
+        print_usage(argv[0]);
+        return 1;
     }
     
     GCMFile iso;
-    if (!iso.load(cfg.input_iso)) {
-        std::cerr << "Error: Failed to load ISO\n";
+    FstIndex fst;
+    if (!iso.load(image) || !fst.load(iso)) {
+        std::cerr << "Error: Failed to read file system table from " << image << "\n";
         return 1;
     }
+    if (paths.empty()) paths.push_back("/");
+    
+    std::vector<uint32_t> targets;
+    for (const auto& path : paths) {
+        uint32_t index = fst.find(path);
+        if (index == FstIndex::NOT_FOUND) {
+            std::cerr << "Error: " << path << " not found on disc\n";
+            return 1;
+        }
+        targets.push_back(index);
+    }
     
-    if (cfg.log_level >= 1) {
-        std::cout << iso.header().format() << "\n";
+    if (list) {
+        for (uint32_t top : targets) {
+            for (uint32_t i = top; i < fst.entry(top).end; i++) {
+                const FstEntry& e = fst.entry(i);
+                if (e.is_dir) {
+                    std::cout << std::setw(10) << "<dir>" << "             /" << fst.path(i) << "\n";
+                } else {
+                    std::cout << std::setw(10) << e.size << "  0x" << std::hex << std::setw(8)
+                              << std::setfill('0') << e.offset << std::dec << std::setfill(' ')
+                              << "  /" << fst.path(i) << "\n";
+                }
+            }
+        }
+        return 0;
     }
     
-    // Read DOL
-    DOLFile dol = iso.read_dol();
-    if (cfg.log_level >= 2 || cfg.print_dol) {
-        std::cout << dol.format_header() << "\n";
+    FstExtractor extractor;
+    if (!extractor.open(image)) {
+        std::cerr << "Error: Cannot open " << image << "\n";
+        return 1;
     }
     
-    // Load payload
-    if (cfg.log_level >= 1) {
-        std::cout << "Loading payload...\n";
+    long files = 0;
+    uint64_t bytes = 0;
+    for (uint32_t top : targets) {
+        long n = extractor.extract_tree(fst, top, out_dir);
+        if (n < 0) {
+            std::cerr << "Error: Failed to extract /" << fst.path(top) << "\n";
+            return 1;
+        }
+        files += n;
+        bytes += fst.total_size(top);
     }
     
-    std::ifstream payload_file("payload/payload.bin", std::ios::binary);
-    if (!payload_file) {
-        std::cerr << "Error: payload/payload.bin not found\n";
-        std::cerr << "Build the runtime first with 'make runtime'\n";
-        return 1;
+    std::cout << "Extracted " << files << " file(s), " << bytes << " bytes to " << out_dir << "\n";
+    return 0;
+}
+
+// patchiso rebuild: replace/add files using free gaps on the disc
+static int run_rebuild(int argc, char** argv) {
+    struct FileOp {
+        bool add;
+        std::string disc_path;
+        std::string host_path;
+    };
+    
+    std::string image;
+    std::string output;
+    std::vector<FileOp> ops;
+    int log_level = 1;
+    
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--replace" || arg == "--add") && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t eq = spec.find('=');
+            if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size()) {
+                std::cerr << "Error: Expected DISC=HOST, got " << spec << "\n";
+                return 1;
+            }
+            ops.push_back({arg == "--add", spec.substr(0, eq), spec.substr(eq + 1)});
+        } else if (arg == "--out" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--log" && i + 1 < argc) {
+            log_level = std::atoi(argv[++i]);
+        } else if (arg[0] != '-' && image.empty()) {
+            image = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
     }
     
-    payload_file.seekg(0, std::ios::end);
-    size_t payload_size = payload_file.tellg();
-    payload_file.seekg(0, std::ios::beg);
+    if (image.empty() || ops.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    std::vector<uint8_t> payload(payload_size);
-    payload_file.read(reinterpret_cast<char*>(payload.data()), payload_size);
+    GCMFile iso;
+    if (!iso.load(image)) {
+        std::cerr << "Error: Failed to load ISO\n";
+        return 1;
+    }
+    uint64_t old_size = iso.size();
     
-    if (cfg.log_level >= 1) {
-        std::cout << "  Payload size: " << payload_size << " bytes\n";
+    std::string error;
+    DiscRebuilder rebuilder(iso);
+    if (!rebuilder.init(error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
     }
     
-    // Load symbol map
-    SymbolMap symbols;
-    if (!symbols.load("payload/payload.sym")) {
-        std::cerr << "Warning: payload.sym not found, using defaults\n";
-        // Set reasonable defaults
-        symbols.symbols["__dolhook_entry"] = 0x80400000;
-        symbols.symbols["__dolhook_original_entry"] = 0x80400100;
+    for (const auto& op : ops) {
+        std::ifstream file(op.host_path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Error: Cannot read " << op.host_path << "\n";
+            return 1;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), {});
+        
+        bool ok = op.add ? rebuilder.add_file(op.disc_path, data, error)
+                         : rebuilder.replace_file(op.disc_path, data, error);
+        if (!ok) {
+            std::cerr << "Error: " << error << "\n";
+            return 1;
+        }
     }
     
-    if (!symbols.has("__dolhook_entry")) {
-        std::cerr << "Error: __dolhook_entry symbol not found\n";
+    if (!rebuilder.commit(error)) {
+        std::cerr << "Error: " << error << "\n";
         return 1;
     }
     
-    uint32_t hook_entry = symbols.get("__dolhook_entry");
-    uint32_t orig_entry_slot = symbols.get("__dolhook_original_entry");
+    if (log_level >= 1) {
+        for (const auto& line : rebuilder.log()) std::cout << "  " << line << "\n";
+        std::cout << "Image size: " << old_size << " -> " << iso.size() << " bytes\n";
+    }
     
-    if (cfg.log_level >= 2) {
-        std::cout << "  Hook entry: 0x" << std::hex << hook_entry << "\n";
-        std::cout << "  Original entry slot: 0x" << std::hex << orig_entry_slot << "\n";
+    if (output.empty()) {
+        if (iso.create_backup() == GCMFile::BackupKind::Failed) {
+            std::cerr << "Error: Failed to create backup\n";
+            return 1;
+        }
+        if (log_level >= 1) {
+            std::cout << "Committing " << iso.dirty_bytes() << " bytes: " << image << "\n";
+        }
+        if (!iso.commit_in_place()) {
+            std::cerr << "Error: Failed to commit ISO (journal kept for recovery)\n";
+            return 1;
+        }
+    } else if (!iso.save(output)) {
+        std::cerr << "Error: Failed to write ISO\n";
+        return 1;
     }
     
-    // Save original entry
-    uint32_t original_entry = dol.header().entry_point;
+    return 0;
+}
+
+// patchiso apply: stream a BPS patch onto a clean image
+static int run_apply(int argc, char** argv) {
+    std::vector<std::string> args;
+    std::string output;
     
-    if (cfg.log_level >= 1) {
-        std::cout << "\nPatching:\n";
-        std::cout << "  Original entry: 0x" << std::hex << original_entry << "\n";
-        std::cout << "  New entry: 0x" << std::hex << hook_entry << "\n";
-    }
-    
-    // Find offset of __dolhook_original_entry in payload
-    // For simplicity, scan for the placeholder value 0x80003100
-    uint32_t placeholder = 0x80003100;
-    size_t entry_offset = 0;
-    bool found_slot = false;
-    
-    for (size_t i = 0; i + 4 <= payload.size(); i += 4) {
-        uint32_t val = (payload[i] << 24) | (payload[i+1] << 16) | 
-                       (payload[i+2] << 8) | payload[i+3];
-        if (val == placeholder) {
-            entry_offset = i;
-            found_slot = true;
-            break;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] != '-') {
+            args.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
         }
     }
     
-    if (!found_slot && cfg.log_level >= 1) {
-        std::cout << "  Warning: Placeholder not found, appending entry data\n";
-        entry_offset = payload.size();
-        payload.resize(payload.size() + 4);
+    if (args.size() != 2 || output.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    BpsInfo info;
+    std::string error;
+    if (!apply_bps(args[0], args[1], output, info, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
     }
     
-    // Write original entry to payload
-    write_be32(payload.data() + entry_offset, original_entry);
+    std::cout << "Applied " << args[0] << " (" << info.patch_size << " bytes): " << output
+              << ", " << info.target_size << " bytes\n";
+    return 0;
+}
+
+// patchiso convert: rewrite an image in another format
+static int run_convert(int argc, char** argv) {
+    std::string image;
+    std::string output;
+    bool scrub = false;
+    int log_level = 1;
     
-    if (cfg.log_level >= 2) {
-        std::cout << "  Wrote original entry at payload offset: 0x" 
-                  << std::hex << entry_offset << "\n";
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--scrub") {
+            scrub = true;
+        } else if (arg == "--log" && i + 1 < argc) {
+            log_level = std::atoi(argv[++i]);
+        } else if (arg[0] != '-' && image.empty()) {
+            image = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
     }
     
-    if (cfg.dry_run) {
-        std::cout << "\nDry run - no changes written\n";
-        return 0;
+    if (image.empty() || output.empty()) {
+        print_usage(argv[0]);
+        return 1;
     }
     
-    // Choose load address (after highest existing section)
-    uint32_t load_addr = (dol.header().get_highest_addr() + 0xFF) & ~0xFF;
-    if (load_addr < 0x80400000) load_addr = 0x80400000;
+    ContainerFormat format = container_format_for(output);
+    if (scrub && format == ContainerFormat::Raw) {
+        std::cerr << "Error: --scrub needs a .gcz or .ciso output\n";
+        return 1;
+    }
+    if (format != ContainerFormat::Raw && !container_supported(format)) {
+        std::cerr << "Error: This build cannot write " << output << "\n";
+        return 1;
+    }
     
-    if (cfg.log_level >= 1) {
-        std::cout << "  Loading payload at: 0x" << std::hex << load_addr << "\n";
+    GCMFile iso;
+    if (!iso.load(image)) {
+        std::cerr << "Error: Failed to load ISO\n";
+        return 1;
     }
+    iso.set_scrub(scrub);
     
-    // Inject payload as text section
-    if (!dol.inject_payload(payload, load_addr, true)) {
-        std::cerr << "Error: Failed to inject payload\n";
+    if (!iso.save(output)) {
+        std::cerr << "Error: Failed to write " << output << "\n";
         return 1;
     }
     
-    // Update entry point
-    dol.header().entry_point = hook_entry;
+    if (log_level >= 1) {
+        std::error_code ec;
+        std::cout << "Wrote " << output << ": " << iso.size() << " byte image in "
+                  << std::filesystem::file_size(output, ec) << " bytes\n";
+        if (format != ContainerFormat::Raw && iso.container_stats().junk) {
+            std::cout << "  " << iso.container_stats().junk << " bytes of junk kept as seeds\n";
+        }
+    }
+    return 0;
+}
+
+static bool load_maps(const std::vector<std::string>& paths, SymbolIndex& index, int log_level) {
+    for (const auto& path : paths) {
+        auto start = std::chrono::steady_clock::now();
+        std::string error;
+        if (!index.load(path, error)) {
+            std::cerr << "Error: " << error << "\n";
+            return false;
+        }
+        if (log_level >= 2) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Loaded " << path << ": " << index.size() << " symbols in " << std::fixed
+                      << std::setprecision(1) << ms << " ms\n" << std::defaultfloat;
+        }
+    }
+    return true;
+}
+
+static void print_symbol(const SymbolInfo& sym) {
+    std::cout << std::hex << std::setfill('0') << std::setw(8) << sym.addr << " " << std::setw(8) << sym.size
+              << std::dec << std::setfill(' ') << " " << sym.name << "\n";
+}
+
+// patchiso symbols: query a game symbol map
+static int run_symbols(int argc, char** argv) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    if (cfg.log_level >= 2) {
-        std::cout << "\nModified DOL:\n" << dol.format_header() << "\n";
+    SymbolIndex index;
+    if (!load_maps({argv[2]}, index, 2)) {
+        return 1;
     }
     
-    // Create backup
-    if (cfg.output_iso.empty()) {
-        if (cfg.log_level >= 1) {
-            std::cout << "Creating backup...\n";
+    int missing = 0;
+    for (int i = 3; i < argc; i++) {
+        std::string query = argv[i];
+        SymbolInfo sym;
+        if (query.size() > 2 && query[0] == '0' && (query[1] == 'x' || query[1] == 'X')) {
+            uint32_t addr = static_cast<uint32_t>(std::strtoul(query.c_str(), nullptr, 16));
+            if (index.lookup(addr, sym)) {
+                print_symbol(sym);
+                continue;
+            }
+        } else if (query.back() == '*') {
+            auto matches = index.with_prefix(std::string_view(query).substr(0, query.size() - 1));
+            for (const auto& m : matches) print_symbol(m);
+            if (!matches.empty()) continue;
+        } else if (index.find(query, sym)) {
+            print_symbol(sym);
+            continue;
         }
-        iso.create_backup(cfg.input_iso);
-        cfg.output_iso = cfg.input_iso;
+        std::cerr << query << ": not found\n";
+        missing++;
+    }
+    return missing ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && std::strcmp(argv[1], "rebuild") == 0) {
+        return run_rebuild(argc, argv);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "verify") == 0) {
+        return run_verify(argc, argv);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "extract") == 0) {
+        return run_extract(argc, argv);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "apply") == 0) {
+        return run_apply(argc, argv);
     }
+    if (argc >= 2 && std::strcmp(argv[1], "convert") == 0) {
+        return run_convert(argc, argv);
+    }
+    if (argc >= 2 && std::strcmp(argv[1], "symbols") == 0) {
+        return run_symbols(argc, argv);
+    }
+    
+    PatcherConfig cfg;
     
-    // Try to write DOL in place first
-    bool wrote_inline = iso.write_dol(dol);
+    if (!parse_args(argc, argv, cfg)) {
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    if (!wrote_inline) {
+    if (cfg.restore) {
+        if (!GCMFile::restore_backup(cfg.input_iso)) {
+            std::cerr << "Error: No usable backup for " << cfg.input_iso << "\n";
+            return 1;
+        }
         if (cfg.log_level >= 1) {
-            std::cout << "DOL too large, relocating to end of ISO...\n";
+            std::cout << "Restored " << cfg.input_iso << "\n";
         }
-        iso.relocate_dol(dol);
+        return 0;
     }
     
-    // Write ISO
+    // Load payload once, shared by every image
     if (cfg.log_level >= 1) {
-        std::cout << "Writing patched ISO: " << cfg.output_iso << "\n";
+        std::cout << "Loading payload...\n";
     }
     
-    if (!iso.save(cfg.output_iso)) {
-        std::cerr << "Error: Failed to write ISO\n";
+    Payload payload;
+    if (!payload.load("payload", std::cerr)) {
         return 1;
     }
     
-    if (cfg.log_level >= 1) {
-        std::cout << "\n✓ Patch complete!\n";
-        std::cout << "  Original entry: 0x" << std::hex << original_entry << "\n";
-        std::cout << "  New entry: 0x" << std::hex << hook_entry << "\n";
-        std::cout << "  Payload size: " << std::dec << payload_size << " bytes\n";
+    DolCache cache(cfg.cache_dir.empty() ? DolCache::default_dir() : cfg.cache_dir);
+    const DolCache* cache_ptr = cfg.no_cache ? nullptr : &cache;
+    
+    SymbolIndex symbols;
+    if (!load_maps(cfg.maps, symbols, cfg.log_level)) {
+        return 1;
+    }
+    const SymbolIndex* symbols_ptr = cfg.maps.empty() ? nullptr : &symbols;
+    
+    GeckoList gecko;
+    if (!cfg.gecko.empty()) {
+        std::string error;
+        if (!gecko.load(cfg.gecko, error)) {
+            std::cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        if (cfg.log_level >= 2) {
+            std::cout << "Loaded " << cfg.gecko << ": " << gecko.codes() << " Gecko codes\n";
+        }
+    }
+    const GeckoList* gecko_ptr = cfg.gecko.empty() ? nullptr : &gecko;
+    
+    if (!cfg.batch_source.empty()) {
+        return run_batch_mode(cfg, payload, cache_ptr, symbols_ptr, gecko_ptr);
+    }
+    
+    PatchOptions opts;
+    opts.output = cfg.output_iso;
+    opts.bps_output = cfg.bps_output;
+    opts.log_level = cfg.log_level;
+    opts.dry_run = cfg.dry_run;
+    opts.print_dol = cfg.print_dol;
+    opts.cache = cache_ptr;
+    opts.game_symbols = symbols_ptr;
+    opts.gecko = gecko_ptr;
+    
+    PatchResult result = patch_image(cfg.input_iso, opts, payload, std::cout);
+    if (!result.ok) {
+        std::cerr << "Error: " << result.error << "\n";
+        return 1;
     }
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,572 @@
+/**
+ * Patch Pipeline Implementation
+ */
+
+#include "patcher.h"
+#include "bps.h"
+#include "gcm.h"
+#include "dol.h"
+#include "dol_cache.h"
+#include "elf.h"
+#include "gecko.h"
+#include "hash.h"
+#include "signatures.h"
+#include "symbols.h"
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+
+namespace dolhook {
+
+static void write_be32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+bool SymbolMap::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream iss(line);
+        std::string name;
+        uint32_t addr;
+
+        if (iss >> name >> std::hex >> addr) {
+            symbols[name] = addr;
+        }
+    }
+
+    return !symbols.empty();
+}
+
+bool Payload::load(const std::string& dir, std::ostream& err) {
+    // The linked ELF carries its symbols and relocations; prefer it
+    std::ifstream elf_file(dir + "/payload.elf", std::ios::binary);
+    if (elf_file) {
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(elf_file)), {});
+        auto image = std::make_shared<ElfImage>();
+        std::string error;
+        if (!image->load(data, error) || !image->relocate(image->base(), code, symbols.symbols, error)) {
+            err << "Error: " << dir << "/payload.elf: " << error << "\n";
+            return false;
+        }
+        for (const char* name : {"__dolhook_entry", "__dolhook_original_entry"}) {
+            if (!symbols.has(name)) {
+                err << "Error: " << name << " symbol not found in payload.elf\n";
+                return false;
+            }
+        }
+        elf = image;
+
+        Sha1 sha;
+        sha.update(data.data(), data.size());
+        digest = sha.hex_digest();
+        return true;
+    }
+
+    std::ifstream payload_file(dir + "/payload.bin", std::ios::binary);
+    if (!payload_file) {
+        err << "Error: " << dir << "/payload.bin not found\n";
+        err << "Build the runtime first with 'make runtime'\n";
+        return false;
+    }
+
+    payload_file.seekg(0, std::ios::end);
+    size_t payload_size = payload_file.tellg();
+    payload_file.seekg(0, std::ios::beg);
+
+    code.resize(payload_size);
+    payload_file.read(reinterpret_cast<char*>(code.data()), payload_size);
+
+    // Load symbol map
+    if (!symbols.load(dir + "/payload.sym")) {
+        err << "Warning: payload.sym not found, using defaults\n";
+        // Set reasonable defaults
+        symbols.symbols["__dolhook_entry"] = 0x80400000;
+        symbols.symbols["__dolhook_original_entry"] = 0x80400100;
+    }
+
+    if (!symbols.has("__dolhook_entry")) {
+        err << "Error: __dolhook_entry symbol not found\n";
+        return false;
+    }
+
+    Sha1 sha;
+    sha.update(code.data(), code.size());
+    for (const auto& sym : symbols.symbols) {
+        sha.update(sym.first.data(), sym.first.size() + 1);
+        sha.update(&sym.second, sizeof(sym.second));
+    }
+    digest = sha.hex_digest();
+
+    return true;
+}
+
+void MemoryBudget::acquire(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return used_ == 0 || used_ + bytes <= limit_; });
+    used_ += bytes;
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_ -= bytes;
+    }
+    cv_.notify_all();
+}
+
+// Holds a budget reservation for the rest of a patch job
+class BudgetLease {
+public:
+    BudgetLease(MemoryBudget* budget, uint64_t bytes) : budget_(budget), bytes_(bytes) {
+        if (budget_) budget_->acquire(bytes_);
+    }
+    ~BudgetLease() {
+        if (budget_) budget_->release(bytes_);
+    }
+    BudgetLease(const BudgetLease&) = delete;
+    BudgetLease& operator=(const BudgetLease&) = delete;
+
+private:
+    MemoryBudget* budget_;
+    uint64_t bytes_;
+};
+
+static PatchResult fail(PatchResult& result, const std::string& msg) {
+    result.ok = false;
+    result.error = msg;
+    return result;
+}
+
+// Patch the original entry into the payload and append it to the DOL
+static bool inject_payload(DOLFile& dol, const Payload& payload_in, const PatchOptions& opts,
+                           PatchResult& result, std::ostream& out) {
+    const int log_level = opts.log_level;
+    const ElfImage* elf = payload_in.elf.get();
+
+    if (log_level >= 1) {
+        out << "  Payload size: " << payload_in.code.size() << " bytes\n";
+    }
+
+    // Lowest address from the payload's link base on that stays clear of
+    // every section and the BSS, including the payload's own BSS
+    uint32_t base = 0x80400000;
+    uint32_t footprint = static_cast<uint32_t>(payload_in.code.size());
+    if (elf) {
+        base = elf->base();
+        footprint = elf->footprint();
+    } else {
+        const SymbolMap& syms = payload_in.symbols;
+        if (syms.has("__dolhook_start")) base = syms.get("__dolhook_start");
+        if (syms.has("__dolhook_end") && syms.get("__dolhook_end") > base) {
+            footprint = std::max(footprint, syms.get("__dolhook_end") - base);
+        }
+    }
+    // A Gecko code list follows the payload's BSS, which is then stored as
+    // zeros; C2 blocks run from it, so it is loaded as code too
+    uint32_t gecko_offset = 0;
+    if (opts.gecko) {
+        if (!payload_in.symbols.has("__dolhook_gecko")) {
+            fail(result, "The payload has no Gecko code engine (__dolhook_gecko)");
+            return false;
+        }
+        // One-time writes are applied before the game's __start, which then
+        // clears its BSS
+        const DOLHeader& hdr = dol.header();
+        auto lost = opts.gecko->writes_in(hdr.bss_addr, hdr.bss_addr + hdr.bss_size);
+        if (!lost.empty()) {
+            std::ostringstream oss;
+            oss << "Gecko codes write once into the game's BSS (0x" << std::hex << hdr.bss_addr << "-0x"
+                << hdr.bss_addr + hdr.bss_size << "), which __start clears: ";
+            for (size_t i = 0; i < lost.size(); i++) oss << (i ? ", " : "") << lost[i].where;
+            fail(result, oss.str());
+            return false;
+        }
+        gecko_offset = (footprint + 31) & ~31u;
+        footprint = gecko_offset + static_cast<uint32_t>(opts.gecko->bytes().size());
+    }
+    uint32_t load_addr;
+    if (elf) {
+        load_addr = dol.header().find_load_addr(footprint, std::max<uint32_t>(base, 0x80400000));
+        if (load_addr == 0) {
+            fail(result, "No room in MEM1 for the payload");
+            return false;
+        }
+    } else {
+        // A flat payload only runs at its link address: [base, base + footprint)
+        // must be clear (checked from the 256-byte line find_load_addr steps by)
+        uint32_t line = base & ~0xFFu;
+        if (dol.header().find_load_addr(footprint + (base - line), line) != line) {
+            std::ostringstream oss;
+            oss << "payload.bin is linked at 0x" << std::hex << base
+                << ", which the game's sections or BSS overlap; provide payload.elf so it can be relocated";
+            fail(result, oss.str());
+            return false;
+        }
+        load_addr = base;
+    }
+    result.load_addr = load_addr;
+
+    // An ELF payload is relocated there; a flat one is already at home
+    std::vector<uint8_t> payload;
+    SymbolMap symbols;
+    if (elf) {
+        std::string error;
+        if (!elf->relocate(load_addr, payload, symbols.symbols, error)) {
+            fail(result, "Failed to relocate payload: " + error);
+            return false;
+        }
+    } else {
+        payload = payload_in.code;
+        symbols = payload_in.symbols;
+    }
+
+    // Resolve the payload's signatures against the game's text now, so the
+    // runtime reads addresses instead of scanning RAM at boot. They are
+    // written after the entry slot, which a flat payload finds by value.
+    std::vector<Signature> sigs;
+    if (symbols.has("__dolhook_sigs_start") && symbols.has("__dolhook_sigs_end")) {
+        std::string error;
+        if (!read_signatures(payload, load_addr, symbols.get("__dolhook_sigs_start"),
+                             symbols.get("__dolhook_sigs_end"), sigs, error) ||
+            !resolve_signatures(dol, opts.game_symbols, sigs, error)) {
+            fail(result, "Failed to resolve signatures: " + error);
+            return false;
+        }
+
+        if (log_level >= 1 && !sigs.empty()) {
+            out << "  Resolved " << std::dec << sigs.size() << " signature(s)\n";
+        }
+        for (const auto& sig : sigs) {
+            if (log_level >= 2) {
+                out << "    " << sig.name << ": 0x" << std::hex << sig.addr;
+                SymbolInfo info;
+                if (!sig.mask.empty() && opts.game_symbols && opts.game_symbols->lookup(sig.addr, info)) {
+                    out << " (" << info.name << ")";
+                }
+                out << "\n";
+            }
+        }
+    }
+
+    uint32_t hook_entry = symbols.get("__dolhook_entry");
+    uint32_t orig_entry_slot = symbols.get("__dolhook_original_entry");
+
+    if (log_level >= 2) {
+        out << "  Hook entry: 0x" << std::hex << hook_entry << "\n";
+        out << "  Original entry slot: 0x" << std::hex << orig_entry_slot << "\n";
+    }
+
+    // Save original entry
+    uint32_t original_entry = dol.header().entry_point;
+    result.original_entry = original_entry;
+    result.new_entry = hook_entry;
+
+    if (log_level >= 1) {
+        out << "\nPatching:\n";
+        out << "  Original entry: 0x" << std::hex << original_entry;
+        SymbolInfo sym;
+        if (opts.game_symbols && opts.game_symbols->lookup(original_entry, sym)) {
+            out << " (" << sym.name << ")";
+        }
+        out << "\n";
+        out << "  New entry: 0x" << std::hex << hook_entry << "\n";
+    }
+
+    size_t entry_offset = 0;
+    if (elf) {
+        // The symbol table says where the slot is
+        entry_offset = orig_entry_slot - load_addr;
+        if (orig_entry_slot < load_addr || entry_offset + 4 > payload.size()) {
+            fail(result, "__dolhook_original_entry is outside the payload image");
+            return false;
+        }
+    } else {
+        // Flat payloads: scan for the placeholder value 0x80003100
+        uint32_t placeholder = 0x80003100;
+        bool found_slot = false;
+
+        for (size_t i = 0; i + 4 <= payload.size(); i += 4) {
+            uint32_t val = (payload[i] << 24) | (payload[i+1] << 16) |
+                           (payload[i+2] << 8) | payload[i+3];
+            if (val == placeholder) {
+                entry_offset = i;
+                found_slot = true;
+                break;
+            }
+        }
+
+        if (!found_slot) {
+            if (log_level >= 1) {
+                out << "  Warning: Placeholder not found, appending entry data\n";
+            }
+            entry_offset = payload.size();
+            payload.resize(payload.size() + 4);
+        }
+    }
+
+    // Write original entry to payload
+    write_be32(payload.data() + entry_offset, original_entry);
+    write_signatures(payload, load_addr, sigs);
+
+    if (opts.gecko) {
+        uint32_t list_slot = symbols.get("__dolhook_gecko");
+        if (list_slot < load_addr || list_slot - load_addr + 8 > payload.size()) {
+            fail(result, "__dolhook_gecko is outside the payload image");
+            return false;
+        }
+        if (payload.size() > gecko_offset) {
+            fail(result, "No room for the Gecko code list after the payload");
+            return false;
+        }
+        const auto& list = opts.gecko->bytes();
+        payload.resize(gecko_offset, 0);
+        payload.insert(payload.end(), list.begin(), list.end());
+        write_be32(payload.data() + (list_slot - load_addr), load_addr + gecko_offset);
+        write_be32(payload.data() + (list_slot - load_addr) + 4, static_cast<uint32_t>(list.size()));
+
+        if (log_level >= 1) {
+            out << "  Gecko codes: " << std::dec << opts.gecko->codes() << " (" << list.size()
+                << " bytes at 0x" << std::hex << load_addr + gecko_offset << ")\n";
+        }
+    }
+
+    if (log_level >= 2) {
+        out << "  Wrote original entry at payload offset: 0x"
+            << std::hex << entry_offset << "\n";
+    }
+
+    if (opts.dry_run) {
+        out << "\nDry run - no changes written\n";
+        return true;
+    }
+
+    if (log_level >= 1) {
+        out << "  Loading payload at: 0x" << std::hex << load_addr << "\n";
+    }
+
+    if (!dol.header().has_free_slot(true) && log_level >= 1) {
+        out << "  No free text slot, merging adjacent sections\n";
+    }
+
+    // Inject payload as text section
+    if (!dol.inject_payload(payload, load_addr, true)) {
+        fail(result, "Failed to inject payload");
+        return false;
+    }
+
+    // Update entry point
+    dol.header().entry_point = hook_entry;
+
+    if (log_level >= 2) {
+        out << "\nModified DOL:\n" << dol.format_header() << "\n";
+    }
+
+    return true;
+}
+
+PatchResult patch_image(const std::string& input, const PatchOptions& opts,
+                        const Payload& payload_in, std::ostream& out) {
+    PatchResult result;
+    const int log_level = opts.log_level;
+
+    // Load ISO
+    if (log_level >= 1) {
+        out << "Loading ISO: " << input << "\n";
+    }
+
+    GCMFile iso;
+    if (!iso.load(input)) {
+        return fail(result, "Failed to load ISO");
+    }
+
+    if (log_level >= 2) {
+        out << "  Backend: " << iso.backend() << "\n";
+    }
+
+    if (log_level >= 1) {
+        out << iso.header().format() << "\n";
+    }
+
+    // Read DOL
+    DOLFile dol = iso.read_dol();
+    if (log_level >= 2 || opts.print_dol) {
+        out << dol.format_header() << "\n";
+    }
+
+    // The DOL is a view of the image; a read-in copy, its overlay copy and
+    // its dirty extent dominate a job
+    BudgetLease lease(opts.budget, 3 * (dol.size() + payload_in.code.size()));
+
+    result.original_entry = dol.header().entry_point;
+
+    // Same original DOL + same payload = same output; splice it straight in
+    std::string cache_key;
+    if (opts.cache) {
+        // Signatures resolved by name depend on the game map too, and the
+        // image on the Gecko codes
+        std::string digest = payload_in.digest;
+        if (opts.game_symbols) digest += opts.game_symbols->digest();
+        if (opts.gecko) digest += opts.gecko->digest();
+        cache_key = DolCache::key(dol.source(), digest);
+
+        std::vector<uint8_t> cached;
+        if (opts.cache->lookup(cache_key, cached) && dol.load(std::move(cached))) {
+            result.cache_hit = true;
+            result.new_entry = dol.header().entry_point;
+            if (log_level >= 1) {
+                out << "Cache hit: " << cache_key << "\n";
+            }
+        }
+    }
+
+    if (!result.cache_hit) {
+        if (!inject_payload(dol, payload_in, opts, result, out)) {
+            return result;
+        }
+        if (opts.dry_run) {
+            result.ok = true;
+            return result;
+        }
+        uint8_t dol_header[DOLHeader::SIZE];
+        if (opts.cache && !opts.cache->store(cache_key, dol.gather(dol_header)) && log_level >= 1) {
+            out << "  Warning: could not store DOL in cache " << opts.cache->dir() << "\n";
+        }
+    } else if (opts.dry_run) {
+        out << "\nDry run - no changes written\n";
+        result.ok = true;
+        return result;
+    }
+
+    // Try to write DOL in place first, then again without alignment slack
+    bool wrote_inline = iso.write_dol(dol);
+    if (!wrote_inline) {
+        size_t before = dol.size();
+        dol.repack(false);
+        wrote_inline = dol.size() < before && iso.write_dol(dol);
+        if (wrote_inline && log_level >= 1) {
+            out << "Repacked DOL to fit in place (" << std::dec << before - dol.size()
+                << " bytes of slack removed)\n";
+        }
+    }
+
+    if (!wrote_inline) {
+        if (log_level >= 1) {
+            out << "DOL too large, relocating to end of ISO...\n";
+        }
+        iso.relocate_dol(dol);
+        result.relocated = true;
+    }
+
+    // Re-running on an already patched target changes nothing; say so and stop
+    const bool to_patch = !opts.bps_output.empty();
+    const bool in_place = opts.output.empty() && !to_patch;
+    if (!to_patch && (in_place ? iso.dirty_bytes() == 0 : iso.output_matches(opts.output))) {
+        if (log_level >= 1) {
+            out << "Up to date: " << (in_place ? input : opts.output) << "\n";
+        }
+        result.up_to_date = true;
+        result.ok = true;
+        return result;
+    }
+
+    // Create backup (needs the final dirty extents for a delta)
+    if (in_place) {
+        if (log_level >= 1) {
+            out << "Creating backup...\n";
+        }
+
+        switch (iso.create_backup()) {
+        case GCMFile::BackupKind::Clone:
+            if (log_level >= 2) out << "  Reflink clone: " << input << ".bak\n";
+            break;
+        case GCMFile::BackupKind::Link:
+            if (log_level >= 2) out << "  Hard link: " << input << ".bak\n";
+            break;
+        case GCMFile::BackupKind::Copy:
+            if (log_level >= 2) out << "  Full copy: " << input << ".bak\n";
+            break;
+        case GCMFile::BackupKind::Delta:
+            if (log_level >= 2) out << "  Delta backup: " << input << ".delta\n";
+            break;
+        case GCMFile::BackupKind::Existing:
+            if (log_level >= 2) out << "  Keeping existing " << input << ".bak\n";
+            break;
+        case GCMFile::BackupKind::Failed:
+            return fail(result, "Failed to create backup");
+        }
+    }
+
+    // Write ISO (or only the difference)
+    if (to_patch) {
+        if (log_level >= 1) {
+            out << "Writing BPS patch: " << opts.bps_output << "\n";
+        }
+
+        BpsInfo info;
+        std::string error;
+        if (!write_bps(iso, opts.bps_output, info, error)) {
+            return fail(result, "Failed to write patch: " + error);
+        }
+        result.bytes_written = info.patch_size;
+
+        if (log_level >= 2) {
+            out << "  " << std::dec << info.patch_size << " bytes, source CRC32 " << std::hex << std::setw(8)
+                << std::setfill('0') << info.source_crc << ", target " << std::setw(8)
+                << info.target_crc << std::dec << std::setfill(' ') << "\n";
+        }
+    } else if (in_place) {
+        auto extents = iso.dirty_extents();
+        result.bytes_written = iso.dirty_bytes();
+
+        if (log_level >= 1) {
+            out << "Committing " << std::dec << result.bytes_written << " bytes in "
+                << extents.size() << " extent(s): " << input << "\n";
+        }
+
+        if (!iso.commit_in_place()) {
+            return fail(result, "Failed to commit ISO (journal kept for recovery)");
+        }
+    } else {
+        if (log_level >= 1) {
+            out << "Writing patched ISO: " << opts.output << "\n";
+        }
+
+        if (!iso.save(opts.output)) {
+            return fail(result, "Failed to write ISO");
+        }
+        result.bytes_written = iso.size();
+
+        const StreamStats& stream = iso.stream_stats();
+        if (stream.bytes && log_level >= 2) {
+            out << "  " << std::dec << stream.bytes << " bytes via " << stream.writer << ", CRC32 "
+                << std::hex << std::setw(8) << std::setfill('0') << stream.crc32 << std::setfill(' ') << "\n";
+        }
+    }
+
+    const ContainerWriteStats& blocks = iso.container_stats();
+    if (blocks.blocks && log_level >= 1) {
+        out << "  Re-encoded " << std::dec << blocks.encoded << " of " << blocks.blocks
+            << " block(s), " << blocks.copied << " passed through\n";
+    }
+
+    if (log_level >= 1) {
+        out << "\n✓ Patch complete!\n";
+        out << "  Original entry: 0x" << std::hex << result.original_entry << "\n";
+        out << "  New entry: 0x" << std::hex << result.new_entry << "\n";
+        out << "  Payload size: " << std::dec << payload_in.code.size() << " bytes\n";
+    }
+
+    result.ok = true;
+    return result;
+}
+
+} // namespace dolhook
@@ -0,0 +1,97 @@
+/**
+ * Patch Pipeline
+ * Applies the DolHook runtime payload to a disc image
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+class DolCache;
+class ElfImage;
+class GeckoList;
+class SymbolIndex;
+
+struct SymbolMap {
+    std::map<std::string, uint32_t> symbols;
+
+    bool load(const std::string& path);
+
+    bool has(const std::string& name) const {
+        return symbols.find(name) != symbols.end();
+    }
+
+    uint32_t get(const std::string& name) const {
+        auto it = symbols.find(name);
+        return it != symbols.end() ? it->second : 0;
+    }
+};
+
+// Runtime payload; loaded once, then shared read-only between jobs
+struct Payload {
+    std::vector<uint8_t> code;
+    SymbolMap symbols;
+    std::string digest;  // SHA-1 over the payload files (cache key input)
+
+    // From payload.elf: relocatable to any load address. code and symbols
+    // are then at its link address.
+    std::shared_ptr<const ElfImage> elf;
+
+    // Load payload.elf, or payload.bin/payload.sym, from dir (warnings/errors to err)
+    bool load(const std::string& dir, std::ostream& err);
+};
+
+// Caps the bytes held by concurrently running patch jobs
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit) : limit_(limit) {}
+
+    // Blocks until bytes fit; a lone job may always exceed the limit
+    void acquire(uint64_t bytes);
+    void release(uint64_t bytes);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t limit_;
+    uint64_t used_ = 0;
+};
+
+struct PatchOptions {
+    std::string output;            // Empty = patch input in place after backup
+    std::string bps_output;        // Write a BPS patch here instead of an image
+    int log_level = 1;             // 0=errors, 1=info, 2=debug
+    bool dry_run = false;
+    bool print_dol = false;
+    MemoryBudget* budget = nullptr; // Optional (batch mode)
+    const DolCache* cache = nullptr; // Optional patched-DOL cache
+    const SymbolIndex* game_symbols = nullptr; // Optional game .map, for naming addresses
+    const GeckoList* gecko = nullptr; // Optional code list for the runtime's Gecko engine
+};
+
+struct PatchResult {
+    bool ok = false;
+    std::string error;
+    uint32_t original_entry = 0;
+    uint32_t new_entry = 0;
+    uint32_t load_addr = 0;
+    bool relocated = false;
+    bool cache_hit = false;
+    bool up_to_date = false;        // Output already matched; nothing written
+    uint64_t bytes_written = 0;
+};
+
+// Patch one image; progress is logged to out
+PatchResult patch_image(const std::string& input, const PatchOptions& opts,
+                        const Payload& payload, std::ostream& out);
+
+} // namespace dolhook
@@ -0,0 +1,446 @@
+/**
+ * Image Streaming Implementation
+ *
+ * stream_image() keeps depth chunk buffers in a ring. Chunk k lives in slot
+ * k % depth and may only be filled once chunk k - depth has been written:
+ *
+ *   readers (N threads)     calling thread              ChunkWriter
+ *   fill(chunk k)      ->   crc32, submit(slot)    ->   io_uring / thread
+ *                      <-   release slot          <-    reap(slot)
+ */
+
+#include "pipeline.h"
+#include "hash.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define DOLHOOK_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace dolhook {
+
+/* ============================================================================
+ * Thread writer
+ * ========================================================================= */
+
+namespace {
+
+class ThreadWriter : public ChunkWriter {
+public:
+    explicit ThreadWriter(int fd) : fd_(fd), thread_([this] { run(); }) {}
+
+    ~ThreadWriter() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    bool submit(size_t slot, uint64_t offset, const uint8_t* data, size_t len) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back({slot, offset, data, len});
+        in_flight_++;
+        cv_.notify_all();
+        return ok_;
+    }
+
+    bool reap(size_t& slot) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (done_.empty() && in_flight_ == 0) return false;
+        cv_.wait(lock, [&] { return !done_.empty(); });
+        slot = done_.front();
+        done_.pop_front();
+        in_flight_--;
+        return ok_;
+    }
+
+    const char* name() const override { return "thread"; }
+
+private:
+    struct Job {
+        size_t slot;
+        uint64_t offset;
+        const uint8_t* data;
+        size_t len;
+    };
+
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) return;
+                job = queue_.front();
+                queue_.pop_front();
+            }
+
+            bool good = pwrite_sparse(fd_, job.offset, job.data, job.len, true);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!good) ok_ = false;
+            done_.push_back(job.slot);
+            cv_.notify_all();
+        }
+    }
+
+    int fd_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> queue_;
+    std::deque<size_t> done_;
+    size_t in_flight_ = 0;
+    bool stop_ = false;
+    bool ok_ = true;
+    std::thread thread_;  // Last: starts once everything above exists
+};
+
+} // namespace
+
+/* ============================================================================
+ * io_uring writer
+ * ========================================================================= */
+
+#ifdef DOLHOOK_HAVE_IO_URING
+
+namespace {
+
+// Raw io_uring: one ring, IORING_OP_WRITE per data run of a chunk
+class UringWriter : public ChunkWriter {
+public:
+    static std::unique_ptr<UringWriter> open(int fd, unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int ring = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring < 0) return nullptr;
+
+        std::unique_ptr<UringWriter> w(new UringWriter());
+        w->ring_fd_ = ring;
+        w->fd_ = fd;
+
+        // IORING_OP_WRITE arrived together with RW_CUR_POS (5.6)
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) return nullptr;
+
+        w->sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        w->cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) w->sq_size_ = w->cq_size_ = std::max(w->sq_size_, w->cq_size_);
+
+        w->sq_ = map(ring, w->sq_size_, IORING_OFF_SQ_RING);
+        w->cq_ = single ? w->sq_ : map(ring, w->cq_size_, IORING_OFF_CQ_RING);
+        w->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = map(ring, w->sqes_size_, IORING_OFF_SQES);
+        if (!w->sq_ || !w->cq_ || !sqes) {
+            if (sqes) munmap(sqes, w->sqes_size_);
+            return nullptr;
+        }
+        w->sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<uint8_t*>(w->sq_);
+        auto* cq = static_cast<uint8_t*>(w->cq_);
+        w->sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        w->sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        w->sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        w->cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        w->cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        w->cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        w->cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Never more ops in flight than SQ entries, so neither ring overflows
+        w->ops_.resize(params.sq_entries);
+        for (uint32_t i = params.sq_entries; i-- > 0;) w->free_ops_.push_back(i);
+        return w;
+    }
+
+    ~UringWriter() override {
+        // The kernel may still be reading the caller's buffers
+        while (ops_.size() != free_ops_.size() && enter(1)) drain();
+
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ && cq_ != sq_) munmap(cq_, cq_size_);
+        if (sq_) munmap(sq_, sq_size_);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+    }
+
+    bool submit(size_t slot, uint64_t offset, const uint8_t* data, size_t len) override {
+        if (slot >= pending_.size()) pending_.resize(slot + 1, 0);
+
+        auto runs = data_runs(offset, data, len);
+        if (runs.empty()) {
+            done_.push_back(slot);
+            return ok_;
+        }
+
+        pending_[slot] = runs.size();
+        for (const Extent& run : runs) {
+            if (!push({slot, offset + run.offset, data + run.offset, static_cast<size_t>(run.size)})) {
+                return false;
+            }
+        }
+        return enter(0) && ok_;
+    }
+
+    bool reap(size_t& slot) override {
+        drain();
+        while (done_.empty()) {
+            if (ops_.size() == free_ops_.size() || !enter(1)) return false;
+            drain();
+        }
+        slot = done_.front();
+        done_.pop_front();
+        return ok_;
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+private:
+    struct Op {
+        size_t slot;
+        uint64_t offset;
+        const uint8_t* data;
+        size_t len;
+    };
+
+    UringWriter() = default;
+
+    static void* map(int ring, size_t size, off_t what) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, what);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    // Queue one write, waiting for a free op first
+    bool push(const Op& op) {
+        while (free_ops_.empty()) {
+            if (!enter(1)) return false;
+            drain();
+        }
+        uint32_t id = free_ops_.back();
+        free_ops_.pop_back();
+        ops_[id] = op;
+
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(op.data);
+        sqe->len = static_cast<uint32_t>(op.len);
+        sqe->off = op.offset;
+        sqe->user_data = id;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted_++;
+        return true;
+    }
+
+    // Submit queued writes; with min_complete, also wait for completions
+    bool enter(unsigned min_complete) {
+        for (;;) {
+            unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+            long n = syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_, min_complete, flags, nullptr, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                ok_ = false;
+                return false;
+            }
+            unsubmitted_ -= std::min<unsigned>(unsubmitted_, static_cast<unsigned>(n));
+            return true;
+        }
+    }
+
+    void drain() {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            finish(static_cast<uint32_t>(cqe.user_data), cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    void finish(uint32_t id, int res) {
+        const Op op = ops_[id];
+        free_ops_.push_back(id);
+
+        if (res < 0) {
+            ok_ = false;
+        } else if (static_cast<size_t>(res) < op.len) {
+            // Short write: finish it synchronously
+            ok_ = pwrite_all(fd_, op.offset + res, op.data + res, op.len - res) && ok_;
+        }
+        if (--pending_[op.slot] == 0) done_.push_back(op.slot);
+    }
+
+    int ring_fd_ = -1;
+    int fd_ = -1;
+    void* sq_ = nullptr;
+    void* cq_ = nullptr;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned unsubmitted_ = 0;
+
+    std::vector<Op> ops_;
+    std::vector<uint32_t> free_ops_;
+    std::vector<size_t> pending_;  // Outstanding writes per slot
+    std::deque<size_t> done_;
+    bool ok_ = true;
+};
+
+} // namespace
+
+#endif // DOLHOOK_HAVE_IO_URING
+
+std::unique_ptr<ChunkWriter> ChunkWriter::create(int fd, size_t depth, bool uring) {
+#ifdef DOLHOOK_HAVE_IO_URING
+    if (uring) {
+        // A few data runs per chunk before submit() has to wait
+        unsigned entries = static_cast<unsigned>(std::min<size_t>(256, std::max<size_t>(8, depth * 4)));
+        if (auto w = UringWriter::open(fd, entries)) return w;
+    }
+#else
+    (void)uring;
+#endif
+    (void)depth;
+    return std::unique_ptr<ChunkWriter>(new ThreadWriter(fd));
+}
+
+/* ============================================================================
+ * Pipeline
+ * ========================================================================= */
+
+bool stream_image(int fd, uint64_t size, const ImageReader& fill, const StreamOptions& opts,
+                  StreamStats* stats) {
+    const size_t chunk = std::max<size_t>(SPARSE_BLOCK, opts.chunk / SPARSE_BLOCK * SPARSE_BLOCK);
+    const uint64_t count = (size + chunk - 1) / chunk;
+    const size_t depth = static_cast<size_t>(std::max<uint64_t>(1, std::min<uint64_t>(std::max<size_t>(2, opts.depth), count)));
+    constexpr uint64_t NONE = ~uint64_t(0);
+
+    unsigned readers = opts.readers;
+    if (readers == 0) readers = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    readers = static_cast<unsigned>(std::min<uint64_t>(readers, count));
+
+    // Buffers outlive the writer, which may still be writing from them
+    std::vector<std::unique_ptr<uint8_t, decltype(&std::free)>> buffers;
+    for (size_t s = 0; s < depth && count; s++) {
+        void* p = nullptr;
+        if (posix_memalign(&p, SPARSE_BLOCK, chunk) != 0) return false;
+        buffers.emplace_back(static_cast<uint8_t*>(p), &std::free);
+    }
+    std::unique_ptr<ChunkWriter> writer = ChunkWriter::create(fd, depth, opts.uring);
+
+    std::vector<uint64_t> ready(depth, NONE);  // Chunk filled into each slot
+    std::vector<uint64_t> owner(depth);        // Chunk each slot may take next
+    std::vector<uint64_t> writing(depth, NONE);
+    for (size_t s = 0; s < depth; s++) owner[s] = s;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool failed = false;
+    std::atomic<uint64_t> next{0};
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < readers; t++) {
+        pool.emplace_back([&] {
+            for (;;) {
+                uint64_t k = next.fetch_add(1);
+                if (k >= count) return;
+                size_t s = static_cast<size_t>(k % depth);
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return failed || owner[s] == k; });
+                    if (failed) return;
+                }
+
+                uint64_t offset = k * chunk;
+                size_t n = static_cast<size_t>(std::min<uint64_t>(chunk, size - offset));
+                bool good = fill(offset, buffers[s].get(), n);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (good) {
+                    ready[s] = k;
+                } else {
+                    failed = true;
+                }
+                cv.notify_all();
+            }
+        });
+    }
+
+    // Hand a written slot back to the readers
+    size_t in_flight = 0;
+    auto reap_one = [&]() {
+        size_t s = 0;
+        if (!writer->reap(s)) return false;
+        in_flight--;
+        std::lock_guard<std::mutex> lock(mutex);
+        owner[s] = writing[s] + depth;
+        cv.notify_all();
+        return true;
+    };
+
+    uint32_t crc = 0;
+    bool ok = true;
+    for (uint64_t k = 0; k < count && ok; k++) {
+        size_t s = static_cast<size_t>(k % depth);
+        while (ok && owner[s] != k) ok = reap_one();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return failed || ready[s] == k; });
+            if (failed) ok = false;
+            ready[s] = NONE;
+        }
+        if (!ok) break;
+
+        uint64_t offset = k * chunk;
+        size_t n = static_cast<size_t>(std::min<uint64_t>(chunk, size - offset));
+        crc = crc32(crc, buffers[s].get(), n);
+        writing[s] = k;
+        in_flight++;
+        ok = writer->submit(s, offset, buffers[s].get(), n);
+    }
+    while (ok && in_flight > 0) ok = reap_one();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) failed = true;
+        cv.notify_all();
+    }
+    for (auto& t : pool) t.join();
+
+    if (stats) {
+        stats->bytes = size;
+        stats->crc32 = crc;
+        stats->writer = writer->name();
+    }
+    return ok && !failed;
+}
+
+} // namespace dolhook
@@ -0,0 +1,53 @@
+/**
+ * Image Streaming
+ * Pipelined read/patch/hash/write of whole images through bounded buffers
+ */
+
+#pragma once
+
+#include "blockdev.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace dolhook {
+
+// Positional writes of caller-owned chunk buffers that complete in the
+// background. Aligned all-zero blocks are skipped, so the file must be fresh.
+class ChunkWriter {
+public:
+    virtual ~ChunkWriter() = default;
+
+    // io_uring where the kernel allows it (and uring is set), else a writer
+    // thread. depth bounds the chunks queued at once.
+    static std::unique_ptr<ChunkWriter> create(int fd, size_t depth, bool uring = true);
+
+    // Queue data for offset; it must stay untouched until slot is reaped
+    virtual bool submit(size_t slot, uint64_t offset, const uint8_t* data, size_t len) = 0;
+
+    // Wait for some queued slot to be fully written; false on a write error
+    virtual bool reap(size_t& slot) = 0;
+
+    virtual const char* name() const = 0;
+};
+
+struct StreamOptions {
+    size_t chunk = 4 << 20;   // Bytes per buffer, a multiple of SPARSE_BLOCK
+    size_t depth = 8;         // Buffers in flight
+    unsigned readers = 0;     // Fill threads (0 = up to 4, by CPU count)
+    bool uring = true;        // false forces the thread writer
+};
+
+struct StreamStats {
+    uint64_t bytes = 0;
+    uint32_t crc32 = 0;             // Of everything written
+    const char* writer = "none";
+};
+
+// Write size bytes of fill to fd (a fresh file). Readers fill chunks in
+// parallel, the calling thread hashes them in order and hands them to a
+// ChunkWriter, so reading, patching, hashing and writing all overlap.
+bool stream_image(int fd, uint64_t size, const ImageReader& fill, const StreamOptions& opts,
+                  StreamStats* stats = nullptr);
+
+} // namespace dolhook
@@ -0,0 +1,428 @@
+/**
+ * Disc Rebuild Implementation
+ */
+
+#include "rebuild.h"
+#include "gcm.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace dolhook {
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static void write_be32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static std::string hex(uint64_t v) {
+    std::ostringstream oss;
+    oss << "0x" << std::hex << v;
+    return oss.str();
+}
+
+/* ============================================================================
+ * FreeSpaceMap
+ * ========================================================================= */
+
+void FreeSpaceMap::insert(uint64_t offset, uint64_t size) {
+    if (size == 0) return;
+    by_offset_[offset] = size;
+    by_size_.insert({size, offset});
+}
+
+void FreeSpaceMap::erase(std::map<uint64_t, uint64_t>::iterator it) {
+    by_size_.erase({it->second, it->first});
+    by_offset_.erase(it);
+}
+
+void FreeSpaceMap::release(uint64_t offset, uint64_t size) {
+    if (size == 0) return;
+    uint64_t end = offset + size;
+
+    // Absorb every free range that overlaps or touches [offset, end)
+    auto it = by_offset_.upper_bound(offset);
+    if (it != by_offset_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second >= offset) {
+            offset = prev->first;
+            end = std::max(end, prev->first + prev->second);
+            erase(prev);
+        }
+    }
+    while (it != by_offset_.end() && it->first <= end) {
+        end = std::max(end, it->first + it->second);
+        auto next = std::next(it);
+        erase(it);
+        it = next;
+    }
+
+    insert(offset, end - offset);
+}
+
+void FreeSpaceMap::reserve(uint64_t offset, uint64_t size) {
+    if (size == 0) return;
+    uint64_t end = offset + size;
+
+    auto it = by_offset_.upper_bound(offset);
+    if (it != by_offset_.begin()) --it;
+
+    while (it != by_offset_.end() && it->first < end) {
+        uint64_t free_start = it->first;
+        uint64_t free_end = it->first + it->second;
+        auto next = std::next(it);
+        if (free_end > offset) {
+            erase(it);
+            if (free_start < offset) insert(free_start, offset - free_start);
+            if (free_end > end) insert(end, free_end - end);
+        }
+        it = next;
+    }
+}
+
+bool FreeSpaceMap::take(uint64_t offset, uint64_t size) {
+    auto it = by_offset_.upper_bound(offset);
+    if (it == by_offset_.begin()) return false;
+    --it;
+    if (it->first + it->second < offset + size) return false;
+
+    reserve(offset, size);
+    return true;
+}
+
+bool FreeSpaceMap::allocate(uint64_t size, uint64_t align, uint64_t& offset) {
+    // Ranges in size order; the first that still fits once aligned is the best fit
+    for (auto it = by_size_.lower_bound({size, 0}); it != by_size_.end(); ++it) {
+        uint64_t start = (it->second + align - 1) / align * align;
+        if (start + size <= it->second + it->first) {
+            offset = start;
+            reserve(start, size);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t FreeSpaceMap::free_bytes(uint64_t limit) const {
+    uint64_t total = 0;
+    for (const auto& ext : by_offset_) {
+        if (ext.first >= limit) break;
+        total += std::min(ext.first + ext.second, limit) - ext.first;
+    }
+    return total;
+}
+
+bool build_free_space(const GCMFile& iso, const FstIndex& fst, FreeSpaceMap& out,
+                      std::vector<Extent>* fixed) {
+    const GCMHeader& hdr = iso.header();
+    out = FreeSpaceMap(std::max<uint64_t>(iso.size(), GCM_DISC_SIZE));
+
+    std::vector<Extent> boot;
+
+    // Header + bi2
+    boot.push_back({0, GCMHeader::SIZE});
+
+    // Apploader; its header starts with a "YYYY/MM/DD" build date. Images
+    // with the DOL directly at 0x2440 have none.
+    uint8_t app[0x20];
+    if (!iso.read_into(GCMHeader::SIZE, app, sizeof(app))) return false;
+    if (hdr.dol_offset != GCMHeader::SIZE && app[4] == '/' && app[7] == '/') {
+        uint64_t app_size = sizeof(app) + uint64_t(read_be32(app + 0x14)) + read_be32(app + 0x18);
+        boot.push_back({GCMHeader::SIZE, app_size});
+    }
+
+    uint32_t dol_size = iso.dol_size();
+    if (dol_size == 0) return false;
+    boot.push_back({hdr.dol_offset, dol_size});
+
+    for (const auto& ext : boot) out.reserve(ext.offset, ext.size);
+    if (fixed) *fixed = boot;
+
+    out.reserve(hdr.fst_offset, hdr.fst_size);
+    for (uint32_t i = 1; i < fst.count(); i++) {
+        const FstEntry& e = fst.entry(i);
+        if (!e.is_dir) out.reserve(e.offset, e.size);
+    }
+    return true;
+}
+
+bool place_dol(const GCMFile& iso, uint64_t size, uint64_t& offset) {
+    FstIndex fst;
+    FreeSpaceMap space;
+    std::vector<Extent> boot;
+    if (!fst.load(iso) || !build_free_space(iso, fst, space, &boot)) return false;
+
+    // Free the current DOL (last boot region), keeping anything sharing its bytes
+    const GCMHeader& hdr = iso.header();
+    space.release(boot.back().offset, boot.back().size);
+    for (size_t i = 0; i + 1 < boot.size(); i++) space.reserve(boot[i].offset, boot[i].size);
+    space.reserve(hdr.fst_offset, hdr.fst_size);
+    for (uint32_t i = 1; i < fst.count(); i++) {
+        const FstEntry& e = fst.entry(i);
+        if (!e.is_dir) space.reserve(e.offset, e.size);
+    }
+
+    if (space.take(hdr.dol_offset, size)) {
+        offset = hdr.dol_offset;
+        return true;
+    }
+    return space.allocate(size, DiscRebuilder::FILE_ALIGN, offset);
+}
+
+/* ============================================================================
+ * DiscRebuilder
+ * ========================================================================= */
+
+static bool name_equal(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](unsigned char x, unsigned char y) {
+               return std::tolower(x) == std::tolower(y);
+           });
+}
+
+static std::vector<std::string> split_path(const std::string& path) {
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream iss(path);
+    while (std::getline(iss, part, '/')) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+bool DiscRebuilder::init(std::string& error) {
+    FstIndex fst;
+    if (!fst.load(iso_)) {
+        error = "No valid FST in image";
+        return false;
+    }
+    if (!build_free_space(iso_, fst, space_, &fixed_)) {
+        error = "Cannot map used space (unreadable DOL/apploader)";
+        return false;
+    }
+
+    nodes_.clear();
+    nodes_.reserve(fst.count());
+    for (uint32_t i = 0; i < fst.count(); i++) {
+        const FstEntry& e = fst.entry(i);
+        nodes_.push_back({fst.name(i), e.is_dir, e.offset, e.size, {}});
+        if (i > 0) nodes_[e.parent].children.push_back(i);
+    }
+    return true;
+}
+
+uint32_t DiscRebuilder::lookup(const std::string& path) const {
+    uint32_t cur = 0;
+    for (const auto& part : split_path(path)) {
+        if (!nodes_[cur].is_dir) return FstIndex::NOT_FOUND;
+
+        uint32_t next = FstIndex::NOT_FOUND;
+        for (uint32_t child : nodes_[cur].children) {
+            if (name_equal(nodes_[child].name, part)) {
+                next = child;
+                break;
+            }
+        }
+        if (next == FstIndex::NOT_FOUND) return next;
+        cur = next;
+    }
+    return cur;
+}
+
+uint32_t DiscRebuilder::make_dirs(const std::string& dir_path, std::string& error) {
+    uint32_t cur = 0;
+    for (const auto& part : split_path(dir_path)) {
+        uint32_t next = FstIndex::NOT_FOUND;
+        for (uint32_t child : nodes_[cur].children) {
+            if (name_equal(nodes_[child].name, part)) {
+                next = child;
+                break;
+            }
+        }
+
+        if (next == FstIndex::NOT_FOUND) {
+            next = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back({part, true, 0, 0, {}});
+            nodes_[cur].children.push_back(next);
+            log_.push_back("mkdir " + part);
+        } else if (!nodes_[next].is_dir) {
+            error = part + " is a file, not a directory";
+            return FstIndex::NOT_FOUND;
+        }
+        cur = next;
+    }
+    return cur;
+}
+
+bool DiscRebuilder::place(uint64_t old_offset, uint64_t old_size, uint64_t size,
+                          uint32_t owner, uint64_t& offset) {
+    if (old_size) {
+        space_.release(old_offset, old_size);
+
+        // Another entry (or the boot area) may share these bytes; keep them
+        uint64_t old_end = old_offset + old_size;
+        for (uint32_t i = 0; i < nodes_.size(); i++) {
+            const Node& node = nodes_[i];
+            if (i == owner || node.is_dir || node.size == 0) continue;
+            if (node.offset < old_end && node.offset + node.size > old_offset) {
+                space_.reserve(node.offset, node.size);
+            }
+        }
+        for (const auto& ext : fixed_) space_.reserve(ext.offset, ext.size);
+
+        // Stay put (growing into free space after the old extent if needed)
+        if (space_.take(old_offset, size)) {
+            offset = old_offset;
+            return true;
+        }
+    }
+
+    if (size == 0) {
+        offset = old_offset;
+        return true;
+    }
+    return space_.allocate(size, FILE_ALIGN, offset);
+}
+
+bool DiscRebuilder::replace_file(const std::string& path, const std::vector<uint8_t>& data,
+                                 std::string& error) {
+    uint32_t idx = lookup(path);
+    if (idx == FstIndex::NOT_FOUND || nodes_[idx].is_dir) {
+        error = path + ": no such file on disc";
+        return false;
+    }
+
+    Node& node = nodes_[idx];
+    uint64_t offset = 0;
+    if (!place(node.offset, node.size, data.size(), idx, offset)) {
+        error = path + ": no free space for " + std::to_string(data.size()) + " bytes";
+        return false;
+    }
+
+    log_.push_back("replace " + path + ": " + std::to_string(node.size) + " -> " +
+                   std::to_string(data.size()) + " bytes " +
+                   (offset == node.offset ? "in place at " + hex(offset)
+                                          : "moved " + hex(node.offset) + " -> " + hex(offset)));
+
+    node.offset = static_cast<uint32_t>(offset);
+    node.size = static_cast<uint32_t>(data.size());
+    iso_.write(node.offset, data);
+    bytes_written_ += data.size();
+    return true;
+}
+
+bool DiscRebuilder::add_file(const std::string& path, const std::vector<uint8_t>& data,
+                             std::string& error) {
+    auto parts = split_path(path);
+    if (parts.empty()) {
+        error = "empty path";
+        return false;
+    }
+    if (lookup(path) != FstIndex::NOT_FOUND) {
+        error = path + ": already exists (use --replace)";
+        return false;
+    }
+
+    std::string dir;
+    for (size_t i = 0; i + 1 < parts.size(); i++) dir += parts[i] + "/";
+    uint32_t parent = make_dirs(dir, error);
+    if (parent == FstIndex::NOT_FOUND) return false;
+
+    uint64_t offset = 0;
+    if (!place(0, 0, data.size(), FstIndex::NOT_FOUND, offset)) {
+        error = path + ": no free space for " + std::to_string(data.size()) + " bytes";
+        return false;
+    }
+
+    uint32_t idx = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back({parts.back(), false, static_cast<uint32_t>(offset),
+                      static_cast<uint32_t>(data.size()), {}});
+    nodes_[parent].children.push_back(idx);
+
+    log_.push_back("add " + path + ": " + std::to_string(data.size()) + " bytes at " + hex(offset));
+    iso_.write(static_cast<uint32_t>(offset), data);
+    bytes_written_ += data.size();
+    return true;
+}
+
+std::vector<uint8_t> DiscRebuilder::serialize_fst() const {
+    // Pre-order walk assigns the new entry indices
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> new_index(nodes_.size());
+    std::vector<uint32_t> parent_of(nodes_.size(), 0);
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        new_index[n] = static_cast<uint32_t>(order.size());
+        order.push_back(n);
+        const auto& kids = nodes_[n].children;
+        for (auto it = kids.rbegin(); it != kids.rend(); ++it) {
+            parent_of[*it] = n;
+            stack.push_back(*it);
+        }
+    }
+
+    // Subtree end = own index + descendant count
+    std::vector<uint32_t> subtree(nodes_.size(), 1);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        if (*it != 0) subtree[parent_of[*it]] += subtree[*it];
+    }
+
+    std::vector<uint8_t> table(order.size() * FstEntry::RAW_SIZE);
+    std::string strings;
+    for (size_t i = 0; i < order.size(); i++) {
+        const Node& node = nodes_[order[i]];
+        uint8_t* raw = table.data() + i * FstEntry::RAW_SIZE;
+
+        uint32_t name_off = 0;
+        if (i > 0) {
+            name_off = static_cast<uint32_t>(strings.size());
+            strings += node.name;
+            strings += '\0';
+        }
+
+        write_be32(raw, (uint32_t(node.is_dir) << 24) | name_off);
+        if (node.is_dir) {
+            write_be32(raw + 4, i ? new_index[parent_of[order[i]]] : 0);
+            write_be32(raw + 8, static_cast<uint32_t>(i + subtree[order[i]]));
+        } else {
+            write_be32(raw + 4, node.offset);
+            write_be32(raw + 8, node.size);
+        }
+    }
+
+    table.insert(table.end(), strings.begin(), strings.end());
+    return table;
+}
+
+bool DiscRebuilder::commit(std::string& error) {
+    auto fst = serialize_fst();
+    GCMHeader& hdr = iso_.header();
+
+    uint64_t offset = 0;
+    if (!place(hdr.fst_offset, hdr.fst_size, fst.size(), FstIndex::NOT_FOUND, offset)) {
+        error = "no free space for a " + std::to_string(fst.size()) + " byte FST";
+        return false;
+    }
+
+    if (offset != hdr.fst_offset) {
+        log_.push_back("FST moved " + hex(hdr.fst_offset) + " -> " + hex(offset));
+    }
+
+    iso_.write(static_cast<uint32_t>(offset), fst);
+    bytes_written_ += fst.size();
+
+    hdr.fst_offset = static_cast<uint32_t>(offset);
+    hdr.fst_size = static_cast<uint32_t>(fst.size());
+    hdr.fst_max_size = std::max<uint32_t>(hdr.fst_max_size, hdr.fst_size);
+    return true;
+}
+
+} // namespace dolhook
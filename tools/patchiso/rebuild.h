@@ -0,0 +1,101 @@
+/**
+ * Disc Rebuild
+ * Free-space tracking and in-place file replacement/addition
+ */
+
+#pragma once
+
+#include "fst.h"
+#include "gcm.h"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+// Free byte ranges of a disc, with best-fit allocation
+class FreeSpaceMap {
+public:
+    FreeSpaceMap() = default;
+    explicit FreeSpaceMap(uint64_t capacity) { release(0, capacity); }
+
+    // Mark a range used / free (coalescing with neighbours)
+    void reserve(uint64_t offset, uint64_t size);
+    void release(uint64_t offset, uint64_t size);
+
+    // Reserve exactly [offset, offset + size) if all of it is free
+    bool take(uint64_t offset, uint64_t size);
+
+    // Smallest free range that fits size at the given alignment
+    bool allocate(uint64_t size, uint64_t align, uint64_t& offset);
+
+    // Free bytes below limit
+    uint64_t free_bytes(uint64_t limit) const;
+
+    const std::map<uint64_t, uint64_t>& extents() const { return by_offset_; }
+
+private:
+    void insert(uint64_t offset, uint64_t size);
+    void erase(std::map<uint64_t, uint64_t>::iterator it);
+
+    std::map<uint64_t, uint64_t> by_offset_;           // offset -> size
+    std::set<std::pair<uint64_t, uint64_t>> by_size_;  // (size, offset)
+};
+
+// Everything not referenced by the header, bi2, apploader, DOL, FST or a file.
+// fixed (optional) receives the boot regions: header/bi2, apploader, DOL.
+bool build_free_space(const GCMFile& iso, const FstIndex& fst, FreeSpaceMap& out,
+                      std::vector<Extent>* fixed = nullptr);
+
+// Where a grown DOL of size bytes should go: its current offset if the
+// space after it is free, else the best-fitting gap. False without an FST.
+bool place_dol(const GCMFile& iso, uint64_t size, uint64_t& offset);
+
+// Replaces and adds files without shifting anything else: a file stays put
+// when it still fits (with any free space after it), otherwise it goes to
+// the best-fitting gap. The FST is rewritten the same way on commit().
+class DiscRebuilder {
+public:
+    static constexpr uint64_t FILE_ALIGN = 32;
+
+    explicit DiscRebuilder(GCMFile& iso) : iso_(iso) {}
+
+    bool init(std::string& error);
+
+    bool replace_file(const std::string& path, const std::vector<uint8_t>& data, std::string& error);
+
+    // Missing parent directories are created
+    bool add_file(const std::string& path, const std::vector<uint8_t>& data, std::string& error);
+
+    // Serialize and place the FST, update the header
+    bool commit(std::string& error);
+
+    // Human-readable placement log
+    const std::vector<std::string>& log() const { return log_; }
+    uint64_t bytes_written() const { return bytes_written_; }
+
+private:
+    struct Node {
+        std::string name;
+        bool is_dir;
+        uint32_t offset;
+        uint32_t size;
+        std::vector<uint32_t> children;
+    };
+
+    uint32_t lookup(const std::string& path) const;
+    uint32_t make_dirs(const std::string& dir_path, std::string& error);
+    bool place(uint64_t old_offset, uint64_t old_size, uint64_t size, uint32_t owner, uint64_t& offset);
+    std::vector<uint8_t> serialize_fst() const;
+
+    GCMFile& iso_;
+    FreeSpaceMap space_;
+    std::vector<Extent> fixed_;
+    std::vector<Node> nodes_;  // nodes_[0] is the root
+    std::vector<std::string> log_;
+    uint64_t bytes_written_ = 0;
+};
+
+} // namespace dolhook
@@ -0,0 +1,219 @@
+/**
+ * Payload Signatures Implementation
+ *
+ * A dh_sig record is four big-endian words: name, pattern and mask
+ * pointers into the payload, then the address the patcher fills in.
+ *
+ * All patterns are matched in one pass over the text. Each pattern with a
+ * fully fixed, aligned word is filed under that word; every text word is
+ * looked up once, and only the patterns filed under it are compared in
+ * full. Patterns without such a word are scanned on their own.
+ */
+
+#include "signatures.h"
+#include "dol.h"
+#include "symbols.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+namespace dolhook {
+
+namespace {
+
+constexpr uint32_t RECORD_SIZE = 16;
+constexpr size_t MAX_NAME = 255;
+constexpr size_t MAX_PATTERN = 256;
+
+} // namespace
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static void write_be32(uint8_t* p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static std::string hex(uint32_t v) {
+    std::ostringstream oss;
+    oss << "0x" << std::hex << v;
+    return oss.str();
+}
+
+// NUL-terminated string at addr inside the image
+static bool read_string(const std::vector<uint8_t>& image, uint32_t load_addr, uint32_t addr, size_t max,
+                        std::string& out) {
+    if (addr < load_addr || addr - load_addr >= image.size()) return false;
+    const char* p = reinterpret_cast<const char*>(image.data() + (addr - load_addr));
+    size_t avail = std::min(image.size() - (addr - load_addr), max + 1);
+    size_t len = strnlen(p, avail);
+    if (len == avail) return false;
+    out.assign(p, len);
+    return true;
+}
+
+bool read_signatures(const std::vector<uint8_t>& image, uint32_t load_addr, uint32_t table_start,
+                     uint32_t table_end, std::vector<Signature>& sigs, std::string& error) {
+    sigs.clear();
+    if (table_end == table_start) return true;
+    if (table_end < table_start || (table_end - table_start) % RECORD_SIZE != 0) {
+        error = "signature table is malformed";
+        return false;
+    }
+    if (table_start < load_addr || table_end - load_addr > image.size()) {
+        error = "signature table is outside the payload image";
+        return false;
+    }
+
+    for (uint32_t rec = table_start; rec < table_end; rec += RECORD_SIZE) {
+        const uint8_t* r = image.data() + (rec - load_addr);
+        Signature sig;
+        sig.record = rec;
+        if (!read_string(image, load_addr, read_be32(r), MAX_NAME, sig.name) || sig.name.empty()) {
+            error = "signature at " + hex(rec) + " has no name";
+            return false;
+        }
+
+        std::string mask;
+        if (!read_string(image, load_addr, read_be32(r + 8), MAX_PATTERN, mask)) {
+            error = "signature " + sig.name + " has no mask";
+            return false;
+        }
+
+        // An empty mask means "by name"; otherwise the mask sets the length
+        if (!mask.empty()) {
+            uint32_t pat = read_be32(r + 4);
+            if (pat < load_addr || pat - load_addr > image.size() ||
+                image.size() - (pat - load_addr) < mask.size()) {
+                error = "signature " + sig.name + " has its pattern outside the payload image";
+                return false;
+            }
+            const uint8_t* p = image.data() + (pat - load_addr);
+            for (size_t i = 0; i < mask.size(); i++) {
+                if (mask[i] != 'x' && mask[i] != '?') {
+                    error = "signature " + sig.name + ": mask may only hold 'x' and '?'";
+                    return false;
+                }
+                bool fixed = mask[i] == 'x';
+                sig.bytes.push_back(fixed ? p[i] : 0);
+                sig.mask.push_back(fixed ? 0xFF : 0x00);
+            }
+            if (mask.find('x') == std::string::npos) {
+                error = "signature " + sig.name + " has no fixed bytes";
+                return false;
+            }
+        }
+
+        sigs.push_back(std::move(sig));
+    }
+
+    return true;
+}
+
+static bool matches(const uint8_t* p, const Signature& sig) {
+    for (size_t j = 0; j < sig.bytes.size(); j++) {
+        if ((p[j] ^ sig.bytes[j]) & sig.mask[j]) return false;
+    }
+    return true;
+}
+
+bool resolve_signatures(const DOLFile& dol, const SymbolIndex* symbols, std::vector<Signature>& sigs,
+                        std::string& error) {
+    // Match count and the first two addresses, for the error message
+    struct Hits {
+        uint32_t count = 0;
+        uint32_t addrs[2] = {0, 0};
+    };
+    std::vector<Hits> hits(sigs.size());
+
+    // Each pattern under its first fixed aligned word (pattern index, word offset)
+    std::unordered_map<uint32_t, std::vector<std::pair<size_t, size_t>>> anchors;
+    std::vector<size_t> unanchored;
+    for (size_t i = 0; i < sigs.size(); i++) {
+        const Signature& sig = sigs[i];
+        if (sig.mask.empty()) continue;
+
+        bool filed = false;
+        for (size_t k = 0; k + 4 <= sig.bytes.size() && !filed; k += 4) {
+            if (std::all_of(sig.mask.begin() + k, sig.mask.begin() + k + 4, [](uint8_t m) { return m == 0xFF; })) {
+                anchors[read_be32(sig.bytes.data() + k)].push_back({i, k});
+                filed = true;
+            }
+        }
+        if (!filed) unanchored.push_back(i);
+    }
+
+    auto record = [&](size_t i, uint32_t addr) {
+        Hits& h = hits[i];
+        if (h.count < 2) h.addrs[h.count] = addr;
+        h.count++;
+    };
+
+    for (const DOLSection& sec : dol.header().get_sections()) {
+        if (!sec.is_text) continue;
+        ByteView text = dol.get_section_data(sec);
+
+        if (!anchors.empty()) {
+            for (size_t pos = 0; pos + 4 <= text.size; pos += 4) {
+                auto it = anchors.find(read_be32(text.data + pos));
+                if (it == anchors.end()) continue;
+                for (const auto& [i, k] : it->second) {
+                    if (pos < k || pos - k + sigs[i].bytes.size() > text.size) continue;
+                    if (matches(text.data + pos - k, sigs[i])) record(i, sec.load_addr + static_cast<uint32_t>(pos - k));
+                }
+            }
+        }
+
+        for (size_t i : unanchored) {
+            for (size_t start = 0; start + sigs[i].bytes.size() <= text.size; start += 4) {
+                if (matches(text.data + start, sigs[i])) record(i, sec.load_addr + static_cast<uint32_t>(start));
+            }
+        }
+    }
+
+    std::string failed;
+    auto fail = [&](const std::string& why) {
+        if (!failed.empty()) failed += "; ";
+        failed += why;
+    };
+
+    for (size_t i = 0; i < sigs.size(); i++) {
+        Signature& sig = sigs[i];
+        if (sig.mask.empty()) {
+            SymbolInfo info;
+            if (!symbols) {
+                fail(sig.name + " is looked up by name and needs a game map (--map)");
+            } else if (!symbols->find(sig.name, info)) {
+                fail(sig.name + " is not in the game map");
+            } else {
+                sig.addr = info.addr;
+            }
+        } else if (hits[i].count == 0) {
+            fail("signature " + sig.name + " not found");
+        } else if (hits[i].count > 1) {
+            fail("signature " + sig.name + " is ambiguous (" + std::to_string(hits[i].count) + " matches: " +
+                 hex(hits[i].addrs[0]) + ", " + hex(hits[i].addrs[1]) + (hits[i].count > 2 ? ", ...)" : ")"));
+        } else {
+            sig.addr = hits[i].addrs[0];
+        }
+    }
+
+    if (!failed.empty()) {
+        error = failed;
+        return false;
+    }
+    return true;
+}
+
+void write_signatures(std::vector<uint8_t>& image, uint32_t load_addr, const std::vector<Signature>& sigs) {
+    for (const Signature& sig : sigs) {
+        write_be32(image.data() + (sig.record + 12 - load_addr), sig.addr);
+    }
+}
+
+} // namespace dolhook
@@ -0,0 +1,39 @@
+/**
+ * Payload Signatures
+ * The payload's dh_sig table, resolved against the game DOL at patch time
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dolhook {
+
+class DOLFile;
+class SymbolIndex;
+
+// One DH_SIGNATURE()/DH_SYMBOL() record (runtime/include/dolhook.h)
+struct Signature {
+    uint32_t record = 0;         // Address of the dh_sig in the payload
+    std::string name;
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask;   // 0xFF = must match, 0x00 = wildcard; empty = by name
+    uint32_t addr = 0;           // Resolved address
+};
+
+// The records from table_start to table_end of a payload image at load_addr
+bool read_signatures(const std::vector<uint8_t>& image, uint32_t load_addr, uint32_t table_start,
+                     uint32_t table_end, std::vector<Signature>& sigs, std::string& error);
+
+// Patterns must match exactly once, word-aligned, in the DOL's text
+// sections; name-only records are looked up in symbols. error lists every
+// signature that can't be resolved.
+bool resolve_signatures(const DOLFile& dol, const SymbolIndex* symbols, std::vector<Signature>& sigs,
+                        std::string& error);
+
+// Store the resolved addresses into the records' addr fields
+void write_signatures(std::vector<uint8_t>& image, uint32_t load_addr, const std::vector<Signature>& sigs);
+
+} // namespace dolhook
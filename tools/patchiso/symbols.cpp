@@ -0,0 +1,258 @@
+/**
+ * Game Symbol Index Implementation
+ *
+ * Map lines are tokenized in place over the mapped file; the only per-symbol
+ * allocation is the 16-byte entry. Recognized lines:
+ *
+ *   start size vaddr fileoff align name [object]   CodeWarrior 2.x+
+ *   start size vaddr align name [object]           CodeWarrior 1.x, Dolphin
+ *   name vaddr                                     plain symbol list
+ *
+ * Section and UNUSED lines, link tree and memory map tables don't match any
+ * of these and fall through.
+ */
+
+#include "symbols.h"
+#include "blockdev.h"
+#include "hash.h"
+#include <algorithm>
+#include <numeric>
+
+namespace dolhook {
+
+static bool parse_hex(std::string_view s, uint32_t& out) {
+    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) s.remove_prefix(2);
+    if (s.empty() || s.size() > 8) return false;
+
+    uint32_t v = 0;
+    for (char c : s) {
+        uint32_t d;
+        if (c >= '0' && c <= '9') d = c - '0';
+        else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+        else return false;
+        v = (v << 4) | d;
+    }
+    out = v;
+    return true;
+}
+
+static bool is_decimal(std::string_view s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Up to max whitespace-separated tokens; returns how many. Tabs, CR and
+// other control characters all count as whitespace.
+static size_t split(std::string_view line, std::string_view* tok, size_t max) {
+    const char* p = line.data();
+    const char* end = p + line.size();
+    size_t n = 0;
+    while (n < max) {
+        while (p != end && static_cast<unsigned char>(*p) <= ' ') p++;
+        if (p == end) break;
+        const char* start = p;
+        while (p != end && static_cast<unsigned char>(*p) > ' ') p++;
+        tok[n++] = std::string_view(start, p - start);
+    }
+    return n;
+}
+
+// 8 bytes of name from depth on, big-endian and zero padded, so keys
+// order like the bytes they hold (names never contain NUL)
+static uint64_t name_chunk(std::string_view name, size_t depth) {
+    uint64_t key = 0;
+    for (size_t i = depth; i < depth + 8; i++) {
+        key = (key << 8) | (i < name.size() ? static_cast<uint8_t>(name[i]) : 0);
+    }
+    return key;
+}
+
+bool SymbolIndex::load(const std::string& path, std::string& error) {
+    size_t added = 0;
+    if (auto dev = MmapBlockDevice::open(path)) {
+        dev->prefetch(0, dev->size());
+        const char* text = reinterpret_cast<const char*>(dev->view(0, dev->size()));
+        added = parse(std::string_view(text, dev->size()));
+    } else if (auto dev = PreadBlockDevice::open(path)) {
+        std::string text(dev->size(), '\0');
+        if (!dev->read(0, text.data(), text.size())) {
+            error = "cannot read " + path;
+            return false;
+        }
+        added = parse(text);
+    } else {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    if (added == 0) {
+        error = "no symbols found in " + path;
+        return false;
+    }
+    return true;
+}
+
+size_t SymbolIndex::parse(std::string_view text) {
+    std::vector<Pending> pending;
+    pending.reserve(text.size() / 64);
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos) end = text.size();
+        std::string_view line = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        std::string_view tok[6];
+        size_t n = split(line, tok, 6);
+
+        std::string_view name;
+        uint32_t start = 0, size = 0, addr = 0, offset = 0;
+        if (n >= 5 && parse_hex(tok[0], start) && parse_hex(tok[1], size) && parse_hex(tok[2], addr)) {
+            if (n >= 6 && tok[3].size() == 8 && parse_hex(tok[3], offset) && is_decimal(tok[4])) {
+                name = tok[5];
+            } else if (is_decimal(tok[3])) {
+                name = tok[4];
+            }
+        } else if (n == 2 && parse_hex(tok[1], addr)) {
+            name = tok[0];
+        }
+
+        // Section starts (.text), fill (*fill*) and comments aren't symbols
+        if (name.empty() || name[0] == '.' || name[0] == '*' || name[0] == '#' || addr == 0) continue;
+        pending.push_back({name, addr, size, 0});
+    }
+
+    size_t added = pending.size();
+    if (added) merge(pending);
+    return added;
+}
+
+// Name order (then address, larger size first), 8 bytes at a time: an
+// integer sort per level, descending only into runs that still tie. Mangled
+// names share long prefixes, which makes plain string compares slow.
+void SymbolIndex::sort_by_name(Pending* first, Pending* last, size_t depth) {
+    bool same = true;
+    for (Pending* p = first; p != last; ++p) {
+        p->key = name_chunk(p->name, depth);
+        same = same && p->key == first->key;
+    }
+    if (!same) {
+        std::sort(first, last, [](const Pending& a, const Pending& b) { return a.key < b.key; });
+    }
+
+    for (Pending* run = first; run != last;) {
+        Pending* end = run + 1;
+        while (end != last && end->key == run->key) ++end;
+        if (end - run > 1) {
+            if (run->name.size() < depth + 8) {
+                // Same name throughout: the chunk's zero padding fixes the
+                // length (a name of exactly depth + 8 may still be a prefix)
+                std::sort(run, end, [](const Pending& a, const Pending& b) {
+                    return a.addr != b.addr ? a.addr < b.addr : a.size > b.size;
+                });
+            } else {
+                sort_by_name(run, end, depth + 8);
+            }
+        }
+        run = end;
+    }
+}
+
+void SymbolIndex::merge(std::vector<Pending>& pending) {
+    // Existing entries join in; their views point into the old buffer,
+    // which stays alive until the swap below
+    pending.reserve(pending.size() + entries_.size());
+    for (const Entry& e : entries_) pending.push_back({name_of(e), e.addr, e.size, 0});
+
+    sort_by_name(pending.data(), pending.data() + pending.size(), 0);
+
+    // Intern in name order, so name offsets compare like the names do.
+    // The same name at the same address is kept once (the largest size).
+    size_t bytes = 0;
+    for (const Pending& p : pending) bytes += p.name.size();
+
+    std::string names;
+    names.reserve(bytes);
+    std::vector<Entry> sorted;
+    sorted.reserve(pending.size());
+
+    for (size_t i = 0; i < pending.size(); i++) {
+        const Pending& p = pending[i];
+        if (i > 0 && p.name == pending[i - 1].name) {
+            if (p.addr == pending[i - 1].addr) continue;
+            sorted.push_back({p.addr, p.size, sorted.back().name, sorted.back().len});
+            continue;
+        }
+        uint32_t offset = static_cast<uint32_t>(names.size());
+        names.append(p.name);
+        sorted.push_back({p.addr, p.size, offset, static_cast<uint32_t>(p.name.size())});
+    }
+
+    // Reorder by address; by_name_ maps name rank to the new position
+    std::vector<uint32_t> order(sorted.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return sorted[a].addr < sorted[b].addr; });
+
+    entries_.resize(sorted.size());
+    by_name_.resize(sorted.size());
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        entries_[pos] = sorted[order[pos]];
+        by_name_[order[pos]] = pos;
+    }
+
+    names_.swap(names);
+}
+
+bool SymbolIndex::find(std::string_view name, SymbolInfo& out) const {
+    auto it = std::lower_bound(by_name_.begin(), by_name_.end(), name,
+                               [&](uint32_t i, std::string_view n) { return name_of(entries_[i]) < n; });
+    if (it == by_name_.end() || name_of(entries_[*it]) != name) return false;
+    out = info(entries_[*it]);
+    return true;
+}
+
+bool SymbolIndex::lookup(uint32_t addr, SymbolInfo& out) const {
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), addr,
+                               [](uint32_t a, const Entry& e) { return a < e.addr; });
+    if (it == entries_.begin()) return false;
+
+    // Several names can start at the nearest address below; any that
+    // reaches addr will do
+    const uint32_t start = std::prev(it)->addr;
+    const Entry* unsized = nullptr;
+    while (it != entries_.begin() && std::prev(it)->addr == start) {
+        --it;
+        if (it->size == 0) {
+            if (!unsized) unsized = &*it;
+        } else if (addr - start < it->size) {
+            out = info(*it);
+            return true;
+        }
+    }
+    if (!unsized) return false;
+    out = info(*unsized);
+    return true;
+}
+
+std::vector<SymbolInfo> SymbolIndex::with_prefix(std::string_view prefix, size_t limit) const {
+    std::vector<SymbolInfo> out;
+    auto it = std::lower_bound(by_name_.begin(), by_name_.end(), prefix,
+                               [&](uint32_t i, std::string_view p) { return name_of(entries_[i]) < p; });
+    for (; it != by_name_.end() && out.size() < limit; ++it) {
+        std::string_view name = name_of(entries_[*it]);
+        if (name.substr(0, prefix.size()) != prefix) break;
+        out.push_back(info(entries_[*it]));
+    }
+    return out;
+}
+
+std::string SymbolIndex::digest() const {
+    Sha1 sha;
+    sha.update(names_.data(), names_.size());
+    sha.update(entries_.data(), entries_.size() * sizeof(Entry));
+    return sha.hex_digest();
+}
+
+} // namespace dolhook
@@ -0,0 +1,76 @@
+/**
+ * Game Symbol Index
+ * Linker maps (CodeWarrior, Dolphin) imported into a flat, sorted index
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dolhook {
+
+struct SymbolInfo {
+    std::string_view name;  // Valid until the index is next modified
+    uint32_t addr = 0;
+    uint32_t size = 0;      // 0 = unknown
+};
+
+// Names are interned once into a single buffer; entries are kept sorted by
+// address, with a second index over them sorted by name.
+class SymbolIndex {
+public:
+    // Add the symbols of a map file: CodeWarrior linker map, Dolphin map,
+    // or "name address" lines. False if the file can't be read.
+    bool load(const std::string& path, std::string& error);
+
+    // Same, from text in memory; returns how many symbol lines were taken
+    size_t parse(std::string_view text);
+
+    size_t size() const { return entries_.size(); }
+
+    // Exact name; the lowest address if the name occurs more than once
+    bool find(std::string_view name, SymbolInfo& out) const;
+
+    // Symbol whose range holds addr (or the nearest one below it when its
+    // size is unknown)
+    bool lookup(uint32_t addr, SymbolInfo& out) const;
+
+    // Names starting with prefix, in name order
+    std::vector<SymbolInfo> with_prefix(std::string_view prefix, size_t limit = SIZE_MAX) const;
+
+    // SHA-1 over the contents, for cache keys
+    std::string digest() const;
+
+private:
+    struct Entry {
+        uint32_t addr;
+        uint32_t size;
+        uint32_t name;  // Offset into names_
+        uint32_t len;
+    };
+
+    struct Pending {
+        std::string_view name;
+        uint32_t addr;
+        uint32_t size;
+        uint64_t key;  // Sort scratch
+    };
+
+    static void sort_by_name(Pending* first, Pending* last, size_t depth);
+    void merge(std::vector<Pending>& pending);
+
+    std::string_view name_of(const Entry& e) const {
+        return std::string_view(names_).substr(e.name, e.len);
+    }
+
+    SymbolInfo info(const Entry& e) const { return {name_of(e), e.addr, e.size}; }
+
+    std::string names_;              // Each distinct name once, in name order
+    std::vector<Entry> entries_;     // By address
+    std::vector<uint32_t> by_name_;  // Indices into entries_, by name then address
+};
+
+} // namespace dolhook
@@ -0,0 +1,249 @@
+/**
+ * Image Verification Implementation
+ */
+
+#include "verify.h"
+#include "hash.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+namespace dolhook {
+
+/* ============================================================================
+ * Hashing pipeline
+ * ========================================================================= */
+
+namespace {
+
+constexpr size_t HASH_CHUNK = 4 << 20;
+constexpr size_t HASH_SLOTS = 8;
+constexpr size_t NO_CHUNK = ~size_t(0);
+
+// One chunk in flight; reused once every consumer has released it
+struct HashSlot {
+    std::vector<uint8_t> buffer;
+    const uint8_t* data = nullptr;
+    size_t len = 0;
+    size_t index = NO_CHUNK;
+    int pending = 0;
+};
+
+} // namespace
+
+bool hash_image(const BlockDevice& dev, ImageDigest& out, unsigned threads) {
+    const uint64_t size = dev.size();
+    const size_t chunks = static_cast<size_t>((size + HASH_CHUNK - 1) / HASH_CHUNK);
+
+    // MD5 and SHA-1 are inherently serial and get a thread each
+    constexpr int SERIAL_HASHERS = 2;
+    if (threads == 0) {
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        threads = hw > SERIAL_HASHERS + 1 ? hw - SERIAL_HASHERS - 1 : 1;
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, chunks)));
+
+    HashSlot slots[HASH_SLOTS];
+    std::vector<uint32_t> crcs(chunks);
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool failed = false;
+
+    auto acquire = [&](size_t i) -> HashSlot* {
+        HashSlot& slot = slots[i % HASH_SLOTS];
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return failed || slot.index == i; });
+        return failed ? nullptr : &slot;
+    };
+    auto release = [&](HashSlot& slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--slot.pending == 0) cv.notify_all();
+    };
+
+    Md5 md5;
+    Sha1 sha1;
+    std::atomic<size_t> next_crc{0};
+    std::vector<std::thread> pool;
+
+    auto serial = [&](auto& hasher) {
+        for (size_t i = 0; i < chunks; i++) {
+            HashSlot* slot = acquire(i);
+            if (!slot) return;
+            hasher.update(slot->data, slot->len);
+            release(*slot);
+        }
+    };
+    pool.emplace_back([&] { serial(md5); });
+    pool.emplace_back([&] { serial(sha1); });
+
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back([&] {
+            for (;;) {
+                size_t i = next_crc.fetch_add(1);
+                if (i >= chunks) return;
+                HashSlot* slot = acquire(i);
+                if (!slot) return;
+                crcs[i] = crc32(0, slot->data, slot->len);
+                release(*slot);
+            }
+        });
+    }
+
+    // Reader: mapped devices are hashed in place, others are read into slots
+    dev.prefetch(0, 2 * HASH_CHUNK);
+    for (size_t i = 0; i < chunks && !failed; i++) {
+        HashSlot& slot = slots[i % HASH_SLOTS];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return slot.pending == 0; });
+        }
+
+        uint64_t offset = uint64_t(i) * HASH_CHUNK;
+        size_t len = static_cast<size_t>(std::min<uint64_t>(HASH_CHUNK, size - offset));
+        dev.prefetch(offset + 2 * HASH_CHUNK, HASH_CHUNK);
+
+        const uint8_t* data = dev.view(offset, len);
+        if (!data) {
+            slot.buffer.resize(len);
+            data = dev.read(offset, slot.buffer.data(), len) ? slot.buffer.data() : nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!data) {
+            failed = true;
+        } else {
+            slot.data = data;
+            slot.len = len;
+            slot.index = i;
+            slot.pending = SERIAL_HASHERS + 1;
+        }
+        cv.notify_all();
+    }
+
+    for (auto& t : pool) t.join();
+    if (failed) return false;
+
+    uint32_t crc = 0;
+    for (size_t i = 0; i < chunks; i++) {
+        uint64_t len = std::min<uint64_t>(HASH_CHUNK, size - uint64_t(i) * HASH_CHUNK);
+        crc = i == 0 ? crcs[0] : crc32_combine(crc, crcs[i], len);
+    }
+
+    out.size = size;
+    out.crc32 = crc;
+    out.md5 = md5.hex_digest();
+    out.sha1 = sha1.hex_digest();
+    return true;
+}
+
+/* ============================================================================
+ * DAT parsing
+ * ========================================================================= */
+
+static std::string xml_unescape(const std::string& s) {
+    static const std::pair<const char*, char> entities[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''},
+    };
+
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        bool replaced = false;
+        if (s[i] == '&') {
+            for (const auto& e : entities) {
+                size_t n = std::char_traits<char>::length(e.first);
+                if (s.compare(i, n, e.first) == 0) {
+                    out += e.second;
+                    i += n - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) out += s[i];
+    }
+    return out;
+}
+
+// Value of attr="..." inside a single tag, or empty
+static std::string tag_attr(const std::string& tag, const char* attr) {
+    std::string key = std::string(" ") + attr + "=\"";
+    size_t pos = tag.find(key);
+    if (pos == std::string::npos) return {};
+    pos += key.size();
+    size_t end = tag.find('"', pos);
+    if (end == std::string::npos) return {};
+    return xml_unescape(tag.substr(pos, end - pos));
+}
+
+static std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+bool DumpDatabase::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::string xml((std::istreambuf_iterator<char>(file)), {});
+
+    size_t before = roms_.size();
+    std::string game;
+    size_t pos = 0;
+
+    for (;;) {
+        size_t open = xml.find('<', pos);
+        if (open == std::string::npos) break;
+        size_t close = xml.find('>', open);
+        if (close == std::string::npos) break;
+        pos = close + 1;
+
+        // Normalise whitespace so " attr=" matches after newlines/tabs
+        std::string tag = xml.substr(open, close - open);
+        std::replace_if(tag.begin(), tag.end(), [](char c) { return c == '\n' || c == '\r' || c == '\t'; }, ' ');
+
+        if (tag.compare(0, 6, "<game ") == 0 || tag.compare(0, 9, "<machine ") == 0) {
+            game = tag_attr(tag, "name");
+        } else if (tag.compare(0, 5, "<rom ") == 0) {
+            DatRom rom;
+            rom.game = game;
+            rom.name = tag_attr(tag, "name");
+            rom.size = std::strtoull(tag_attr(tag, "size").c_str(), nullptr, 10);
+            std::string crc = tag_attr(tag, "crc");
+            if (crc.empty()) continue;
+            rom.crc32 = static_cast<uint32_t>(std::strtoul(crc.c_str(), nullptr, 16));
+            rom.md5 = lower(tag_attr(tag, "md5"));
+            rom.sha1 = lower(tag_attr(tag, "sha1"));
+
+            by_crc_.emplace(rom.crc32, roms_.size());
+            by_name_.emplace(rom.name, roms_.size());
+            roms_.push_back(std::move(rom));
+        }
+    }
+
+    return roms_.size() > before;
+}
+
+const DatRom* DumpDatabase::find(const ImageDigest& digest) const {
+    auto range = by_crc_.equal_range(digest.crc32);
+    for (auto it = range.first; it != range.second; ++it) {
+        const DatRom& rom = roms_[it->second];
+        if (rom.size != digest.size) continue;
+        if (!rom.md5.empty() && rom.md5 != digest.md5) continue;
+        if (!rom.sha1.empty() && rom.sha1 != digest.sha1) continue;
+        return &rom;
+    }
+    return nullptr;
+}
+
+const DatRom* DumpDatabase::find_by_name(const std::string& file_name) const {
+    auto it = by_name_.find(file_name);
+    return it != by_name_.end() ? &roms_[it->second] : nullptr;
+}
+
+} // namespace dolhook
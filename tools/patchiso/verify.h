@@ -0,0 +1,58 @@
+/**
+ * Image Verification
+ * One-pass CRC32/MD5/SHA-1 of disc images and redump-style DAT lookup
+ */
+
+#pragma once
+
+#include "blockdev.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dolhook {
+
+struct ImageDigest {
+    uint64_t size = 0;
+    uint32_t crc32 = 0;
+    std::string md5;   // Lowercase hex
+    std::string sha1;  // Lowercase hex
+};
+
+// Hash a whole device in one read pass. A reader thread feeds fixed-size
+// chunks to parallel CRC workers (combined afterwards) while MD5 and SHA-1
+// each stream the chunks in order on their own thread.
+// threads = CRC workers (0 = hardware concurrency minus the serial hashers).
+bool hash_image(const BlockDevice& dev, ImageDigest& out, unsigned threads = 0);
+
+struct DatRom {
+    std::string game;   // <game name="...">
+    std::string name;   // <rom name="...">
+    uint64_t size = 0;
+    uint32_t crc32 = 0;
+    std::string md5;    // Empty if the DAT omits it
+    std::string sha1;   // Empty if the DAT omits it
+};
+
+// Local dump database loaded from one or more redump/No-Intro XML DATs
+class DumpDatabase {
+public:
+    // Appends every <rom> in the file; false if unreadable or empty
+    bool load(const std::string& path);
+
+    size_t size() const { return roms_.size(); }
+
+    // Entry whose size and every hash given in the DAT match, or nullptr
+    const DatRom* find(const ImageDigest& digest) const;
+
+    // Entry with this rom file name (to flag bad dumps), or nullptr
+    const DatRom* find_by_name(const std::string& file_name) const;
+
+private:
+    std::vector<DatRom> roms_;
+    std::unordered_multimap<uint32_t, size_t> by_crc_;
+    std::unordered_map<std::string, size_t> by_name_;
+};
+
+} // namespace dolhook